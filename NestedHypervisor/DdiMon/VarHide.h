@@ -16,6 +16,7 @@
 #include <algorithm>
 #include <array>
 #include "cs_driver_mm.h"
+#include "shadow_page_store.h"
 using namespace std;
 struct HookInformation;
 struct HideInformation;
@@ -23,27 +24,22 @@ extern SharedShadowHookData shared_sh_data;
 
 HideInformation* FindPatchInfoByAddress(SharedShadowHookData* data, void* address);
 
-
-struct MyPage {
-	UCHAR* page;
-	MyPage();
-	~MyPage(); 
-};
-
 struct ShadowHookData;
 struct HideInformation {
 	void* patch_address;  // An address where a hook is installed
 	void* handler;        // An address of the handler routine
 
-						  // A copy of a pages where patch_address belongs to. shadow_page_base_for_rw
-						  // is exposed to a guest for read and write operation against the page of
-						  // patch_address, and shadow_page_base_for_exec is exposed for execution.
-	std::shared_ptr<MyPage> shadow_page_base_for_rw;	//VA for rw hooking page of created / retrieved page of Original page
-	std::shared_ptr<MyPage> shadow_page_base_for_exec;  //VA for exec hooking page of created / retrieved page of Original page
+						  // Copies of a page where patch_address belongs to, shared with shadow
+						  // hooks on the same page. page_for_rw is exposed to a guest for read and
+						  // write operation, and page_for_exec is exposed for execution.
+	ShadowPageStore* store;							//Store shadow_page was acquired from
+	const ShadowPage* shadow_page;					//Released when this object is destroyed
+	HideInformation() = default;
+	~HideInformation();
 
-													  // Phyisical address of the above two copied pages
-	ULONG64 pa_base_for_rw;							//PA of above
-	ULONG64 pa_base_for_exec;							//PA of above
+	// Owns a reference to shadow_page, so a copy would release it twice
+	HideInformation(const HideInformation&) = delete;
+	HideInformation& operator=(const HideInformation&) = delete;
 
 														// A name of breakpont (a DDI name)
 	string name;
@@ -15,23 +15,49 @@
 #include "../HyperPlatform/HyperPlatform/ept.h"
 #include "../HyperPlatform/HyperPlatform/kernel_stl.h"
 #include <array>
+#include <vector>
+#include "hook_events.h"
+#include "image_ranges.h"
 #include "shadow_hook.h"
+#include "trampoline_arena.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // macro utilities
 //
 
+// Defines a hook target whose trampoline is stored in a slot of the handler
+#define DDIMONP_HOOK_TARGET(name, handler)                                \
+  {                                                                       \
+    RTL_CONSTANT_STRING(name), handler,                                   \
+        &DdimonpOriginalCall<decltype(&handler), handler>::address,       \
+  }
+
+// Returns a trampoline to call an original function of the handler
+#define DDIMONP_FIND_ORIGINAL(handler) \
+  DdimonpFindOrignal<decltype(&handler), handler>()
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // constants and macros
 //
 
+// The smallest number of slots of DdimonpTargetIndex::exact_targets
+static const SIZE_T kDdimonpMinimumTargetIndexSize = 16;
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // types
 //
 
+// Kinds of events recorded by handlers
+enum DdimonpEventKind : ULONG {
+  kDdimonpEventExFreePool,
+  kDdimonpEventExFreePoolWithTag,
+  kDdimonpEventExQueueWorkItem,
+  kDdimonpEventExAllocatePoolWithTag,
+};
+
 // A helper type for parsing a PoolTag value
 union PoolTag {
   ULONG value;
@@ -43,6 +69,29 @@ using EnumExportedSymbolsCallbackType = bool (*)(
     ULONG index, ULONG_PTR base_address, PIMAGE_EXPORT_DIRECTORY directory,
     ULONG_PTR directory_base, ULONG_PTR directory_end, void* context);
 
+// Hook targets looked up while enumerating exports
+struct DdimonpTargetIndex {
+  SharedShadowHookData* shared_sh_data;
+
+  // Targets with exact names in an open addressing hash table keyed by their
+  // case-folded names. The size is a power of two, and empty slots are nullptr.
+  std::vector<ShadowHookTarget*> exact_targets;
+
+  // Targets with wildcards, which are matched with FsRtlIsNameInExpression()
+  std::vector<ShadowHookTarget*> wildcard_targets;
+};
+
+// Holds an address of a trampoline code to call an original function of the
+// Handler. Each handler has its own slot filled by ShInstallHook() so that
+// finding it costs a single load regardless of the number of hooks.
+template <typename T, T Handler>
+struct DdimonpOriginalCall {
+  static void* address;
+};
+
+template <typename T, T Handler>
+void* DdimonpOriginalCall<T, Handler>::address = nullptr;
+
 // For SystemProcessInformation
 enum SystemInformationClass {
   kSystemProcessInformation = 5,
@@ -82,10 +131,32 @@ _IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C
         _In_ PIMAGE_EXPORT_DIRECTORY directory, _In_ ULONG_PTR directory_base,
         _In_ ULONG_PTR directory_end, _In_opt_ void* context);
 
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C static void DdimonpBuildTargetIndex(
+    _Out_ DdimonpTargetIndex* index);
+
+static bool DdimonpIsWildcardName(_In_ const UNICODE_STRING& name);
+
+static UCHAR DdimonpToUpperAscii(_In_ UCHAR c);
+
+template <typename CharT>
+static ULONG DdimonpHashExportName(_In_reads_(length) const CharT* name,
+                                   _In_ SIZE_T length);
+
+static bool DdimonpIsSameExportName(_In_ const UNICODE_STRING& target_name,
+                                    _In_reads_(length) const char* name,
+                                    _In_ SIZE_T length);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C static bool DdimonpInstallHook(
+    _In_ const DdimonpTargetIndex& index, _In_ ULONG_PTR export_address,
+    _In_ const char* export_name, _In_ ShadowHookTarget* target);
+
 static std::array<char, 5> DdimonpTagToString(_In_ ULONG tag_value);
 
-template <typename T>
-static T DdimonpFindOrignal(_In_ T handler);
+_IRQL_requires_max_(PASSIVE_LEVEL) static void DdimonpFormatEvent(
+    _In_ const HookEvent& event);
+
+template <typename T, T Handler>
+static T DdimonpFindOrignal();
 
 static VOID DdimonpHandleExQueueWorkItem(_Inout_ PWORK_QUEUE_ITEM work_item,
                                          _In_ WORK_QUEUE_TYPE queue_type);
@@ -108,8 +179,11 @@ static NTSTATUS DdimonpHandleNtQuerySystemInformation(
 #pragma alloc_text(INIT, DdimonInitialization)
 #pragma alloc_text(INIT, DdimonpEnumExportedSymbols)
 #pragma alloc_text(INIT, DdimonpEnumExportedSymbolsCallback)
+#pragma alloc_text(INIT, DdimonpBuildTargetIndex)
+#pragma alloc_text(INIT, DdimonpInstallHook)
 #pragma alloc_text(PAGE, DdimonTermination)
 #pragma alloc_text(PAGE, DdimonpFreeAllocatedTrampolineRegions)
+#pragma alloc_text(PAGE, DdimonpFormatEvent)
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -134,25 +208,13 @@ static NTSTATUS DdimonpHandleNtQuerySystemInformation(
 //    production level security. Vefity and capture all contents from user
 //    surpplied address to VMM, then use them.
 static ShadowHookTarget g_ddimonp_hook_targets[] = {
-    {
-        RTL_CONSTANT_STRING(L"EXQUEUEWORKITEM"), DdimonpHandleExQueueWorkItem,
-        nullptr,
-    },
-    {
-        RTL_CONSTANT_STRING(L"EXALLOCATEPOOLWITHTAG"),
-        DdimonpHandleExAllocatePoolWithTag, nullptr,
-    },
-    {
-        RTL_CONSTANT_STRING(L"EXFREEPOOL"), DdimonpHandleExFreePool, nullptr,
-    },
-    {
-        RTL_CONSTANT_STRING(L"EXFREEPOOLWITHTAG"),
-        DdimonpHandleExFreePoolWithTag, nullptr,
-    },
-    {
-        RTL_CONSTANT_STRING(L"NTQUERYSYSTEMINFORMATION"),
-        DdimonpHandleNtQuerySystemInformation, nullptr,
-    },
+    DDIMONP_HOOK_TARGET(L"EXQUEUEWORKITEM", DdimonpHandleExQueueWorkItem),
+    DDIMONP_HOOK_TARGET(L"EXALLOCATEPOOLWITHTAG",
+                        DdimonpHandleExAllocatePoolWithTag),
+    DDIMONP_HOOK_TARGET(L"EXFREEPOOL", DdimonpHandleExFreePool),
+    DDIMONP_HOOK_TARGET(L"EXFREEPOOLWITHTAG", DdimonpHandleExFreePoolWithTag),
+    DDIMONP_HOOK_TARGET(L"NTQUERYSYSTEMINFORMATION",
+                        DdimonpHandleNtQuerySystemInformation),
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -171,11 +233,29 @@ DdimonInitialization(SharedShadowHookData* shared_sh_data) {
     return STATUS_UNSUCCESSFUL;
   }
 
+  // Cache ranges of loaded images for handlers to check return addresses
+  auto status = ImageRangesInitialization();
+  if (!NT_SUCCESS(status)) {
+    return status;
+  }
+
+  // Start formatting events recorded by handlers asynchronously
+  status = HookEventsInitialization(DdimonpFormatEvent);
+  if (!NT_SUCCESS(status)) {
+    ImageRangesTermination();
+    return status;
+  }
+
   // Install hooks by enumerating exports of ntoskrnl, but not activate them yet
-  auto status = DdimonpEnumExportedSymbols(reinterpret_cast<ULONG_PTR>(nt_base),
-                                           DdimonpEnumExportedSymbolsCallback,
-                                           shared_sh_data);
+  DdimonpTargetIndex index = {};
+  index.shared_sh_data = shared_sh_data;
+  DdimonpBuildTargetIndex(&index);
+  status = DdimonpEnumExportedSymbols(reinterpret_cast<ULONG_PTR>(nt_base),
+                                      DdimonpEnumExportedSymbolsCallback,
+                                      &index);
   if (!NT_SUCCESS(status)) {
+    HookEventsTermination();
+    ImageRangesTermination();
     return status;
   }
 
@@ -183,6 +263,8 @@ DdimonInitialization(SharedShadowHookData* shared_sh_data) {
   status = ShEnableHooks();
   if (!NT_SUCCESS(status)) {
     DdimonpFreeAllocatedTrampolineRegions();
+    HookEventsTermination();
+    ImageRangesTermination();
     return status;
   }
 
@@ -198,6 +280,8 @@ _Use_decl_annotations_ EXTERN_C void DdimonTermination() {
   ShDisableHooks();
   UtilSleep(500);
   DdimonpFreeAllocatedTrampolineRegions();
+  HookEventsTermination();
+  ImageRangesTermination();
   HYPERPLATFORM_LOG_INFO("DdiMon has been terminated.");
 }
 
@@ -208,11 +292,9 @@ DdimonpFreeAllocatedTrampolineRegions() {
   PAGED_CODE();
 
   for (auto& target : g_ddimonp_hook_targets) {
-    if (target.original_call) {
-      ExFreePoolWithTag(target.original_call, kHyperPlatformCommonPoolTag);
-      target.original_call = nullptr;
-    }
+    *target.original_call = nullptr;
   }
+  TrampolineArenaFreeAll();
 }
 
 // Enumerates all exports in a module specified by base_address.
@@ -267,6 +349,30 @@ _Use_decl_annotations_ EXTERN_C static bool DdimonpEnumExportedSymbolsCallback(
     return true;
   }
 
+  const auto target_index = reinterpret_cast<DdimonpTargetIndex*>(context);
+
+  // Is this export listed as a target with an exact name
+  const auto length = strlen(export_name);
+  const auto mask = target_index->exact_targets.size() - 1;
+  for (auto i = DdimonpHashExportName(export_name, length) & mask;;
+       i = (i + 1) & mask) {
+    const auto target = target_index->exact_targets[i];
+    if (!target) {
+      break;
+    }
+    if (!DdimonpIsSameExportName(target->target_name, export_name, length)) {
+      continue;
+    }
+    if (!DdimonpInstallHook(*target_index, export_address, export_name,
+                            target)) {
+      return false;
+    }
+  }
+
+  if (target_index->wildcard_targets.empty()) {
+    return true;
+  }
+
   // convert the name to UNICODE_STRING
   wchar_t name[100];
   auto status =
@@ -277,21 +383,112 @@ _Use_decl_annotations_ EXTERN_C static bool DdimonpEnumExportedSymbolsCallback(
   UNICODE_STRING name_u = {};
   RtlInitUnicodeString(&name_u, name);
 
+  for (auto target : target_index->wildcard_targets) {
+    // Is this export matched with a wildcard target
+    if (!FsRtlIsNameInExpression(&target->target_name, &name_u, TRUE,
+                                 nullptr)) {
+      continue;
+    }
+    if (!DdimonpInstallHook(*target_index, export_address, export_name,
+                            target)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Installs a hook to the export
+_Use_decl_annotations_ EXTERN_C static bool DdimonpInstallHook(
+    const DdimonpTargetIndex& index, ULONG_PTR export_address,
+    const char* export_name, ShadowHookTarget* target) {
+  PAGED_CODE();
+
+  if (!ShInstallHook(index.shared_sh_data,
+                     reinterpret_cast<void*>(export_address), target)) {
+    // This is an error which should not happen
+    DdimonpFreeAllocatedTrampolineRegions();
+    return false;
+  }
+  HYPERPLATFORM_LOG_INFO("Hook has been installed at %p %s.", export_address,
+                         export_name);
+  return true;
+}
+
+// Sorts g_ddimonp_hook_targets into exact names and wildcards, and builds a
+// hash table of the former so that each export is checked in constant time
+_Use_decl_annotations_ EXTERN_C static void DdimonpBuildTargetIndex(
+    DdimonpTargetIndex* index) {
+  PAGED_CODE();
+
+  // Keep the load factor at or below 1/2
+  auto size = kDdimonpMinimumTargetIndexSize;
+  while (size < RTL_NUMBER_OF(g_ddimonp_hook_targets) * 2) {
+    size *= 2;
+  }
+  index->exact_targets.assign(size, nullptr);
+
+  const auto mask = size - 1;
   for (auto& target : g_ddimonp_hook_targets) {
-    // Is this export listed as a target
-    if (!FsRtlIsNameInExpression(&target.target_name, &name_u, TRUE, nullptr)) {
+    if (DdimonpIsWildcardName(target.target_name)) {
+      index->wildcard_targets.push_back(&target);
       continue;
     }
 
-    // Yes, install a hook to the export
-    if (!ShInstallHook(reinterpret_cast<SharedShadowHookData*>(context),
-                       reinterpret_cast<void*>(export_address), &target)) {
-      // This is an error which should not happen
-      DdimonpFreeAllocatedTrampolineRegions();
+    const auto hash = DdimonpHashExportName(
+        target.target_name.Buffer, target.target_name.Length / sizeof(WCHAR));
+    auto i = hash & mask;
+    while (index->exact_targets[i]) {
+      i = (i + 1) & mask;
+    }
+    index->exact_targets[i] = &target;
+  }
+}
+
+// Checks if the name contains wildcard characters of FsRtlIsNameInExpression()
+_Use_decl_annotations_ static bool DdimonpIsWildcardName(
+    const UNICODE_STRING& name) {
+  for (auto i = 0ul; i < name.Length / sizeof(WCHAR); ++i) {
+    switch (name.Buffer[i]) {
+      case L'*':
+      case L'?':
+      case DOS_STAR:
+      case DOS_QM:
+      case DOS_DOT:
+        return true;
+      default:
+        break;
+    }
+  }
+  return false;
+}
+
+// Folds an ASCII character to upper case
+_Use_decl_annotations_ static UCHAR DdimonpToUpperAscii(UCHAR c) {
+  return (c >= 'a' && c <= 'z') ? static_cast<UCHAR>(c - 'a' + 'A') : c;
+}
+
+// Returns FNV-1a hash of the ASCII name folded to upper case
+template <typename CharT>
+static ULONG DdimonpHashExportName(const CharT* name, SIZE_T length) {
+  ULONG hash = 2166136261;
+  for (auto i = 0ull; i < length; ++i) {
+    hash ^= DdimonpToUpperAscii(static_cast<UCHAR>(name[i]));
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+// Checks if the target name equals to the ASCII export name ignoring case
+_Use_decl_annotations_ static bool DdimonpIsSameExportName(
+    const UNICODE_STRING& target_name, const char* name, SIZE_T length) {
+  if (target_name.Length / sizeof(WCHAR) != length) {
+    return false;
+  }
+  for (auto i = 0ull; i < length; ++i) {
+    if (DdimonpToUpperAscii(static_cast<UCHAR>(target_name.Buffer[i])) !=
+        DdimonpToUpperAscii(static_cast<UCHAR>(name[i]))) {
       return false;
     }
-    HYPERPLATFORM_LOG_INFO("Hook has been installed at %p %s.", export_address,
-                           export_name);
   }
   return true;
 }
@@ -317,59 +514,93 @@ _Use_decl_annotations_ static std::array<char, 5> DdimonpTagToString(
   return str;
 }
 
-// Finds a handler to call an original function
-template <typename T>
-static T DdimonpFindOrignal(T handler) {
-  for (const auto& target : g_ddimonp_hook_targets) {
-    if (target.handler == handler) {
-      NT_ASSERT(target.original_call);
-      return reinterpret_cast<T>(target.original_call);
-    }
+// Formats an event recorded by a handler. Called by the drain thread.
+_Use_decl_annotations_ static void DdimonpFormatEvent(const HookEvent& event) {
+  PAGED_CODE();
+
+  switch (event.kind) {
+    case kDdimonpEventExFreePool:
+      HYPERPLATFORM_LOG_INFO("%p: ExFreePool(P= %p) (PID= %Iu, TID= %Iu)",
+                             event.caller, event.args[0], event.process_id,
+                             event.thread_id);
+      break;
+    case kDdimonpEventExFreePoolWithTag:
+      HYPERPLATFORM_LOG_INFO(
+          "%p: ExFreePoolWithTag(P= %p, Tag= %s) (PID= %Iu, TID= %Iu)",
+          event.caller, event.args[0],
+          DdimonpTagToString(static_cast<ULONG>(event.args[1])).data(),
+          event.process_id, event.thread_id);
+      break;
+    case kDdimonpEventExQueueWorkItem:
+      HYPERPLATFORM_LOG_INFO(
+          "%p: ExQueueWorkItem({Routine= %p, Parameter= %p}, %d) (PID= %Iu, "
+          "TID= %Iu)",
+          event.caller, event.args[0], event.args[1],
+          static_cast<int>(event.args[2]), event.process_id, event.thread_id);
+      break;
+    case kDdimonpEventExAllocatePoolWithTag:
+      HYPERPLATFORM_LOG_INFO(
+          "%p: ExAllocatePoolWithTag(POOL_TYPE= %08x, NumberOfBytes= %08X, "
+          "Tag= %s) => %p (PID= %Iu, TID= %Iu)",
+          event.caller, static_cast<ULONG>(event.args[0]), event.args[1],
+          DdimonpTagToString(static_cast<ULONG>(event.args[2])).data(),
+          event.result, event.process_id, event.thread_id);
+      break;
+    default:
+      NT_ASSERT(false);
+      break;
   }
-  NT_ASSERT(false);
-  return nullptr;
+}
+
+// Finds a handler to call an original function
+template <typename T, T Handler>
+static T DdimonpFindOrignal() {
+  const auto original_call = DdimonpOriginalCall<T, Handler>::address;
+  NT_ASSERT(original_call);
+  return reinterpret_cast<T>(original_call);
 }
 
 // The hook handler for ExFreePool(). Logs if ExFreePool() is called from where
 // not backed by any image
 _Use_decl_annotations_ static VOID DdimonpHandleExFreePool(PVOID p) {
-  const auto original = DdimonpFindOrignal(DdimonpHandleExFreePool);
+  const auto original = DDIMONP_FIND_ORIGINAL(DdimonpHandleExFreePool);
   original(p);
 
   // Is inside image?
   auto return_addr = _ReturnAddress();
-  if (UtilPcToFileHeader(return_addr)) {
+  if (ImageRangesFindImageBase(return_addr)) {
     return;
   }
 
-  HYPERPLATFORM_LOG_INFO_SAFE("%p: ExFreePool(P= %p)", return_addr, p);
+  HookEventsRecord(kDdimonpEventExFreePool, return_addr,
+                   reinterpret_cast<ULONG_PTR>(p), 0, 0, 0);
 }
 
 // The hook handler for ExFreePoolWithTag(). Logs if ExFreePoolWithTag() is
 // called from where not backed by any image.
 _Use_decl_annotations_ static VOID DdimonpHandleExFreePoolWithTag(PVOID p,
                                                                   ULONG tag) {
-  const auto original = DdimonpFindOrignal(DdimonpHandleExFreePoolWithTag);
+  const auto original = DDIMONP_FIND_ORIGINAL(DdimonpHandleExFreePoolWithTag);
   original(p, tag);
 
   // Is inside image?
   auto return_addr = _ReturnAddress();
-  if (UtilPcToFileHeader(return_addr)) {
+  if (ImageRangesFindImageBase(return_addr)) {
     return;
   }
 
-  HYPERPLATFORM_LOG_INFO_SAFE("%p: ExFreePoolWithTag(P= %p, Tag= %s)",
-                              return_addr, p, DdimonpTagToString(tag).data());
+  HookEventsRecord(kDdimonpEventExFreePoolWithTag, return_addr,
+                   reinterpret_cast<ULONG_PTR>(p), tag, 0, 0);
 }
 
 // The hook handler for ExQueueWorkItem(). Logs if a WorkerRoutine points to
 // where not backed by any image.
 _Use_decl_annotations_ static VOID DdimonpHandleExQueueWorkItem(
     PWORK_QUEUE_ITEM work_item, WORK_QUEUE_TYPE queue_type) {
-  const auto original = DdimonpFindOrignal(DdimonpHandleExQueueWorkItem);
+  const auto original = DDIMONP_FIND_ORIGINAL(DdimonpHandleExQueueWorkItem);
 
   // Is inside image?
-  if (UtilPcToFileHeader(work_item->WorkerRoutine)) {
+  if (ImageRangesFindImageBase(work_item->WorkerRoutine)) {
     // Call an original after checking parameters. It is common that a work
     // routine frees a work_item object resulting in wrong analysis.
     original(work_item, queue_type);
@@ -377,9 +608,10 @@ _Use_decl_annotations_ static VOID DdimonpHandleExQueueWorkItem(
   }
 
   auto return_addr = _ReturnAddress();
-  HYPERPLATFORM_LOG_INFO_SAFE(
-      "%p: ExQueueWorkItem({Routine= %p, Parameter= %p}, %d)", return_addr,
-      work_item->WorkerRoutine, work_item->Parameter, queue_type);
+  HookEventsRecord(kDdimonpEventExQueueWorkItem, return_addr,
+                   reinterpret_cast<ULONG_PTR>(work_item->WorkerRoutine),
+                   reinterpret_cast<ULONG_PTR>(work_item->Parameter),
+                   queue_type, 0);
 
   original(work_item, queue_type);
 }
@@ -388,20 +620,18 @@ _Use_decl_annotations_ static VOID DdimonpHandleExQueueWorkItem(
 // is called from where not backed by any image.
 _Use_decl_annotations_ static PVOID DdimonpHandleExAllocatePoolWithTag(
     POOL_TYPE pool_type, SIZE_T number_of_bytes, ULONG tag) {
-  const auto original = DdimonpFindOrignal(DdimonpHandleExAllocatePoolWithTag);
+  const auto original =
+      DDIMONP_FIND_ORIGINAL(DdimonpHandleExAllocatePoolWithTag);
   const auto result = original(pool_type, number_of_bytes, tag);
 
   // Is inside image?
   auto return_addr = _ReturnAddress();
-  if (UtilPcToFileHeader(return_addr)) {
+  if (ImageRangesFindImageBase(return_addr)) {
     return result;
   }
 
-  HYPERPLATFORM_LOG_INFO_SAFE(
-      "%p: ExAllocatePoolWithTag(POOL_TYPE= %08x, NumberOfBytes= %08X, Tag= "
-      "%s) => %p",
-      return_addr, pool_type, number_of_bytes, DdimonpTagToString(tag).data(),
-      result);
+  HookEventsRecord(kDdimonpEventExAllocatePoolWithTag, return_addr, pool_type,
+                   number_of_bytes, tag, reinterpret_cast<ULONG_PTR>(result));
   return result;
 }
 
@@ -411,7 +641,7 @@ _Use_decl_annotations_ static NTSTATUS DdimonpHandleNtQuerySystemInformation(
     SystemInformationClass system_information_class, PVOID system_information,
     ULONG system_information_length, PULONG return_length) {
   const auto original =
-      DdimonpFindOrignal(DdimonpHandleNtQuerySystemInformation);
+      DDIMONP_FIND_ORIGINAL(DdimonpHandleNtQuerySystemInformation);
   const auto result = original(system_information_class, system_information,
                                system_information_length, return_length);
   if (!NT_SUCCESS(result)) {
@@ -0,0 +1,209 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the decode cache.
+///
+/// Entries are kept in a set-associative table indexed by a hash of an address
+/// and a mode, and the least recently used entry of a set is replaced on a
+/// miss. Each entry holds a copy of cs_insn, whose bytes are compared with the
+/// current code on every lookup so that patched code is decoded again. Only
+/// handles with CS_OPT_DETAIL off are supported since details are not cached.
+/// Operations are not serialized, just like the Capstone handle in front of
+/// which the cache is used.
+
+#include "decode_cache.h"
+#include "../HyperPlatform/HyperPlatform/common.h"
+#include "../HyperPlatform/HyperPlatform/log.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+// The number of sets. Must be a power of two.
+static const SIZE_T kDecodeCachepSets = 64;
+
+// The number of entries in each set
+static const SIZE_T kDecodeCachepWays = 4;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// A cached instruction
+struct DecodeCacheEntry {
+  ULONG64 last_used;  // A tick of the last hit or insertion; 0 when empty
+  cs_mode mode;       // A mode the instruction was decoded in
+  cs_insn insn;       // A decoded instruction whose detail is nullptr
+};
+
+struct DecodeCache {
+  DecodeCacheEntry entries[kDecodeCachepSets][kDecodeCachepWays];
+  ULONG64 tick;    // Incremented on every hit or insertion
+  ULONG64 hits;    // The number of lookups answered by the cache
+  ULONG64 misses;  // The number of lookups that required decoding
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+static DecodeCacheEntry* DecodeCachepFindEntry(_In_ DecodeCache* cache,
+                                               _In_ cs_mode mode,
+                                               _In_ const uint8_t* code,
+                                               _In_ size_t code_size,
+                                               _In_ uint64_t address);
+
+static DecodeCacheEntry* DecodeCachepGetSet(_In_ DecodeCache* cache,
+                                            _In_ cs_mode mode,
+                                            _In_ uint64_t address);
+
+#if defined(ALLOC_PRAGMA)
+#pragma alloc_text(INIT, DecodeCacheAllocate)
+#pragma alloc_text(INIT, DecodeCacheLookup)
+#pragma alloc_text(INIT, DecodeCacheDisasm)
+#pragma alloc_text(INIT, DecodeCachepFindEntry)
+#pragma alloc_text(INIT, DecodeCachepGetSet)
+#pragma alloc_text(PAGE, DecodeCacheFree)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Allocates an empty cache
+_Use_decl_annotations_ EXTERN_C DecodeCache* DecodeCacheAllocate() {
+  PAGED_CODE();
+
+  auto cache = new DecodeCache();
+  RtlFillMemory(cache, sizeof(DecodeCache), 0);
+  return cache;
+}
+
+// Frees the cache
+_Use_decl_annotations_ EXTERN_C void DecodeCacheFree(DecodeCache* cache) {
+  PAGED_CODE();
+
+  HYPERPLATFORM_LOG_DEBUG("Decode cache: %I64u hits, %I64u misses", cache->hits,
+                          cache->misses);
+  delete cache;
+}
+
+// Returns an instruction previously decoded from the same bytes at the address
+// in the mode, or nullptr
+_Use_decl_annotations_ EXTERN_C const cs_insn* DecodeCacheLookup(
+    DecodeCache* cache, cs_mode mode, const uint8_t* code, size_t code_size,
+    uint64_t address) {
+  PAGED_CODE();
+
+  if (!cache) {
+    return nullptr;
+  }
+
+  const auto entry =
+      DecodeCachepFindEntry(cache, mode, code, code_size, address);
+  if (!entry) {
+    return nullptr;
+  }
+  entry->last_used = ++cache->tick;
+  cache->hits++;
+  return &entry->insn;
+}
+
+// Decodes an instruction like cs_disasm_iter() but returns a cached one when
+// the same bytes were already decoded at the address. The cache may be nullptr,
+// in which case it is cs_disasm_iter().
+_Use_decl_annotations_ EXTERN_C bool DecodeCacheDisasm(
+    DecodeCache* cache, csh handle, cs_mode mode, const uint8_t** code,
+    size_t* code_size, uint64_t* address, cs_insn* insn) {
+  PAGED_CODE();
+
+  if (!cache) {
+    return cs_disasm_iter(handle, code, code_size, address, insn);
+  }
+
+  const auto cached =
+      DecodeCacheLookup(cache, mode, *code, *code_size, *address);
+  if (cached) {
+    const auto detail = insn->detail;
+    *insn = *cached;
+    insn->detail = detail;
+    *code += insn->size;
+    *code_size -= insn->size;
+    *address += insn->size;
+    return true;
+  }
+
+  cache->misses++;
+  const auto decoded_address = *address;
+  if (!cs_disasm_iter(handle, code, code_size, address, insn)) {
+    return false;
+  }
+
+  // Replace a stale entry for the address if any. Otherwise, replace an empty
+  // or the least recently used entry in the set.
+  const auto set = DecodeCachepGetSet(cache, mode, decoded_address);
+  auto victim = &set[0];
+  for (SIZE_T i = 0; i < kDecodeCachepWays; ++i) {
+    if (set[i].last_used && set[i].insn.address == decoded_address &&
+        set[i].mode == mode) {
+      victim = &set[i];
+      break;
+    }
+    if (set[i].last_used < victim->last_used) {
+      victim = &set[i];
+    }
+  }
+  victim->last_used = ++cache->tick;
+  victim->mode = mode;
+  victim->insn = *insn;
+  victim->insn.detail = nullptr;
+  return true;
+}
+
+// Returns an entry for the address and the mode whose bytes match the code, or
+// nullptr
+_Use_decl_annotations_ static DecodeCacheEntry* DecodeCachepFindEntry(
+    DecodeCache* cache, cs_mode mode, const uint8_t* code, size_t code_size,
+    uint64_t address) {
+  const auto set = DecodeCachepGetSet(cache, mode, address);
+  for (SIZE_T i = 0; i < kDecodeCachepWays; ++i) {
+    const auto entry = &set[i];
+    if (!entry->last_used || entry->insn.address != address ||
+        entry->mode != mode) {
+      continue;
+    }
+
+    // The code has been patched since the instruction was decoded
+    if (entry->insn.size > code_size ||
+        !RtlEqualMemory(entry->insn.bytes, code, entry->insn.size)) {
+      return nullptr;
+    }
+    return entry;
+  }
+  return nullptr;
+}
+
+// Returns the first entry of a set the address and the mode belong to
+_Use_decl_annotations_ static DecodeCacheEntry* DecodeCachepGetSet(
+    DecodeCache* cache, cs_mode mode, uint64_t address) {
+  // Mix upper bits of the address into a set index with a multiplicative hash
+  const auto key = address ^ static_cast<uint64_t>(mode);
+  const auto hash = static_cast<SIZE_T>((key * 0x9e3779b97f4a7c15ull) >> 32);
+  return cache->entries[hash & (kDecodeCachepSets - 1)];
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// @brief Declares interfaces to the decode cache.
+///
+/// The cache sits in front of a Capstone handle and remembers instructions
+/// decoded at each address, so that decoding the same function prologue again,
+/// for example when a hook falls back from a jump to 0xcc or when several hooks
+/// share a target, costs a hash probe and a comparison of instruction bytes.
+/// A cached instruction is only returned while the bytes at the address are
+/// still the ones it was decoded from.
+
+#ifndef DDIMON_DECODE_CACHE_H_
+#define DDIMON_DECODE_CACHE_H_
+
+#include <fltKernel.h>
+#include <capstone.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+struct DecodeCache;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C DecodeCache* DecodeCacheAllocate();
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C
+    void DecodeCacheFree(_In_ DecodeCache* cache);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C const cs_insn* DecodeCacheLookup(
+    _In_opt_ DecodeCache* cache, _In_ cs_mode mode, _In_ const uint8_t* code,
+    _In_ size_t code_size, _In_ uint64_t address);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) _Success_(return ) EXTERN_C
+    bool DecodeCacheDisasm(_In_opt_ DecodeCache* cache, _In_ csh handle,
+                           _In_ cs_mode mode, _Inout_ const uint8_t** code,
+                           _Inout_ size_t* code_size,
+                           _Inout_ uint64_t* address, _Inout_ cs_insn* insn);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+#endif  // DDIMON_DECODE_CACHE_H_
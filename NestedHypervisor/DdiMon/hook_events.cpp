@@ -0,0 +1,275 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the hook event channel.
+///
+/// Each processor has a bounded ring in which every slot carries a sequence
+/// number. A producer claims a slot by advancing the head of the ring with
+/// compare-exchange, fills it, and then publishes it by updating the sequence
+/// number of the slot. Since a producer may be interrupted by another producer
+/// on the same processor, or migrate to another processor after choosing a
+/// ring, claiming is not assumed to be exclusive. The single consumer, the
+/// drain thread, reads slots in order and hands them back by updating their
+/// sequence numbers. When a ring is full, an event is dropped and counted.
+
+#include "hook_events.h"
+#include <intrin.h>
+#include "../HyperPlatform/HyperPlatform/common.h"
+#include "../HyperPlatform/HyperPlatform/log.h"
+#include "../HyperPlatform/HyperPlatform/util.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+// The number of slots per processor. Must be a power of two.
+static const LONG64 kHookEventspRingDepth = 1024;
+static_assert((kHookEventspRingDepth & (kHookEventspRingDepth - 1)) == 0,
+              "Must be a power of two");
+
+// An interval to drain rings
+static const LONG kHookEventspDrainIntervalMsec = 100;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// An element of a ring
+struct HookEventSlot {
+  // Equal to a position when the slot is free for a producer at the position,
+  // and the position + 1 when it holds an event for the consumer
+  volatile LONG64 sequence;
+  HookEvent event;
+};
+
+// A ring of a processor
+struct HookEventRing {
+  volatile LONG64 head;     // The next position to be claimed by producers
+  volatile LONG64 dropped;  // The number of events dropped since last drain
+  LONG64 tail;              // The next position to be read by the consumer
+  HookEventSlot slots[kHookEventspRingDepth];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static void HookEventspDrainRing(
+    _Inout_ HookEventRing* ring, _In_ ULONG processor);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static void HookEventspDrainAllRings();
+
+static KSTART_ROUTINE HookEventspDrainThreadRoutine;
+
+#if defined(ALLOC_PRAGMA)
+#pragma alloc_text(INIT, HookEventsInitialization)
+#pragma alloc_text(PAGE, HookEventsTermination)
+#pragma alloc_text(PAGE, HookEventspDrainRing)
+#pragma alloc_text(PAGE, HookEventspDrainAllRings)
+#pragma alloc_text(PAGE, HookEventspDrainThreadRoutine)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+// Rings indexed by a processor number
+static HookEventRing* g_hook_eventsp_rings;
+
+// The number of elements in g_hook_eventsp_rings
+static ULONG g_hook_eventsp_number_of_rings;
+
+// Formats drained events
+static HookEventFormatterType g_hook_eventsp_formatter;
+
+// The thread draining rings
+static HANDLE g_hook_eventsp_drain_thread_handle;
+
+// Tells the drain thread to exit
+static volatile bool g_hook_eventsp_drain_thread_should_be_alive;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Allocates rings and starts the drain thread
+_Use_decl_annotations_ EXTERN_C NTSTATUS
+HookEventsInitialization(HookEventFormatterType formatter) {
+  PAGED_CODE();
+
+  // Use the maximum count so that hot-plugged processors have rings too
+  const auto number_of_rings =
+      KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+  const auto rings = reinterpret_cast<HookEventRing*>(
+      ExAllocatePoolWithTag(NonPagedPoolNx,
+                            sizeof(HookEventRing) * number_of_rings,
+                            kHyperPlatformCommonPoolTag));
+  if (!rings) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+  for (auto i = 0ul; i < number_of_rings; ++i) {
+    auto& ring = rings[i];
+    ring.head = 0;
+    ring.dropped = 0;
+    ring.tail = 0;
+    for (auto position = 0ll; position < kHookEventspRingDepth; ++position) {
+      ring.slots[position].sequence = position;
+    }
+  }
+
+  g_hook_eventsp_rings = rings;
+  g_hook_eventsp_number_of_rings = number_of_rings;
+  g_hook_eventsp_formatter = formatter;
+  g_hook_eventsp_drain_thread_should_be_alive = true;
+  const auto status = PsCreateSystemThread(
+      &g_hook_eventsp_drain_thread_handle, GENERIC_ALL, nullptr, nullptr,
+      nullptr, HookEventspDrainThreadRoutine, nullptr);
+  if (!NT_SUCCESS(status)) {
+    g_hook_eventsp_drain_thread_should_be_alive = false;
+    g_hook_eventsp_rings = nullptr;
+    g_hook_eventsp_number_of_rings = 0;
+    ExFreePoolWithTag(rings, kHyperPlatformCommonPoolTag);
+    return status;
+  }
+  return status;
+}
+
+// Stops the drain thread after it drained remaining events and frees rings.
+// Handlers must not be recording events anymore.
+_Use_decl_annotations_ EXTERN_C void HookEventsTermination() {
+  PAGED_CODE();
+
+  if (!g_hook_eventsp_drain_thread_handle) {
+    return;
+  }
+
+  g_hook_eventsp_drain_thread_should_be_alive = false;
+  auto status = ZwWaitForSingleObject(g_hook_eventsp_drain_thread_handle,
+                                      FALSE, nullptr);
+  NT_VERIFY(NT_SUCCESS(status));
+  ZwClose(g_hook_eventsp_drain_thread_handle);
+  g_hook_eventsp_drain_thread_handle = nullptr;
+
+  const auto rings = g_hook_eventsp_rings;
+  g_hook_eventsp_rings = nullptr;
+  g_hook_eventsp_number_of_rings = 0;
+  ExFreePoolWithTag(rings, kHyperPlatformCommonPoolTag);
+}
+
+// Records an event into a ring of the current processor. It neither formats
+// nor acquires a lock, and drops the event when the ring is full.
+_Use_decl_annotations_ EXTERN_C void HookEventsRecord(
+    ULONG kind, void* caller, ULONG_PTR arg0, ULONG_PTR arg1, ULONG_PTR arg2,
+    ULONG_PTR result) {
+  const auto rings = g_hook_eventsp_rings;
+  if (!rings) {
+    return;
+  }
+
+  const auto processor = KeGetCurrentProcessorNumberEx(nullptr);
+  if (processor >= g_hook_eventsp_number_of_rings) {
+    return;
+  }
+  auto& ring = rings[processor];
+
+  auto position = ring.head;
+  for (;;) {
+    auto& slot = ring.slots[position & (kHookEventspRingDepth - 1)];
+    const auto sequence = slot.sequence;
+    if (sequence == position) {
+      // The slot is free. Try to claim it.
+      const auto previous =
+          InterlockedCompareExchange64(&ring.head, position + 1, position);
+      if (previous != position) {
+        position = previous;
+        continue;
+      }
+
+      auto& event = slot.event;
+      event.tsc = __rdtsc();
+      event.caller = caller;
+      event.process_id = PsGetCurrentProcessId();
+      event.thread_id = PsGetCurrentThreadId();
+      event.args[0] = arg0;
+      event.args[1] = arg1;
+      event.args[2] = arg2;
+      event.result = result;
+      event.kind = kind;
+      event.processor = processor;
+      InterlockedExchange64(&slot.sequence, position + 1);
+      return;
+    }
+
+    if (sequence < position) {
+      // The consumer has not read an event one lap behind yet. It is full.
+      InterlockedIncrement64(&ring.dropped);
+      return;
+    }
+
+    // Another producer claimed the slot meanwhile
+    position = ring.head;
+  }
+}
+
+// Passes all published events in the ring to the formatter
+_Use_decl_annotations_ static void HookEventspDrainRing(HookEventRing* ring,
+                                                        ULONG processor) {
+  PAGED_CODE();
+
+  for (;;) {
+    auto& slot = ring->slots[ring->tail & (kHookEventspRingDepth - 1)];
+    if (slot.sequence != ring->tail + 1) {
+      // Not yet published
+      break;
+    }
+
+    const auto event = slot.event;
+    InterlockedExchange64(&slot.sequence, ring->tail + kHookEventspRingDepth);
+    ring->tail++;
+    g_hook_eventsp_formatter(event);
+  }
+
+  const auto dropped = InterlockedExchange64(&ring->dropped, 0);
+  if (dropped) {
+    HYPERPLATFORM_LOG_WARN("%lld hook events were dropped on processor %lu.",
+                           dropped, processor);
+  }
+}
+
+// Drains rings of all processors
+_Use_decl_annotations_ static void HookEventspDrainAllRings() {
+  PAGED_CODE();
+
+  for (auto i = 0ul; i < g_hook_eventsp_number_of_rings; ++i) {
+    HookEventspDrainRing(&g_hook_eventsp_rings[i], i);
+  }
+}
+
+// A thread runs as long as g_hook_eventsp_drain_thread_should_be_alive is true
+// and drains rings every kHookEventspDrainIntervalMsec msec
+_Use_decl_annotations_ static VOID HookEventspDrainThreadRoutine(
+    void* start_context) {
+  PAGED_CODE();
+  UNREFERENCED_PARAMETER(start_context);
+
+  while (g_hook_eventsp_drain_thread_should_be_alive) {
+    HookEventspDrainAllRings();
+    UtilSleep(kHookEventspDrainIntervalMsec);
+  }
+
+  // Events recorded before termination was requested
+  HookEventspDrainAllRings();
+  PsTerminateSystemThread(STATUS_SUCCESS);
+}
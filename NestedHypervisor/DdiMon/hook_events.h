@@ -0,0 +1,71 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// @brief Declares interfaces to the hook event channel.
+///
+/// Hook handlers record fixed-size events into a per-processor ring without
+/// formatting a string or acquiring a lock. A system thread drains rings
+/// periodically and passes events to a formatter given at initialization.
+
+#ifndef DDIMON_HOOK_EVENTS_H_
+#define DDIMON_HOOK_EVENTS_H_
+
+#include <fltKernel.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// An event recorded by a hook handler
+struct HookEvent {
+  ULONG64 tsc;          // TSC when the event was recorded
+  void* caller;         // A return address of the hooked call
+  HANDLE process_id;    // A process that made the call
+  HANDLE thread_id;     // A thread that made the call
+  ULONG_PTR args[3];    // Parameters, meaning of which depends on kind
+  ULONG_PTR result;     // A return value if any
+  ULONG kind;           // Defined by a user of the channel
+  ULONG processor;      // A processor number that recorded the event
+};
+
+// A callback type for formatting an event. Called at PASSIVE_LEVEL.
+using HookEventFormatterType = void (*)(const HookEvent& event);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C NTSTATUS
+    HookEventsInitialization(_In_ HookEventFormatterType formatter);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C void HookEventsTermination();
+
+_IRQL_requires_max_(HIGH_LEVEL) EXTERN_C void HookEventsRecord(
+    _In_ ULONG kind, _In_ void* caller, _In_ ULONG_PTR arg0,
+    _In_ ULONG_PTR arg1, _In_ ULONG_PTR arg2, _In_ ULONG_PTR result);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+#endif  // DDIMON_HOOK_EVENTS_H_
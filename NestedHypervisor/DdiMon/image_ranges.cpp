@@ -0,0 +1,348 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the loaded image range cache.
+///
+/// Readers look up an immutable snapshot sorted by base addresses without any
+/// lock. A writer, the load image notify routine, builds a new snapshot,
+/// publishes it with a single pointer exchange, and frees the old one once no
+/// processor can be reading it. Readers stay at DISPATCH_LEVEL while using a
+/// snapshot, so running on every processor at PASSIVE_LEVEL is enough to know
+/// that.
+
+#include "image_ranges.h"
+#include "../HyperPlatform/HyperPlatform/common.h"
+#include "../HyperPlatform/HyperPlatform/log.h"
+#include "../HyperPlatform/HyperPlatform/util.h"
+#include "../HyperPlatform/HyperPlatform/kernel_stl.h"
+#include <algorithm>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// An address range of a loaded image
+struct ImageRange {
+  ULONG_PTR base;  // A base address of an image
+  ULONG_PTR end;   // An address right after the end of an image
+};
+
+// Sorted image ranges. Never modified once published.
+struct ImageRangesSnapshot {
+  ULONG count;            // The number of valid elements in ranges
+  ImageRange ranges[1];  // Sorted by base addresses
+};
+
+// For SystemModuleInformation
+enum SystemInformationClass {
+  kSystemModuleInformation = 11,
+};
+
+// For ZwQuerySystemInformation
+struct RtlProcessModuleInformation {
+  HANDLE section;
+  void* mapped_base;
+  void* image_base;
+  ULONG image_size;
+  ULONG flags;
+  USHORT load_order_index;
+  USHORT init_order_index;
+  USHORT load_count;
+  USHORT offset_to_file_name;
+  UCHAR full_path_name[256];
+};
+
+// For ZwQuerySystemInformation
+struct RtlProcessModules {
+  ULONG number_of_modules;
+  RtlProcessModuleInformation modules[1];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+EXTERN_C NTSYSAPI NTSTATUS NTAPI
+ZwQuerySystemInformation(_In_ SystemInformationClass system_information_class,
+                         _Out_writes_bytes_opt_(system_information_length)
+                             PVOID system_information,
+                         _In_ ULONG system_information_length,
+                         _Out_opt_ PULONG return_length);
+
+_IRQL_requires_max_(APC_LEVEL) static ImageRangesSnapshot*
+    ImageRangespAllocateSnapshot(_In_ ULONG count);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static ImageRangesSnapshot*
+    ImageRangespBuildSnapshot();
+
+_IRQL_requires_max_(APC_LEVEL) static ImageRangesSnapshot*
+    ImageRangespAddRange(_In_opt_ const ImageRangesSnapshot* snapshot,
+                         _In_ const ImageRange& range);
+
+static ImageRangesSnapshot* ImageRangespExchangeSnapshot(
+    _In_opt_ ImageRangesSnapshot* snapshot);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static void ImageRangespFreeSnapshot(
+    _In_opt_ ImageRangesSnapshot* snapshot);
+
+static void ImageRangespLoadImageNotifyRoutine(
+    _In_opt_ PUNICODE_STRING full_image_name, _In_ HANDLE process_id,
+    _In_ PIMAGE_INFO image_info);
+
+#if defined(ALLOC_PRAGMA)
+#pragma alloc_text(INIT, ImageRangesInitialization)
+#pragma alloc_text(INIT, ImageRangespBuildSnapshot)
+#pragma alloc_text(PAGE, ImageRangesTermination)
+#pragma alloc_text(PAGE, ImageRangespAllocateSnapshot)
+#pragma alloc_text(PAGE, ImageRangespAddRange)
+#pragma alloc_text(PAGE, ImageRangespFreeSnapshot)
+#pragma alloc_text(PAGE, ImageRangespLoadImageNotifyRoutine)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+// The latest snapshot read by ImageRangesFindImageBase()
+static ImageRangesSnapshot* volatile g_image_rangesp_snapshot;
+
+// Serializes writers of g_image_rangesp_snapshot
+static FAST_MUTEX g_image_rangesp_mutex;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Takes a snapshot of loaded images and starts tracking newly loaded ones
+_Use_decl_annotations_ EXTERN_C NTSTATUS ImageRangesInitialization() {
+  PAGED_CODE();
+
+  ExInitializeFastMutex(&g_image_rangesp_mutex);
+
+  const auto snapshot = ImageRangespBuildSnapshot();
+  if (!snapshot) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+  g_image_rangesp_snapshot = snapshot;
+
+  const auto status =
+      PsSetLoadImageNotifyRoutine(ImageRangespLoadImageNotifyRoutine);
+  if (!NT_SUCCESS(status)) {
+    g_image_rangesp_snapshot = nullptr;
+    ExFreePoolWithTag(snapshot, kHyperPlatformCommonPoolTag);
+    return status;
+  }
+
+  HYPERPLATFORM_LOG_DEBUG("Tracking %lu images.", snapshot->count);
+  return status;
+}
+
+// Stops tracking images and frees the snapshot
+_Use_decl_annotations_ EXTERN_C void ImageRangesTermination() {
+  PAGED_CODE();
+
+  PsRemoveLoadImageNotifyRoutine(ImageRangespLoadImageNotifyRoutine);
+  ImageRangespFreeSnapshot(ImageRangespExchangeSnapshot(nullptr));
+}
+
+// Returns a base address of an image containing the address, or nullptr. It
+// is a binary search and does not acquire any lock.
+_Use_decl_annotations_ EXTERN_C void* ImageRangesFindImageBase(void* address) {
+  // Stay on DISPATCH_LEVEL while using a snapshot so that a writer can tell
+  // when no processor is using an old one
+  const auto old_irql = KeGetCurrentIrql();
+  if (old_irql < DISPATCH_LEVEL) {
+    KeRaiseIrqlToDpcLevel();
+  }
+
+  void* base = nullptr;
+  const auto snapshot = g_image_rangesp_snapshot;
+  if (snapshot) {
+    // Find the last range whose base is equal to or lower than the address
+    const auto pc = reinterpret_cast<ULONG_PTR>(address);
+    const auto begin = snapshot->ranges;
+    const auto end = snapshot->ranges + snapshot->count;
+    const auto found = std::upper_bound(
+        begin, end, pc,
+        [](ULONG_PTR value, const ImageRange& range) {
+          return value < range.base;
+        });
+    if (found != begin && pc < (found - 1)->end) {
+      base = reinterpret_cast<void*>((found - 1)->base);
+    }
+  }
+
+  if (old_irql < DISPATCH_LEVEL) {
+    KeLowerIrql(old_irql);
+  }
+  return base;
+}
+
+// Allocates a snapshot that can hold count ranges
+_Use_decl_annotations_ static ImageRangesSnapshot*
+ImageRangespAllocateSnapshot(ULONG count) {
+  PAGED_CODE();
+
+  const auto snapshot = reinterpret_cast<ImageRangesSnapshot*>(
+      ExAllocatePoolWithTag(NonPagedPoolNx,
+                            sizeof(ImageRangesSnapshot) +
+                                sizeof(ImageRange) * count,
+                            kHyperPlatformCommonPoolTag));
+  if (snapshot) {
+    snapshot->count = 0;
+  }
+  return snapshot;
+}
+
+// Builds a snapshot from the loaded module list
+_Use_decl_annotations_ static ImageRangesSnapshot*
+ImageRangespBuildSnapshot() {
+  PAGED_CODE();
+
+  // Query the list, retrying while modules are being loaded
+  RtlProcessModules* modules = nullptr;
+  ULONG size = 0;
+  auto status = STATUS_INFO_LENGTH_MISMATCH;
+  while (status == STATUS_INFO_LENGTH_MISMATCH) {
+    if (modules) {
+      ExFreePoolWithTag(modules, kHyperPlatformCommonPoolTag);
+    }
+    size += PAGE_SIZE;
+    modules = reinterpret_cast<RtlProcessModules*>(ExAllocatePoolWithTag(
+        PagedPool, size, kHyperPlatformCommonPoolTag));
+    if (!modules) {
+      return nullptr;
+    }
+    status = ZwQuerySystemInformation(kSystemModuleInformation, modules, size,
+                                      &size);
+  }
+  if (!NT_SUCCESS(status)) {
+    ExFreePoolWithTag(modules, kHyperPlatformCommonPoolTag);
+    return nullptr;
+  }
+
+  const auto count = modules->number_of_modules;
+  const auto snapshot = ImageRangespAllocateSnapshot(count);
+  if (snapshot) {
+    for (auto i = 0ul; i < modules->number_of_modules; ++i) {
+      const auto& module = modules->modules[i];
+      const auto base = reinterpret_cast<ULONG_PTR>(module.image_base);
+      snapshot->ranges[i] = {base, base + module.image_size};
+    }
+    snapshot->count = modules->number_of_modules;
+    std::sort(snapshot->ranges, snapshot->ranges + snapshot->count,
+              [](const ImageRange& lhs, const ImageRange& rhs) {
+                return lhs.base < rhs.base;
+              });
+  }
+  ExFreePoolWithTag(modules, kHyperPlatformCommonPoolTag);
+  return snapshot;
+}
+
+// Returns a copy of the snapshot with the range inserted. Ranges overlapping
+// with the new one are dropped since they belong to images already unloaded,
+// which is the only way unloading is reflected as there is no notification.
+_Use_decl_annotations_ static ImageRangesSnapshot* ImageRangespAddRange(
+    const ImageRangesSnapshot* snapshot, const ImageRange& range) {
+  PAGED_CODE();
+
+  const auto old_count = (snapshot) ? snapshot->count : 0;
+  const auto new_snapshot = ImageRangespAllocateSnapshot(old_count + 1);
+  if (!new_snapshot) {
+    return nullptr;
+  }
+
+  auto inserted = false;
+  auto count = 0ul;
+  for (auto i = 0ul; i < old_count; ++i) {
+    const auto& current = snapshot->ranges[i];
+    if (current.base < range.end && range.base < current.end) {
+      continue;
+    }
+    if (!inserted && range.base < current.base) {
+      new_snapshot->ranges[count++] = range;
+      inserted = true;
+    }
+    new_snapshot->ranges[count++] = current;
+  }
+  if (!inserted) {
+    new_snapshot->ranges[count++] = range;
+  }
+  new_snapshot->count = count;
+  return new_snapshot;
+}
+
+// Publishes the snapshot and returns the previous one
+_Use_decl_annotations_ static ImageRangesSnapshot*
+ImageRangespExchangeSnapshot(ImageRangesSnapshot* snapshot) {
+  return reinterpret_cast<ImageRangesSnapshot*>(InterlockedExchangePointer(
+      reinterpret_cast<void* volatile*>(&g_image_rangesp_snapshot),
+      snapshot));
+}
+
+// Frees a snapshot no longer published once all processors stopped using it
+_Use_decl_annotations_ static void ImageRangespFreeSnapshot(
+    ImageRangesSnapshot* snapshot) {
+  PAGED_CODE();
+
+  if (!snapshot) {
+    return;
+  }
+
+  // Once this thread has run on every processor, no reader is still at
+  // DISPATCH_LEVEL with the snapshot
+  UtilForEachProcessor(
+      [](void* context) {
+        UNREFERENCED_PARAMETER(context);
+        return STATUS_SUCCESS;
+      },
+      nullptr);
+  ExFreePoolWithTag(snapshot, kHyperPlatformCommonPoolTag);
+}
+
+// Adds a range of a newly loaded kernel image to the snapshot
+_Use_decl_annotations_ static void ImageRangespLoadImageNotifyRoutine(
+    PUNICODE_STRING full_image_name, HANDLE process_id,
+    PIMAGE_INFO image_info) {
+  PAGED_CODE();
+  UNREFERENCED_PARAMETER(full_image_name);
+  UNREFERENCED_PARAMETER(process_id);
+
+  if (!image_info->SystemModeImage) {
+    return;
+  }
+
+  const auto base = reinterpret_cast<ULONG_PTR>(image_info->ImageBase);
+  const ImageRange range = {base, base + image_info->ImageSize};
+
+  ImageRangesSnapshot* old_snapshot = nullptr;
+  ExAcquireFastMutex(&g_image_rangesp_mutex);
+  const auto snapshot = ImageRangespAddRange(g_image_rangesp_snapshot, range);
+  if (snapshot) {
+    old_snapshot = ImageRangespExchangeSnapshot(snapshot);
+  }
+  ExReleaseFastMutex(&g_image_rangesp_mutex);
+
+  if (!snapshot) {
+    HYPERPLATFORM_LOG_WARN("Failed to track an image at %p.",
+                           image_info->ImageBase);
+    return;
+  }
+  ImageRangespFreeSnapshot(old_snapshot);
+}
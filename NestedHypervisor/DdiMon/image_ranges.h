@@ -0,0 +1,55 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// @brief Declares interfaces to the loaded image range cache.
+///
+/// The cache keeps a sorted snapshot of address ranges of loaded kernel images
+/// so that hook handlers can tell whether an address is backed by an image
+/// without walking the loaded module list on every call.
+
+#ifndef DDIMON_IMAGE_RANGES_H_
+#define DDIMON_IMAGE_RANGES_H_
+
+#include <fltKernel.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C NTSTATUS
+    ImageRangesInitialization();
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C void ImageRangesTermination();
+
+_IRQL_requires_max_(DISPATCH_LEVEL) EXTERN_C
+    void* ImageRangesFindImageBase(_In_ void* address);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+#endif  // DDIMON_IMAGE_RANGES_H_
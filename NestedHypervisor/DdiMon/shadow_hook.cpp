@@ -16,8 +16,10 @@
 #include "../HyperPlatform/HyperPlatform/kernel_stl.h"
 #include <vector>
 #include <memory>
-#include <algorithm>
 #include "cs_driver_mm.h"
+#include "decode_cache.h"
+#include "shadow_page_store.h"
+#include "trampoline_arena.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -29,42 +31,79 @@
 // constants and macros
 //
 
+// Whether read and write access to hooked pages is handled by switching to an
+// EPT hierarchy exposing read/write shadow pages rather than by single-stepping
+// with MTF. It costs another EPT hierarchy for each processor. It takes effect
+// only where ShAllocateShadowHookData() is called, which the nested
+// HyperPlatform does not do as it runs without EPT (see VmpInitializeVm()).
+static const bool kShpUseEptViewForRW = true;
+
+// Whether a hook is installed as a jump to a handler rather than 0xcc when the
+// first instruction is long enough to be overwritten by the jump and can be
+// relocated to a trampoline. Hooks with a jump cost no VM-exit on each call.
+static const bool kShpUseJumpHook = true;
+
+// Whether instructions decoded for hooks are cached by their addresses so that
+// decoding the same code again, for example when a hook falls back to 0xcc or
+// another hook targets the same function, does not run the disassembler.
+static const bool kShpUseDecodeCache = true;
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // types
 //
 
-// Copy of a page seen by a guest as a result of memory shadowing
-struct Page {
-  UCHAR* page;  // A page aligned copy of a page
-  Page();
-  ~Page();
-};
-
 // Contains a single steal thook information
 struct HookInformation {
   void* patch_address;  // An address where a hook is installed
   void* handler;        // An address of the handler routine
 
-  // A copy of a pages where patch_address belongs to. shadow_page_base_for_rw
-  // is exposed to a guest for read and write operation against the page of
-  // patch_address, and shadow_page_base_for_exec is exposed for execution.
-  std::shared_ptr<Page> shadow_page_base_for_rw;
-  std::shared_ptr<Page> shadow_page_base_for_exec;
+  // Copies of a page where patch_address belongs to. page_for_rw is exposed
+  // to a guest for read and write operation against the page of
+  // patch_address, and page_for_exec is exposed for execution. Shared with
+  // other hooks and features shadowing the same page.
+  const ShadowPage* shadow_page;
+};
 
-  // Phyisical address of the above two copied pages
-  ULONG64 pa_base_for_rw;
-  ULONG64 pa_base_for_exec;
+// An entry of an open-addressed hash index of HookInformation
+struct HookIndexEntry {
+  ULONG_PTR key;                // A PFN or a patch address
+  const HookInformation* info;  // nullptr when the entry is empty
 };
 
 // Data structure shared across all processors
 struct SharedShadowHookData {
   std::vector<std::unique_ptr<HookInformation>> hooks;  // Hold installed hooks
+  ShadowPageStore* shadow_pages;  // Holds copies of pages shadowed by hooks
+
+  // A disassembler handle without details and an instruction buffer for it,
+  // reused for every hook, and a cache of instructions it decoded, which is
+  // nullptr when not used. Only used by ShInstallHook().
+  csh capstone_handle;
+  cs_mode capstone_mode;
+  cs_insn* capstone_insn;
+  DecodeCache* decode_cache;
+
+  // Indexes of the above hooks by a PFN of a hooked page and by an exact patch
+  // address. The number of entries is a power of two and at least twice as
+  // many as hooks. They are only rebuilt by ShInstallHook() before hooks are
+  // enabled, and read by all processors without a lock afterwards.
+  std::vector<HookIndexEntry> index_by_pfn;
+  std::vector<HookIndexEntry> index_by_address;
 };
 
 // Data structure for each processor
 struct ShadowHookData {
   const HookInformation* last_hook_info;  // Remember which hook hit the last
+
+  // An EPT hierarchy exposing read/write shadow pages as read/write but not
+  // executable, or nullptr when read and write access is handled with MTF.
+  // Processors switch to it on read or write access to a hooked page and back
+  // to the default one on execution of a hooked page.
+  EptData* ept_data_for_rw;
+  ULONG64 ept_pointer_for_rw;    // An EPT pointer of ept_data_for_rw
+  ULONG64 ept_pointer_for_exec;  // An EPT pointer of the default hierarchy
+  bool rw_view_active;           // true while ept_data_for_rw is in use
 };
 
 // A structure reflects inline hook code.
@@ -91,6 +130,12 @@ static_assert(sizeof(TrampolineCode) == 7, "Size check");
 #endif
 #include <poppack.h>
 
+// A jump from a patch address to a hook handler
+struct JumpCode {
+  UCHAR code[6 + sizeof(void*)];  // Code bytes
+  SIZE_T size;                    // A size of valid bytes in code
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // prototypes
@@ -102,21 +147,52 @@ _IRQL_requires_max_(PASSIVE_LEVEL) static std::unique_ptr<
                                               _In_ void* address,
                                               _In_ ShadowHookTarget* target);
 
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C static bool ShpOpenDisassembler(
+    _Inout_ SharedShadowHookData* shared_sh_data);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C static void ShpCloseDisassembler(
+    _Inout_ SharedShadowHookData* shared_sh_data);
+
 _IRQL_requires_max_(PASSIVE_LEVEL) _Success_(return ) EXTERN_C
-    static bool ShpSetupInlineHook(_In_ void* patch_address,
+    static bool ShpSetupInlineHook(_In_ SharedShadowHookData* shared_sh_data,
+                                   _In_ void* patch_address,
+                                   _In_ void* handler,
                                    _In_ UCHAR* shadow_exec_page,
                                    _Out_ void** original_call_ptr);
 
 _IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C static SIZE_T
-    ShpGetInstructionSize(_In_ void* address);
+    ShpGetInstructionSize(_In_ const SharedShadowHookData* shared_sh_data,
+                          _In_ void* address);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C static SIZE_T
+    ShpGetRelocatableSize(_In_ const SharedShadowHookData* shared_sh_data,
+                          _In_ void* address, _In_ SIZE_T required_size);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C static bool
+    ShpIsRelocatableInstruction(_In_ const cs_insn* instruction);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C static JumpCode
+    ShpMakeJumpCode(_In_ void* patch_address, _In_ void* hook_handler);
 
 _IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C static TrampolineCode
     ShpMakeTrampolineCode(_In_ void* hook_handler);
 
-static HookInformation* ShpFindPatchInfoByPage(
-    _In_ const SharedShadowHookData* shared_sh_data, _In_ void* address);
+_IRQL_requires_max_(PASSIVE_LEVEL) static void ShpBuildHookIndexes(
+    _Inout_ SharedShadowHookData* shared_sh_data);
 
-static HookInformation* ShpFindPatchInfoByAddress(
+_IRQL_requires_max_(PASSIVE_LEVEL) static void ShpInsertHookIndex(
+    _Inout_ std::vector<HookIndexEntry>* index, _In_ ULONG_PTR key,
+    _In_ const HookInformation* info);
+
+static const HookInformation* ShpLookupHookIndex(
+    _In_ const std::vector<HookIndexEntry>& index, _In_ ULONG_PTR key);
+
+static ULONG_PTR ShpHashHookIndexKey(_In_ ULONG_PTR key);
+
+static const HookInformation* ShpFindPatchInfoByPage(
+    _In_ const SharedShadowHookData* shared_sh_data, _In_ ULONG64 pa);
+
+static const HookInformation* ShpFindPatchInfoByAddress(
     _In_ const SharedShadowHookData* shared_sh_data, _In_ void* address);
 
 static void ShpEnablePageShadowingForExec(_In_ const HookInformation& info,
@@ -125,6 +201,11 @@ static void ShpEnablePageShadowingForExec(_In_ const HookInformation& info,
 static void ShpEnablePageShadowingForRW(_In_ const HookInformation& info,
                                         _In_ EptData* ept_data);
 
+static void ShpEnablePageShadowingForRWView(_In_ const HookInformation& info,
+                                            _In_ EptData* ept_data_for_rw);
+
+static void ShpSwitchEptView(_In_ ShadowHookData* sh_data, _In_ bool for_rw);
+
 static void ShpDisablePageShadowing(_In_ const HookInformation& info,
                                     _In_ EptData* ept_data);
 
@@ -145,11 +226,18 @@ static bool ShpIsShadowHookActive(
 #pragma alloc_text(INIT, ShAllocateSharedShaowHookData)
 #pragma alloc_text(INIT, ShEnableHooks)
 #pragma alloc_text(INIT, ShInstallHook)
+#pragma alloc_text(INIT, ShpOpenDisassembler)
 #pragma alloc_text(INIT, ShpSetupInlineHook)
 #pragma alloc_text(INIT, ShpGetInstructionSize)
+#pragma alloc_text(INIT, ShpGetRelocatableSize)
+#pragma alloc_text(INIT, ShpIsRelocatableInstruction)
+#pragma alloc_text(INIT, ShpMakeJumpCode)
 #pragma alloc_text(INIT, ShpMakeTrampolineCode)
+#pragma alloc_text(INIT, ShpBuildHookIndexes)
+#pragma alloc_text(INIT, ShpInsertHookIndex)
 #pragma alloc_text(PAGE, ShFreeShadowHookData)
 #pragma alloc_text(PAGE, ShFreeSharedShadowHookData)
+#pragma alloc_text(PAGE, ShpCloseDisassembler)
 #pragma alloc_text(PAGE, ShDisableHooks)
 #endif
 
@@ -169,6 +257,14 @@ _Use_decl_annotations_ EXTERN_C ShadowHookData* ShAllocateShadowHookData() {
 
   auto p = new ShadowHookData();
   RtlFillMemory(p, sizeof(ShadowHookData), 0);
+
+  // Fall back to MTF when another EPT hierarchy is not available
+  if (kShpUseEptViewForRW) {
+    p->ept_data_for_rw = EptInitialization();
+    if (p->ept_data_for_rw) {
+      p->ept_pointer_for_rw = EptGetEptPointer(p->ept_data_for_rw);
+    }
+  }
   return p;
 }
 
@@ -177,6 +273,9 @@ _Use_decl_annotations_ EXTERN_C void ShFreeShadowHookData(
     ShadowHookData* sh_data) {
   PAGED_CODE();
 
+  if (sh_data->ept_data_for_rw) {
+    EptTermination(sh_data->ept_data_for_rw);
+  }
   delete sh_data;
 }
 
@@ -191,6 +290,16 @@ ShAllocateSharedShaowHookData() {
 
   auto p = new SharedShadowHookData();
   RtlFillMemory(p, sizeof(SharedShadowHookData), 0);
+  p->shadow_pages = ShadowPageStoreAllocate();
+  if (!p->shadow_pages) {
+    delete p;
+    return nullptr;
+  }
+  if (!ShpOpenDisassembler(p)) {
+    ShadowPageStoreFree(p->shadow_pages);
+    delete p;
+    return nullptr;
+  }
   return p;
 }
 
@@ -199,9 +308,77 @@ _Use_decl_annotations_ EXTERN_C void ShFreeSharedShadowHookData(
     SharedShadowHookData* shared_sh_data) {
   PAGED_CODE();
 
+  for (auto& info : shared_sh_data->hooks) {
+    ShadowPageStoreRelease(shared_sh_data->shadow_pages, info->shadow_page);
+  }
+  shared_sh_data->hooks.clear();
+  ShadowPageStoreFree(shared_sh_data->shadow_pages);
+  ShpCloseDisassembler(shared_sh_data);
   delete shared_sh_data;
 }
 
+// Opens a disassembler handle reused for all hooks. Opening one initializes
+// the whole X86 module, which is too costly to repeat for each hook.
+_Use_decl_annotations_ EXTERN_C static bool ShpOpenDisassembler(
+    SharedShadowHookData* shared_sh_data) {
+  PAGED_CODE();
+
+  KFLOATING_SAVE float_save = {};
+  auto status = KeSaveFloatingPointState(&float_save);
+  if (!NT_SUCCESS(status)) {
+    return false;
+  }
+
+  csh handle = {};
+  const auto mode = IsX64() ? CS_MODE_64 : CS_MODE_32;
+  if (cs_open(CS_ARCH_X86, mode, &handle) != CS_ERR_OK) {
+    KeRestoreFloatingPointState(&float_save);
+    return false;
+  }
+
+  // Sizes, mnemonics and operand strings are all hooks need
+  cs_option(handle, CS_OPT_DETAIL, CS_OPT_OFF);
+  const auto insn = cs_malloc(handle);
+  if (!insn) {
+    cs_close(&handle);
+    KeRestoreFloatingPointState(&float_save);
+    return false;
+  }
+
+  shared_sh_data->capstone_handle = handle;
+  shared_sh_data->capstone_mode = mode;
+  shared_sh_data->capstone_insn = insn;
+  if (kShpUseDecodeCache) {
+    shared_sh_data->decode_cache = DecodeCacheAllocate();
+  }
+  KeRestoreFloatingPointState(&float_save);
+  return true;
+}
+
+// Closes the disassembler handle
+_Use_decl_annotations_ EXTERN_C static void ShpCloseDisassembler(
+    SharedShadowHookData* shared_sh_data) {
+  PAGED_CODE();
+
+  if (!shared_sh_data->capstone_insn) {
+    return;
+  }
+  if (shared_sh_data->decode_cache) {
+    DecodeCacheFree(shared_sh_data->decode_cache);
+    shared_sh_data->decode_cache = nullptr;
+  }
+  cs_free(shared_sh_data->capstone_insn, 1);
+  cs_close(&shared_sh_data->capstone_handle);
+  shared_sh_data->capstone_insn = nullptr;
+}
+
+// Returns the store of shadow pages so that other features shadowing pages can
+// share copies with hooks
+_Use_decl_annotations_ EXTERN_C ShadowPageStore* ShGetShadowPageStore(
+    SharedShadowHookData* shared_sh_data) {
+  return shared_sh_data->shadow_pages;
+}
+
 // Enables page shadowing for all hooks
 _Use_decl_annotations_ EXTERN_C NTSTATUS ShEnableHooks() {
   PAGED_CODE();
@@ -228,25 +405,49 @@ _Use_decl_annotations_ EXTERN_C NTSTATUS ShDisableHooks() {
 
 // Enables page shadowing for all hooks
 _Use_decl_annotations_ NTSTATUS ShEnablePageShadowing(
-    EptData* ept_data, const SharedShadowHookData* shared_sh_data) {
+    EptData* ept_data, ShadowHookData* sh_data,
+    const SharedShadowHookData* shared_sh_data) {
   HYPERPLATFORM_COMMON_DBG_BREAK();
 
   for (auto& info : shared_sh_data->hooks) {
     ShpEnablePageShadowingForExec(*info, ept_data);
   }
+
+  if (sh_data->ept_data_for_rw) {
+    sh_data->ept_pointer_for_exec = UtilVmRead64(VmcsField::kEptPointer);
+    for (auto& info : shared_sh_data->hooks) {
+      ShpEnablePageShadowingForRWView(*info, sh_data->ept_data_for_rw);
+    }
+    UtilInveptAll();
+  }
   return STATUS_SUCCESS;
 }
 
 // Disables page shadowing for all hooks
 _Use_decl_annotations_ void ShVmCallDisablePageShadowing(
-    EptData* ept_data, const SharedShadowHookData* shared_sh_data) {
+    EptData* ept_data, ShadowHookData* sh_data,
+    const SharedShadowHookData* shared_sh_data) {
   HYPERPLATFORM_COMMON_DBG_BREAK();
 
+  if (sh_data->rw_view_active) {
+    ShpSwitchEptView(sh_data, false);
+  }
+
   for (auto& info : shared_sh_data->hooks) {
     ShpDisablePageShadowing(*info, ept_data);
+    if (sh_data->ept_data_for_rw) {
+      ShpDisablePageShadowing(*info, sh_data->ept_data_for_rw);
+    }
   }
 }
 
+// Returns EptData of an EPT hierarchy the current processor is using
+_Use_decl_annotations_ EptData* ShGetCurrentEptData(ShadowHookData* sh_data,
+                                                    EptData* ept_data) {
+  return (sh_data && sh_data->rw_view_active) ? sh_data->ept_data_for_rw
+                                               : ept_data;
+}
+
 // Handles #BP. Checks if the #BP happened on where DdiMon set a break point,
 // and if so, modifies the contents of guest's IP to execute a corresponding
 // hook handler.
@@ -283,16 +484,34 @@ _Use_decl_annotations_ void ShHandleMonitorTrapFlag(
 // Handles EPT violation VM-exit.
 _Use_decl_annotations_ void ShHandleEptViolation(
     ShadowHookData* sh_data, const SharedShadowHookData* shared_sh_data,
-    EptData* ept_data, void* fault_va) {
+    EptData* ept_data, ULONG64 fault_pa) {
   if (!ShpIsShadowHookActive(shared_sh_data)) {
     return;
   }
 
-  const auto info = ShpFindPatchInfoByPage(shared_sh_data, fault_va);
+  const auto info = ShpFindPatchInfoByPage(shared_sh_data, fault_pa);
   if (!info) {
     return;
   }
 
+  // A guest tried to execute a hooked page that is not executable on the view
+  // for read and write. Show exec shadow pages again.
+  if (sh_data->rw_view_active) {
+    ShpSwitchEptView(sh_data, false);
+    return;
+  }
+
+  // Let a guest read or write read/write shadow pages by switching the view
+  // unless the instruction is on a hooked page, which is not executable on
+  // the view and would cause another EPT violation immediately.
+  const auto guest_ip =
+      reinterpret_cast<void*>(UtilVmRead(VmcsField::kGuestRip));
+  if (sh_data->ept_data_for_rw &&
+      !ShpFindPatchInfoByPage(shared_sh_data, UtilPaFromVa(guest_ip))) {
+    ShpSwitchEptView(sh_data, true);
+    return;
+  }
+
   // EPT violation was caused because a guest tried to read or write to a page
   // where currently set as execute only for protecting a hook. Let a guest
   // read or write a page from a read/write shadow page and run a single
@@ -314,56 +533,65 @@ _Use_decl_annotations_ EXTERN_C bool ShInstallHook(
     return false;
   }
 
-  if (!ShpSetupInlineHook(info->patch_address,
-                          info->shadow_page_base_for_exec->page,
-                          &target->original_call)) {
+  if (!ShpSetupInlineHook(shared_sh_data, info->patch_address, info->handler,
+                          info->shadow_page->page_for_exec,
+                          target->original_call)) {
+    ShadowPageStoreRelease(shared_sh_data->shadow_pages, info->shadow_page);
     return false;
   }
 
   HYPERPLATFORM_LOG_DEBUG(
       "Patch = %p, Exec = %p, RW = %p, Trampoline = %p", info->patch_address,
-      info->shadow_page_base_for_exec->page + BYTE_OFFSET(info->patch_address),
-      info->shadow_page_base_for_rw->page + BYTE_OFFSET(info->patch_address),
-      target->original_call);
+      info->shadow_page->page_for_exec + BYTE_OFFSET(info->patch_address),
+      info->shadow_page->page_for_rw + BYTE_OFFSET(info->patch_address),
+      *target->original_call);
 
   shared_sh_data->hooks.push_back(std::move(info));
+  ShpBuildHookIndexes(shared_sh_data);
   return true;
 }
 
-// Creates or reuses a couple of copied pages and initializes HookInformation
+// Acquires a couple of copied pages from the store and initializes
+// HookInformation. The pages are shared when the page is already shadowed.
 _Use_decl_annotations_ static std::unique_ptr<HookInformation>
 ShpCreateHookInformation(SharedShadowHookData* shared_sh_data, void* address,
                          ShadowHookTarget* target) {
   auto info = std::make_unique<HookInformation>();
-  auto reusable_info = ShpFindPatchInfoByPage(shared_sh_data, address);
-  if (reusable_info) {
-    // Found an existing HookInformation object targetting the same page as this
-    // one. re-use shadow pages.
-    info->shadow_page_base_for_rw = reusable_info->shadow_page_base_for_rw;
-    info->shadow_page_base_for_exec = reusable_info->shadow_page_base_for_exec;
-  } else {
-    // This hook is for a page that is not currently have any hooks (ie not
-    // shadowed). Creates shadow pages.
-    info->shadow_page_base_for_rw = std::make_shared<Page>();
-    info->shadow_page_base_for_exec = std::make_shared<Page>();
-    auto page_base = PAGE_ALIGN(address);
-    RtlCopyMemory(info->shadow_page_base_for_rw->page, page_base, PAGE_SIZE);
-    RtlCopyMemory(info->shadow_page_base_for_exec->page, page_base, PAGE_SIZE);
+  info->shadow_page =
+      ShadowPageStoreAcquire(shared_sh_data->shadow_pages, address);
+  if (!info->shadow_page) {
+    return nullptr;
   }
   info->patch_address = address;
-  info->pa_base_for_rw = UtilPaFromVa(info->shadow_page_base_for_rw->page);
-  info->pa_base_for_exec = UtilPaFromVa(info->shadow_page_base_for_exec->page);
   info->handler = target->handler;
   return info;
 }
 
-// Builds a trampoline code for calling an orignal code and embeds 0xcc on the
-// shadow_exec_page
+// Builds a trampoline code for calling an orignal code and embeds either a jump
+// to the handler or 0xcc on the shadow_exec_page
 _Use_decl_annotations_ EXTERN_C static bool ShpSetupInlineHook(
-    void* patch_address, UCHAR* shadow_exec_page, void** original_call_ptr) {
+    SharedShadowHookData* shared_sh_data, void* patch_address, void* handler,
+    UCHAR* shadow_exec_page, void** original_call_ptr) {
   PAGED_CODE();
 
-  const auto patch_size = ShpGetInstructionSize(patch_address);
+  // Use a jump when it overwrites only the first instruction and that can run
+  // on a trampoline. Otherwise fall back to 0xcc, which is handled on #BP
+  // VM-exit. Spanning more instructions is unsafe: code may branch to the
+  // second one (e.g. a loop back to the function head), and a thread may be
+  // interrupted between them and resume in the middle of the jump.
+  //
+  // A hazard remains on unload: a thread preempted on a trampoline or in a
+  // handler still runs there after hooks are disabled, and resumes in freed
+  // memory if the trampoline arena is released before it leaves.
+  const auto jmp_to_handler = ShpMakeJumpCode(patch_address, handler);
+  auto patch_size =
+      (kShpUseJumpHook) ? ShpGetRelocatableSize(shared_sh_data, patch_address,
+                                                jmp_to_handler.size)
+                        : 0;
+  const auto use_jump = (patch_size != 0);
+  if (!use_jump) {
+    patch_size = ShpGetInstructionSize(shared_sh_data, patch_address);
+  }
   if (!patch_size) {
     return false;
   }
@@ -371,12 +599,8 @@ _Use_decl_annotations_ EXTERN_C static bool ShpSetupInlineHook(
   // Build trampoline code (copied stub -> in the middle of original)
   const auto jmp_to_original = ShpMakeTrampolineCode(
       reinterpret_cast<UCHAR*>(patch_address) + patch_size);
-#pragma warning(push)
-#pragma warning(disable : 30030)  // Allocating executable POOL_TYPE memory
-  const auto original_call = ExAllocatePoolWithTag(
-      NonPagedPoolExecute, patch_size + sizeof(jmp_to_original),
-      kHyperPlatformCommonPoolTag);
-#pragma warning(pop)
+  const auto original_call =
+      TrampolineArenaAllocate(patch_size + sizeof(jmp_to_original));
   if (!original_call) {
     return false;
   }
@@ -397,8 +621,13 @@ _Use_decl_annotations_ EXTERN_C static bool ShpSetupInlineHook(
   static const UCHAR kBreakpoint[] = {
       0xcc,
   };
-  RtlCopyMemory(shadow_exec_page + BYTE_OFFSET(patch_address), kBreakpoint,
-                sizeof(kBreakpoint));
+  if (use_jump) {
+    RtlCopyMemory(shadow_exec_page + BYTE_OFFSET(patch_address),
+                  jmp_to_handler.code, jmp_to_handler.size);
+  } else {
+    RtlCopyMemory(shadow_exec_page + BYTE_OFFSET(patch_address), kBreakpoint,
+                  sizeof(kBreakpoint));
+  }
 
   KeInvalidateAllCaches();
 
@@ -408,9 +637,19 @@ _Use_decl_annotations_ EXTERN_C static bool ShpSetupInlineHook(
 
 // Returns a size of an instruction at the address
 _Use_decl_annotations_ EXTERN_C static SIZE_T ShpGetInstructionSize(
-    void* address) {
+    const SharedShadowHookData* shared_sh_data, void* address) {
   PAGED_CODE();
 
+  // The instruction is usually cached already when a jump could not be used
+  static const auto kLongestInstSize = 15;
+  const auto cached = DecodeCacheLookup(
+      shared_sh_data->decode_cache, shared_sh_data->capstone_mode,
+      reinterpret_cast<uint8_t*>(address), kLongestInstSize,
+      reinterpret_cast<uint64_t>(address));
+  if (cached) {
+    return cached->size;
+  }
+
   // Save floating point state
   KFLOATING_SAVE float_save = {};
   auto status = KeSaveFloatingPointState(&float_save);
@@ -418,33 +657,103 @@ _Use_decl_annotations_ EXTERN_C static SIZE_T ShpGetInstructionSize(
     return 0;
   }
 
-  // Disassemble at most 15 bytes to get an instruction size
-  csh handle = {};
-  const auto mode = IsX64() ? CS_MODE_64 : CS_MODE_32;
-  if (cs_open(CS_ARCH_X86, mode, &handle) != CS_ERR_OK) {
-    KeRestoreFloatingPointState(&float_save);
+  // Decode at most 15 bytes to get an instruction size. Nothing but the size
+  // is needed, so skip formatting it.
+  const auto size = cs_insn_length(
+      shared_sh_data->capstone_handle, reinterpret_cast<uint8_t*>(address),
+      kLongestInstSize, reinterpret_cast<uint64_t>(address));
+
+  // Restore floating point state
+  KeRestoreFloatingPointState(&float_save);
+  return size;
+}
+
+// Returns a size of an instruction at the address when it covers at least
+// required_size bytes and can be executed on a trampoline, or 0 when it does
+// not or goes beyond the page
+_Use_decl_annotations_ EXTERN_C static SIZE_T ShpGetRelocatableSize(
+    const SharedShadowHookData* shared_sh_data, void* address,
+    SIZE_T required_size) {
+  PAGED_CODE();
+
+  // Do not read the next page, which may not be present
+  static const auto kLongestInstSize = 15;
+  const auto bytes_in_page = PAGE_SIZE - BYTE_OFFSET(address);
+  if (required_size > bytes_in_page) {
     return 0;
   }
 
-  static const auto kLongestInstSize = 15;
-  cs_insn* instructions = nullptr;
-  const auto count =
-      cs_disasm(handle, reinterpret_cast<uint8_t*>(address), kLongestInstSize,
-                reinterpret_cast<uint64_t>(address), 1, &instructions);
-  if (count == 0) {
-    cs_close(&handle);
-    KeRestoreFloatingPointState(&float_save);
+  // Save floating point state
+  KFLOATING_SAVE float_save = {};
+  auto status = KeSaveFloatingPointState(&float_save);
+  if (!NT_SUCCESS(status)) {
     return 0;
   }
 
-  // Get a size of the first instruction
-  const auto size = instructions[0].size;
-  cs_free(instructions, count);
-  cs_close(&handle);
+  // Decode only the first instruction
+  auto code = reinterpret_cast<const uint8_t*>(address);
+  size_t code_size = min(static_cast<SIZE_T>(kLongestInstSize), bytes_in_page);
+  auto code_address = reinterpret_cast<uint64_t>(address);
+  const auto insn = shared_sh_data->capstone_insn;
+  SIZE_T size = 0;
+  if (DecodeCacheDisasm(shared_sh_data->decode_cache,
+                        shared_sh_data->capstone_handle,
+                        shared_sh_data->capstone_mode, &code, &code_size,
+                        &code_address, insn) &&
+      ShpIsRelocatableInstruction(insn)) {
+    size = insn->size;
+  }
 
   // Restore floating point state
   KeRestoreFloatingPointState(&float_save);
-  return size;
+  return (size >= required_size) ? size : 0;
+}
+
+// Checks if an instruction works the same on a trampoline. Relative branches
+// and RIP-relative operands do not, and a function that returns or jumps away
+// this early is too small to be overwritten with a jump.
+_Use_decl_annotations_ EXTERN_C static bool ShpIsRelocatableInstruction(
+    const cs_insn* instruction) {
+  PAGED_CODE();
+
+  static const char* kNonRelocatableMnemonics[] = {
+      "j", "call", "loop", "ret", "int3",
+  };
+  for (auto mnemonic : kNonRelocatableMnemonics) {
+    if (strncmp(instruction->mnemonic, mnemonic, strlen(mnemonic)) == 0) {
+      return false;
+    }
+  }
+  return strstr(instruction->op_str, "rip") == nullptr;
+}
+
+// Returns code bytes jumping from the patch address to the handler
+_Use_decl_annotations_ EXTERN_C static JumpCode ShpMakeJumpCode(
+    void* patch_address, void* hook_handler) {
+  PAGED_CODE();
+
+  JumpCode jmp = {};
+  static const auto kRel32JmpSize = 5;
+  const auto distance = reinterpret_cast<LONG_PTR>(hook_handler) -
+                        (reinterpret_cast<LONG_PTR>(patch_address) +
+                         kRel32JmpSize);
+  if (distance == static_cast<LONG>(distance)) {
+    // e900000000       jmp     hook_handler
+    jmp.code[0] = 0xe9;
+    *reinterpret_cast<LONG*>(&jmp.code[1]) = static_cast<LONG>(distance);
+    jmp.size = kRel32JmpSize;
+  } else {
+    // ff2500000000     jmp     qword ptr cs:jmp_addr
+    // jmp_addr:
+    // 0000000000000000 dq hook_handler
+    static const UCHAR kJmp[] = {
+        0xff, 0x25, 0x00, 0x00, 0x00, 0x00,
+    };
+    RtlCopyMemory(jmp.code, kJmp, sizeof(kJmp));
+    *reinterpret_cast<void**>(&jmp.code[sizeof(kJmp)]) = hook_handler;
+    jmp.size = sizeof(kJmp) + sizeof(void*);
+  }
+  return jmp;
 }
 
 // Returns code bytes for inline hooking
@@ -474,30 +783,90 @@ _Use_decl_annotations_ EXTERN_C static TrampolineCode ShpMakeTrampolineCode(
 #endif
 }
 
-// Find a HookInformation instance by address
-_Use_decl_annotations_ static HookInformation* ShpFindPatchInfoByPage(
-    const SharedShadowHookData* shared_sh_data, void* address) {
-  const auto found = std::find_if(
-      shared_sh_data->hooks.cbegin(), shared_sh_data->hooks.cend(),
-      [address](const auto& info) {
-        return PAGE_ALIGN(info->patch_address) == PAGE_ALIGN(address);
-      });
-  if (found == shared_sh_data->hooks.cend()) {
-    return nullptr;
+// Rebuilds indexes of all hooks. When more than one hook is on the same page,
+// the page is indexed by the first one like a linear search would find.
+_Use_decl_annotations_ static void ShpBuildHookIndexes(
+    SharedShadowHookData* shared_sh_data) {
+  PAGED_CODE();
+
+  // Keep the load factor at most 1/2 so that probing stays short and always
+  // reaches an empty entry
+  SIZE_T size = 16;
+  while (size < shared_sh_data->hooks.size() * 2) {
+    size *= 2;
+  }
+  shared_sh_data->index_by_pfn.assign(size, HookIndexEntry{});
+  shared_sh_data->index_by_address.assign(size, HookIndexEntry{});
+
+  for (const auto& info : shared_sh_data->hooks) {
+    ShpInsertHookIndex(&shared_sh_data->index_by_pfn,
+                       UtilPfnFromPa(UtilPaFromVa(info->patch_address)),
+                       info.get());
+    ShpInsertHookIndex(&shared_sh_data->index_by_address,
+                       reinterpret_cast<ULONG_PTR>(info->patch_address),
+                       info.get());
   }
-  return found->get();
 }
 
-// Find a HookInformation instance that are on the same page as the address
-_Use_decl_annotations_ static HookInformation* ShpFindPatchInfoByAddress(
-    const SharedShadowHookData* shared_sh_data, void* address) {
-  auto found = std::find_if(
-      shared_sh_data->hooks.cbegin(), shared_sh_data->hooks.cend(),
-      [address](const auto& info) { return info->patch_address == address; });
-  if (found == shared_sh_data->hooks.cend()) {
+// Inserts a hook to the index unless the key is already indexed
+_Use_decl_annotations_ static void ShpInsertHookIndex(
+    std::vector<HookIndexEntry>* index, ULONG_PTR key,
+    const HookInformation* info) {
+  PAGED_CODE();
+
+  const auto mask = index->size() - 1;
+  for (auto i = ShpHashHookIndexKey(key) & mask;; i = (i + 1) & mask) {
+    auto& entry = (*index)[i];
+    if (!entry.info) {
+      entry.key = key;
+      entry.info = info;
+      return;
+    }
+    if (entry.key == key) {
+      return;
+    }
+  }
+}
+
+// Returns a hook indexed with the key, or nullptr. Probing always ends since
+// the index is never more than half full.
+_Use_decl_annotations_ static const HookInformation* ShpLookupHookIndex(
+    const std::vector<HookIndexEntry>& index, ULONG_PTR key) {
+  if (index.empty()) {
     return nullptr;
   }
-  return found->get();
+
+  const auto mask = index.size() - 1;
+  for (auto i = ShpHashHookIndexKey(key) & mask;; i = (i + 1) & mask) {
+    const auto& entry = index[i];
+    if (!entry.info) {
+      return nullptr;
+    }
+    if (entry.key == key) {
+      return entry.info;
+    }
+  }
+}
+
+// Scatters keys with Fibonacci hashing since both PFNs and patch addresses are
+// often close to each other
+_Use_decl_annotations_ static ULONG_PTR ShpHashHookIndexKey(ULONG_PTR key) {
+  return static_cast<ULONG_PTR>(
+      (static_cast<ULONG64>(key) * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+// Find a HookInformation instance that are on the same page as the physical
+// address
+_Use_decl_annotations_ static const HookInformation* ShpFindPatchInfoByPage(
+    const SharedShadowHookData* shared_sh_data, ULONG64 pa) {
+  return ShpLookupHookIndex(shared_sh_data->index_by_pfn, UtilPfnFromPa(pa));
+}
+
+// Find a HookInformation instance by address
+_Use_decl_annotations_ static const HookInformation* ShpFindPatchInfoByAddress(
+    const SharedShadowHookData* shared_sh_data, void* address) {
+  return ShpLookupHookIndex(shared_sh_data->index_by_address,
+                            reinterpret_cast<ULONG_PTR>(address));
 }
 
 // Show a shadowed page for execution
@@ -513,7 +882,8 @@ _Use_decl_annotations_ static void ShpEnablePageShadowingForExec(
 
   // Only execution is allowed on the adresss. Show the copied page for exec
   // that has an actual breakpoint to the guest.
-  ept_pt_entry->fields.physial_address = UtilPfnFromPa(info.pa_base_for_exec);
+  ept_pt_entry->fields.physial_address =
+      UtilPfnFromPa(info.shadow_page->pa_base_for_exec);
 
   UtilInveptAll();
 }
@@ -529,11 +899,37 @@ _Use_decl_annotations_ static void ShpEnablePageShadowingForRW(
   // all modification by a guest if that happened.
   ept_pt_entry->fields.write_access = true;
   ept_pt_entry->fields.read_access = true;
-  ept_pt_entry->fields.physial_address = UtilPfnFromPa(info.pa_base_for_rw);
+  ept_pt_entry->fields.physial_address =
+      UtilPfnFromPa(info.shadow_page->pa_base_for_rw);
 
   UtilInveptAll();
 }
 
+// Show a shadowed page for read and write on the view for read and write.
+// Unlike ShpEnablePageShadowingForRW(), it is set only once when hooks are
+// enabled and execution is denied to switch back to the default view.
+_Use_decl_annotations_ static void ShpEnablePageShadowingForRWView(
+    const HookInformation& info, EptData* ept_data_for_rw) {
+  const auto ept_pt_entry =
+      EptGetEptPtEntry(ept_data_for_rw, UtilPaFromVa(info.patch_address));
+  ept_pt_entry->fields.write_access = true;
+  ept_pt_entry->fields.read_access = true;
+  ept_pt_entry->fields.execute_access = false;
+  ept_pt_entry->fields.physial_address =
+      UtilPfnFromPa(info.shadow_page->pa_base_for_rw);
+}
+
+// Switches an EPT hierarchy used by the current processor. Neither MTF nor
+// INVEPT is needed since cached translations are tagged with an EPT pointer
+// and neither hierarchy changes while hooks are enabled.
+_Use_decl_annotations_ static void ShpSwitchEptView(ShadowHookData* sh_data,
+                                                    bool for_rw) {
+  UtilVmWrite64(VmcsField::kEptPointer, (for_rw)
+                                            ? sh_data->ept_pointer_for_rw
+                                            : sh_data->ept_pointer_for_exec);
+  sh_data->rw_view_active = for_rw;
+}
+
 // Stop showing a shadow page
 _Use_decl_annotations_ static void ShpDisablePageShadowing(
     const HookInformation& info, EptData* ept_data) {
@@ -541,6 +937,7 @@ _Use_decl_annotations_ static void ShpDisablePageShadowing(
   const auto ept_pt_entry = EptGetEptPtEntry(ept_data, pa_base);
   ept_pt_entry->fields.write_access = true;
   ept_pt_entry->fields.read_access = true;
+  ept_pt_entry->fields.execute_access = true;
   ept_pt_entry->fields.physial_address = UtilPfnFromPa(pa_base);
 
   UtilInveptAll();
@@ -576,16 +973,3 @@ _Use_decl_annotations_ static bool ShpIsShadowHookActive(
     const SharedShadowHookData* shared_sh_data) {
   return !!(shared_sh_data);
 }
-
-// Allocates a non-paged, page-alined page. Issues bug check on failure
-Page::Page()
-    : page(reinterpret_cast<UCHAR*>(ExAllocatePoolWithTag(
-          NonPagedPool, PAGE_SIZE, kHyperPlatformCommonPoolTag))) {
-  if (!page) {
-    HYPERPLATFORM_COMMON_BUG_CHECK(
-        HyperPlatformBugCheck::kCritialPoolAllocationFailure, 0, 0, 0);
-  }
-}
-
-// De-allocates the allocated page
-Page::~Page() { ExFreePoolWithTag(page, kHyperPlatformCommonPoolTag); }
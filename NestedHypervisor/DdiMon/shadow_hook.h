@@ -28,15 +28,17 @@
 struct EptData;
 struct ShadowHookData;
 struct SharedShadowHookData;
+struct ShadowPageStore;
 
 // Expresses where to install hooks by a function name, and its handlers
 struct ShadowHookTarget {
   UNICODE_STRING target_name;  // An export name to hook
   void* handler;               // An address of a hook handler
 
-  // An address of a trampoline code to call original function. Initialized by
-  // a successful call of ShInstallHook().
-  void* original_call;
+  // An address of a variable to store an address of a trampoline code to call
+  // original function. The variable is initialized by a successful call of
+  // ShInstallHook().
+  void** original_call;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -56,16 +58,23 @@ _IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C
 _IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C
     void ShFreeSharedShadowHookData(_In_ SharedShadowHookData* shared_sh_data);
 
+EXTERN_C ShadowPageStore* ShGetShadowPageStore(
+    _In_ SharedShadowHookData* shared_sh_data);
+
 _IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C NTSTATUS ShEnableHooks();
 
 _IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C NTSTATUS ShDisableHooks();
 
 _IRQL_requires_min_(DISPATCH_LEVEL) NTSTATUS
-    ShEnablePageShadowing(_In_ EptData* ept_data,
+    ShEnablePageShadowing(_In_ EptData* ept_data, _In_ ShadowHookData* sh_data,
                           _In_ const SharedShadowHookData* shared_sh_data);
 
 _IRQL_requires_min_(DISPATCH_LEVEL) void ShVmCallDisablePageShadowing(
-    _In_ EptData* ept_data, _In_ const SharedShadowHookData* shared_sh_data);
+    _In_ EptData* ept_data, _In_ ShadowHookData* sh_data,
+    _In_ const SharedShadowHookData* shared_sh_data);
+
+_IRQL_requires_min_(DISPATCH_LEVEL) EptData* ShGetCurrentEptData(
+    _In_opt_ ShadowHookData* sh_data, _In_ EptData* ept_data);
 
 _IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C
     bool ShInstallHook(_In_ SharedShadowHookData* shared_sh_data,
@@ -82,7 +91,7 @@ _IRQL_requires_min_(DISPATCH_LEVEL) void ShHandleMonitorTrapFlag(
 _IRQL_requires_min_(DISPATCH_LEVEL) void ShHandleEptViolation(
     _In_ ShadowHookData* sh_data,
     _In_ const SharedShadowHookData* shared_sh_data, _In_ EptData* ept_data,
-    _In_ void* fault_va);
+    _In_ ULONG64 fault_pa);
 
 ////////////////////////////////////////////////////////////////////////////////
 //
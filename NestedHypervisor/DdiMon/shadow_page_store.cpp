@@ -0,0 +1,201 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the shadow page store.
+
+#include "shadow_page_store.h"
+#include "../HyperPlatform/HyperPlatform/common.h"
+#include "../HyperPlatform/HyperPlatform/log.h"
+#include "../HyperPlatform/HyperPlatform/util.h"
+#include "../HyperPlatform/HyperPlatform/kernel_stl.h"
+#include <algorithm>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+// The number of pages allocated at once. A shadowed page consumes two.
+static const SIZE_T kShadowPageStorepPagesPerSlab = 16;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+struct ShadowPageStore {
+  FAST_MUTEX mutex;                       // Serializes all operations
+  std::vector<ShadowPage*> pages_by_pfn;  // Shadowed pages sorted by PFNs
+  std::vector<UCHAR*> slabs;              // Allocated slabs of pages
+  std::vector<UCHAR*> free_pages;         // Pages in slabs not in use
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+_IRQL_requires_max_(APC_LEVEL) static bool ShadowPageStorepAddSlab(
+    _In_ ShadowPageStore* store);
+
+_IRQL_requires_max_(APC_LEVEL) static UCHAR* ShadowPageStorepAllocatePage(
+    _In_ ShadowPageStore* store);
+
+#if defined(ALLOC_PRAGMA)
+#pragma alloc_text(INIT, ShadowPageStoreAllocate)
+#pragma alloc_text(PAGE, ShadowPageStoreFree)
+#pragma alloc_text(PAGE, ShadowPageStoreAcquire)
+#pragma alloc_text(PAGE, ShadowPageStoreRelease)
+#pragma alloc_text(PAGE, ShadowPageStorepAddSlab)
+#pragma alloc_text(PAGE, ShadowPageStorepAllocatePage)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Allocates a store with a slab of pages
+_Use_decl_annotations_ EXTERN_C ShadowPageStore* ShadowPageStoreAllocate() {
+  PAGED_CODE();
+
+  auto store = new ShadowPageStore();
+  ExInitializeFastMutex(&store->mutex);
+  if (!ShadowPageStorepAddSlab(store)) {
+    delete store;
+    return nullptr;
+  }
+  return store;
+}
+
+// Frees the store. All shadow pages must have been released.
+_Use_decl_annotations_ EXTERN_C void ShadowPageStoreFree(
+    ShadowPageStore* store) {
+  PAGED_CODE();
+
+  NT_ASSERT(store->pages_by_pfn.empty());
+  for (auto slab : store->slabs) {
+    ExFreePoolWithTag(slab, kHyperPlatformCommonPoolTag);
+  }
+  delete store;
+}
+
+// Returns a pair of copies of the page containing the address. The pair is
+// created by copying the page on the first acquisition and shared afterwards.
+_Use_decl_annotations_ EXTERN_C const ShadowPage* ShadowPageStoreAcquire(
+    ShadowPageStore* store, void* address) {
+  PAGED_CODE();
+
+  const auto pfn = UtilPfnFromVa(address);
+  const auto less_pfn = [](const ShadowPage* page, PFN_NUMBER value) {
+    return page->pfn < value;
+  };
+
+  ExAcquireFastMutex(&store->mutex);
+  auto it = std::lower_bound(store->pages_by_pfn.begin(),
+                             store->pages_by_pfn.end(), pfn, less_pfn);
+  if (it != store->pages_by_pfn.end() && (*it)->pfn == pfn) {
+    // The page is already shadowed by someone. Share it.
+    const auto shadow_page = *it;
+    shadow_page->reference_count++;
+    ExReleaseFastMutex(&store->mutex);
+    return shadow_page;
+  }
+
+  const auto page_for_rw = ShadowPageStorepAllocatePage(store);
+  const auto page_for_exec = ShadowPageStorepAllocatePage(store);
+  if (!page_for_rw || !page_for_exec) {
+    if (page_for_rw) {
+      store->free_pages.push_back(page_for_rw);
+    }
+    if (page_for_exec) {
+      store->free_pages.push_back(page_for_exec);
+    }
+    ExReleaseFastMutex(&store->mutex);
+    return nullptr;
+  }
+
+  const auto page_base = PAGE_ALIGN(address);
+  RtlCopyMemory(page_for_rw, page_base, PAGE_SIZE);
+  RtlCopyMemory(page_for_exec, page_base, PAGE_SIZE);
+
+  auto shadow_page = new ShadowPage();
+  shadow_page->pfn = pfn;
+  shadow_page->page_for_rw = page_for_rw;
+  shadow_page->page_for_exec = page_for_exec;
+  shadow_page->pa_base_for_rw = UtilPaFromVa(page_for_rw);
+  shadow_page->pa_base_for_exec = UtilPaFromVa(page_for_exec);
+  shadow_page->reference_count = 1;
+  store->pages_by_pfn.insert(it, shadow_page);
+  ExReleaseFastMutex(&store->mutex);
+  return shadow_page;
+}
+
+// Drops a reference to the pair and returns its pages to the slab when it was
+// the last one
+_Use_decl_annotations_ EXTERN_C void ShadowPageStoreRelease(
+    ShadowPageStore* store, const ShadowPage* shadow_page) {
+  PAGED_CODE();
+
+  ExAcquireFastMutex(&store->mutex);
+  auto it = std::find(store->pages_by_pfn.begin(), store->pages_by_pfn.end(),
+                      shadow_page);
+  NT_ASSERT(it != store->pages_by_pfn.end());
+  const auto page = *it;
+  if (--page->reference_count == 0) {
+    store->pages_by_pfn.erase(it);
+    store->free_pages.push_back(page->page_for_rw);
+    store->free_pages.push_back(page->page_for_exec);
+    delete page;
+  }
+  ExReleaseFastMutex(&store->mutex);
+}
+
+// Allocates a slab and adds its pages to the free list
+_Use_decl_annotations_ static bool ShadowPageStorepAddSlab(
+    ShadowPageStore* store) {
+  PAGED_CODE();
+
+  // Exec copies run as code in the guest
+#pragma warning(push)
+#pragma warning(disable : 30030)  // Allocating executable POOL_TYPE memory
+  const auto slab = reinterpret_cast<UCHAR*>(ExAllocatePoolWithTag(
+      NonPagedPool, kShadowPageStorepPagesPerSlab * PAGE_SIZE,
+      kHyperPlatformCommonPoolTag));
+#pragma warning(pop)
+  if (!slab) {
+    return false;
+  }
+
+  store->slabs.push_back(slab);
+  for (auto i = 0ull; i < kShadowPageStorepPagesPerSlab; ++i) {
+    store->free_pages.push_back(slab + i * PAGE_SIZE);
+  }
+  return true;
+}
+
+// Takes a page from the free list, adding a slab if necessary
+_Use_decl_annotations_ static UCHAR* ShadowPageStorepAllocatePage(
+    ShadowPageStore* store) {
+  PAGED_CODE();
+
+  if (store->free_pages.empty() && !ShadowPageStorepAddSlab(store)) {
+    return nullptr;
+  }
+  const auto page = store->free_pages.back();
+  store->free_pages.pop_back();
+  return page;
+}
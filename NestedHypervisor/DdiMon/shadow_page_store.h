@@ -0,0 +1,74 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// @brief Declares interfaces to the shadow page store.
+///
+/// The store hands out a pair of copies of a guest page, one exposed for read
+/// and write and the other for execution, keyed by a PFN of the original page.
+/// Features shadowing the same page, such as shadow hooks and variable hiding,
+/// share a single pair that is reference counted. Copies are carved out of
+/// preallocated slabs of pages.
+
+#ifndef DDIMON_SHADOW_PAGE_STORE_H_
+#define DDIMON_SHADOW_PAGE_STORE_H_
+
+#include <fltKernel.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// A pair of copies of a guest page
+struct ShadowPage {
+  PFN_NUMBER pfn;            // A PFN of the original page
+  UCHAR* page_for_rw;        // A copy exposed for read and write
+  UCHAR* page_for_exec;      // A copy exposed for execution
+  ULONG64 pa_base_for_rw;    // A physical address of page_for_rw
+  ULONG64 pa_base_for_exec;  // A physical address of page_for_exec
+  ULONG reference_count;     // The number of users of this pair
+};
+
+struct ShadowPageStore;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C
+    ShadowPageStore* ShadowPageStoreAllocate();
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C
+    void ShadowPageStoreFree(_In_ ShadowPageStore* store);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C const ShadowPage*
+    ShadowPageStoreAcquire(_In_ ShadowPageStore* store, _In_ void* address);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C
+    void ShadowPageStoreRelease(_In_ ShadowPageStore* store,
+                                _In_ const ShadowPage* shadow_page);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+#endif  // DDIMON_SHADOW_PAGE_STORE_H_
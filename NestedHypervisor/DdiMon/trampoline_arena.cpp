@@ -0,0 +1,137 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the trampoline arena.
+///
+/// Trampolines are carved out of executable chunks of a page from the lowest
+/// address, each aligned to 16 bytes. A chunk is never reused until all of
+/// them are freed by TrampolineArenaFreeAll(). Allocation is not serialized
+/// since hooks are installed by a single thread.
+
+#include "trampoline_arena.h"
+#include "../HyperPlatform/HyperPlatform/common.h"
+#include "../HyperPlatform/HyperPlatform/log.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+// A size of a chunk
+static const SIZE_T kTrampolineArenapChunkSize = PAGE_SIZE;
+
+// Alignment of each trampoline
+static const SIZE_T kTrampolineArenapAlignment = 16;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// A header at the beginning of a chunk
+struct TrampolineArenaChunk {
+  TrampolineArenaChunk* next;  // A previously allocated chunk
+  SIZE_T used;                 // Bytes used including this header
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static TrampolineArenaChunk*
+    TrampolineArenapAddChunk();
+
+static SIZE_T TrampolineArenapAlignUp(_In_ SIZE_T size);
+
+#if defined(ALLOC_PRAGMA)
+#pragma alloc_text(INIT, TrampolineArenaAllocate)
+#pragma alloc_text(INIT, TrampolineArenapAddChunk)
+#pragma alloc_text(PAGE, TrampolineArenaFreeAll)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+// The chunk trampolines are currently carved from, linked to older ones
+static TrampolineArenaChunk* g_trampoline_arenap_chunks;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Returns executable memory of the size aligned to 16 bytes, or nullptr
+_Use_decl_annotations_ EXTERN_C void* TrampolineArenaAllocate(SIZE_T size) {
+  PAGED_CODE();
+
+  const auto header_size =
+      TrampolineArenapAlignUp(sizeof(TrampolineArenaChunk));
+  const auto aligned_size = TrampolineArenapAlignUp(size);
+  if (aligned_size > kTrampolineArenapChunkSize - header_size) {
+    return nullptr;
+  }
+
+  auto chunk = g_trampoline_arenap_chunks;
+  if (!chunk || chunk->used + aligned_size > kTrampolineArenapChunkSize) {
+    chunk = TrampolineArenapAddChunk();
+    if (!chunk) {
+      return nullptr;
+    }
+  }
+
+  const auto trampoline = reinterpret_cast<UCHAR*>(chunk) + chunk->used;
+  chunk->used += aligned_size;
+  return trampoline;
+}
+
+// Frees all trampolines. None of them may be executed anymore.
+_Use_decl_annotations_ EXTERN_C void TrampolineArenaFreeAll() {
+  PAGED_CODE();
+
+  auto chunk = g_trampoline_arenap_chunks;
+  g_trampoline_arenap_chunks = nullptr;
+  while (chunk) {
+    const auto next = chunk->next;
+    ExFreePoolWithTag(chunk, kHyperPlatformCommonPoolTag);
+    chunk = next;
+  }
+}
+
+// Allocates a new chunk and makes it current
+_Use_decl_annotations_ static TrampolineArenaChunk*
+TrampolineArenapAddChunk() {
+  PAGED_CODE();
+
+#pragma warning(push)
+#pragma warning(disable : 30030)  // Allocating executable POOL_TYPE memory
+  const auto chunk = reinterpret_cast<TrampolineArenaChunk*>(
+      ExAllocatePoolWithTag(NonPagedPoolExecute, kTrampolineArenapChunkSize,
+                            kHyperPlatformCommonPoolTag));
+#pragma warning(pop)
+  if (!chunk) {
+    return nullptr;
+  }
+
+  // Fill unused space with int 3
+  RtlFillMemory(chunk, kTrampolineArenapChunkSize, 0xcc);
+  chunk->next = g_trampoline_arenap_chunks;
+  chunk->used = TrampolineArenapAlignUp(sizeof(TrampolineArenaChunk));
+  g_trampoline_arenap_chunks = chunk;
+  return chunk;
+}
+
+// Rounds up the size to kTrampolineArenapAlignment
+_Use_decl_annotations_ static SIZE_T TrampolineArenapAlignUp(SIZE_T size) {
+  return (size + kTrampolineArenapAlignment - 1) &
+         ~(kTrampolineArenapAlignment - 1);
+}
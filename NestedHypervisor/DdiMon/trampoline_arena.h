@@ -0,0 +1,51 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// @brief Declares interfaces to the trampoline arena.
+///
+/// The arena packs trampoline code of hooks contiguously into a few executable
+/// pages instead of allocating each from pool, and frees them all at once.
+
+#ifndef DDIMON_TRAMPOLINE_ARENA_H_
+#define DDIMON_TRAMPOLINE_ARENA_H_
+
+#include <fltKernel.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C
+    void* TrampolineArenaAllocate(_In_ SIZE_T size);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) EXTERN_C void TrampolineArenaFreeAll();
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+#endif  // DDIMON_TRAMPOLINE_ARENA_H_
@@ -0,0 +1,348 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Measures the loaded image range cache of DdiMon on the host.
+///
+/// ImageRangesFindImageBase() of image_ranges.cpp is built as it is and looks
+/// up a snapshot taken from synthetic modules returned by a stand-in of
+/// ZwQuerySystemInformation(). It is compared with what UtilPcToFileHeader()
+/// did before: walking a linked list of the same modules in load order under a
+/// shared lock, as RtlPcToFileHeader() walks PsLoadedModuleList. Both are
+/// asked about the same addresses, three quarters of which are inside images
+/// like return addresses checked by hook handlers, and must agree.
+///
+/// Usage: image_ranges_bench [-n iterations] [-m modules]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "../DdiMon/image_ranges.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+// The default number of lookups of each benchmark
+static const ULONG64 kImageRangesBenchpDefaultIterations = 10000000;
+
+// The default number of synthetic modules
+static const ULONG kImageRangesBenchpDefaultModules = 300;
+
+// The number of distinct addresses looked up in turn
+static const SIZE_T kImageRangesBenchpAddresses = 4096;
+
+// Where synthetic modules are placed
+static const ULONG_PTR kImageRangesBenchpImageBase = 0xfffff80000000000;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// Same layout as RtlProcessModuleInformation in image_ranges.cpp
+struct ImageRangesBenchModule {
+  HANDLE section;
+  void* mapped_base;
+  void* image_base;
+  ULONG image_size;
+  ULONG flags;
+  USHORT load_order_index;
+  USHORT init_order_index;
+  USHORT load_count;
+  USHORT offset_to_file_name;
+  UCHAR full_path_name[256];
+};
+
+// Same layout as RtlProcessModules in image_ranges.cpp
+struct ImageRangesBenchModules {
+  ULONG number_of_modules;
+  ImageRangesBenchModule modules[1];
+};
+
+// An entry of the loaded module list, sized like KLDR_DATA_TABLE_ENTRY
+struct ImageRangesBenchListEntry {
+  ImageRangesBenchListEntry* flink;
+  ImageRangesBenchListEntry* blink;
+  UCHAR reserved[0x20];
+  void* dll_base;
+  void* entry_point;
+  ULONG size_of_image;
+  UCHAR reserved2[0x74];
+};
+
+// A lookup of an image base of an address
+typedef void* (*ImageRangesBenchRoutine)(void* address);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+EXTERN_C NTSTATUS ZwQuerySystemInformation(
+    _In_ int system_information_class, _Out_opt_ PVOID system_information,
+    _In_ ULONG system_information_length, _Out_opt_ PULONG return_length);
+
+EXTERN_C NTSTATUS UtilForEachProcessor(
+    _In_ NTSTATUS (*callback_routine)(void*), _In_opt_ void* context);
+
+EXTERN_C NTSTATUS LogpPrint(_In_ ULONG level, _In_ const char* function_name,
+                            _In_ const char* format, ...);
+
+static void ImageRangesBenchpCreateModules(_In_ ULONG count);
+
+static void* ImageRangesBenchpWalkList(_In_ void* address);
+
+static double ImageRangesBenchpRun(_In_ const char* name,
+                                   _In_ ULONG64 iterations,
+                                   _In_ ImageRangesBenchRoutine routine);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+// Synthetic modules in load order
+static std::vector<ImageRangesBenchModule> g_irbp_modules;
+
+// The same modules as a circular list headed by g_irbp_list_head
+static ImageRangesBenchListEntry g_irbp_list_head;
+
+// Stands in for PsLoadedModuleResource acquired shared
+static volatile LONG g_irbp_list_lock;
+
+// Addresses looked up in turn
+static std::vector<void*> g_irbp_addresses;
+
+// Stands in for the current IRQL of the processor
+static KIRQL g_irbp_irql = PASSIVE_LEVEL;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Kernel APIs used by image_ranges.cpp
+
+EXTERN_C PVOID ExAllocatePoolWithTag(POOL_TYPE pool_type,
+                                     SIZE_T number_of_bytes, ULONG tag) {
+  UNREFERENCED_PARAMETER(pool_type);
+  UNREFERENCED_PARAMETER(tag);
+  return malloc(number_of_bytes);
+}
+
+EXTERN_C void ExFreePoolWithTag(PVOID p, ULONG tag) {
+  UNREFERENCED_PARAMETER(tag);
+  free(p);
+}
+
+EXTERN_C void ExInitializeFastMutex(PFAST_MUTEX fast_mutex) {
+  fast_mutex->count = 0;
+}
+
+EXTERN_C void ExAcquireFastMutex(PFAST_MUTEX fast_mutex) {
+  fast_mutex->count++;
+}
+
+EXTERN_C void ExReleaseFastMutex(PFAST_MUTEX fast_mutex) {
+  fast_mutex->count--;
+}
+
+EXTERN_C KIRQL KeGetCurrentIrql() { return g_irbp_irql; }
+
+EXTERN_C KIRQL KeRaiseIrqlToDpcLevel() {
+  const auto old_irql = g_irbp_irql;
+  g_irbp_irql = DISPATCH_LEVEL;
+  return old_irql;
+}
+
+EXTERN_C void KeLowerIrql(KIRQL new_irql) { g_irbp_irql = new_irql; }
+
+EXTERN_C NTSTATUS
+PsSetLoadImageNotifyRoutine(PLOAD_IMAGE_NOTIFY_ROUTINE notify_routine) {
+  UNREFERENCED_PARAMETER(notify_routine);
+  return STATUS_SUCCESS;
+}
+
+EXTERN_C NTSTATUS
+PsRemoveLoadImageNotifyRoutine(PLOAD_IMAGE_NOTIFY_ROUTINE notify_routine) {
+  UNREFERENCED_PARAMETER(notify_routine);
+  return STATUS_SUCCESS;
+}
+
+// Returns synthetic modules for SystemModuleInformation
+_Use_decl_annotations_ EXTERN_C NTSTATUS ZwQuerySystemInformation(
+    int system_information_class, PVOID system_information,
+    ULONG system_information_length, PULONG return_length) {
+  UNREFERENCED_PARAMETER(system_information_class);
+
+  const auto required =
+      static_cast<ULONG>(offsetof(ImageRangesBenchModules, modules) +
+                         sizeof(ImageRangesBenchModule) * g_irbp_modules.size());
+  if (return_length) {
+    *return_length = required;
+  }
+  if (system_information_length < required) {
+    return STATUS_INFO_LENGTH_MISMATCH;
+  }
+  const auto modules =
+      static_cast<ImageRangesBenchModules*>(system_information);
+  modules->number_of_modules = static_cast<ULONG>(g_irbp_modules.size());
+  memcpy(modules->modules, g_irbp_modules.data(),
+         sizeof(ImageRangesBenchModule) * g_irbp_modules.size());
+  return STATUS_SUCCESS;
+}
+
+// There is only one processor
+_Use_decl_annotations_ EXTERN_C NTSTATUS UtilForEachProcessor(
+    NTSTATUS (*callback_routine)(void*), void* context) {
+  return callback_routine(context);
+}
+
+// Logs are discarded
+_Use_decl_annotations_ EXTERN_C NTSTATUS LogpPrint(ULONG level,
+                                                   const char* function_name,
+                                                   const char* format, ...) {
+  UNREFERENCED_PARAMETER(level);
+  UNREFERENCED_PARAMETER(function_name);
+  UNREFERENCED_PARAMETER(format);
+  return STATUS_SUCCESS;
+}
+
+// Creates modules of 4KB to 2MB with gaps of 64KB to 320KB in random load
+// order, the list of them, and addresses to look up
+_Use_decl_annotations_ static void ImageRangesBenchpCreateModules(ULONG count) {
+  std::mt19937_64 random(1);
+  auto base = kImageRangesBenchpImageBase;
+  for (auto i = 0ul; i < count; ++i) {
+    ImageRangesBenchModule module = {};
+    module.image_base = reinterpret_cast<void*>(base);
+    module.image_size = static_cast<ULONG>((1 + random() % 512) * PAGE_SIZE);
+    g_irbp_modules.push_back(module);
+    base += module.image_size + (16 + random() % 64) * PAGE_SIZE;
+  }
+  std::shuffle(g_irbp_modules.begin(), g_irbp_modules.end(), random);
+  for (auto i = 0ul; i < count; ++i) {
+    g_irbp_modules[i].load_order_index = static_cast<USHORT>(i);
+  }
+
+  g_irbp_list_head.flink = &g_irbp_list_head;
+  g_irbp_list_head.blink = &g_irbp_list_head;
+  for (const auto& module : g_irbp_modules) {
+    const auto entry = new ImageRangesBenchListEntry();
+    entry->dll_base = module.image_base;
+    entry->size_of_image = module.image_size;
+    entry->flink = &g_irbp_list_head;
+    entry->blink = g_irbp_list_head.blink;
+    g_irbp_list_head.blink->flink = entry;
+    g_irbp_list_head.blink = entry;
+  }
+
+  // Inside a random image, or else somewhere in pool
+  for (SIZE_T i = 0; i < kImageRangesBenchpAddresses; ++i) {
+    ULONG_PTR address = 0;
+    if (random() % 4) {
+      const auto& module = g_irbp_modules[random() % count];
+      address = reinterpret_cast<ULONG_PTR>(module.image_base) +
+                random() % module.image_size;
+    } else {
+      address = 0xffffe00000000000 + random() % 0x100000000;
+    }
+    g_irbp_addresses.push_back(reinterpret_cast<void*>(address));
+  }
+}
+
+// Walks the module list like RtlPcToFileHeader()
+_Use_decl_annotations_ static void* ImageRangesBenchpWalkList(void* address) {
+  __atomic_add_fetch(&g_irbp_list_lock, 1, __ATOMIC_ACQUIRE);
+  void* base = nullptr;
+  const auto pc = reinterpret_cast<ULONG_PTR>(address);
+  for (auto entry = g_irbp_list_head.flink; entry != &g_irbp_list_head;
+       entry = entry->flink) {
+    const auto dll_base = reinterpret_cast<ULONG_PTR>(entry->dll_base);
+    if (pc >= dll_base && pc < dll_base + entry->size_of_image) {
+      base = entry->dll_base;
+      break;
+    }
+  }
+  __atomic_sub_fetch(&g_irbp_list_lock, 1, __ATOMIC_RELEASE);
+  return base;
+}
+
+// Runs a benchmark, prints results, and returns the time per lookup
+_Use_decl_annotations_ static double ImageRangesBenchpRun(
+    const char* name, ULONG64 iterations, ImageRangesBenchRoutine routine) {
+  ULONG64 found = 0;
+  const auto begin = std::chrono::steady_clock::now();
+  for (ULONG64 i = 0; i < iterations; ++i) {
+    found += (routine(g_irbp_addresses[i % kImageRangesBenchpAddresses]) !=
+              nullptr);
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  const auto ns = std::chrono::duration<double, std::nano>(end - begin).count();
+  printf("%-24s %10llu %10.1f %9.1f%%\n", name,
+         static_cast<unsigned long long>(iterations), ns / iterations,
+         100.0 * found / iterations);
+  return ns / iterations;
+}
+
+int main(int argc, char* argv[]) {
+  auto iterations = kImageRangesBenchpDefaultIterations;
+  auto modules = kImageRangesBenchpDefaultModules;
+  for (auto i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      iterations = strtoull(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+      modules = strtoul(argv[++i], nullptr, 0);
+    } else {
+      fprintf(stderr, "Usage: %s [-n iterations] [-m modules]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (!iterations) {
+    iterations = 1;
+  }
+  if (!modules || modules > MAXUSHORT) {
+    modules = kImageRangesBenchpDefaultModules;
+  }
+
+  ImageRangesBenchpCreateModules(modules);
+  if (!NT_SUCCESS(ImageRangesInitialization())) {
+    printf("ImageRangesInitialization() failed\n");
+    return EXIT_FAILURE;
+  }
+
+  // Both must tell the same image for every address
+  for (const auto address : g_irbp_addresses) {
+    if (ImageRangesFindImageBase(address) !=
+        ImageRangesBenchpWalkList(address)) {
+      printf("Lookups disagree on %p\n", address);
+      ImageRangesTermination();
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("%lu modules\n", static_cast<unsigned long>(modules));
+  printf("%-24s %10s %10s %10s\n", "benchmark", "iterations", "ns/op",
+         "found");
+  const auto list = ImageRangesBenchpRun("linear list walk", iterations,
+                                         ImageRangesBenchpWalkList);
+  const auto snapshot = ImageRangesBenchpRun(
+      "ImageRangesFindImageBase", iterations, ImageRangesFindImageBase);
+  printf("speedup %.1fx\n", list / snapshot);
+
+  ImageRangesTermination();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Stands in for the WDK header on Linux.
+///
+/// Defines only what DdiMon code built on the host and the HyperPlatform
+/// headers it includes use: LLP64 integer types, a few constants and
+/// structures, and SAL annotations expanding to nothing. Kernel APIs are only
+/// declared here; the benchmark defines the ones it needs.
+
+#ifndef DDIMON_BENCH_FLTKERNEL_H_
+#define DDIMON_BENCH_FLTKERNEL_H_
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+#define EXTERN_C extern "C"
+#define RTL_NUMBER_OF(A) (sizeof(A) / sizeof((A)[0]))
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+#define PAGED_CODE()
+
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#define RtlCopyMemory(Destination, Source, Length) \
+  memcpy((Destination), (Source), (Length))
+
+#define InterlockedExchangePointer(Target, Value) \
+  __atomic_exchange_n((Target), (Value), __ATOMIC_SEQ_CST)
+#define InterlockedDecrement(Addend) \
+  __atomic_sub_fetch((Addend), 1, __ATOMIC_SEQ_CST)
+
+// Calling conventions and declaration specifiers
+#define __cdecl
+#define NTAPI
+#define NTSYSAPI
+#define NTKERNELAPI
+#define DECLSPEC_NORETURN [[noreturn]]
+
+// The C++ runtime of the host provides what kernel_stl.h declares for drivers,
+// so skip the header, whose operator delete conflicts with <new>
+#define HYPERPLATFORM_KERNEL_STL_H_
+
+// SAL annotations
+#define _In_
+#define _In_opt_
+#define _In_z_
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_z_(size)
+#define _Out_writes_bytes_opt_(size)
+#define _Inout_
+#define _Inout_opt_
+#define _Use_decl_annotations_
+#define _Success_(expr)
+#define _IRQL_requires_max_(irql)
+#define _IRQL_requires_min_(irql)
+#define _IRQL_raises_(irql)
+#define _IRQL_saves_
+#define _IRQL_restores_
+#define _When_(expr, annotation)
+#define _Must_inspect_result_
+#define _Check_return_opt_
+#define _Printf_format_string_params_(count)
+
+// MSVC integer keywords used by ia32_type.h
+#define __int8 char
+#define __int16 short
+#define __int32 int
+#define __int64 long long
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+#if defined(__x86_64__) && !defined(_AMD64_)
+#define _AMD64_ 1
+#endif
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAXUSHORT 0xffff
+#define MAXULONG 0xffffffffUL
+#define MAXULONG64 0xffffffffffffffffULL
+
+#define PAGE_SIZE 0x1000
+#define PAGE_SHIFT 12
+
+#define PASSIVE_LEVEL 0
+#define APC_LEVEL 1
+#define DISPATCH_LEVEL 2
+
+#define STATUS_SUCCESS ((NTSTATUS)0x00000000L)
+#define STATUS_UNSUCCESSFUL ((NTSTATUS)0xC0000001L)
+#define STATUS_INFO_LENGTH_MISMATCH ((NTSTATUS)0xC0000004L)
+#define STATUS_INSUFFICIENT_RESOURCES ((NTSTATUS)0xC000009AL)
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+typedef void VOID, *PVOID;
+typedef char CHAR, *PCHAR;
+typedef unsigned char UCHAR, *PUCHAR;
+typedef unsigned char BOOLEAN, *PBOOLEAN;
+typedef short SHORT, *PSHORT;
+typedef unsigned short USHORT, *PUSHORT;
+typedef int32_t LONG, *PLONG;
+typedef uint32_t ULONG, *PULONG;
+typedef int32_t LONG32, *PLONG32;
+typedef uint32_t ULONG32, *PULONG32;
+typedef int64_t LONG64, *PLONG64;
+typedef uint64_t ULONG64, *PULONG64;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR, *PULONG_PTR;
+typedef uintptr_t SIZE_T;
+typedef UCHAR KIRQL;
+typedef LONG NTSTATUS;
+typedef ULONG PFN_COUNT;
+typedef ULONG_PTR PFN_NUMBER;
+typedef void *HANDLE;
+typedef struct __locale_struct *_locale_t;
+
+// Opaque kernel objects that appear only in prototypes
+typedef struct _DRIVER_OBJECT *PDRIVER_OBJECT;
+typedef struct _UNICODE_STRING *PUNICODE_STRING;
+
+typedef enum _POOL_TYPE {
+  NonPagedPool,
+  PagedPool,
+  NonPagedPoolNx = 512,
+} POOL_TYPE;
+
+typedef struct _FAST_MUTEX {
+  volatile LONG count;
+} FAST_MUTEX, *PFAST_MUTEX;
+
+typedef struct _IMAGE_INFO {
+  ULONG Properties : 8;
+  ULONG ImageAddressingMode : 8;
+  ULONG SystemModeImage : 1;
+  ULONG ImageMappedToAllPids : 1;
+  ULONG ExtendedInfoPresent : 1;
+  ULONG MachineTypeMismatch : 1;
+  ULONG ImageSignatureLevel : 4;
+  ULONG ImageSignatureType : 3;
+  ULONG ImagePartialMap : 1;
+  ULONG Reserved : 4;
+  PVOID ImageBase;
+  ULONG ImageSelector;
+  SIZE_T ImageSize;
+  ULONG ImageSectionNumber;
+} IMAGE_INFO, *PIMAGE_INFO;
+
+typedef void (*PLOAD_IMAGE_NOTIFY_ROUTINE)(_In_opt_ PUNICODE_STRING
+                                               full_image_name,
+                                           _In_ HANDLE process_id,
+                                           _In_ PIMAGE_INFO image_info);
+
+static_assert(sizeof(ULONG) == 4, "LLP64 requires 32-bit ULONG");
+static_assert(sizeof(ULONG_PTR) == sizeof(void *), "Size check");
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+EXTERN_C PVOID ExAllocatePoolWithTag(_In_ POOL_TYPE pool_type,
+                                     _In_ SIZE_T number_of_bytes,
+                                     _In_ ULONG tag);
+EXTERN_C void ExFreePoolWithTag(_In_ PVOID p, _In_ ULONG tag);
+
+EXTERN_C void ExInitializeFastMutex(_Out_ PFAST_MUTEX fast_mutex);
+EXTERN_C void ExAcquireFastMutex(_Inout_ PFAST_MUTEX fast_mutex);
+EXTERN_C void ExReleaseFastMutex(_Inout_ PFAST_MUTEX fast_mutex);
+
+EXTERN_C KIRQL KeGetCurrentIrql();
+EXTERN_C KIRQL KeRaiseIrqlToDpcLevel();
+EXTERN_C void KeLowerIrql(_In_ KIRQL new_irql);
+
+EXTERN_C NTSTATUS
+PsSetLoadImageNotifyRoutine(_In_ PLOAD_IMAGE_NOTIFY_ROUTINE notify_routine);
+EXTERN_C NTSTATUS
+PsRemoveLoadImageNotifyRoutine(_In_ PLOAD_IMAGE_NOTIFY_ROUTINE notify_routine);
+
+#endif  // DDIMON_BENCH_FLTKERNEL_H_
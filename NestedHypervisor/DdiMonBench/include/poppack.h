@@ -0,0 +1,8 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Stands in for the SDK header on Linux. Deliberately has no include guard.
+
+#pragma pack(pop)
@@ -568,7 +568,10 @@ _Use_decl_annotations_ void EptHandleEptViolation(
       NT_VERIFY(EptpIsDeviceMemory(fault_pa));
     }
 //	DbgPrint("CR3 without EPT : %x  %s\r\n", guest_cr3, ((ULONG)PsGetCurrentProcess()+0x2D8));
-	EptpConstructTables(ept_data->ept_pml4, 4, fault_pa, ept_data);
+	// Construct tables of the hierarchy in use as DdiMon may have switched it
+	const auto current_ept_data = ShGetCurrentEptData(sh_data, ept_data);
+	EptpConstructTables(current_ept_data->ept_pml4, 4, fault_pa,
+	                    current_ept_data);
 
     UtilInveptAll();
   } 
@@ -589,7 +592,7 @@ _Use_decl_annotations_ void EptHandleEptViolation(
 	if (read_failure || write_failure || execute_failure) {
 		//if (!K_HandleEptViolation(sh_data, shared_sh_data, ept_data, fault_va, execute_failure))
 		//{
-			ShHandleEptViolation(sh_data, shared_sh_data, ept_data, fault_va);
+			ShHandleEptViolation(sh_data, shared_sh_data, ept_data, fault_pa);
 		//}
     } else {
       DbgPrint("[IGNR] OTH VA = %p, PA = %016llx", fault_va,
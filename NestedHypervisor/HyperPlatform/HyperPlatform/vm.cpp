@@ -324,6 +324,11 @@ _Use_decl_annotations_ static void VmpInitializeVm(ULONG_PTR guest_stack_pointer
   }
   RtlZeroMemory(processor_data, sizeof(ProcessorData));
 
+  // EPT and shadow hooks are inactive while this VMM runs nested, so neither
+  // ept_data nor sh_data exist. ShAllocateShadowHookData() would also build
+  // the second EPT hierarchy for read/write views (ept_data_for_rw), which
+  // ShFreeShadowHookData() releases in VmpFreeProcessorData(); re-enable both
+  // blocks together with the EPT pointer in VmpSetupVMCS().
   /*processor_data->ept_data = EptInitialization();
   if (!processor_data->ept_data) 
   {
@@ -1075,6 +1080,7 @@ _Use_decl_annotations_ static void VmpFreeProcessorData(
     ExFreePoolWithTag(processor_data->vmxon_region,
                       kHyperPlatformCommonPoolTag);
   }
+ // Pairs with the allocation disabled in VmpInitializeVm()
  /* if (processor_data->sh_data) {
     ShFreeShadowHookData(processor_data->sh_data);
   }
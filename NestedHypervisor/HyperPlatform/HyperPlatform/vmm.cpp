@@ -932,6 +932,7 @@ _Use_decl_annotations_ static void VmmpHandleVmCall(
      /*
 		 ShEnablePageShadowing(
 			  guest_context->stack->processor_data->ept_data,
+			  guest_context->stack->processor_data->sh_data,
 			  guest_context->stack->processor_data->shared_data->shared_sh_data);
 		*/
 	//設置RIP/EIP
@@ -948,6 +949,7 @@ _Use_decl_annotations_ static void VmmpHandleVmCall(
       /*
 		ShVmCallDisablePageShadowing(
         guest_context->stack->processor_data->ept_data,
+        guest_context->stack->processor_data->sh_data,
         guest_context->stack->processor_data->shared_data->shared_sh_data); 
 	  */
 	
@@ -36,6 +36,15 @@ void SStream_concat0(SStream *ss, char *s)
 #endif
 }
 
+void SStream_concatN(SStream *ss, const char *s, unsigned int len)
+{
+#ifndef CAPSTONE_DIET
+	memcpy(ss->buffer + ss->index, s, len);
+	ss->index += len;
+	ss->buffer[ss->index] = '\0';
+#endif
+}
+
 void SStream_concat(SStream *ss, const char *fmt, ...)
 {
 #ifndef CAPSTONE_DIET
@@ -49,28 +58,82 @@ void SStream_concat(SStream *ss, const char *fmt, ...)
 #endif
 }
 
+#ifndef CAPSTONE_DIET
+static const char hex_digits[] = "0123456789abcdef";
+
+// "00" to "99", so that two decimal digits are produced by one division
+static const char dec_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+#endif
+
+void SStream_concatHex(SStream *ss, uint64_t val)
+{
+#ifndef CAPSTONE_DIET
+	char tmp[2 + 16];	// "0x" and up to 16 digits
+	char *p = tmp + sizeof(tmp);
+
+	// digits are produced from the lowest one, so fill the buffer backward
+	do {
+		*--p = hex_digits[val & 0xf];
+		val >>= 4;
+	} while (val);
+	*--p = 'x';
+	*--p = '0';
+
+	SStream_concatN(ss, p, (unsigned int)(tmp + sizeof(tmp) - p));
+#endif
+}
+
+void SStream_concatDec(SStream *ss, uint64_t val)
+{
+#ifndef CAPSTONE_DIET
+	char tmp[20];	// up to 20 digits
+	char *p = tmp + sizeof(tmp);
+	unsigned int pair;
+
+	// most numbers printed in decimal are no more than HEX_THRESHOLD
+	if (val < 10) {
+		ss->buffer[ss->index++] = (char)('0' + val);
+		ss->buffer[ss->index] = '\0';
+		return;
+	}
+
+	while (val >= 100) {
+		pair = (unsigned int)(val % 100);
+		val /= 100;
+		p -= 2;
+		memcpy(p, dec_pairs + pair * 2, 2);
+	}
+	if (val >= 10) {
+		p -= 2;
+		memcpy(p, dec_pairs + val * 2, 2);
+	} else
+		*--p = (char)('0' + val);
+
+	SStream_concatN(ss, p, (unsigned int)(tmp + sizeof(tmp) - p));
+#endif
+}
+
 // print number with prefix #
 void printInt64Bang(SStream *O, int64_t val)
 {
-	if (val >= 0) {
-		if (val > HEX_THRESHOLD)
-			SStream_concat(O, "#0x%"PRIx64, val);
-		else
-			SStream_concat(O, "#%"PRIu64, val);
-	} else {
-		if (val <- HEX_THRESHOLD)
-			SStream_concat(O, "#-0x%"PRIx64, -val);
-		else
-			SStream_concat(O, "#-%"PRIu64, -val);
-	}
+	SStream_concatLit(O, "#");
+	printInt64(O, val);
 }
 
 void printUInt64Bang(SStream *O, uint64_t val)
 {
-	if (val > HEX_THRESHOLD)
-		SStream_concat(O, "#0x%"PRIx64, val);
-	else
-		SStream_concat(O, "#%"PRIu64, val);
+	SStream_concatLit(O, "#");
+	printUInt64(O, val);
 }
 
 // print number
@@ -78,70 +141,72 @@ void printInt64(SStream *O, int64_t val)
 {
 	if (val >= 0) {
 		if (val > HEX_THRESHOLD)
-			SStream_concat(O, "0x%"PRIx64, val);
+			SStream_concatHex(O, val);
 		else
-			SStream_concat(O, "%"PRIu64, val);
+			SStream_concatDec(O, val);
 	} else {
+		// negate as unsigned, so that INT64_MIN is printed as its magnitude
+		SStream_concatLit(O, "-");
 		if (val <- HEX_THRESHOLD)
-			SStream_concat(O, "-0x%"PRIx64, -val);
+			SStream_concatHex(O, 0 - (uint64_t)val);
 		else
-			SStream_concat(O, "-%"PRIu64, -val);
+			SStream_concatDec(O, 0 - (uint64_t)val);
 	}
 }
 
+void printUInt64(SStream *O, uint64_t val)
+{
+	if (val > HEX_THRESHOLD)
+		SStream_concatHex(O, val);
+	else
+		SStream_concatDec(O, val);
+}
+
 // print number in decimal mode
 void printInt32BangDec(SStream *O, int32_t val)
 {
 	if (val >= 0)
-		SStream_concat(O, "#%u", val);
+		SStream_concatLit(O, "#");
 	else
-		SStream_concat(O, "#-%u", -val);
+		SStream_concatLit(O, "#-");
+	SStream_concatDec(O, val >= 0 ? (uint32_t)val : 0 - (uint32_t)val);
 }
 
 void printInt32Bang(SStream *O, int32_t val)
 {
-	if (val >= 0) {
-		if (val > HEX_THRESHOLD)
-			SStream_concat(O, "#0x%x", val);
-		else
-			SStream_concat(O, "#%u", val);
-	} else {
-		if (val <- HEX_THRESHOLD)
-			SStream_concat(O, "#-0x%x", -val);
-		else
-			SStream_concat(O, "#-%u", -val);
-	}
+	SStream_concatLit(O, "#");
+	printInt32(O, val);
 }
 
 void printInt32(SStream *O, int32_t val)
 {
 	if (val >= 0) {
 		if (val > HEX_THRESHOLD)
-			SStream_concat(O, "0x%x", val);
+			SStream_concatHex(O, (uint32_t)val);
 		else
-			SStream_concat(O, "%u", val);
+			SStream_concatDec(O, (uint32_t)val);
 	} else {
+		// negate as unsigned, so that INT32_MIN is printed as its magnitude
+		SStream_concatLit(O, "-");
 		if (val <- HEX_THRESHOLD)
-			SStream_concat(O, "-0x%x", -val);
+			SStream_concatHex(O, 0 - (uint32_t)val);
 		else
-			SStream_concat(O, "-%u", -val);
+			SStream_concatDec(O, 0 - (uint32_t)val);
 	}
 }
 
 void printUInt32Bang(SStream *O, uint32_t val)
 {
-	if (val > HEX_THRESHOLD)
-		SStream_concat(O, "#0x%x", val);
-	else
-		SStream_concat(O, "#%u", val);
+	SStream_concatLit(O, "#");
+	printUInt32(O, val);
 }
 
 void printUInt32(SStream *O, uint32_t val)
 {
 	if (val > HEX_THRESHOLD)
-		SStream_concat(O, "0x%x", val);
+		SStream_concatHex(O, val);
 	else
-		SStream_concat(O, "%u", val);
+		SStream_concatDec(O, val);
 }
 
 /*
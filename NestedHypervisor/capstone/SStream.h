@@ -15,12 +15,25 @@ void SStream_concat(SStream *ss, const char *fmt, ...);
 
 void SStream_concat0(SStream *ss, char *s);
 
+void SStream_concatN(SStream *ss, const char *s, unsigned int len);
+
+// append a string literal without scanning for its length
+#define SStream_concatLit(ss, s) SStream_concatN(ss, s, sizeof(s) - 1)
+
+// append a number as "0x%"PRIx64 would
+void SStream_concatHex(SStream *ss, uint64_t val);
+
+// append a number as "%"PRIu64 would
+void SStream_concatDec(SStream *ss, uint64_t val);
+
 void printInt64Bang(SStream *O, int64_t val);
 
 void printUInt64Bang(SStream *O, uint64_t val);
 
 void printInt64(SStream *O, int64_t val);
 
+void printUInt64(SStream *O, uint64_t val);
+
 void printInt32Bang(SStream *O, int32_t val);
 
 void printInt32(SStream *O, int32_t val);
@@ -14271,10 +14271,17 @@ static insn_map insns[] = {
 #define ARM64_INS_NEGS (unsigned short)-1
 #define ARM64_INS_NGCS (unsigned short)-2
 
+// build the index cache of insns[] for a new handle
+bool AArch64_init_insn_cache(cs_struct *h)
+{
+	h->insn_cache = insn_cache_build(insns, ARR_SIZE(insns));
+	return h->insn_cache != NULL;
+}
+
 // given internal insn id, return public instruction info
 void AArch64_get_insn_id(cs_struct *h, cs_insn *insn, unsigned int id)
 {
-	int i = insn_find(insns, ARR_SIZE(insns), id, &h->insn_cache);
+	int i = insn_find(insns, ARR_SIZE(insns), id, h->insn_cache);
 	if (i != 0) {
 		insn->id = insns[i].mapid;
 
@@ -9,7 +9,7 @@
 #include "AArch64InstPrinter.h"
 #include "AArch64Mapping.h"
 
-static cs_err init(cs_struct *ud)
+cs_err AArch64_global_init(cs_struct *ud)
 {
 	MCRegisterInfo *mri;
 
@@ -17,6 +17,9 @@ static cs_err init(cs_struct *ud)
 	if (ud->mode & ~(CS_MODE_LITTLE_ENDIAN | CS_MODE_ARM | CS_MODE_BIG_ENDIAN))
 		return CS_ERR_MODE;
 
+	if (!AArch64_init_insn_cache(ud))
+		return CS_ERR_MEM;
+
 	mri = cs_mem_malloc(sizeof(*mri));
 
 	AArch64_init(mri);
@@ -33,23 +36,13 @@ static cs_err init(cs_struct *ud)
 	return CS_ERR_OK;
 }
 
-static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
+cs_err AArch64_option(cs_struct *handle, cs_opt_type type, size_t value)
 {
 	return CS_ERR_OK;
 }
 
-static void destroy(cs_struct *handle)
+void AArch64_destroy(cs_struct *handle)
 {
 }
 
-void AArch64_enable(void)
-{
-	arch_init[CS_ARCH_ARM64] = init;
-	arch_option[CS_ARCH_ARM64] = option;
-	arch_destroy[CS_ARCH_ARM64] = destroy;
-
-	// support this arch
-	all_arch |= (1 << CS_ARCH_ARM64);
-}
-
 #endif
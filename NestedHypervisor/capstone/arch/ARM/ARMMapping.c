@@ -13543,9 +13543,16 @@ static insn_map insns[] = {
 	},
 };
 
+// build the index cache of insns[] for a new handle
+bool ARM_init_insn_cache(cs_struct *h)
+{
+	h->insn_cache = insn_cache_build(insns, ARR_SIZE(insns));
+	return h->insn_cache != NULL;
+}
+
 void ARM_get_insn_id(cs_struct *h, cs_insn *insn, unsigned int id)
 {
-	int i = insn_find(insns, ARR_SIZE(insns), id, &h->insn_cache);
+	int i = insn_find(insns, ARR_SIZE(insns), id, h->insn_cache);
 	if (i != 0) {
 		insn->id = insns[i].mapid;
 
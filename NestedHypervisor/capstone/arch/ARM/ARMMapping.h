@@ -11,6 +11,9 @@
 const char *ARM_reg_name(csh handle, unsigned int reg);
 const char *ARM_reg_name2(csh handle, unsigned int reg);
 
+// build the index cache for the function below when a handle is opened
+bool ARM_init_insn_cache(cs_struct *h);
+
 // given internal insn id, return public instruction ID
 void ARM_get_insn_id(cs_struct *h, cs_insn *insn, unsigned int id);
 
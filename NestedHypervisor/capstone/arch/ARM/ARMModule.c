@@ -9,7 +9,7 @@
 #include "ARMInstPrinter.h"
 #include "ARMMapping.h"
 
-static cs_err init(cs_struct *ud)
+cs_err ARM_global_init(cs_struct *ud)
 {
 	MCRegisterInfo *mri;
 
@@ -18,6 +18,9 @@ static cs_err init(cs_struct *ud)
 				CS_MODE_MCLASS | CS_MODE_THUMB | CS_MODE_BIG_ENDIAN))
 		return CS_ERR_MODE;
 
+	if (!ARM_init_insn_cache(ud))
+		return CS_ERR_MEM;
+
 	mri = cs_mem_malloc(sizeof(*mri));
 
 	ARM_init(mri);
@@ -39,7 +42,7 @@ static cs_err init(cs_struct *ud)
 	return CS_ERR_OK;
 }
 
-static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
+cs_err ARM_option(cs_struct *handle, cs_opt_type type, size_t value)
 {
 	switch(type) {
 		case CS_OPT_MODE:
@@ -61,18 +64,8 @@ static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
 	return CS_ERR_OK;
 }
 
-static void destroy(cs_struct *handle)
+void ARM_destroy(cs_struct *handle)
 {
 }
 
-void ARM_enable(void)
-{
-	arch_init[CS_ARCH_ARM] = init;
-	arch_option[CS_ARCH_ARM] = option;
-	arch_destroy[CS_ARCH_ARM] = destroy;
-
-	// support this arch
-	all_arch |= (1 << CS_ARCH_ARM);
-}
-
 #endif
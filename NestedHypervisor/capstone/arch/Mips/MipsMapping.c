@@ -9213,12 +9213,19 @@ static insn_map insns[] = {
 	},
 };
 
+// build the index cache of insns[] for a new handle
+bool Mips_init_insn_cache(cs_struct *h)
+{
+	h->insn_cache = insn_cache_build(insns, ARR_SIZE(insns));
+	return h->insn_cache != NULL;
+}
+
 // given internal insn id, return public instruction info
 void Mips_get_insn_id(cs_struct *h, cs_insn *insn, unsigned int id)
 {
 	unsigned int i;
 
-	i = insn_find(insns, ARR_SIZE(insns), id, &h->insn_cache);
+	i = insn_find(insns, ARR_SIZE(insns), id, h->insn_cache);
 	if (i != 0) {
 		insn->id = insns[i].mapid;
 
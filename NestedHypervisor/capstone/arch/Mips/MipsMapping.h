@@ -9,6 +9,9 @@
 // return name of regiser in friendly string
 const char *Mips_reg_name(csh handle, unsigned int reg);
 
+// build the index cache for the function below when a handle is opened
+bool Mips_init_insn_cache(cs_struct *h);
+
 // given internal insn id, return public instruction info
 void Mips_get_insn_id(cs_struct *h, cs_insn *insn, unsigned int id);
 
@@ -9,7 +9,7 @@
 #include "MipsInstPrinter.h"
 #include "MipsMapping.h"
 
-static cs_err init(cs_struct *ud)
+cs_err Mips_global_init(cs_struct *ud)
 {
 	MCRegisterInfo *mri;
 
@@ -19,6 +19,9 @@ static cs_err init(cs_struct *ud)
 				CS_MODE_MIPSGP64 | CS_MODE_BIG_ENDIAN))
 		return CS_ERR_MODE;
 
+	if (!Mips_init_insn_cache(ud))
+		return CS_ERR_MEM;
+
 	mri = cs_mem_malloc(sizeof(*mri));
 
 	Mips_init(mri);
@@ -38,7 +41,7 @@ static cs_err init(cs_struct *ud)
 	return CS_ERR_OK;
 }
 
-static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
+cs_err Mips_option(cs_struct *handle, cs_opt_type type, size_t value)
 {
 	if (type == CS_OPT_MODE) {
 		if (value & CS_MODE_32)
@@ -51,18 +54,8 @@ static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
 	return CS_ERR_OK;
 }
 
-static void destroy(cs_struct *handle)
+void Mips_destroy(cs_struct *handle)
 {
 }
 
-void Mips_enable(void)
-{
-	arch_init[CS_ARCH_MIPS] = init;
-	arch_option[CS_ARCH_MIPS] = option;
-	arch_destroy[CS_ARCH_MIPS] = destroy;
-
-	// support this arch
-	all_arch |= (1 << CS_ARCH_MIPS);
-}
-
 #endif
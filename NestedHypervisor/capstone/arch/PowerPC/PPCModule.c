@@ -9,7 +9,7 @@
 #include "PPCInstPrinter.h"
 #include "PPCMapping.h"
 
-static cs_err init(cs_struct *ud)
+cs_err PPC_global_init(cs_struct *ud)
 {
 	MCRegisterInfo *mri;
 
@@ -18,6 +18,9 @@ static cs_err init(cs_struct *ud)
 				CS_MODE_BIG_ENDIAN))
 		return CS_ERR_MODE;
 
+	if (!PPC_init_insn_cache(ud))
+		return CS_ERR_MEM;
+
 	mri = (MCRegisterInfo *) cs_mem_malloc(sizeof(*mri));
 
 	PPC_init(mri);
@@ -35,7 +38,7 @@ static cs_err init(cs_struct *ud)
 	return CS_ERR_OK;
 }
 
-static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
+cs_err PPC_option(cs_struct *handle, cs_opt_type type, size_t value)
 {
 	if (type == CS_OPT_SYNTAX)
 		handle->syntax = (int) value;
@@ -43,18 +46,8 @@ static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
 	return CS_ERR_OK;
 }
 
-static void destroy(cs_struct *handle)
+void PPC_destroy(cs_struct *handle)
 {
 }
 
-void PPC_enable(void)
-{
-	arch_init[CS_ARCH_PPC] = init;
-	arch_option[CS_ARCH_PPC] = option;
-	arch_destroy[CS_ARCH_PPC] = destroy;
-
-	// support this arch
-	all_arch |= (1 << CS_ARCH_PPC);
-}
-
 #endif
@@ -9,7 +9,7 @@
 #include "SparcInstPrinter.h"
 #include "SparcMapping.h"
 
-static cs_err init(cs_struct *ud)
+cs_err Sparc_global_init(cs_struct *ud)
 {
 	MCRegisterInfo *mri;
 
@@ -17,6 +17,9 @@ static cs_err init(cs_struct *ud)
 	if (ud->mode & ~(CS_MODE_BIG_ENDIAN | CS_MODE_V9))
 		return CS_ERR_MODE;
 
+	if (!Sparc_init_insn_cache(ud))
+		return CS_ERR_MEM;
+
 	mri = cs_mem_malloc(sizeof(*mri));
 
 	Sparc_init(mri);
@@ -34,7 +37,7 @@ static cs_err init(cs_struct *ud)
 	return CS_ERR_OK;
 }
 
-static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
+cs_err Sparc_option(cs_struct *handle, cs_opt_type type, size_t value)
 {
 	if (type == CS_OPT_SYNTAX)
 		handle->syntax = (int) value;
@@ -42,18 +45,8 @@ static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
 	return CS_ERR_OK;
 }
 
-static void destroy(cs_struct *handle)
+void Sparc_destroy(cs_struct *handle)
 {
 }
 
-void Sparc_enable(void)
-{
-	arch_init[CS_ARCH_SPARC] = init;
-	arch_option[CS_ARCH_SPARC] = option;
-	arch_destroy[CS_ARCH_SPARC] = destroy;
-
-	// support this arch
-	all_arch |= (1 << CS_ARCH_SPARC);
-}
-
 #endif
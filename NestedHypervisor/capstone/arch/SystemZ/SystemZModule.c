@@ -9,10 +9,13 @@
 #include "SystemZInstPrinter.h"
 #include "SystemZMapping.h"
 
-static cs_err init(cs_struct *ud)
+cs_err SystemZ_global_init(cs_struct *ud)
 {
 	MCRegisterInfo *mri;
 
+	if (!SystemZ_init_insn_cache(ud))
+		return CS_ERR_MEM;
+
 	mri = cs_mem_malloc(sizeof(*mri));
 
 	SystemZ_init(mri);
@@ -30,7 +33,7 @@ static cs_err init(cs_struct *ud)
 	return CS_ERR_OK;
 }
 
-static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
+cs_err SystemZ_option(cs_struct *handle, cs_opt_type type, size_t value)
 {
 	if (type == CS_OPT_SYNTAX)
 		handle->syntax = (int) value;
@@ -38,18 +41,8 @@ static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
 	return CS_ERR_OK;
 }
 
-static void destroy(cs_struct *handle)
+void SystemZ_destroy(cs_struct *handle)
 {
 }
 
-void SystemZ_enable(void)
-{
-	arch_init[CS_ARCH_SYSZ] = init;
-	arch_option[CS_ARCH_SYSZ] = option;
-	arch_destroy[CS_ARCH_SYSZ] = destroy;
-
-	// support this arch
-	all_arch |= (1 << CS_ARCH_SYSZ);
-}
-
 #endif
@@ -81,19 +81,22 @@ static InstructionContext contextForAttrs(uint16_t attrMask)
 }
 
 /*
- * modRMRequired - Reads the appropriate instruction table to determine whether
- *   the ModR/M byte is required to decode a particular instruction.
+ * modRMDecision - Reads the appropriate instruction table to find how the
+ *   ModR/M byte selects the instruction for a particular opcode.  Both whether
+ *   the ModR/M byte is required and the ID of the instruction are determined
+ *   from the returned entry, so the tables are walked only once per lookup.
  *
  * @param type        - The opcode type (i.e., how many bytes it has).
  * @param insnContext - The context for the instruction, as returned by
  *                      contextForAttrs.
  * @param opcode      - The last byte of the instruction's opcode, not counting
  *                      ModR/M extensions and escapes.
- * @return            - true if the ModR/M byte is required, false otherwise.
+ * @return            - The decision for @opcode in @insnContext, or an entry of
+ *                      emptyTable if the context has no table for this type.
  */
-static int modRMRequired(OpcodeType type,
+static const struct ModRMDecision *modRMDecision(OpcodeType type,
 		InstructionContext insnContext,
-		uint16_t opcode)
+		uint8_t opcode)
 {
 	const struct OpcodeDecision *decision = NULL;
 	const uint8_t *indextable = NULL;
@@ -131,107 +134,47 @@ static int modRMRequired(OpcodeType type,
 			indextable = index_x86DisassemblerXOPAOpcodes;
 			break;
 		case T3DNOW_MAP:
-			// 3DNow instructions always have ModRM byte
-			return true;
+			decision = T3DNOW_MAP_SYM;
+			indextable = index_x86DisassemblerT3DNOWOpcodes;
+			break;
 #endif
 	}
 
 	index = indextable[insnContext];
 	if (index)
-		return decision[index - 1].modRMDecisions[opcode].modrm_type != MODRM_ONEENTRY;
+		return &decision[index - 1].modRMDecisions[opcode];
 	else
-		return false;
+		return &emptyTable.modRMDecisions[opcode];
 }
 
 /*
- * decode - Reads the appropriate instruction table to obtain the unique ID of
- *   an instruction.
+ * modRMRequired - Determines whether the ModR/M byte is required to decode a
+ *   particular instruction.
  *
- * @param type        - See modRMRequired().
- * @param insnContext - See modRMRequired().
- * @param opcode      - See modRMRequired().
- * @param modRM       - The ModR/M byte if required, or any value if not.
- * @return            - The UID of the instruction, or 0 on failure.
+ * @param type  - See modRMDecision().
+ * @param dec   - The decision returned by modRMDecision().
+ * @return      - true if the ModR/M byte is required, false otherwise.
  */
-static InstrUID decode(OpcodeType type,
-		InstructionContext insnContext,
-		uint8_t opcode,
-		uint8_t modRM)
+static bool modRMRequired(OpcodeType type, const struct ModRMDecision *dec)
 {
-	const struct ModRMDecision *dec = NULL;
-	const uint8_t *indextable = NULL;
-	uint8_t index;
-
-	switch (type) {
-		default:
-		case ONEBYTE:
-			indextable = index_x86DisassemblerOneByteOpcodes;
-			index = indextable[insnContext];
-			if (index)
-				dec = &ONEBYTE_SYM[index - 1].modRMDecisions[opcode];
-			else
-				dec = &emptyTable.modRMDecisions[opcode];
-			break;
-		case TWOBYTE:
-			indextable = index_x86DisassemblerTwoByteOpcodes;
-			index = indextable[insnContext];
-			if (index)
-				dec = &TWOBYTE_SYM[index - 1].modRMDecisions[opcode];
-			else
-				dec = &emptyTable.modRMDecisions[opcode];
-			break;
-		case THREEBYTE_38:
-			indextable = index_x86DisassemblerThreeByte38Opcodes;
-			index = indextable[insnContext];
-			if (index)
-				dec = &THREEBYTE38_SYM[index - 1].modRMDecisions[opcode];
-			else
-				dec = &emptyTable.modRMDecisions[opcode];
-			break;
-		case THREEBYTE_3A:
-			indextable = index_x86DisassemblerThreeByte3AOpcodes;
-			index = indextable[insnContext];
-			if (index)
-				dec = &THREEBYTE3A_SYM[index - 1].modRMDecisions[opcode];
-			else
-				dec = &emptyTable.modRMDecisions[opcode];
-			break;
 #ifndef CAPSTONE_X86_REDUCE
-		case XOP8_MAP:
-			indextable = index_x86DisassemblerXOP8Opcodes;
-			index = indextable[insnContext];
-			if (index)
-				dec = &XOP8_MAP_SYM[index - 1].modRMDecisions[opcode];
-			else
-				dec = &emptyTable.modRMDecisions[opcode];
-			break;
-		case XOP9_MAP:
-			indextable = index_x86DisassemblerXOP9Opcodes;
-			index = indextable[insnContext];
-			if (index)
-				dec = &XOP9_MAP_SYM[index - 1].modRMDecisions[opcode];
-			else
-				dec = &emptyTable.modRMDecisions[opcode];
-			break;
-		case XOPA_MAP:
-			indextable = index_x86DisassemblerXOPAOpcodes;
-			index = indextable[insnContext];
-			if (index)
-				dec = &XOPA_MAP_SYM[index - 1].modRMDecisions[opcode];
-			else
-				dec = &emptyTable.modRMDecisions[opcode];
-			break;
-		case T3DNOW_MAP:
-			indextable = index_x86DisassemblerT3DNOWOpcodes;
-			index = indextable[insnContext];
-			if (index)
-				dec = &T3DNOW_MAP_SYM[index - 1].modRMDecisions[opcode];
-			else
-				dec = &emptyTable.modRMDecisions[opcode];
-			break;
+	// 3DNow instructions always have ModRM byte
+	if (type == T3DNOW_MAP)
+		return true;
 #endif
-	}
 
+	return dec->modrm_type != MODRM_ONEENTRY;
+}
+
+/*
+ * decode - Obtains the unique ID of an instruction from its ModR/M decision.
+ *
+ * @param dec   - The decision returned by modRMDecision().
+ * @param modRM - The ModR/M byte if required, or any value if not.
+ * @return      - The UID of the instruction, or 0 on failure.
+ */
+static InstrUID decode(const struct ModRMDecision *dec, uint8_t modRM)
+{
 	switch (dec->modrm_type) {
 		default:
 			//debug("Corrupt table!  Unknown modrm_type");
@@ -340,6 +283,44 @@ CONSUME_FUNC(consumeUInt16, uint16_t)
 CONSUME_FUNC(consumeUInt32, uint32_t)
 CONSUME_FUNC(consumeUInt64, uint64_t)
 
+/*
+ * Classification of every byte that may precede an opcode, so that
+ * readPrefixes() can recognize a prefix and its group with a single lookup
+ * instead of comparing the byte against each prefix in turn.  Segment override
+ * prefixes also carry the SegmentOverride they select in their upper bits.
+ */
+#define PFX_LOCKREP	0x01	/* F0, F2, F3 */
+#define PFX_SEGMENT	0x02	/* 26, 2E, 36, 3E, 64, 65 */
+#define PFX_OPSIZE	0x04	/* 66 */
+#define PFX_ADSIZE	0x08	/* 67 */
+#define PFX_REX	0x10	/* 40-4F, only a prefix in 64-bit mode */
+#define PFX_LEGACY	(PFX_LOCKREP | PFX_SEGMENT | PFX_OPSIZE | PFX_ADSIZE)
+
+#define PFX_SEG_SHIFT	5
+#define PFX_SEG(seg)	(PFX_SEGMENT | (SEG_OVERRIDE_##seg << PFX_SEG_SHIFT))
+
+static const uint8_t prefixTable[256] = {
+	/* 00 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 10 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 20 */ 0, 0, 0, 0, 0, 0, PFX_SEG(ES), 0, 0, 0, 0, 0, 0, 0, PFX_SEG(CS), 0,
+	/* 30 */ 0, 0, 0, 0, 0, 0, PFX_SEG(SS), 0, 0, 0, 0, 0, 0, 0, PFX_SEG(DS), 0,
+	/* 40 */ PFX_REX, PFX_REX, PFX_REX, PFX_REX, PFX_REX, PFX_REX, PFX_REX, PFX_REX,
+	/* 48 */ PFX_REX, PFX_REX, PFX_REX, PFX_REX, PFX_REX, PFX_REX, PFX_REX, PFX_REX,
+	/* 50 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 60 */ 0, 0, 0, 0, PFX_SEG(FS), PFX_SEG(GS), PFX_OPSIZE, PFX_ADSIZE,
+	/* 68 */ 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 70 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 80 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 90 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* A0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* B0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* C0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* D0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* E0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* F0 */ PFX_LOCKREP, 0, PFX_LOCKREP, PFX_LOCKREP, 0, 0, 0, 0,
+	/* F8 */ 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
 /*
  * setPrefixPresent - Marks that a particular prefix is present at a particular
  *   location.
@@ -479,6 +460,7 @@ static int readPrefixes(struct InternalInstruction *insn)
 	bool isPrefix = true;
 	uint64_t prefixLocation;
 	uint8_t byte = 0, nextByte;
+	uint8_t prefixClass;
 
 	bool hasAdSize = false;
 	bool hasOpSize = false;
@@ -489,11 +471,11 @@ static int readPrefixes(struct InternalInstruction *insn)
 			if (consumeByte(insn, &byte))
 				return -1;
 
-			if ((byte & 0xf0) == 0x40) {
+			if (prefixTable[byte] & PFX_REX) {
 				while(true) {
 					if (lookAtByte(insn, &byte))	// out of input code
 						return -1;
-					if ((byte & 0xf0) == 0x40) {
+					if (prefixTable[byte] & PFX_REX) {
 						// another REX prefix, but we only remember the last one
 						if (consumeByte(insn, &byte))
 							return -1;
@@ -502,23 +484,8 @@ static int readPrefixes(struct InternalInstruction *insn)
 				}
 
 				// recover the last REX byte if next byte is not a legacy prefix
-				switch (byte) {
-					case 0xf2:  /* REPNE/REPNZ */
-					case 0xf3:  /* REP or REPE/REPZ */
-					case 0xf0:  /* LOCK */
-					case 0x2e:  /* CS segment override -OR- Branch not taken */
-					case 0x36:  /* SS segment override -OR- Branch taken */
-					case 0x3e:  /* DS segment override */
-					case 0x26:  /* ES segment override */
-					case 0x64:  /* FS segment override */
-					case 0x65:  /* GS segment override */
-					case 0x66:  /* Operand-size override */
-					case 0x67:  /* Address-size override */
-						break;
-					default:    /* Not a prefix byte */
-						unconsumeByte(insn);
-						break;
-				}
+				if (!(prefixTable[byte] & PFX_LEGACY))
+					unconsumeByte(insn);
 			} else {
 				unconsumeByte(insn);
 			}
@@ -558,7 +525,7 @@ static int readPrefixes(struct InternalInstruction *insn)
 					 nextByte == 0xc6 || nextByte == 0xc7))
 				insn->xAcquireRelease = true;
 
-			if (insn->mode == MODE_64BIT && (nextByte & 0xf0) == 0x40) {
+			if (insn->mode == MODE_64BIT && (prefixTable[nextByte] & PFX_REX)) {
 				if (consumeByte(insn, &nextByte))
 					return -1;
 				if (lookAtByte(insn, &nextByte))
@@ -567,108 +534,42 @@ static int readPrefixes(struct InternalInstruction *insn)
 			}
 		}
 
-		switch (byte) {
-			case 0xf2:  /* REPNE/REPNZ */
-			case 0xf3:  /* REP or REPE/REPZ */
-			case 0xf0:  /* LOCK */
-				// only accept the last prefix
-				insn->isPrefixf2 = false;
-				insn->isPrefixf3 = false;
-				insn->isPrefixf0 = false;
-				setPrefixPresent(insn, byte, prefixLocation);
-				insn->prefix0 = byte;
-				break;
-			case 0x2e:  /* CS segment override -OR- Branch not taken */
-				insn->segmentOverride = SEG_OVERRIDE_CS;
-				// only accept the last prefix
-				insn->isPrefix2e = false;
-				insn->isPrefix36 = false;
-				insn->isPrefix3e = false;
-				insn->isPrefix26 = false;
-				insn->isPrefix64 = false;
-				insn->isPrefix65 = false;
-
-				setPrefixPresent(insn, byte, prefixLocation);
-				insn->prefix1 = byte;
-				break;
-			case 0x36:  /* SS segment override -OR- Branch taken */
-				insn->segmentOverride = SEG_OVERRIDE_SS;
-				// only accept the last prefix
-				insn->isPrefix2e = false;
-				insn->isPrefix36 = false;
-				insn->isPrefix3e = false;
-				insn->isPrefix26 = false;
-				insn->isPrefix64 = false;
-				insn->isPrefix65 = false;
-
-				setPrefixPresent(insn, byte, prefixLocation);
-				insn->prefix1 = byte;
-				break;
-			case 0x3e:  /* DS segment override */
-				insn->segmentOverride = SEG_OVERRIDE_DS;
-				// only accept the last prefix
-				insn->isPrefix2e = false;
-				insn->isPrefix36 = false;
-				insn->isPrefix3e = false;
-				insn->isPrefix26 = false;
-				insn->isPrefix64 = false;
-				insn->isPrefix65 = false;
-
-				setPrefixPresent(insn, byte, prefixLocation);
-				insn->prefix1 = byte;
-				break;
-			case 0x26:  /* ES segment override */
-				insn->segmentOverride = SEG_OVERRIDE_ES;
-				// only accept the last prefix
-				insn->isPrefix2e = false;
-				insn->isPrefix36 = false;
-				insn->isPrefix3e = false;
-				insn->isPrefix26 = false;
-				insn->isPrefix64 = false;
-				insn->isPrefix65 = false;
-
-				setPrefixPresent(insn, byte, prefixLocation);
-				insn->prefix1 = byte;
-				break;
-			case 0x64:  /* FS segment override */
-				insn->segmentOverride = SEG_OVERRIDE_FS;
-				// only accept the last prefix
-				insn->isPrefix2e = false;
-				insn->isPrefix36 = false;
-				insn->isPrefix3e = false;
-				insn->isPrefix26 = false;
-				insn->isPrefix64 = false;
-				insn->isPrefix65 = false;
-
-				setPrefixPresent(insn, byte, prefixLocation);
-				insn->prefix1 = byte;
-				break;
-			case 0x65:  /* GS segment override */
-				insn->segmentOverride = SEG_OVERRIDE_GS;
-				// only accept the last prefix
-				insn->isPrefix2e = false;
-				insn->isPrefix36 = false;
-				insn->isPrefix3e = false;
-				insn->isPrefix26 = false;
-				insn->isPrefix64 = false;
-				insn->isPrefix65 = false;
-
-				setPrefixPresent(insn, byte, prefixLocation);
-				insn->prefix1 = byte;
-				break;
-			case 0x66:  /* Operand-size override */
-				hasOpSize = true;
-				setPrefixPresent(insn, byte, prefixLocation);
-				insn->prefix2 = byte;
-				break;
-			case 0x67:  /* Address-size override */
-				hasAdSize = true;
-				setPrefixPresent(insn, byte, prefixLocation);
-				insn->prefix3 = byte;
-				break;
-			default:    /* Not a prefix byte */
-				isPrefix = false;
-				break;
+		prefixClass = prefixTable[byte];
+
+		if (prefixClass & PFX_LOCKREP) {
+			/* LOCK, REPNE/REPNZ, REP or REPE/REPZ */
+			// only accept the last prefix
+			insn->isPrefixf2 = false;
+			insn->isPrefixf3 = false;
+			insn->isPrefixf0 = false;
+			setPrefixPresent(insn, byte, prefixLocation);
+			insn->prefix0 = byte;
+		} else if (prefixClass & PFX_SEGMENT) {
+			/* Segment override -OR- Branch (not) taken */
+			insn->segmentOverride = (SegmentOverride)(prefixClass >> PFX_SEG_SHIFT);
+			// only accept the last prefix
+			insn->isPrefix2e = false;
+			insn->isPrefix36 = false;
+			insn->isPrefix3e = false;
+			insn->isPrefix26 = false;
+			insn->isPrefix64 = false;
+			insn->isPrefix65 = false;
+
+			setPrefixPresent(insn, byte, prefixLocation);
+			insn->prefix1 = byte;
+		} else if (prefixClass & PFX_OPSIZE) {
+			/* Operand-size override */
+			hasOpSize = true;
+			setPrefixPresent(insn, byte, prefixLocation);
+			insn->prefix2 = byte;
+		} else if (prefixClass & PFX_ADSIZE) {
+			/* Address-size override */
+			hasAdSize = true;
+			setPrefixPresent(insn, byte, prefixLocation);
+			insn->prefix3 = byte;
+		} else {
+			/* Not a prefix byte */
+			isPrefix = false;
 		}
 
 		//if (isPrefix)
@@ -840,13 +741,13 @@ static int readPrefixes(struct InternalInstruction *insn)
 		}
 	} else {
 		if (insn->mode == MODE_64BIT) {
-			if ((byte & 0xf0) == 0x40) {
+			if (prefixTable[byte] & PFX_REX) {
 				uint8_t opcodeByte;
 
 				while(true) {
 					if (lookAtByte(insn, &opcodeByte))	// out of input code
 						return -1;
-					if ((opcodeByte & 0xf0) == 0x40) {
+					if (prefixTable[opcodeByte] & PFX_REX) {
 						// another REX prefix, but we only remember the last one
 						if (consumeByte(insn, &byte))
 							return -1;
@@ -1076,7 +977,7 @@ static int getIDWithAttrMask(uint16_t *instructionID,
 		struct InternalInstruction *insn,
 		uint16_t attrMask)
 {
-	bool hasModRMExtension;
+	const struct ModRMDecision *dec;
 
 	InstructionContext instructionClass;
 
@@ -1093,23 +994,15 @@ static int getIDWithAttrMask(uint16_t *instructionID,
 	else
 		instructionClass = contextForAttrs(attrMask);
 
-	hasModRMExtension = modRMRequired(insn->opcodeType,
-			instructionClass,
-			insn->opcode);
+	dec = modRMDecision(insn->opcodeType, instructionClass, insn->opcode);
 
-	if (hasModRMExtension) {
+	if (modRMRequired(insn->opcodeType, dec)) {
 		if (readModRM(insn))
 			return -1;
 
-		*instructionID = decode(insn->opcodeType,
-				instructionClass,
-				insn->opcode,
-				insn->modRM);
+		*instructionID = decode(dec, insn->modRM);
 	} else {
-		*instructionID = decode(insn->opcodeType,
-				instructionClass,
-				insn->opcode,
-				0);
+		*instructionID = decode(dec, 0);
 	}
 
 	return 0;
@@ -1589,9 +1482,8 @@ static int readModRM(struct InternalInstruction *insn)
 						return -1;
 					break;
 				case 0x3:
+					insn->eaDisplacement = EA_DISP_NONE;
 					insn->eaBase = (EABase)(insn->eaRegBase + rm);
-					if (readDisplacement(insn))
-						return -1;
 					break;
 			}
 			break;
@@ -63,7 +63,7 @@ static void set_mem_access(MCInst *MI, bool status)
 
 static void printopaquemem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "ptr ");
+	SStream_concatLit(O, "ptr ");
 
 	switch(MI->csh->mode) {
 		case CS_MODE_16:
@@ -93,7 +93,7 @@ static void printopaquemem(MCInst *MI, unsigned OpNo, SStream *O)
 
 static void printi8mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "byte ptr ");
+	SStream_concatLit(O, "byte ptr ");
 	MI->x86opsize = 1;
 	printMemReference(MI, OpNo, O);
 }
@@ -101,27 +101,27 @@ static void printi8mem(MCInst *MI, unsigned OpNo, SStream *O)
 static void printi16mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
 	MI->x86opsize = 2;
-	SStream_concat0(O, "word ptr ");
+	SStream_concatLit(O, "word ptr ");
 	printMemReference(MI, OpNo, O);
 }
 
 static void printi32mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
 	MI->x86opsize = 4;
-	SStream_concat0(O, "dword ptr ");
+	SStream_concatLit(O, "dword ptr ");
 	printMemReference(MI, OpNo, O);
 }
 
 static void printi64mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "qword ptr ");
+	SStream_concatLit(O, "qword ptr ");
 	MI->x86opsize = 8;
 	printMemReference(MI, OpNo, O);
 }
 
 static void printi128mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "xmmword ptr ");
+	SStream_concatLit(O, "xmmword ptr ");
 	MI->x86opsize = 16;
 	printMemReference(MI, OpNo, O);
 }
@@ -129,56 +129,56 @@ static void printi128mem(MCInst *MI, unsigned OpNo, SStream *O)
 #ifndef CAPSTONE_X86_REDUCE
 static void printi256mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "ymmword ptr ");
+	SStream_concatLit(O, "ymmword ptr ");
 	MI->x86opsize = 32;
 	printMemReference(MI, OpNo, O);
 }
 
 static void printi512mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "zmmword ptr ");
+	SStream_concatLit(O, "zmmword ptr ");
 	MI->x86opsize = 64;
 	printMemReference(MI, OpNo, O);
 }
 
 static void printf32mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "dword ptr ");
+	SStream_concatLit(O, "dword ptr ");
 	MI->x86opsize = 4;
 	printMemReference(MI, OpNo, O);
 }
 
 static void printf64mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "qword ptr ");
+	SStream_concatLit(O, "qword ptr ");
 	MI->x86opsize = 8;
 	printMemReference(MI, OpNo, O);
 }
 
 static void printf80mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "xword ptr ");
+	SStream_concatLit(O, "xword ptr ");
 	MI->x86opsize = 10;
 	printMemReference(MI, OpNo, O);
 }
 
 static void printf128mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "xmmword ptr ");
+	SStream_concatLit(O, "xmmword ptr ");
 	MI->x86opsize = 16;
 	printMemReference(MI, OpNo, O);
 }
 
 static void printf256mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "ymmword ptr ");
+	SStream_concatLit(O, "ymmword ptr ");
 	MI->x86opsize = 32;
 	printMemReference(MI, OpNo, O);
 }
 
 static void printf512mem(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "zmmword ptr ");
+	SStream_concatLit(O, "zmmword ptr ");
 	MI->x86opsize = 64;
 	printMemReference(MI, OpNo, O);
 }
@@ -188,22 +188,22 @@ static void printSSECC(MCInst *MI, unsigned Op, SStream *OS)
 	int64_t Imm = MCOperand_getImm(MCInst_getOperand(MI, Op)) & 7;
 	switch (Imm) {
 		default: break;	// never reach
-		case    0: SStream_concat0(OS, "eq"); op_addSseCC(MI, X86_SSE_CC_EQ); break;
-		case    1: SStream_concat0(OS, "lt"); op_addSseCC(MI, X86_SSE_CC_LT); break;
-		case    2: SStream_concat0(OS, "le"); op_addSseCC(MI, X86_SSE_CC_LE); break;
-		case    3: SStream_concat0(OS, "unord"); op_addSseCC(MI, X86_SSE_CC_UNORD); break;
-		case    4: SStream_concat0(OS, "neq"); op_addSseCC(MI, X86_SSE_CC_NEQ); break;
-		case    5: SStream_concat0(OS, "nlt"); op_addSseCC(MI, X86_SSE_CC_NLT); break;
-		case    6: SStream_concat0(OS, "nle"); op_addSseCC(MI, X86_SSE_CC_NLE); break;
-		case    7: SStream_concat0(OS, "ord"); op_addSseCC(MI, X86_SSE_CC_ORD); break;
-		case    8: SStream_concat0(OS, "eq_uq"); op_addSseCC(MI, X86_SSE_CC_EQ_UQ); break;
-		case    9: SStream_concat0(OS, "nge"); op_addSseCC(MI, X86_SSE_CC_NGE); break;
-		case  0xa: SStream_concat0(OS, "ngt"); op_addSseCC(MI, X86_SSE_CC_NGT); break;
-		case  0xb: SStream_concat0(OS, "false"); op_addSseCC(MI, X86_SSE_CC_FALSE); break;
-		case  0xc: SStream_concat0(OS, "neq_oq"); op_addSseCC(MI, X86_SSE_CC_NEQ_OQ); break;
-		case  0xd: SStream_concat0(OS, "ge"); op_addSseCC(MI, X86_SSE_CC_GE); break;
-		case  0xe: SStream_concat0(OS, "gt"); op_addSseCC(MI, X86_SSE_CC_GT); break;
-		case  0xf: SStream_concat0(OS, "true"); op_addSseCC(MI, X86_SSE_CC_TRUE); break;
+		case    0: SStream_concatLit(OS, "eq"); op_addSseCC(MI, X86_SSE_CC_EQ); break;
+		case    1: SStream_concatLit(OS, "lt"); op_addSseCC(MI, X86_SSE_CC_LT); break;
+		case    2: SStream_concatLit(OS, "le"); op_addSseCC(MI, X86_SSE_CC_LE); break;
+		case    3: SStream_concatLit(OS, "unord"); op_addSseCC(MI, X86_SSE_CC_UNORD); break;
+		case    4: SStream_concatLit(OS, "neq"); op_addSseCC(MI, X86_SSE_CC_NEQ); break;
+		case    5: SStream_concatLit(OS, "nlt"); op_addSseCC(MI, X86_SSE_CC_NLT); break;
+		case    6: SStream_concatLit(OS, "nle"); op_addSseCC(MI, X86_SSE_CC_NLE); break;
+		case    7: SStream_concatLit(OS, "ord"); op_addSseCC(MI, X86_SSE_CC_ORD); break;
+		case    8: SStream_concatLit(OS, "eq_uq"); op_addSseCC(MI, X86_SSE_CC_EQ_UQ); break;
+		case    9: SStream_concatLit(OS, "nge"); op_addSseCC(MI, X86_SSE_CC_NGE); break;
+		case  0xa: SStream_concatLit(OS, "ngt"); op_addSseCC(MI, X86_SSE_CC_NGT); break;
+		case  0xb: SStream_concatLit(OS, "false"); op_addSseCC(MI, X86_SSE_CC_FALSE); break;
+		case  0xc: SStream_concatLit(OS, "neq_oq"); op_addSseCC(MI, X86_SSE_CC_NEQ_OQ); break;
+		case  0xd: SStream_concatLit(OS, "ge"); op_addSseCC(MI, X86_SSE_CC_GE); break;
+		case  0xe: SStream_concatLit(OS, "gt"); op_addSseCC(MI, X86_SSE_CC_GT); break;
+		case  0xf: SStream_concatLit(OS, "true"); op_addSseCC(MI, X86_SSE_CC_TRUE); break;
 	}
 }
 
@@ -212,38 +212,38 @@ static void printAVXCC(MCInst *MI, unsigned Op, SStream *O)
 	int64_t Imm = MCOperand_getImm(MCInst_getOperand(MI, Op)) & 0x1f;
 	switch (Imm) {
 		default: break;//printf("Invalid avxcc argument!\n"); break;
-		case    0: SStream_concat0(O, "eq"); op_addAvxCC(MI, X86_AVX_CC_EQ); break;
-		case    1: SStream_concat0(O, "lt"); op_addAvxCC(MI, X86_AVX_CC_LT); break;
-		case    2: SStream_concat0(O, "le"); op_addAvxCC(MI, X86_AVX_CC_LE); break;
-		case    3: SStream_concat0(O, "unord"); op_addAvxCC(MI, X86_AVX_CC_UNORD); break;
-		case    4: SStream_concat0(O, "neq"); op_addAvxCC(MI, X86_AVX_CC_NEQ); break;
-		case    5: SStream_concat0(O, "nlt"); op_addAvxCC(MI, X86_AVX_CC_NLT); break;
-		case    6: SStream_concat0(O, "nle"); op_addAvxCC(MI, X86_AVX_CC_NLE); break;
-		case    7: SStream_concat0(O, "ord"); op_addAvxCC(MI, X86_AVX_CC_ORD); break;
-		case    8: SStream_concat0(O, "eq_uq"); op_addAvxCC(MI, X86_AVX_CC_EQ_UQ); break;
-		case    9: SStream_concat0(O, "nge"); op_addAvxCC(MI, X86_AVX_CC_NGE); break;
-		case  0xa: SStream_concat0(O, "ngt"); op_addAvxCC(MI, X86_AVX_CC_NGT); break;
-		case  0xb: SStream_concat0(O, "false"); op_addAvxCC(MI, X86_AVX_CC_FALSE); break;
-		case  0xc: SStream_concat0(O, "neq_oq"); op_addAvxCC(MI, X86_AVX_CC_NEQ_OQ); break;
-		case  0xd: SStream_concat0(O, "ge"); op_addAvxCC(MI, X86_AVX_CC_GE); break;
-		case  0xe: SStream_concat0(O, "gt"); op_addAvxCC(MI, X86_AVX_CC_GT); break;
-		case  0xf: SStream_concat0(O, "true"); op_addAvxCC(MI, X86_AVX_CC_TRUE); break;
-		case 0x10: SStream_concat0(O, "eq_os"); op_addAvxCC(MI, X86_AVX_CC_EQ_OS); break;
-		case 0x11: SStream_concat0(O, "lt_oq"); op_addAvxCC(MI, X86_AVX_CC_LT_OQ); break;
-		case 0x12: SStream_concat0(O, "le_oq"); op_addAvxCC(MI, X86_AVX_CC_LE_OQ); break;
-		case 0x13: SStream_concat0(O, "unord_s"); op_addAvxCC(MI, X86_AVX_CC_UNORD_S); break;
-		case 0x14: SStream_concat0(O, "neq_us"); op_addAvxCC(MI, X86_AVX_CC_NEQ_US); break;
-		case 0x15: SStream_concat0(O, "nlt_uq"); op_addAvxCC(MI, X86_AVX_CC_NLT_UQ); break;
-		case 0x16: SStream_concat0(O, "nle_uq"); op_addAvxCC(MI, X86_AVX_CC_NLE_UQ); break;
-		case 0x17: SStream_concat0(O, "ord_s"); op_addAvxCC(MI, X86_AVX_CC_ORD_S); break;
-		case 0x18: SStream_concat0(O, "eq_us"); op_addAvxCC(MI, X86_AVX_CC_EQ_US); break;
-		case 0x19: SStream_concat0(O, "nge_uq"); op_addAvxCC(MI, X86_AVX_CC_NGE_UQ); break;
-		case 0x1a: SStream_concat0(O, "ngt_uq"); op_addAvxCC(MI, X86_AVX_CC_NGT_UQ); break;
-		case 0x1b: SStream_concat0(O, "false_os"); op_addAvxCC(MI, X86_AVX_CC_FALSE_OS); break;
-		case 0x1c: SStream_concat0(O, "neq_os"); op_addAvxCC(MI, X86_AVX_CC_NEQ_OS); break;
-		case 0x1d: SStream_concat0(O, "ge_oq"); op_addAvxCC(MI, X86_AVX_CC_GE_OQ); break;
-		case 0x1e: SStream_concat0(O, "gt_oq"); op_addAvxCC(MI, X86_AVX_CC_GT_OQ); break;
-		case 0x1f: SStream_concat0(O, "true_us"); op_addAvxCC(MI, X86_AVX_CC_TRUE_US); break;
+		case    0: SStream_concatLit(O, "eq"); op_addAvxCC(MI, X86_AVX_CC_EQ); break;
+		case    1: SStream_concatLit(O, "lt"); op_addAvxCC(MI, X86_AVX_CC_LT); break;
+		case    2: SStream_concatLit(O, "le"); op_addAvxCC(MI, X86_AVX_CC_LE); break;
+		case    3: SStream_concatLit(O, "unord"); op_addAvxCC(MI, X86_AVX_CC_UNORD); break;
+		case    4: SStream_concatLit(O, "neq"); op_addAvxCC(MI, X86_AVX_CC_NEQ); break;
+		case    5: SStream_concatLit(O, "nlt"); op_addAvxCC(MI, X86_AVX_CC_NLT); break;
+		case    6: SStream_concatLit(O, "nle"); op_addAvxCC(MI, X86_AVX_CC_NLE); break;
+		case    7: SStream_concatLit(O, "ord"); op_addAvxCC(MI, X86_AVX_CC_ORD); break;
+		case    8: SStream_concatLit(O, "eq_uq"); op_addAvxCC(MI, X86_AVX_CC_EQ_UQ); break;
+		case    9: SStream_concatLit(O, "nge"); op_addAvxCC(MI, X86_AVX_CC_NGE); break;
+		case  0xa: SStream_concatLit(O, "ngt"); op_addAvxCC(MI, X86_AVX_CC_NGT); break;
+		case  0xb: SStream_concatLit(O, "false"); op_addAvxCC(MI, X86_AVX_CC_FALSE); break;
+		case  0xc: SStream_concatLit(O, "neq_oq"); op_addAvxCC(MI, X86_AVX_CC_NEQ_OQ); break;
+		case  0xd: SStream_concatLit(O, "ge"); op_addAvxCC(MI, X86_AVX_CC_GE); break;
+		case  0xe: SStream_concatLit(O, "gt"); op_addAvxCC(MI, X86_AVX_CC_GT); break;
+		case  0xf: SStream_concatLit(O, "true"); op_addAvxCC(MI, X86_AVX_CC_TRUE); break;
+		case 0x10: SStream_concatLit(O, "eq_os"); op_addAvxCC(MI, X86_AVX_CC_EQ_OS); break;
+		case 0x11: SStream_concatLit(O, "lt_oq"); op_addAvxCC(MI, X86_AVX_CC_LT_OQ); break;
+		case 0x12: SStream_concatLit(O, "le_oq"); op_addAvxCC(MI, X86_AVX_CC_LE_OQ); break;
+		case 0x13: SStream_concatLit(O, "unord_s"); op_addAvxCC(MI, X86_AVX_CC_UNORD_S); break;
+		case 0x14: SStream_concatLit(O, "neq_us"); op_addAvxCC(MI, X86_AVX_CC_NEQ_US); break;
+		case 0x15: SStream_concatLit(O, "nlt_uq"); op_addAvxCC(MI, X86_AVX_CC_NLT_UQ); break;
+		case 0x16: SStream_concatLit(O, "nle_uq"); op_addAvxCC(MI, X86_AVX_CC_NLE_UQ); break;
+		case 0x17: SStream_concatLit(O, "ord_s"); op_addAvxCC(MI, X86_AVX_CC_ORD_S); break;
+		case 0x18: SStream_concatLit(O, "eq_us"); op_addAvxCC(MI, X86_AVX_CC_EQ_US); break;
+		case 0x19: SStream_concatLit(O, "nge_uq"); op_addAvxCC(MI, X86_AVX_CC_NGE_UQ); break;
+		case 0x1a: SStream_concatLit(O, "ngt_uq"); op_addAvxCC(MI, X86_AVX_CC_NGT_UQ); break;
+		case 0x1b: SStream_concatLit(O, "false_os"); op_addAvxCC(MI, X86_AVX_CC_FALSE_OS); break;
+		case 0x1c: SStream_concatLit(O, "neq_os"); op_addAvxCC(MI, X86_AVX_CC_NEQ_OS); break;
+		case 0x1d: SStream_concatLit(O, "ge_oq"); op_addAvxCC(MI, X86_AVX_CC_GE_OQ); break;
+		case 0x1e: SStream_concatLit(O, "gt_oq"); op_addAvxCC(MI, X86_AVX_CC_GT_OQ); break;
+		case 0x1f: SStream_concatLit(O, "true_us"); op_addAvxCC(MI, X86_AVX_CC_TRUE_US); break;
 	}
 }
 
@@ -251,10 +251,10 @@ static void printRoundingControl(MCInst *MI, unsigned Op, SStream *O)
 {
 	int64_t Imm = MCOperand_getImm(MCInst_getOperand(MI, Op)) & 0x3;
 	switch (Imm) {
-		case 0: SStream_concat0(O, "{rn-sae}"); op_addAvxSae(MI); op_addAvxRoundingMode(MI, X86_AVX_RM_RN); break;
-		case 1: SStream_concat0(O, "{rd-sae}"); op_addAvxSae(MI); op_addAvxRoundingMode(MI, X86_AVX_RM_RD); break;
-		case 2: SStream_concat0(O, "{ru-sae}"); op_addAvxSae(MI); op_addAvxRoundingMode(MI, X86_AVX_RM_RU); break;
-		case 3: SStream_concat0(O, "{rz-sae}"); op_addAvxSae(MI); op_addAvxRoundingMode(MI, X86_AVX_RM_RZ); break;
+		case 0: SStream_concatLit(O, "{rn-sae}"); op_addAvxSae(MI); op_addAvxRoundingMode(MI, X86_AVX_RM_RN); break;
+		case 1: SStream_concatLit(O, "{rd-sae}"); op_addAvxSae(MI); op_addAvxRoundingMode(MI, X86_AVX_RM_RD); break;
+		case 2: SStream_concatLit(O, "{ru-sae}"); op_addAvxSae(MI); op_addAvxRoundingMode(MI, X86_AVX_RM_RU); break;
+		case 3: SStream_concatLit(O, "{rz-sae}"); op_addAvxSae(MI); op_addAvxRoundingMode(MI, X86_AVX_RM_RZ); break;
 		default: break;	// never reach
 	}
 }
@@ -275,18 +275,7 @@ static void _printOperand(MCInst *MI, unsigned OpNo, SStream *O)
 		printRegName(O, MCOperand_getReg(Op));
 	} else if (MCOperand_isImm(Op)) {
 		int64_t imm = MCOperand_getImm(Op);
-		if (imm < 0) {
-			if (imm < -HEX_THRESHOLD)
-				SStream_concat(O, "-0x%"PRIx64, -imm);
-			else
-				SStream_concat(O, "-%"PRIu64, -imm);
-
-		} else {
-			if (imm > HEX_THRESHOLD)
-				SStream_concat(O, "0x%"PRIx64, imm);
-			else
-				SStream_concat(O, "%"PRIu64, imm);
-		}
+		printInt64(O, imm);
 	}
 }
 
@@ -314,13 +303,13 @@ static void printSrcIdx(MCInst *MI, unsigned Op, SStream *O)
 		if (MI->csh->detail) {
 			MI->flat_insn->detail->x86.operands[MI->flat_insn->detail->x86.op_count].mem.segment = reg;
 		}
-		SStream_concat0(O, ":");
+		SStream_concatLit(O, ":");
 	}
 
-	SStream_concat0(O, "[");
+	SStream_concatLit(O, "[");
 	set_mem_access(MI, true);
 	printOperand(MI, Op, O);
-	SStream_concat0(O, "]");
+	SStream_concatLit(O, "]");
 	set_mem_access(MI, false);
 }
 
@@ -338,71 +327,71 @@ static void printDstIdx(MCInst *MI, unsigned Op, SStream *O)
 
 	// DI accesses are always ES-based on non-64bit mode
 	if (MI->csh->mode != CS_MODE_64) {
-		SStream_concat(O, "es:[");
+		SStream_concatLit(O, "es:[");
 		if (MI->csh->detail) {
 			MI->flat_insn->detail->x86.operands[MI->flat_insn->detail->x86.op_count].mem.segment = X86_REG_ES;
 		}
 	} else
-		SStream_concat(O, "[");
+		SStream_concatLit(O, "[");
 
 	set_mem_access(MI, true);
 	printOperand(MI, Op, O);
-	SStream_concat0(O, "]");
+	SStream_concatLit(O, "]");
 	set_mem_access(MI, false);
 }
 
 void printSrcIdx8(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "byte ptr ");
+	SStream_concatLit(O, "byte ptr ");
 	MI->x86opsize = 1;
 	printSrcIdx(MI, OpNo, O);
 }
 
 void printSrcIdx16(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "word ptr ");
+	SStream_concatLit(O, "word ptr ");
 	MI->x86opsize = 2;
 	printSrcIdx(MI, OpNo, O);
 }
 
 void printSrcIdx32(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "dword ptr ");
+	SStream_concatLit(O, "dword ptr ");
 	MI->x86opsize = 4;
 	printSrcIdx(MI, OpNo, O);
 }
 
 void printSrcIdx64(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "qword ptr ");
+	SStream_concatLit(O, "qword ptr ");
 	MI->x86opsize = 8;
 	printSrcIdx(MI, OpNo, O);
 }
 
 void printDstIdx8(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "byte ptr ");
+	SStream_concatLit(O, "byte ptr ");
 	MI->x86opsize = 1;
 	printDstIdx(MI, OpNo, O);
 }
 
 void printDstIdx16(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "word ptr ");
+	SStream_concatLit(O, "word ptr ");
 	MI->x86opsize = 2;
 	printDstIdx(MI, OpNo, O);
 }
 
 void printDstIdx32(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "dword ptr ");
+	SStream_concatLit(O, "dword ptr ");
 	MI->x86opsize = 4;
 	printDstIdx(MI, OpNo, O);
 }
 
 void printDstIdx64(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "qword ptr ");
+	SStream_concatLit(O, "qword ptr ");
 	MI->x86opsize = 8;
 	printDstIdx(MI, OpNo, O);
 }
@@ -427,29 +416,26 @@ static void printMemOffset(MCInst *MI, unsigned Op, SStream *O)
 	reg = MCOperand_getReg(SegReg);
 	if (reg) {
 		_printOperand(MI, Op + 1, O);
-		SStream_concat0(O, ":");
+		SStream_concatLit(O, ":");
 		if (MI->csh->detail) {
 			MI->flat_insn->detail->x86.operands[MI->flat_insn->detail->x86.op_count].mem.segment = reg;
 		}
 	}
 
-	SStream_concat0(O, "[");
+	SStream_concatLit(O, "[");
 
 	if (MCOperand_isImm(DispSpec)) {
 		int64_t imm = MCOperand_getImm(DispSpec);
 		if (MI->csh->detail)
 			MI->flat_insn->detail->x86.operands[MI->flat_insn->detail->x86.op_count].mem.disp = imm;
 		if (imm < 0) {
-			SStream_concat(O, "0x%"PRIx64, arch_masks[MI->csh->mode] & imm);
+			SStream_concatHex(O, arch_masks[MI->csh->mode] & imm);
 		} else {
-			if (imm > HEX_THRESHOLD)
-				SStream_concat(O, "0x%"PRIx64, imm);
-			else
-				SStream_concat(O, "%"PRIu64, imm);
+			printUInt64(O, imm);
 		}
 	}
 
-	SStream_concat0(O, "]");
+	SStream_concatLit(O, "]");
 
 	if (MI->csh->detail)
 		MI->flat_insn->detail->x86.op_count++;
@@ -460,28 +446,28 @@ static void printMemOffset(MCInst *MI, unsigned Op, SStream *O)
 
 static void printMemOffs8(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "byte ptr ");
+	SStream_concatLit(O, "byte ptr ");
 	MI->x86opsize = 1;
 	printMemOffset(MI, OpNo, O);
 }
 
 static void printMemOffs16(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "word ptr ");
+	SStream_concatLit(O, "word ptr ");
 	MI->x86opsize = 2;
 	printMemOffset(MI, OpNo, O);
 }
 
 static void printMemOffs32(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "dword ptr ");
+	SStream_concatLit(O, "dword ptr ");
 	MI->x86opsize = 4;
 	printMemOffset(MI, OpNo, O);
 }
 
 static void printMemOffs64(MCInst *MI, unsigned OpNo, SStream *O)
 {
-	SStream_concat0(O, "qword ptr ");
+	SStream_concatLit(O, "qword ptr ");
 	MI->x86opsize = 8;
 	printMemOffset(MI, OpNo, O);
 }
@@ -557,12 +543,9 @@ static void printPCRelImm(MCInst *MI, unsigned OpNo, SStream *O)
 			imm = imm & 0xffff;
 
 		if (imm < 0) {
-			SStream_concat(O, "0x%"PRIx64, imm);
+			SStream_concatHex(O, imm);
 		} else {
-			if (imm > HEX_THRESHOLD)
-				SStream_concat(O, "0x%"PRIx64, imm);
-			else
-				SStream_concat(O, "%"PRIu64, imm);
+			printUInt64(O, imm);
 		}
 		if (MI->csh->detail) {
 			MI->flat_insn->detail->x86.operands[MI->flat_insn->detail->x86.op_count].type = X86_OP_IMM;
@@ -683,18 +666,7 @@ static void printOperand(MCInst *MI, unsigned OpNo, SStream *O)
 
 		switch(MI->flat_insn->id) {
 			default:
-				if (imm >= 0) {
-					if (imm > HEX_THRESHOLD)
-						SStream_concat(O, "0x%"PRIx64, imm);
-					else
-						SStream_concat(O, "%"PRIu64, imm);
-				} else {
-					if (imm < -HEX_THRESHOLD)
-						SStream_concat(O, "-0x%"PRIx64, -imm);
-					else
-						SStream_concat(O, "-%"PRIu64, -imm);
-				}
-
+				printInt64(O, imm);
 				break;
 
 			case X86_INS_LCALL:
@@ -705,9 +677,9 @@ static void printOperand(MCInst *MI, unsigned OpNo, SStream *O)
 					opsize = 2;
 				}
 				if (imm > HEX_THRESHOLD)
-					SStream_concat(O, "0x%"PRIx64, imm);
+					SStream_concatHex(O, imm);
 				else
-					SStream_concat(O, "%"PRIu64, imm);
+					SStream_concatDec(O, imm);
 				break;
 
 			case X86_INS_AND:
@@ -715,19 +687,19 @@ static void printOperand(MCInst *MI, unsigned OpNo, SStream *O)
 			case X86_INS_XOR:
 				// do not print number in negative form
 				if (imm >= 0 && imm <= HEX_THRESHOLD)
-					SStream_concat(O, "%u", imm);
+					SStream_concatDec(O, imm);
 				else {
 					imm = arch_masks[MI->op1_size? MI->op1_size : MI->imm_size] & imm;
-					SStream_concat(O, "0x%"PRIx64, imm);
+					SStream_concatHex(O, imm);
 				}
 				break;
 			case X86_INS_RET:
 				// RET imm16
 				if (imm >= 0 && imm <= HEX_THRESHOLD)
-					SStream_concat(O, "%u", imm);
+					SStream_concatDec(O, imm);
 				else {
 					imm = 0xffff & imm;
-					SStream_concat(O, "0x%x", 0xffff & imm);
+					SStream_concatHex(O, imm);
 				}
 				break;
 		}
@@ -785,10 +757,10 @@ static void printMemReference(MCInst *MI, unsigned Op, SStream *O)
 		if (MI->csh->detail) {
 			MI->flat_insn->detail->x86.operands[MI->flat_insn->detail->x86.op_count].mem.segment = reg;
 		}
-		SStream_concat0(O, ":");
+		SStream_concatLit(O, ":");
 	}
 
-	SStream_concat0(O, "[");
+	SStream_concatLit(O, "[");
 
 	if (MCOperand_getReg(BaseReg)) {
 		_printOperand(MI, Op + X86_AddrBaseReg, O);
@@ -796,10 +768,12 @@ static void printMemReference(MCInst *MI, unsigned Op, SStream *O)
 	}
 
 	if (MCOperand_getReg(IndexReg)) {
-		if (NeedPlus) SStream_concat0(O, " + ");
+		if (NeedPlus) SStream_concatLit(O, " + ");
 		_printOperand(MI, Op + X86_AddrIndexReg, O);
-		if (ScaleVal != 1)
-			SStream_concat(O, "*%u", ScaleVal);
+		if (ScaleVal != 1) {
+			SStream_concatLit(O, "*");
+			SStream_concatDec(O, ScaleVal);
+		}
 		NeedPlus = true;
 	}
 
@@ -810,36 +784,32 @@ static void printMemReference(MCInst *MI, unsigned Op, SStream *O)
 		if (DispVal) {
 			if (NeedPlus) {
 				if (DispVal < 0) {
+					SStream_concatLit(O, " - ");
 					if (DispVal <  -HEX_THRESHOLD)
-						SStream_concat(O, " - 0x%"PRIx64, -DispVal);
+						SStream_concatHex(O, 0 - (uint64_t)DispVal);
 					else
-						SStream_concat(O, " - %"PRIu64, -DispVal);
+						SStream_concatDec(O, 0 - (uint64_t)DispVal);
 				} else {
-					if (DispVal > HEX_THRESHOLD)
-						SStream_concat(O, " + 0x%"PRIx64, DispVal);
-					else
-						SStream_concat(O, " + %"PRIu64, DispVal);
+					SStream_concatLit(O, " + ");
+					printUInt64(O, DispVal);
 				}
 			} else {
 				// memory reference to an immediate address
 				if (DispVal < 0) {
-					SStream_concat(O, "0x%"PRIx64, arch_masks[MI->csh->mode] & DispVal);
+					SStream_concatHex(O, arch_masks[MI->csh->mode] & DispVal);
 				} else {
-					if (DispVal > HEX_THRESHOLD)
-						SStream_concat(O, "0x%"PRIx64, DispVal);
-					else
-						SStream_concat(O, "%"PRIu64, DispVal);
+					printUInt64(O, DispVal);
 				}
 			}
 
 		} else {
 			// DispVal = 0
 			if (!NeedPlus)	// [0]
-				SStream_concat0(O, "0");
+				SStream_concatLit(O, "0");
 		}
 	}
 
-	SStream_concat0(O, "]");
+	SStream_concatLit(O, "]");
 
 	if (MI->csh->detail)
 		MI->flat_insn->detail->x86.op_count++;
@@ -47050,10 +47050,17 @@ static void arr_replace(uint8_t *arr, uint8_t max, x86_reg r1, x86_reg r2)
 }
 #endif
 
+// build the index cache of insns[] for a new handle
+bool X86_init_insn_cache(cs_struct *h)
+{
+	h->insn_cache = insn_cache_build(insns, ARR_SIZE(insns));
+	return h->insn_cache != NULL;
+}
+
 // given internal insn id, return public instruction info
 void X86_get_insn_id(cs_struct *h, cs_insn *insn, unsigned int id)
 {
-	int i = insn_find(insns, ARR_SIZE(insns), id, &h->insn_cache);
+	int i = insn_find(insns, ARR_SIZE(insns), id, h->insn_cache);
 	if (i != 0) {
 		insn->id = insns[i].mapid;
 
@@ -47553,7 +47560,7 @@ x86_reg X86_insn_reg_att(unsigned int id)
 static bool valid_repne(cs_struct *h, unsigned int opcode)
 {
 	unsigned int id;
-	int i = insn_find(insns, ARR_SIZE(insns), opcode, &h->insn_cache);
+	int i = insn_find(insns, ARR_SIZE(insns), opcode, h->insn_cache);
 	if (i != 0) {
 		id = insns[i].mapid;
 		switch(id) {
@@ -47613,7 +47620,7 @@ static bool valid_repne(cs_struct *h, unsigned int opcode)
 static bool valid_rep(cs_struct *h, unsigned int opcode)
 {
 	unsigned int id;
-	int i = insn_find(insns, ARR_SIZE(insns), opcode, &h->insn_cache);
+	int i = insn_find(insns, ARR_SIZE(insns), opcode, h->insn_cache);
 	if (i != 0) {
 		id = insns[i].mapid;
 		switch(id) {
@@ -47668,7 +47675,7 @@ static bool valid_rep(cs_struct *h, unsigned int opcode)
 static bool valid_repe(cs_struct *h, unsigned int opcode)
 {
 	unsigned int id;
-	int i = insn_find(insns, ARR_SIZE(insns), opcode, &h->insn_cache);
+	int i = insn_find(insns, ARR_SIZE(insns), opcode, h->insn_cache);
 	if (i != 0) {
 		id = insns[i].mapid;
 		switch(id) {
@@ -47736,14 +47743,14 @@ bool X86_lockrep(MCInst *MI, SStream *O)
 			break;
 		case 0xf0:
 #ifndef CAPSTONE_DIET
-			SStream_concat(O, "lock|");
+			SStream_concatLit(O, "lock|");
 #endif
 			break;
 		case 0xf2:	// repne
 			opcode = MCInst_getOpcode(MI);
 #ifndef CAPSTONE_DIET	// only care about memonic in standard (non-diet) mode
 			if (valid_repne(MI->csh, opcode)) {
-				SStream_concat(O, "repne|");
+				SStream_concatLit(O, "repne|");
 				add_cx(MI);
 			} else {
 				// invalid prefix
@@ -47753,7 +47760,7 @@ bool X86_lockrep(MCInst *MI, SStream *O)
 #ifndef CAPSTONE_X86_REDUCE
 				if (opcode == X86_MULPDrr) {
 					MCInst_setOpcode(MI, X86_MULSDrr);
-					SStream_concat(O, "mulsd\t");
+					SStream_concatLit(O, "mulsd\t");
 					res = true;
 				}
 #endif
@@ -47775,10 +47782,10 @@ bool X86_lockrep(MCInst *MI, SStream *O)
 			opcode = MCInst_getOpcode(MI);
 #ifndef CAPSTONE_DIET	// only care about memonic in standard (non-diet) mode
 			if (valid_rep(MI->csh, opcode)) {
-				SStream_concat(O, "rep|");
+				SStream_concatLit(O, "rep|");
 				add_cx(MI);
 			} else if (valid_repe(MI->csh, opcode)) {
-				SStream_concat(O, "repe|");
+				SStream_concatLit(O, "repe|");
 				add_cx(MI);
 			} else {
 				// invalid prefix
@@ -47788,7 +47795,7 @@ bool X86_lockrep(MCInst *MI, SStream *O)
 #ifndef CAPSTONE_X86_REDUCE
 				if (opcode == X86_MULPDrr) {
 					MCInst_setOpcode(MI, X86_MULSSrr);
-					SStream_concat(O, "mulss\t");
+					SStream_concatLit(O, "mulss\t");
 					res = true;
 				}
 #endif
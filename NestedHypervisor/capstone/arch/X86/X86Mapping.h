@@ -19,6 +19,9 @@ x86_reg x86_map_segment(int r);
 // return name of regiser in friendly string
 const char *X86_reg_name(csh handle, unsigned int reg);
 
+// build the index cache for the function below when a handle is opened
+bool X86_init_insn_cache(cs_struct *h);
+
 // given internal insn id, return public instruction info
 void X86_get_insn_id(cs_struct *h, cs_insn *insn, unsigned int id);
 
@@ -9,7 +9,7 @@
 #include "X86InstPrinter.h"
 #include "X86Mapping.h"
 
-static cs_err init(cs_struct *ud)
+cs_err X86_global_init(cs_struct *ud)
 {
 	MCRegisterInfo *mri;
 
@@ -17,6 +17,9 @@ static cs_err init(cs_struct *ud)
 	if (ud->mode & ~(CS_MODE_LITTLE_ENDIAN | CS_MODE_32 | CS_MODE_64 | CS_MODE_16))
 		return CS_ERR_MODE;
 
+	if (!X86_init_insn_cache(ud))
+		return CS_ERR_MEM;
+
 	mri = cs_mem_malloc(sizeof(*mri));
 
 	X86_init(mri);
@@ -40,7 +43,7 @@ static cs_err init(cs_struct *ud)
 	return CS_ERR_OK;
 }
 
-static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
+cs_err X86_option(cs_struct *handle, cs_opt_type type, size_t value)
 {
 	switch(type) {
 		default:
@@ -87,18 +90,8 @@ static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
 	return CS_ERR_OK;
 }
 
-static void destroy(cs_struct *handle)
+void X86_destroy(cs_struct *handle)
 {
 }
 
-void X86_enable(void)
-{
-	arch_init[CS_ARCH_X86] = init;
-	arch_option[CS_ARCH_X86] = option;
-	arch_destroy[CS_ARCH_X86] = destroy;
-
-	// support this arch
-	all_arch |= (1 << CS_ARCH_X86);
-}
-
 #endif
@@ -9,10 +9,13 @@
 #include "XCoreInstPrinter.h"
 #include "XCoreMapping.h"
 
-static cs_err init(cs_struct *ud)
+cs_err XCore_global_init(cs_struct *ud)
 {
 	MCRegisterInfo *mri;
 
+	if (!XCore_init_insn_cache(ud))
+		return CS_ERR_MEM;
+
 	mri = cs_mem_malloc(sizeof(*mri));
 
 	XCore_init(mri);
@@ -30,23 +33,13 @@ static cs_err init(cs_struct *ud)
 	return CS_ERR_OK;
 }
 
-static cs_err option(cs_struct *handle, cs_opt_type type, size_t value)
+cs_err XCore_option(cs_struct *handle, cs_opt_type type, size_t value)
 {
 	return CS_ERR_OK;
 }
 
-static void destroy(cs_struct *handle)
+void XCore_destroy(cs_struct *handle)
 {
 }
 
-void XCore_enable(void)
-{
-	arch_init[CS_ARCH_XCORE] = init;
-	arch_option[CS_ARCH_XCORE] = option;
-	arch_destroy[CS_ARCH_XCORE] = destroy;
-
-	// support this arch
-	all_arch |= (1 << CS_ARCH_XCORE);
-}
-
 #endif
@@ -0,0 +1,332 @@
+/* Capstone Disassembly Engine */
+/* Parallel linear sweep over large code regions */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parallel_sweep.h"
+
+// number of chunks per thread. More chunks balance the load better when
+// some parts of the buffer decode slower than others.
+#define CHUNKS_PER_THREAD 8
+
+// minimum size of a chunk, so that short buffers are not split needlessly
+#define MIN_CHUNK_SIZE (64 * 1024)
+
+// number of bytes decoded before a chunk to resynchronize with the real
+// instruction stream. Variable length instructions usually converge within
+// a few instructions.
+#define SYNC_WINDOW 64
+
+// instructions decoded for a chunk
+struct sweep_chunk {
+	uint64_t start;		// address of the first byte of this chunk
+	uint64_t end;		// address following the last byte of this chunk
+	uint64_t next;		// address at which decoding of this chunk stopped
+	sweep_insn *insns;	// instructions starting in [start, end)
+	size_t count;
+	size_t capacity;
+	cs_err err;
+};
+
+// state shared by workers
+struct sweep_job {
+	cs_arch arch;
+	cs_mode mode;
+	const uint8_t *code;
+	size_t code_size;
+	uint64_t address;
+	struct sweep_chunk *chunks;
+	size_t chunk_count;
+	size_t next_chunk;	// index of the next chunk to be taken by a worker
+};
+
+static bool push_insn(sweep_insn **insns, size_t *count, size_t *capacity,
+		uint64_t address, unsigned int id, uint16_t size)
+{
+	sweep_insn *tmp;
+
+	if (*count == *capacity) {
+		size_t new_capacity = *capacity ? *capacity * 2 : 1024;
+		tmp = realloc(*insns, new_capacity * sizeof(**insns));
+		if (!tmp)
+			return false;
+		*insns = tmp;
+		*capacity = new_capacity;
+	}
+
+	(*insns)[*count].address = address;
+	(*insns)[*count].id = id;
+	(*insns)[*count].size = size;
+	(*count)++;
+
+	return true;
+}
+
+// decode one instruction at @address, or skip one byte if it is invalid.
+// return the address following what was consumed.
+static uint64_t sweep_one(csh handle, cs_insn *insn, const struct sweep_job *job,
+		uint64_t address, bool *valid)
+{
+	const uint8_t *code = job->code + (address - job->address);
+	size_t size = job->code_size - (size_t)(address - job->address);
+	uint64_t next = address;
+
+	*valid = cs_disasm_iter(handle, &code, &size, &next, insn);
+	return *valid ? next : address + 1;
+}
+
+// decode a chunk starting a little before it
+static void sweep_chunk(csh handle, cs_insn *insn, const struct sweep_job *job,
+		struct sweep_chunk *chunk)
+{
+	uint64_t address, next;
+	bool valid;
+
+	if (chunk->start - job->address > SYNC_WINDOW)
+		address = chunk->start - SYNC_WINDOW;
+	else
+		address = job->address;
+
+	chunk->capacity = (size_t)(chunk->end - chunk->start) / 3 + 1;
+	chunk->insns = malloc(chunk->capacity * sizeof(*chunk->insns));
+	if (!chunk->insns) {
+		chunk->err = CS_ERR_MEM;
+		return;
+	}
+
+	while (address < chunk->end) {
+		next = sweep_one(handle, insn, job, address, &valid);
+		if (valid && address >= chunk->start &&
+				!push_insn(&chunk->insns, &chunk->count, &chunk->capacity,
+					address, insn->id, insn->size)) {
+			chunk->err = CS_ERR_MEM;
+			return;
+		}
+		address = next;
+	}
+
+	chunk->next = address;
+}
+
+static void *sweep_worker(void *arg)
+{
+	struct sweep_job *job = arg;
+	cs_insn *insn = NULL;
+	csh handle = 0;
+	cs_err err;
+	size_t i;
+
+	err = cs_open(job->arch, job->mode, &handle);
+	if (err == CS_ERR_OK) {
+		insn = cs_malloc(handle);
+		if (!insn)
+			err = CS_ERR_MEM;
+	}
+
+	for (;;) {
+		i = __sync_fetch_and_add(&job->next_chunk, 1);
+		if (i >= job->chunk_count)
+			break;
+
+		if (err != CS_ERR_OK)
+			job->chunks[i].err = err;
+		else
+			sweep_chunk(handle, insn, job, &job->chunks[i]);
+	}
+
+	if (insn)
+		cs_free(insn, 1);
+	if (handle)
+		cs_close(&handle);
+
+	return NULL;
+}
+
+// find an instruction at @address in a chunk
+static sweep_insn *find_insn(const struct sweep_chunk *chunk, uint64_t address)
+{
+	size_t lo = 0, hi = chunk->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (chunk->insns[mid].address < address)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < chunk->count && chunk->insns[lo].address == address)
+		return &chunk->insns[lo];
+
+	return NULL;
+}
+
+// concatenate chunks, decoding sequentially where the stream of a chunk has
+// not converged with the stream coming from the previous chunk
+static cs_err sweep_merge(const struct sweep_job *job, sweep_insn **insns,
+		size_t *count)
+{
+	sweep_insn *out = NULL, *sync;
+	size_t out_count = 0, out_capacity = 0;
+	size_t i, n;
+	uint64_t address = job->address, next;
+	cs_insn *insn = NULL;
+	csh handle = 0;
+	cs_err err = CS_ERR_OK;
+	bool valid;
+
+	for (i = 0; i < job->chunk_count; i++) {
+		const struct sweep_chunk *chunk = &job->chunks[i];
+
+		while (address < chunk->end) {
+			sync = find_insn(chunk, address);
+			if (sync) {
+				// both streams meet here. the rest of the chunk is exact.
+				n = chunk->count - (size_t)(sync - chunk->insns);
+				if (out_count + n > out_capacity) {
+					sweep_insn *tmp;
+					size_t new_capacity = out_capacity * 2;
+					if (new_capacity < out_count + n)
+						new_capacity = out_count + n;
+					tmp = realloc(out, new_capacity * sizeof(*out));
+					if (!tmp) {
+						err = CS_ERR_MEM;
+						goto out;
+					}
+					out = tmp;
+					out_capacity = new_capacity;
+				}
+				memcpy(out + out_count, sync, n * sizeof(*out));
+				out_count += n;
+				address = chunk->next;
+				break;
+			}
+
+			// not converged yet: decode one instruction on this thread
+			if (!handle) {
+				err = cs_open(job->arch, job->mode, &handle);
+				if (err != CS_ERR_OK)
+					goto out;
+				insn = cs_malloc(handle);
+				if (!insn) {
+					err = CS_ERR_MEM;
+					goto out;
+				}
+			}
+
+			next = sweep_one(handle, insn, job, address, &valid);
+			if (valid && !push_insn(&out, &out_count, &out_capacity,
+						address, insn->id, insn->size)) {
+				err = CS_ERR_MEM;
+				goto out;
+			}
+			address = next;
+		}
+	}
+
+out:
+	if (insn)
+		cs_free(insn, 1);
+	if (handle)
+		cs_close(&handle);
+
+	if (err != CS_ERR_OK) {
+		free(out);
+		return err;
+	}
+
+	*insns = out;
+	*count = out_count;
+
+	return CS_ERR_OK;
+}
+
+cs_err sweep_disasm(cs_arch arch, cs_mode mode,
+		const uint8_t *code, size_t code_size, uint64_t address,
+		unsigned int threads, sweep_insn **insns, size_t *count)
+{
+	struct sweep_job job;
+	pthread_t *workers;
+	size_t chunk_size, i;
+	unsigned int t, started;
+	cs_err err = CS_ERR_OK;
+
+	*insns = NULL;
+	*count = 0;
+
+	if (!threads) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = online > 0 ? (unsigned int)online : 1;
+	}
+
+	job.arch = arch;
+	job.mode = mode;
+	job.code = code;
+	job.code_size = code_size;
+	job.address = address;
+	job.next_chunk = 0;
+
+	job.chunk_count = (size_t)threads * CHUNKS_PER_THREAD;
+	chunk_size = code_size / job.chunk_count + 1;
+	if (chunk_size < MIN_CHUNK_SIZE) {
+		chunk_size = MIN_CHUNK_SIZE;
+		job.chunk_count = code_size / chunk_size + 1;
+	}
+	if (job.chunk_count < threads)
+		threads = (unsigned int)job.chunk_count;
+
+	job.chunks = calloc(job.chunk_count, sizeof(*job.chunks));
+	workers = calloc(threads, sizeof(*workers));
+	if (!job.chunks || !workers) {
+		free(job.chunks);
+		free(workers);
+		return CS_ERR_MEM;
+	}
+
+	for (i = 0; i < job.chunk_count; i++) {
+		size_t offset = i * chunk_size;
+		size_t end = offset + chunk_size;
+		if (offset > code_size)
+			offset = code_size;
+		if (end > code_size)
+			end = code_size;
+		job.chunks[i].start = address + offset;
+		job.chunks[i].end = address + end;
+		job.chunks[i].next = address + end;
+		job.chunks[i].err = CS_ERR_OK;
+	}
+
+	// the calling thread works too
+	for (started = 0; started + 1 < threads; started++) {
+		if (pthread_create(&workers[started], NULL, sweep_worker, &job))
+			break;
+	}
+	sweep_worker(&job);
+	for (t = 0; t < started; t++)
+		pthread_join(workers[t], NULL);
+
+	for (i = 0; i < job.chunk_count; i++) {
+		if (job.chunks[i].err != CS_ERR_OK) {
+			err = job.chunks[i].err;
+			break;
+		}
+	}
+
+	if (err == CS_ERR_OK)
+		err = sweep_merge(&job, insns, count);
+
+	for (i = 0; i < job.chunk_count; i++)
+		free(job.chunks[i].insns);
+	free(job.chunks);
+	free(workers);
+
+	return err;
+}
+
+void sweep_free(sweep_insn *insns)
+{
+	free(insns);
+}
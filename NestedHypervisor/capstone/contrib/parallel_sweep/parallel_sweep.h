@@ -0,0 +1,57 @@
+/* Capstone Disassembly Engine */
+/* Parallel linear sweep over large code regions */
+
+#ifndef CS_PARALLEL_SWEEP_H_
+#define CS_PARALLEL_SWEEP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <capstone.h>
+
+// An instruction found by the sweep. Only what is needed to locate
+// instruction boundaries is kept, so that whole images fit in memory.
+typedef struct sweep_insn {
+	uint64_t address;	// address of this instruction
+	unsigned int id;	// instruction ID, as in cs_insn.id
+	uint16_t size;		// size of this instruction
+} sweep_insn;
+
+/*
+ Disassemble the whole buffer with a linear sweep on multiple threads.
+
+ The result is the same as decoding the buffer from its start with
+ cs_disasm_iter() on one thread, skipping one byte whenever an invalid
+ instruction is met. The buffer is split into chunks that worker threads,
+ each with its own handle, decode independently starting a little before
+ the chunk, so that decoding most likely resynchronizes with the real
+ instruction stream before reaching the chunk. Chunks are then merged in
+ address order, and any remaining mismatch at a chunk boundary is fixed
+ by decoding sequentially until both streams meet.
+
+ @arch: architecture passed to cs_open()
+ @mode: mode passed to cs_open()
+ @code: buffer containing raw binary code to be disassembled
+ @code_size: size of above code
+ @address: address of the first byte in @code
+ @threads: number of worker threads, or 0 for one per online processor
+ @insns: array of instructions allocated by this API. Free it with
+	sweep_free().
+ @count: number of instructions in @insns
+
+ @return CS_ERR_OK on success, or other value on failure (refer to cs_err
+ enum for detailed error).
+*/
+cs_err sweep_disasm(cs_arch arch, cs_mode mode,
+		const uint8_t *code, size_t code_size, uint64_t address,
+		unsigned int threads, sweep_insn **insns, size_t *count);
+
+// Free memory allocated by sweep_disasm()
+void sweep_free(sweep_insn *insns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
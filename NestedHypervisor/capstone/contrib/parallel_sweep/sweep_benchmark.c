@@ -0,0 +1,241 @@
+/* Capstone Disassembly Engine */
+/* Measures how sweep_disasm() scales with threads on a synthetic x86-64 blob */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parallel_sweep.h"
+
+// default size of the blob in MB
+#define DEFAULT_BLOB_MB 64
+
+// address the blob is disassembled at
+#define BLOB_ADDRESS 0x140001000ULL
+
+static uint64_t rand_state = 0x2545f4914f6cdd1dULL;
+
+static unsigned int next_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return (unsigned int)rand_state;
+}
+
+static uint8_t *emit(uint8_t *p, const char *bytes, size_t len)
+{
+	memcpy(p, bytes, len);
+	return p + len;
+}
+
+// fill the buffer with functions built from common x86-64 instructions,
+// with occasional data between them as compilers emit for jump tables
+static void make_blob(uint8_t *blob, size_t size)
+{
+	uint8_t *p = blob, *end = blob + size - 64;
+	unsigned int i, n, r;
+
+	while (p < end) {
+		// prologue
+		p = emit(p, "\x55\x48\x89\xe5\x48\x83\xec", 7);
+		*p++ = (uint8_t)(next_rand() & 0x78);
+
+		n = 8 + next_rand() % 64;
+		for (i = 0; i < n && p < end; i++) {
+			r = next_rand();
+			switch (r % 10) {
+				case 0:	// mov rax, [rbp + disp8]
+					p = emit(p, "\x48\x8b\x45", 3);
+					*p++ = (uint8_t)(r >> 8);
+					break;
+				case 1:	// mov [rsp + disp8], rax
+					p = emit(p, "\x48\x89\x44\x24", 4);
+					*p++ = (uint8_t)(r >> 8);
+					break;
+				case 2:	// lea rcx, [rbp + disp8]
+					p = emit(p, "\x48\x8d\x4d", 3);
+					*p++ = (uint8_t)(r >> 8);
+					break;
+				case 3:	// add/or/adc/sbb/and/sub/xor/cmp r64, r64
+					*p++ = 0x48;
+					*p++ = (uint8_t)(((r >> 8) & 7) << 3 | 1);
+					*p++ = (uint8_t)(0xc0 | ((r >> 16) & 0x3f));
+					break;
+				case 4:	// call rel32
+					*p++ = 0xe8;
+					memcpy(p, &r, 4);
+					p += 4;
+					break;
+				case 5:	// jz/jnz rel8
+					*p++ = (uint8_t)(0x74 + ((r >> 8) & 1));
+					*p++ = (uint8_t)(r >> 16);
+					break;
+				case 6:	// test eax, eax
+					p = emit(p, "\x85\xc0", 2);
+					break;
+				case 7:	// mov r32, imm32
+					*p++ = (uint8_t)(0xb8 + ((r >> 8) & 7));
+					memcpy(p, &r, 4);
+					p += 4;
+					break;
+				case 8:	// push/pop r64
+					*p++ = (uint8_t)(0x50 + ((r >> 8) & 0xf));
+					break;
+				case 9:	// mov r64, [rip + disp32]
+					p = emit(p, "\x48\x8b\x05", 3);
+					memcpy(p, &r, 4);
+					p += 4;
+					break;
+			}
+		}
+
+		// epilogue and padding
+		p = emit(p, "\xc9\xc3", 2);
+		while ((p - blob) & 15)
+			*p++ = 0xcc;
+
+		if (next_rand() % 32 == 0) {
+			// a jump table
+			n = 4 + next_rand() % 16;
+			for (i = 0; i < n && p + 4 < end; i++) {
+				r = next_rand();
+				memcpy(p, &r, 4);
+				p += 4;
+			}
+		}
+	}
+
+	while (p < blob + size)
+		*p++ = 0xcc;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the linear sweep sweep_disasm() must reproduce, on the calling thread
+static sweep_insn *sweep_sequential(const uint8_t *blob, size_t size,
+		uint64_t address, size_t *count)
+{
+	sweep_insn *insns = malloc(size * sizeof(*insns));
+	const uint8_t *code = blob;
+	uint64_t next = address;
+	cs_insn *insn;
+	csh handle;
+
+	*count = 0;
+	if (!insns || cs_open(CS_ARCH_X86, CS_MODE_64, &handle) != CS_ERR_OK) {
+		free(insns);
+		return NULL;
+	}
+	insn = cs_malloc(handle);
+
+	while (size) {
+		if (cs_disasm_iter(handle, &code, &size, &next, insn)) {
+			insns[*count].address = insn->address;
+			insns[*count].id = insn->id;
+			insns[*count].size = insn->size;
+			(*count)++;
+		} else {
+			// skip an invalid byte
+			code++;
+			size--;
+			next++;
+		}
+	}
+
+	cs_free(insn, 1);
+	cs_close(&handle);
+
+	return insns;
+}
+
+static bool same_insns(const sweep_insn *a, size_t a_count,
+		const sweep_insn *b, size_t b_count)
+{
+	size_t i;
+
+	if (a_count != b_count)
+		return false;
+
+	for (i = 0; i < a_count; i++) {
+		if (a[i].address != b[i].address || a[i].id != b[i].id ||
+				a[i].size != b[i].size)
+			return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	size_t blob_mb = argc > 1 ? (size_t)atoi(argv[1]) : DEFAULT_BLOB_MB;
+	size_t size = blob_mb * 1024 * 1024;
+	unsigned int max_threads = (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int threads;
+	sweep_insn *reference, *insns;
+	size_t reference_count, count;
+	double start, elapsed, base;
+	uint8_t *blob;
+	cs_err err;
+	bool same;
+
+	if (argc > 2)
+		max_threads = (unsigned int)atoi(argv[2]);
+
+	blob = malloc(size);
+	if (!blob) {
+		printf("Failed to allocate %zu MB\n", blob_mb);
+		return 1;
+	}
+	make_blob(blob, size);
+
+	printf("%zu MB blob, 1 to %u threads\n", blob_mb, max_threads);
+
+	start = now();
+	reference = sweep_sequential(blob, size, BLOB_ADDRESS, &reference_count);
+	base = now() - start;
+	if (!reference) {
+		printf("Failed to disassemble sequentially\n");
+		return 1;
+	}
+	printf("sequential:  %8.1f MB/s, %5.2fx, %zu insns\n",
+			blob_mb / base, 1.0, reference_count);
+
+	for (threads = 1; ; threads *= 2) {
+		if (threads > max_threads)
+			threads = max_threads;
+
+		start = now();
+		err = sweep_disasm(CS_ARCH_X86, CS_MODE_64, blob, size, BLOB_ADDRESS,
+				threads, &insns, &count);
+		elapsed = now() - start;
+		if (err != CS_ERR_OK) {
+			printf("Failed on sweep_disasm() with error returned: %u\n", err);
+			return 1;
+		}
+
+		same = same_insns(insns, count, reference, reference_count);
+		printf("%3u threads: %8.1f MB/s, %5.2fx, %zu insns, %s\n",
+				threads, blob_mb / elapsed, base / elapsed, count,
+				same ? "same as sequential" : "MISMATCH");
+		sweep_free(insns);
+		if (!same)
+			return 1;
+
+		if (threads == max_threads)
+			break;
+	}
+
+	free(reference);
+	free(blob);
+
+	return 0;
+}
@@ -27,56 +27,207 @@
 // default SKIPDATA mnemonic
 #define SKIPDATA_MNEM ".byte"
 
-cs_err (*arch_init[MAX_ARCH])(cs_struct *) = { NULL };
-cs_err (*arch_option[MAX_ARCH]) (cs_struct *, cs_opt_type, size_t value) = { NULL };
-void (*arch_destroy[MAX_ARCH]) (cs_struct *) = { NULL };
-
-extern void ARM_enable(void);
-extern void AArch64_enable(void);
-extern void Mips_enable(void);
-extern void X86_enable(void);
-extern void PPC_enable(void);
-extern void Sparc_enable(void);
-extern void SystemZ_enable(void);
-extern void XCore_enable(void);
-
-static void archs_enable(void)
-{
-	static bool initialized = false;
-
-	if (initialized)
-		return;
-
+// modules of all archs are known at compile time, so their tables are
+// constant and cs_open() never writes global state
 #ifdef CAPSTONE_HAS_ARM
-	ARM_enable();
+extern cs_err ARM_global_init(cs_struct *ud);
+extern cs_err ARM_option(cs_struct *handle, cs_opt_type type, size_t value);
+extern void ARM_destroy(cs_struct *handle);
 #endif
 #ifdef CAPSTONE_HAS_ARM64
-	AArch64_enable();
+extern cs_err AArch64_global_init(cs_struct *ud);
+extern cs_err AArch64_option(cs_struct *handle, cs_opt_type type, size_t value);
+extern void AArch64_destroy(cs_struct *handle);
 #endif
 #ifdef CAPSTONE_HAS_MIPS
-	Mips_enable();
+extern cs_err Mips_global_init(cs_struct *ud);
+extern cs_err Mips_option(cs_struct *handle, cs_opt_type type, size_t value);
+extern void Mips_destroy(cs_struct *handle);
+#endif
+#ifdef CAPSTONE_HAS_X86
+extern cs_err X86_global_init(cs_struct *ud);
+extern cs_err X86_option(cs_struct *handle, cs_opt_type type, size_t value);
+extern void X86_destroy(cs_struct *handle);
 #endif
 #ifdef CAPSTONE_HAS_POWERPC
-	PPC_enable();
+extern cs_err PPC_global_init(cs_struct *ud);
+extern cs_err PPC_option(cs_struct *handle, cs_opt_type type, size_t value);
+extern void PPC_destroy(cs_struct *handle);
 #endif
 #ifdef CAPSTONE_HAS_SPARC
-	Sparc_enable();
+extern cs_err Sparc_global_init(cs_struct *ud);
+extern cs_err Sparc_option(cs_struct *handle, cs_opt_type type, size_t value);
+extern void Sparc_destroy(cs_struct *handle);
 #endif
 #ifdef CAPSTONE_HAS_SYSZ
-	SystemZ_enable();
+extern cs_err SystemZ_global_init(cs_struct *ud);
+extern cs_err SystemZ_option(cs_struct *handle, cs_opt_type type, size_t value);
+extern void SystemZ_destroy(cs_struct *handle);
+#endif
+#ifdef CAPSTONE_HAS_XCORE
+extern cs_err XCore_global_init(cs_struct *ud);
+extern cs_err XCore_option(cs_struct *handle, cs_opt_type type, size_t value);
+extern void XCore_destroy(cs_struct *handle);
+#endif
+
+// constructor initialization for all archs
+static cs_err (*const arch_init[MAX_ARCH])(cs_struct *) = {
+#ifdef CAPSTONE_HAS_ARM
+	ARM_global_init,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_ARM64
+	AArch64_global_init,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_MIPS
+	Mips_global_init,
+#else
+	NULL,
 #endif
 #ifdef CAPSTONE_HAS_X86
-	X86_enable();
+	X86_global_init,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_POWERPC
+	PPC_global_init,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_SPARC
+	Sparc_global_init,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_SYSZ
+	SystemZ_global_init,
+#else
+	NULL,
 #endif
 #ifdef CAPSTONE_HAS_XCORE
-	XCore_enable();
+	XCore_global_init,
+#else
+	NULL,
 #endif
+};
 
+// support cs_option() for all archs
+static cs_err (*const arch_option[MAX_ARCH]) (cs_struct *, cs_opt_type, size_t value) = {
+#ifdef CAPSTONE_HAS_ARM
+	ARM_option,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_ARM64
+	AArch64_option,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_MIPS
+	Mips_option,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_X86
+	X86_option,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_POWERPC
+	PPC_option,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_SPARC
+	Sparc_option,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_SYSZ
+	SystemZ_option,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_XCORE
+	XCore_option,
+#else
+	NULL,
+#endif
+};
 
-	initialized = true;
-}
+// deinitialized functions: to be called when cs_close() is called
+static void (*const arch_destroy[MAX_ARCH]) (cs_struct *) = {
+#ifdef CAPSTONE_HAS_ARM
+	ARM_destroy,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_ARM64
+	AArch64_destroy,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_MIPS
+	Mips_destroy,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_X86
+	X86_destroy,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_POWERPC
+	PPC_destroy,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_SPARC
+	Sparc_destroy,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_SYSZ
+	SystemZ_destroy,
+#else
+	NULL,
+#endif
+#ifdef CAPSTONE_HAS_XCORE
+	XCore_destroy,
+#else
+	NULL,
+#endif
+};
 
-unsigned int all_arch = 0;
+static const unsigned int all_arch = 0
+#ifdef CAPSTONE_HAS_ARM
+	| (1 << CS_ARCH_ARM)
+#endif
+#ifdef CAPSTONE_HAS_ARM64
+	| (1 << CS_ARCH_ARM64)
+#endif
+#ifdef CAPSTONE_HAS_MIPS
+	| (1 << CS_ARCH_MIPS)
+#endif
+#ifdef CAPSTONE_HAS_X86
+	| (1 << CS_ARCH_X86)
+#endif
+#ifdef CAPSTONE_HAS_POWERPC
+	| (1 << CS_ARCH_PPC)
+#endif
+#ifdef CAPSTONE_HAS_SPARC
+	| (1 << CS_ARCH_SPARC)
+#endif
+#ifdef CAPSTONE_HAS_SYSZ
+	| (1 << CS_ARCH_SYSZ)
+#endif
+#ifdef CAPSTONE_HAS_XCORE
+	| (1 << CS_ARCH_XCORE)
+#endif
+	;
 
 #ifdef CAPSTONE_USE_SYS_DYN_MEM
 #ifndef CAPSTONE_HAS_OSXKERNEL
@@ -112,8 +263,6 @@ cs_vsnprintf_t cs_vsnprintf = NULL;
 CAPSTONE_EXPORT
 unsigned int CAPSTONE_API cs_version(int *major, int *minor)
 {
-	archs_enable();
-
 	if (major != NULL && minor != NULL) {
 		*major = CS_API_MAJOR;
 		*minor = CS_API_MINOR;
@@ -125,8 +274,6 @@ unsigned int CAPSTONE_API cs_version(int *major, int *minor)
 CAPSTONE_EXPORT
 bool CAPSTONE_API cs_support(int query)
 {
-	archs_enable();
-
 	if (query == CS_ARCH_ALL)
 		return all_arch == ((1 << CS_ARCH_ARM) | (1 << CS_ARCH_ARM64) |
 				(1 << CS_ARCH_MIPS) | (1 << CS_ARCH_X86) |
@@ -211,8 +358,6 @@ cs_err CAPSTONE_API cs_open(cs_arch arch, cs_mode mode, csh *handle)
 		// with cs_option(CS_OPT_MEM)
 		return CS_ERR_MEMSETUP;
 
-	archs_enable();
-
 	if (arch < CS_ARCH_MAX && arch_init[arch]) {
 		ud = cs_mem_calloc(1, sizeof(*ud));
 		if (!ud) {
@@ -257,6 +402,8 @@ cs_err CAPSTONE_API cs_close(csh *handle)
 
 	ud = (struct cs_struct *)(*handle);
 
+	arch_destroy[ud->arch](ud);
+
 	if (ud->printer_info)
 		cs_mem_free(ud->printer_info);
 
@@ -361,8 +508,6 @@ CAPSTONE_EXPORT
 cs_err CAPSTONE_API cs_option(csh ud, cs_opt_type type, size_t value)
 {
 	struct cs_struct *handle;
-	archs_enable();
-
 	// cs_option() can be called with NULL handle just for CS_OPT_MEM
 	// This is supposed to be executed before all other APIs (even cs_open())
 	if (type == CS_OPT_MEM) {
@@ -516,7 +661,9 @@ size_t CAPSTONE_API cs_disasm(csh ud, const uint8_t *buffer, size_t size, uint64
 
 			mci.flat_insn->size = insn_size;
 
-			// map internal instruction opcode to public insn ID
+			// map internal instruction opcode to public insn ID. opcodes without
+			// mapping leave the ID untouched, so clear what a reused insn had.
+			insn_cache->id = 0;
 			handle->insn_id(handle, insn_cache, mci.Opcode);
 
 			handle->printer(&mci, &ss, handle->printer_info);
@@ -720,7 +867,9 @@ bool CAPSTONE_API cs_disasm_iter(csh ud, const uint8_t **code, size_t *size,
 
 		mci.flat_insn->size = insn_size;
 
-		// map internal instruction opcode to public insn ID
+		// map internal instruction opcode to public insn ID. opcodes without
+		// mapping leave the ID untouched, so clear what a reused insn had.
+		insn->id = 0;
 		handle->insn_id(handle, insn, mci.Opcode);
 
 		handle->printer(&mci, &ss, handle->printer_info);
@@ -768,6 +917,165 @@ bool CAPSTONE_API cs_disasm_iter(csh ud, const uint8_t **code, size_t *size,
 	return true;
 }
 
+// disassemble instructions into arrays provided by the caller
+CAPSTONE_EXPORT
+size_t CAPSTONE_API cs_disasm_into(csh ud, const uint8_t *code, size_t code_size,
+		uint64_t address, size_t count,
+		cs_insn *insn, size_t insn_count,
+		cs_detail *detail, size_t detail_count)
+{
+	struct cs_struct *handle;
+	uint16_t insn_size;
+	MCInst mci;
+	size_t c = 0;
+	size_t capacity;
+	size_t skipdata_bytes;
+	size_t next_offset;
+	uint64_t offset_org; // save all the original info of the buffer
+	size_t size_org;
+	const uint8_t *code_org;
+	cs_insn *insn_cache;
+	bool r;
+
+	handle = (struct cs_struct *)(uintptr_t)ud;
+	if (!handle) {
+		return 0;
+	}
+
+	handle->errnum = CS_ERR_OK;
+
+	// every instruction needs its own @detail when the option is on
+	capacity = insn_count;
+	if (handle->detail && detail_count < capacity)
+		capacity = detail_count;
+	if (count > 0 && count < capacity)
+		capacity = count;
+
+	// save the original offset for SKIPDATA
+	code_org = code;
+	offset_org = address;
+	size_org = code_size;
+
+	while (code_size > 0 && c < capacity) {
+		insn_cache = &insn[c];
+
+		MCInst_Init(&mci);
+		mci.csh = handle;
+
+		// relative branches need to know the address & size of current insn
+		mci.address = address;
+
+		insn_cache->detail = handle->detail ? &detail[c] : NULL;
+
+		// save all the information for non-detailed mode
+		mci.flat_insn = insn_cache;
+		mci.flat_insn->address = address;
+#ifdef CAPSTONE_DIET
+		// zero out mnemonic & op_str
+		mci.flat_insn->mnemonic[0] = '\0';
+		mci.flat_insn->op_str[0] = '\0';
+#endif
+
+		r = handle->disasm(ud, code, code_size, &mci, &insn_size, address, handle->getinsn_info);
+		if (r) {
+			SStream ss;
+			SStream_Init(&ss);
+
+			mci.flat_insn->size = insn_size;
+
+			// map internal instruction opcode to public insn ID. opcodes without
+			// mapping leave the ID untouched, so clear what a reused insn had.
+			insn_cache->id = 0;
+			handle->insn_id(handle, insn_cache, mci.Opcode);
+
+			handle->printer(&mci, &ss, handle->printer_info);
+
+			fill_insn(handle, insn_cache, ss.buffer, &mci, handle->post_printer, code);
+
+			next_offset = insn_size;
+		} else	{
+			// encounter a broken instruction
+
+			// if there is no request to skip data, or remaining data is too small,
+			// then bail out
+			if (!handle->skipdata || handle->skipdata_size > code_size)
+				break;
+
+			if (handle->skipdata_setup.callback) {
+				skipdata_bytes = handle->skipdata_setup.callback(code_org, size_org,
+						(size_t)(address - offset_org), handle->skipdata_setup.user_data);
+				if (skipdata_bytes > code_size)
+					// remaining data is not enough
+					break;
+
+				if (!skipdata_bytes)
+					// user requested not to skip data, so bail out
+					break;
+			} else
+				skipdata_bytes = handle->skipdata_size;
+
+			// we have to skip some amount of data, depending on arch & mode
+			insn_cache->id = 0;	// invalid ID for this "data" instruction
+			insn_cache->address = address;
+			insn_cache->size = (uint16_t)skipdata_bytes;
+			memcpy(insn_cache->bytes, code, skipdata_bytes);
+			strncpy(insn_cache->mnemonic, handle->skipdata_setup.mnemonic,
+					sizeof(insn_cache->mnemonic) - 1);
+			skipdata_opstr(insn_cache->op_str, code, skipdata_bytes);
+			insn_cache->detail = NULL;
+
+			next_offset = skipdata_bytes;
+		}
+
+		// one more instruction disassembled
+		c++;
+
+		code += next_offset;
+		code_size -= next_offset;
+		address += next_offset;
+	}
+
+	return c;
+}
+
+// decode an instruction only to get its size
+CAPSTONE_EXPORT
+size_t CAPSTONE_API cs_insn_length(csh ud, const uint8_t *code, size_t code_size,
+		uint64_t address)
+{
+	struct cs_struct *handle;
+	uint16_t insn_size;
+	cs_insn insn;
+	MCInst mci;
+	cs_opt_value detail;
+	bool r;
+
+	handle = (struct cs_struct *)(uintptr_t)ud;
+	if (!handle) {
+		return 0;
+	}
+
+	handle->errnum = CS_ERR_OK;
+
+	MCInst_Init(&mci);
+	mci.csh = handle;
+	mci.address = address;
+
+	// decoders still write basic information of the instruction here
+	insn.detail = NULL;
+	mci.flat_insn = &insn;
+	mci.flat_insn->address = address;
+
+	// decoders fill in details according to this flag, so turn it off while
+	// decoding as there is no buffer for them
+	detail = handle->detail;
+	handle->detail = CS_OPT_OFF;
+	r = handle->disasm(ud, code, code_size, &mci, &insn_size, address, handle->getinsn_info);
+	handle->detail = detail;
+
+	return r ? insn_size : 0;
+}
+
 // return friendly name of regiser in a string
 CAPSTONE_EXPORT
 const char * CAPSTONE_API cs_reg_name(csh ud, unsigned int reg)
@@ -58,17 +58,6 @@ struct cs_struct {
 
 #define MAX_ARCH 8
 
-// constructor initialization for all archs
-extern cs_err (*arch_init[MAX_ARCH]) (cs_struct *);
-
-// support cs_option() for all archs
-extern cs_err (*arch_option[MAX_ARCH]) (cs_struct*, cs_opt_type, size_t value);
-
-// deinitialized functions: to be called when cs_close() is called
-extern void (*arch_destroy[MAX_ARCH]) (cs_struct*);
-
-extern unsigned int all_arch;
-
 extern cs_malloc_t cs_mem_malloc;
 extern cs_calloc_t cs_mem_calloc;
 extern cs_realloc_t cs_mem_realloc;
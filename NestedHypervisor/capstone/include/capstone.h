@@ -526,6 +526,76 @@ bool CAPSTONE_API cs_disasm_iter(csh handle,
 	const uint8_t **code, size_t *size,
 	uint64_t *address, cs_insn *insn);
 
+/*
+ Disassemble binary code into arrays provided by the caller, given the code
+ buffer, size, address and number of instructions to be decoded.
+
+ Unlike cs_disasm(), this API never allocates memory. Instructions are stored
+ into @insn, and when CS_OPT_DETAIL is on, the detail of @insn[i] is stored
+ into @detail[i] and @insn[i].detail points to it. This makes it suitable for
+ hot paths and for environments where dynamic memory is expensive, such as OS
+ kernel, as the same arrays can be reused for every call.
+
+ Disassembling stops at the end of the input buffer, at an invalid instruction
+ (unless SKIPDATA mode is on), after @count instructions, or when either array
+ is full, whichever comes first. To continue after a full array, call this API
+ again with the code following the last instruction returned.
+
+ NOTE: memory of @insn and @detail is owned by the caller. Do not pass them to
+ cs_free().
+
+ @handle: handle returned by cs_open()
+ @code: buffer containing raw binary code to be disassembled
+ @code_size: size of above code
+ @address: address of the first insn in given raw code buffer
+ @count: number of instructions to be disassembled, or 0 to get all of them
+ @insn: array of instructions filled in by this API
+ @insn_count: number of elements in @insn
+ @detail: array of details filled in by this API. Ignored, and can be NULL,
+	when CS_OPT_DETAIL is off.
+ @detail_count: number of elements in @detail
+
+ @return: the number of successfully disassembled instructions,
+ or 0 if this function failed to disassemble the given code
+
+ On failure, call cs_errno() for error code.
+*/
+CAPSTONE_EXPORT
+size_t CAPSTONE_API cs_disasm_into(csh handle,
+	const uint8_t *code, size_t code_size,
+	uint64_t address,
+	size_t count,
+	cs_insn *insn, size_t insn_count,
+	cs_detail *detail, size_t detail_count);
+
+/*
+ Return the size of the first instruction in the buffer without formatting it.
+
+ This API only runs the decoder of the architecture. It neither maps the
+ instruction ID, runs the printer, fills in details nor allocates memory, so
+ it is much faster than cs_disasm_iter() when the size is all that is needed,
+ for example to find instruction boundaries.
+ A size returned by this API is the same as one cs_disasm() would return for
+ the same input and mode.
+
+ NOTE: SKIPDATA mode is not taken into account. Invalid input returns 0 even
+ when the option is on.
+
+ @handle: handle returned by cs_open()
+ @code: buffer containing raw binary code to be decoded
+ @code_size: size of above code
+ @address: address of the first insn in given raw code buffer
+
+ @return: size of the instruction in bytes, or 0 when the input does not
+ begin with a valid instruction.
+
+ On failure, call cs_errno() for error code.
+*/
+CAPSTONE_EXPORT
+size_t CAPSTONE_API cs_insn_length(csh handle,
+	const uint8_t *code, size_t code_size,
+	uint64_t address);
+
 /*
  Return friendly name of register in a string.
  Find the instruction id from header file of corresponding architecture (arm.h for ARM,
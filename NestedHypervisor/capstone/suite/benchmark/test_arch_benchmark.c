@@ -0,0 +1,389 @@
+/* Capstone Disassembler Engine */
+/* Throughput of every architecture, written as CSV for regression tracking */
+
+// Usage: test_arch_benchmark [MC directory] [instructions per run]
+//
+// Corpora of ARM, ARM64, MIPS, PPC, SPARC and SystemZ are the encodings listed
+// in suite/MC (../MC by default). suite/MC has nothing for X86 and XCore, so
+// code samples embedded below are used for them instead. Every corpus is first
+// decoded once and only the instructions this build of Capstone recognizes are
+// kept, so that each run measures decoding of valid code only.
+//
+// Each corpus is measured with cs_disasm() and cs_disasm_iter() with detail
+// off and on, and with cs_insn_length(), which decodes without running the
+// printer. One CSV row is printed to stdout per measurement.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../myinttypes.h"
+
+#include <capstone.h>
+
+// real-mode boot code: relocation of a MBR, BIOS teletype output & disk reads
+#define X86_CODE16 "\xfa\x31\xc0\x8e\xd8\x8e\xc0\x8e\xd0\xbc\x00\x7c\xfb\xfc" \
+	"\xbe\x00\x7c\xbf\x00\x06\xb9\x00\x01\xf3\xa5\xea\x1d\x06\x00\x00" \
+	"\xbe\xbe\x07\xb3\x04\x80\x3c\x80\x74\x0e\x80\x3c\x00\x75\x1c\x83\xc6\x10" \
+	"\xfe\xcb\x75\xef\xcd\x18\x8b\x14\x8b\x4c\x02\x8b\xee\x83\xc6\x10\xfe\xcb" \
+	"\x74\x1a\x80\x3c\x00\x74\xf4\xbe\x8b\x06\xac\x3c\x00\x74\x0b\x56\xbb\x07" \
+	"\x00\xb4\x0e\xcd\x10\x5e\xeb\xf0\xeb\xfe\xbf\x05\x00\xbb\x00\x7c\xb8\x01" \
+	"\x02\x57\xcd\x13\x5f\x73\x0c\x33\xc0\xcd\x13\x4f\x75\xed\xbe\xa3\x06\xeb" \
+	"\xd3\xbe\xc2\x06\xbf\xfe\x7d\x81\x3d\x55\xaa\x75\xc7\x8b\xf5\xea\x00\x7c" \
+	"\x00\x00\x8d\x4c\x32\x08\x01\xd8\x81\xc6\x34\x12\x00\x00\x05\x23\x01\x00" \
+	"\x00\x36\x8b\x84\x91\x23\x01\x00\x00\x41\x8d\x84\x39\x89\x67\x00\x00\x8d" \
+	"\x87\x89\x67\x00\x00\xb4\xc6"
+
+// prologues, bodies & epilogues of 32-bit Windows kernel & user mode functions
+#define X86_CODE32 "\x8b\xff\x55\x8b\xec\x83\xec\x10\x53\x56\x57\x64\xa1\x24\x01" \
+	"\x00\x00\x8d\x4c\x32\x08\x01\xcb\x81\xc1\xff\xff\x00\x00\x8b\x45\x08\x0f" \
+	"\xb6\x4d\x0c\x66\x89\x45\xfc\xf0\x0f\xc1\x08\xff\x75\x08\xe8\x00\x00\x00" \
+	"\x00\x5f\x5e\x5b\xc9\xc2\x08\x00\x53\x8b\xdc\x83\xec\x08\x83\xe4\xf0\x83" \
+	"\xc4\x04\x55\x8b\x6b\x04\x89\x6c\x24\x04\x8b\xec\x83\xec\x78\xa1\x90\xa3" \
+	"\x4b\x01\x33\xc5\x89\x45\xfc\x8b\x41\x04\x0f\x28\x05\x80\x30\x20\x01\x0f" \
+	"\x29\x45\xd0\x0f\x28\x05\x50\xab\x1e\x01\x89\x4d\x90\x89\x45\xb8\x0f\x29" \
+	"\x45\xe0\x56\x8b\x73\x08\x57\xc7\x06\x00\x00\x00\x00\xc7\x46\x04\x00\x00" \
+	"\x00\x00\x85\xc0\x0f\x84\xcb\x01\x00\x00\x33\xff\x8d\x64\x24\x00\x8b\x01" \
+	"\x8b\x0c\x07\x89\x4d\xbc\x85\xc9\x0f\x84\xa6\x01\x00\x00\x8b\x43\x0c\x0f" \
+	"\x10\x00\x0f\x29\x45\xd0\xf3\x0f\x10\x65\xd0\x8d\x55\xd0\xf3\x0f\x59\xca" \
+	"\x8b\x4d\xbc\xf3\x0f\x58\xc8\xf3\x0f\x11\x4d\xd0\x8b\x80\xf8\x00\x00\x00" \
+	"\xff\xd0\x0f\x2f\xd3\x0f\x83\x8e\x00\x00\x00\x8b\xce\xe8\xe8\xac\x86\xff" \
+	"\x84\xc0\x75\x53\x8a\x4c\x31\x01\xd1\xe9\x03\xf1\x3b\xf3\x72\xe0\xf7\xd8" \
+	"\x1b\xc0\x23\xc6\x8b\xe5\x5d\xc3"
+
+// prologues, bodies & epilogues of 64-bit Windows kernel functions
+#define X86_CODE64 "\x48\x89\x5c\x24\x08\x48\x89\x74\x24\x10\x57\x48\x83\xec\x20" \
+	"\x48\x8b\xf9\x8b\xf2\x48\x8b\xd9\x4c\x8b\xc1\x0f\xb6\xc2\x45\x33\xc9\x48" \
+	"\x8b\x05\xb8\x13\x00\x00\xff\x15\x22\x00\x00\x00\x0f\x1f\x44\x00\x00\x65" \
+	"\x48\x8b\x04\x25\x88\x01\x00\x00\x66\x44\x89\x44\x24\x30\xf0\x48\x0f\xb1" \
+	"\x0a\xf3\x48\xab\xc5\xf8\x77\x0f\x01\xd9\x0f\xae\x5c\x24\x04\x48\xb8\x88" \
+	"\x77\x66\x55\x44\x33\x22\x11\xc7\x44\x24\x20\x01\x00\x00\x00\x66\x0f\x6f" \
+	"\x05\x00\x10\x00\x00\xc4\xe2\x79\x18\x05\x00\x00\x00\x00\x4c\x8d\x05\x11" \
+	"\x22\x33\x00\x48\x63\xc8\x4a\x8b\x0c\xc1\x48\x85\xc9\x74\x12\x41\xb8\x01" \
+	"\x00\x00\x00\x8b\xd3\xe8\x40\x00\x00\x00\x84\xc0\x75\xe2\x49\x8b\x43\x18" \
+	"\x48\x3b\xc7\x0f\x87\x20\x01\x00\x00\x44\x0f\x20\xc0\x0f\x22\xc1\x0f\x32" \
+	"\x48\xc1\xe2\x20\x48\x0b\xc2\x48\x83\xc4\x20\x5f\xc3\xcc\xcc\xe9\x79\xff" \
+	"\xff\xff\xeb\xfe"
+
+#define XCORE_CODE "\xfe\x0f\xfe\x17\x13\x17\xc6\xfe\xec\x17\x97\xf8\xec\x4f\x1f" \
+	"\xfd\xec\x37\x07\xf2\x45\x5b\xf9\xfa\x02\x06\x1b\x10\x09\xfd\xec\xa7"
+
+#define EMBEDDED(code) (const uint8_t *)(code), sizeof(code) - 1
+
+struct platform {
+	cs_arch arch;
+	cs_mode mode;
+	const char *name;
+	// subdirectory of suite/MC and the first line its files must start with
+	const char *mc_dir;
+	const char *mc_header;
+	// used when there is no suite/MC directory for this platform
+	const uint8_t *code;
+	size_t size;
+	// bytes to skip over an encoding this build cannot decode
+	size_t skip;
+};
+
+static const struct platform platforms[] = {
+	{ CS_ARCH_X86, CS_MODE_16, "x86-16", NULL, NULL, EMBEDDED(X86_CODE16), 1 },
+	{ CS_ARCH_X86, CS_MODE_32, "x86-32", NULL, NULL, EMBEDDED(X86_CODE32), 1 },
+	{ CS_ARCH_X86, CS_MODE_64, "x86-64", NULL, NULL, EMBEDDED(X86_CODE64), 1 },
+	{ CS_ARCH_ARM, CS_MODE_ARM, "arm", "ARM",
+		"# CS_ARCH_ARM, CS_MODE_ARM,", NULL, 0, 4 },
+	{ CS_ARCH_ARM, CS_MODE_THUMB, "thumb", "ARM",
+		"# CS_ARCH_ARM, CS_MODE_THUMB,", NULL, 0, 2 },
+	{ CS_ARCH_ARM64, CS_MODE_ARM, "arm64", "AArch64",
+		"# CS_ARCH_ARM64, 0,", NULL, 0, 4 },
+	{ CS_ARCH_MIPS, CS_MODE_MIPS32 | CS_MODE_BIG_ENDIAN, "mips32be", "Mips",
+		"# CS_ARCH_MIPS, CS_MODE_MIPS32+CS_MODE_BIG_ENDIAN,", NULL, 0, 4 },
+	{ CS_ARCH_PPC, CS_MODE_BIG_ENDIAN, "ppc64be", "PowerPC",
+		"# CS_ARCH_PPC, CS_MODE_BIG_ENDIAN,", NULL, 0, 4 },
+	{ CS_ARCH_SPARC, CS_MODE_BIG_ENDIAN, "sparc", "Sparc",
+		"# CS_ARCH_SPARC, CS_MODE_BIG_ENDIAN,", NULL, 0, 4 },
+	{ CS_ARCH_SYSZ, CS_MODE_BIG_ENDIAN, "systemz", "SystemZ",
+		"# CS_ARCH_SYSZ, 0,", NULL, 0, 2 },
+	{ CS_ARCH_XCORE, CS_MODE_BIG_ENDIAN, "xcore", NULL, NULL,
+		EMBEDDED(XCORE_CODE), 2 },
+};
+
+struct corpus {
+	uint8_t *code;
+	size_t size;
+	size_t capacity;
+	// number of instructions in @code
+	size_t count;
+};
+
+static int corpus_append(struct corpus *corpus, const uint8_t *code, size_t size)
+{
+	if (corpus->size + size > corpus->capacity) {
+		size_t capacity = corpus->capacity ? corpus->capacity * 2 : 4096;
+		uint8_t *grown;
+
+		while (capacity < corpus->size + size)
+			capacity *= 2;
+		grown = realloc(corpus->code, capacity);
+		if (!grown)
+			return 0;
+		corpus->code = grown;
+		corpus->capacity = capacity;
+	}
+
+	memcpy(corpus->code + corpus->size, code, size);
+	corpus->size += size;
+	return 1;
+}
+
+// append the encodings of every line of a suite/MC file ("0x.., 0x.. = asm"),
+// if its first line is @header
+static int corpus_load_mc_file(struct corpus *corpus, const char *path,
+		const char *header)
+{
+	char line[512];
+	FILE *file;
+	int ok = 1;
+
+	file = fopen(path, "r");
+	if (!file)
+		return 1;
+
+	if (!fgets(line, sizeof(line), file) ||
+			strncmp(line, header, strlen(header))) {
+		fclose(file);
+		return 1;
+	}
+
+	while (ok && fgets(line, sizeof(line), file)) {
+		char *p = line;
+
+		while (*p == ' ' || *p == '\t')
+			p++;
+		while (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+			uint8_t byte = (uint8_t)strtoul(p, &p, 16);
+
+			if (!corpus_append(corpus, &byte, 1)) {
+				ok = 0;
+				break;
+			}
+			while (*p == ',' || *p == ' ')
+				p++;
+		}
+	}
+
+	fclose(file);
+	return ok;
+}
+
+static int corpus_load_mc(struct corpus *corpus, const char *mc_root,
+		const struct platform *platform)
+{
+	char path[1024];
+	struct dirent *entry;
+	DIR *dir;
+	int ok = 1;
+
+	snprintf(path, sizeof(path), "%s/%s", mc_root, platform->mc_dir);
+	dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return 0;
+	}
+
+	while (ok && (entry = readdir(dir))) {
+		size_t length = strlen(entry->d_name);
+
+		if (length < 3 || strcmp(entry->d_name + length - 3, ".cs"))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s/%s", mc_root, platform->mc_dir,
+				entry->d_name);
+		ok = corpus_load_mc_file(corpus, path, platform->mc_header);
+	}
+
+	closedir(dir);
+	return ok;
+}
+
+// build the corpus of @platform with only instructions @handle can decode
+static int corpus_build(struct corpus *corpus, csh handle, const char *mc_root,
+		const struct platform *platform)
+{
+	struct corpus raw = { NULL, 0, 0, 0 };
+	const uint8_t *code;
+	size_t size;
+	uint64_t address = 0x1000;
+	cs_insn *insn;
+	int ok = 1;
+
+	if (platform->mc_dir) {
+		if (!corpus_load_mc(&raw, mc_root, platform)) {
+			free(raw.code);
+			return 0;
+		}
+	} else if (!corpus_append(&raw, platform->code, platform->size)) {
+		return 0;
+	}
+
+	insn = cs_malloc(handle);
+	code = raw.code;
+	size = raw.size;
+	while (ok && size) {
+		if (cs_disasm_iter(handle, &code, &size, &address, insn)) {
+			ok = corpus_append(corpus, insn->bytes, insn->size);
+			corpus->count++;
+		} else {
+			size_t skip = size < platform->skip ? size : platform->skip;
+
+			code += skip;
+			size -= skip;
+			address += skip;
+		}
+	}
+	cs_free(insn, 1);
+
+	free(raw.code);
+	return ok && corpus->count;
+}
+
+static size_t bench_disasm(csh handle, const struct corpus *corpus, int rounds)
+{
+	cs_insn *insn;
+	size_t count, total = 0;
+	int i;
+
+	for (i = 0; i < rounds; i++) {
+		count = cs_disasm(handle, corpus->code, corpus->size, 0x1000, 0, &insn);
+		if (count)
+			cs_free(insn, count);
+		total += count;
+	}
+
+	return total;
+}
+
+static size_t bench_disasm_iter(csh handle, const struct corpus *corpus,
+		int rounds)
+{
+	cs_insn *insn;
+	const uint8_t *code;
+	size_t size, total = 0;
+	uint64_t address;
+	int i;
+
+	insn = cs_malloc(handle);
+	for (i = 0; i < rounds; i++) {
+		code = corpus->code;
+		size = corpus->size;
+		address = 0x1000;
+		while (cs_disasm_iter(handle, &code, &size, &address, insn))
+			total++;
+	}
+	cs_free(insn, 1);
+
+	return total;
+}
+
+static size_t bench_insn_length(csh handle, const struct corpus *corpus,
+		int rounds)
+{
+	size_t offset, length, total = 0;
+	int i;
+
+	for (i = 0; i < rounds; i++) {
+		for (offset = 0; offset < corpus->size; offset += length) {
+			length = cs_insn_length(handle, corpus->code + offset,
+					corpus->size - offset, 0x1000 + offset);
+			if (!length)
+				break;
+			total++;
+		}
+	}
+
+	return total;
+}
+
+typedef size_t (*bench_func)(csh handle, const struct corpus *corpus,
+		int rounds);
+
+static void measure(csh handle, const struct platform *platform,
+		const struct corpus *corpus, int rounds, const char *api,
+		bench_func bench, cs_opt_value detail, int printer)
+{
+	clock_t start;
+	double seconds;
+	size_t count;
+
+	cs_option(handle, CS_OPT_DETAIL, detail);
+
+	start = clock();
+	count = bench(handle, corpus, rounds);
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	if (seconds <= 0)
+		seconds = 1.0 / CLOCKS_PER_SEC;
+
+	printf("%s,%s,%s,%s,%zu,%zu,%.6f,%.0f,%.2f\n", platform->name, api,
+			detail == CS_OPT_ON ? "on" : "off", printer ? "on" : "off",
+			corpus->size, count, seconds, count / seconds,
+			count ? seconds * 1e9 / count : 0.0);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mc_root = argc > 1 ? argv[1] : "../MC";
+	long target = argc > 2 ? strtol(argv[2], NULL, 0) : 2000000;
+	size_t i;
+
+	if (target <= 0) {
+		fprintf(stderr, "Usage: %s [MC directory] [instructions per run]\n",
+				argv[0]);
+		return 1;
+	}
+
+	printf("platform,api,detail,printer,corpus_bytes,instructions,seconds,"
+			"insns_per_sec,ns_per_insn\n");
+
+	for (i = 0; i < sizeof(platforms) / sizeof(platforms[0]); i++) {
+		const struct platform *platform = &platforms[i];
+		struct corpus corpus = { NULL, 0, 0, 0 };
+		csh handle;
+		int rounds;
+		cs_err err;
+
+		if (!cs_support(platform->arch))
+			continue;
+
+		err = cs_open(platform->arch, platform->mode, &handle);
+		if (err) {
+			fprintf(stderr, "%s: cs_open() failed with error %u\n",
+					platform->name, err);
+			continue;
+		}
+
+		if (!corpus_build(&corpus, handle, mc_root, platform)) {
+			fprintf(stderr, "%s: no corpus to measure\n", platform->name);
+			free(corpus.code);
+			cs_close(&handle);
+			continue;
+		}
+
+		// repeat the corpus until about @target instructions are decoded
+		rounds = (int)((target + corpus.count - 1) / corpus.count);
+
+		measure(handle, platform, &corpus, rounds, "cs_disasm",
+				bench_disasm, CS_OPT_OFF, 1);
+		measure(handle, platform, &corpus, rounds, "cs_disasm",
+				bench_disasm, CS_OPT_ON, 1);
+		measure(handle, platform, &corpus, rounds, "cs_disasm_iter",
+				bench_disasm_iter, CS_OPT_OFF, 1);
+		measure(handle, platform, &corpus, rounds, "cs_disasm_iter",
+				bench_disasm_iter, CS_OPT_ON, 1);
+		measure(handle, platform, &corpus, rounds, "cs_insn_length",
+				bench_insn_length, CS_OPT_OFF, 0);
+
+		free(corpus.code);
+		cs_close(&handle);
+	}
+
+	return 0;
+}
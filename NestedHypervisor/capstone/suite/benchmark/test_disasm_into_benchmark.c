@@ -0,0 +1,138 @@
+/* Capstone Disassembler Engine */
+/* Compares throughput of cs_disasm(), cs_disasm_iter() & cs_disasm_into() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../myinttypes.h"
+
+#include <capstone.h>
+
+#define X86_CODE32 "\x55\x8b\xec\x83\xec\x10\x53\x56\x57\x8b\x7d\x08\x85\xff\x74\x5a" \
+	"\x8b\x47\x04\x8d\x4d\xf0\x51\x50\xe8\x10\x20\x00\x00\x83\xc4\x08\x85\xc0\x74\x3e" \
+	"\x8b\x0c\x07\x89\x4d\xbc\x85\xc9\x66\x89\x44\x24\x02\xc7\x46\x08\x00\x00\x00\x00" \
+	"\x8b\x80\xf8\x00\x00\x00\xff\xd0\x8a\x4c\x31\x01\xd1\xe9\x03\xf1\x3b\xf3\x72\xe0" \
+	"\xa1\x90\xa3\x4b\x01\x33\xc5\x89\x45\xfc\x8d\x64\x24\x00\xf7\xd8\x1b\xc0\x23\xc6" \
+	"\x5f\x5e\x5b\x8b\xe5\x5d\xc2\x08\x00"
+
+// number of times the code is disassembled by each API
+#define ROUNDS 200000
+
+// size of arrays given to cs_disasm_into()
+#define ARRAY_COUNT 64
+
+static const uint8_t *code_org = (const uint8_t *)X86_CODE32;
+static const size_t size_org = sizeof(X86_CODE32) - 1;
+
+static void report(const char *name, clock_t start, size_t bytes)
+{
+	double time_used = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("%-16s %10.0f bytes/sec (%.3f sec)\n", name, bytes / time_used, time_used);
+}
+
+static size_t bench_disasm(csh handle)
+{
+	cs_insn *insn;
+	size_t count, bytes = 0;
+	int i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		count = cs_disasm(handle, code_org, size_org, 0x1000, 0, &insn);
+		if (count) {
+			bytes += (size_t)(insn[count - 1].address + insn[count - 1].size - 0x1000);
+			cs_free(insn, count);
+		}
+	}
+
+	return bytes;
+}
+
+static size_t bench_disasm_iter(csh handle)
+{
+	cs_insn *insn;
+	const uint8_t *code;
+	size_t size, bytes = 0;
+	uint64_t address;
+	int i;
+
+	insn = cs_malloc(handle);
+	for (i = 0; i < ROUNDS; i++) {
+		code = code_org;
+		size = size_org;
+		address = 0x1000;
+		while (cs_disasm_iter(handle, &code, &size, &address, insn))
+			;
+		bytes += size_org - size;
+	}
+	cs_free(insn, 1);
+
+	return bytes;
+}
+
+static size_t bench_disasm_into(csh handle)
+{
+	static cs_insn insn[ARRAY_COUNT];
+	static cs_detail detail[ARRAY_COUNT];
+	const uint8_t *code;
+	size_t size, count, consumed, bytes = 0;
+	uint64_t address;
+	int i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		code = code_org;
+		size = size_org;
+		address = 0x1000;
+		// refill the same arrays until the whole code is consumed
+		while ((count = cs_disasm_into(handle, code, size, address, 0,
+						insn, ARRAY_COUNT, detail, ARRAY_COUNT))) {
+			consumed = (size_t)(insn[count - 1].address + insn[count - 1].size - address);
+			code += consumed;
+			size -= consumed;
+			address += consumed;
+		}
+		bytes += size_org - size;
+	}
+
+	return bytes;
+}
+
+static void test(cs_opt_value detail)
+{
+	csh handle;
+	clock_t start;
+	size_t bytes;
+	cs_err err;
+
+	err = cs_open(CS_ARCH_X86, CS_MODE_32, &handle);
+	if (err) {
+		printf("Failed on cs_open() with error returned: %u\n", err);
+		return;
+	}
+	cs_option(handle, CS_OPT_DETAIL, detail);
+
+	printf("CS_OPT_DETAIL %s:\n", detail == CS_OPT_ON ? "on" : "off");
+
+	start = clock();
+	bytes = bench_disasm(handle);
+	report("cs_disasm", start, bytes);
+
+	start = clock();
+	bytes = bench_disasm_iter(handle);
+	report("cs_disasm_iter", start, bytes);
+
+	start = clock();
+	bytes = bench_disasm_into(handle);
+	report("cs_disasm_into", start, bytes);
+
+	cs_close(&handle);
+}
+
+int main()
+{
+	test(CS_OPT_OFF);
+	test(CS_OPT_ON);
+
+	return 0;
+}
@@ -86,10 +86,30 @@ static void test()
 		}
 	}
 	cs_free(insn, 1);
-	cs_close(&handle);
 	end = clock();
 	timeUsed = (double)(end - start) / CLOCKS_PER_SEC;
 	printf("time used:%f\n", timeUsed);
+	printf("cs_disasm_iter: %.0f insns/sec\n", i / timeUsed);
+
+	// decode the same instructions only for their sizes
+	start = clock();
+	for (i = 0; i < maxcount;) {
+		size_t length;
+		code = (const uint8_t *)X86_CODE32;
+		address = 0x1000;
+		size = sizeof(X86_CODE32) - 1;
+		while ((length = cs_insn_length(handle, code, size, address))) {
+			code += length;
+			size -= length;
+			address += length;
+			i++;
+		}
+	}
+	end = clock();
+	timeUsed = (double)(end - start) / CLOCKS_PER_SEC;
+	printf("cs_insn_length: %.0f insns/sec\n", i / timeUsed);
+
+	cs_close(&handle);
 }
 
 int main()
@@ -0,0 +1,215 @@
+/* Capstone Disassembly Engine */
+/* Regression test for opening and using handles from many threads at once */
+
+// Instruction mapping caches used to be built lazily on the first lookup and
+// the architecture tables were filled in by the first cs_open(), so threads
+// opening handles at the same time could race on both. This test starts every
+// thread at once, has each of them open, use and close handles of several
+// architectures in a loop, and compares a digest of everything they decoded
+// with the one produced by a single thread afterwards.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <capstone.h>
+
+#define THREAD_COUNT 8
+#define ITERATIONS 20
+
+// The number of bytes of pseudo-random code each handle decodes
+#define RANDOM_CODE_SIZE (16 * 1024)
+
+struct platform {
+	cs_arch arch;
+	cs_mode mode;
+	const char *name;
+};
+
+static const struct platform kPlatforms[] = {
+	{ CS_ARCH_X86, CS_MODE_64, "X86-64" },
+	{ CS_ARCH_X86, CS_MODE_32, "X86-32" },
+	{ CS_ARCH_ARM, CS_MODE_ARM, "ARM" },
+	{ CS_ARCH_ARM, CS_MODE_THUMB, "Thumb" },
+	{ CS_ARCH_ARM64, CS_MODE_ARM, "ARM-64" },
+	{ CS_ARCH_MIPS, CS_MODE_MIPS32 | CS_MODE_BIG_ENDIAN, "MIPS-32 (BE)" },
+	{ CS_ARCH_PPC, CS_MODE_BIG_ENDIAN, "PPC-64" },
+	{ CS_ARCH_SPARC, CS_MODE_BIG_ENDIAN, "Sparc" },
+	{ CS_ARCH_SYSZ, CS_MODE_BIG_ENDIAN, "SystemZ" },
+	{ CS_ARCH_XCORE, CS_MODE_BIG_ENDIAN, "XCore" },
+};
+
+#define PLATFORM_COUNT (sizeof(kPlatforms) / sizeof(kPlatforms[0]))
+
+struct worker {
+	pthread_t thread;
+	int index;
+	int failed;
+	uint64_t digests[PLATFORM_COUNT];
+};
+
+static uint8_t *g_code;
+static pthread_mutex_t g_start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_start_cond = PTHREAD_COND_INITIALIZER;
+static int g_started;
+
+// FNV-1a over the fields a caller would look at
+static uint64_t digest_bytes(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static uint64_t digest_insn(csh handle, uint64_t hash, const cs_insn *insn)
+{
+	const cs_detail *detail = insn->detail;
+
+	hash = digest_bytes(hash, &insn->id, sizeof(insn->id));
+	hash = digest_bytes(hash, &insn->address, sizeof(insn->address));
+	hash = digest_bytes(hash, &insn->size, sizeof(insn->size));
+	hash = digest_bytes(hash, insn->mnemonic, strlen(insn->mnemonic));
+	hash = digest_bytes(hash, insn->op_str, strlen(insn->op_str));
+
+	// names come from the mapping tables whose caches are under test
+	if (cs_insn_name(handle, insn->id))
+		hash = digest_bytes(hash, cs_insn_name(handle, insn->id),
+				strlen(cs_insn_name(handle, insn->id)));
+	if (detail) {
+		hash = digest_bytes(hash, detail->regs_read, detail->regs_read_count);
+		hash = digest_bytes(hash, detail->regs_write, detail->regs_write_count);
+		hash = digest_bytes(hash, detail->groups, detail->groups_count);
+	}
+
+	return hash;
+}
+
+// decode the whole buffer with a freshly opened handle and return its digest,
+// or 0 if the handle could not be opened
+static uint64_t digest_platform(const struct platform *platform)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const uint8_t *code = g_code;
+	size_t size = RANDOM_CODE_SIZE;
+	uint64_t address = 0x1000;
+	cs_insn *insn;
+	csh handle;
+
+	if (cs_open(platform->arch, platform->mode, &handle) != CS_ERR_OK)
+		return 0;
+	cs_option(handle, CS_OPT_DETAIL, CS_OPT_ON);
+	cs_option(handle, CS_OPT_SKIPDATA, CS_OPT_ON);
+
+	insn = cs_malloc(handle);
+	while (cs_disasm_iter(handle, &code, &size, &address, insn))
+		hash = digest_insn(handle, hash, insn);
+	cs_free(insn, 1);
+
+	cs_close(&handle);
+	return hash;
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *worker = arg;
+	int i;
+	size_t p;
+
+	// hold every thread back until all of them exist, so that the first
+	// cs_open() calls in this process overlap as much as possible
+	pthread_mutex_lock(&g_start_lock);
+	while (!g_started)
+		pthread_cond_wait(&g_start_cond, &g_start_lock);
+	pthread_mutex_unlock(&g_start_lock);
+
+	for (i = 0; i < ITERATIONS; i++) {
+		for (p = 0; p < PLATFORM_COUNT; p++) {
+			// walk the platforms in a different order in each thread
+			size_t index = (p + worker->index) % PLATFORM_COUNT;
+			uint64_t hash = digest_platform(&kPlatforms[index]);
+
+			if (i == 0)
+				worker->digests[index] = hash;
+			else if (worker->digests[index] != hash)
+				worker->failed = 1;
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct worker workers[THREAD_COUNT];
+	uint32_t state = 0x12345678;
+	int failed = 0;
+	size_t i, p;
+
+	// A deterministic linear congruential generator keeps failures
+	// reproducible
+	g_code = malloc(RANDOM_CODE_SIZE);
+	if (!g_code) {
+		printf("ERROR: malloc() failed\n");
+		return 1;
+	}
+	for (i = 0; i < RANDOM_CODE_SIZE; i++) {
+		state = state * 1103515245 + 12345;
+		g_code[i] = (uint8_t)(state >> 16);
+	}
+
+	memset(workers, 0, sizeof(workers));
+	for (i = 0; i < THREAD_COUNT; i++) {
+		workers[i].index = (int)i;
+		if (pthread_create(&workers[i].thread, NULL, worker_main,
+					&workers[i])) {
+			printf("ERROR: pthread_create() failed\n");
+			return 1;
+		}
+	}
+
+	pthread_mutex_lock(&g_start_lock);
+	g_started = 1;
+	pthread_cond_broadcast(&g_start_cond);
+	pthread_mutex_unlock(&g_start_lock);
+
+	for (i = 0; i < THREAD_COUNT; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	// only now compute the reference, with no other thread running
+	for (p = 0; p < PLATFORM_COUNT; p++) {
+		uint64_t reference;
+		size_t mismatches = 0;
+
+		if (!cs_support(kPlatforms[p].arch))
+			continue;
+
+		reference = digest_platform(&kPlatforms[p]);
+		for (i = 0; i < THREAD_COUNT; i++) {
+			if (workers[i].digests[p] != reference)
+				mismatches++;
+		}
+
+		printf("%s: %d threads, %zu mismatches\n", kPlatforms[p].name,
+				THREAD_COUNT, mismatches);
+		failed |= reference == 0 || mismatches != 0;
+	}
+
+	for (i = 0; i < THREAD_COUNT; i++) {
+		if (workers[i].failed) {
+			printf("thread %zu: digests changed between iterations\n", i);
+			failed = 1;
+		}
+	}
+
+	free(g_code);
+
+	printf(failed ? "FAILED\n" : "PASSED\n");
+	return failed;
+}
@@ -0,0 +1,127 @@
+/* Capstone Disassembly Engine */
+/* Regression test for instruction lengths decoded with a reused handle */
+
+// DdiMon decodes instructions of hook targets with a single handle that has
+// details turned off and a buffer allocated once with cs_malloc(), and gets
+// sizes with cs_insn_length(). This test makes sure both paths return the same
+// lengths as opening a fresh handle with details on and calling cs_disasm() for
+// each instruction.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <capstone.h>
+
+// Function prologues and bodies commonly seen in ntoskrnl exports
+static const uint8_t kKernelCode64[] =
+	"\x48\x89\x5c\x24\x08\x48\x89\x74\x24\x10\x57\x48\x83\xec\x20"
+	"\x48\x8b\xf9\x8b\xf2\x48\x8b\xd9\x4c\x8b\xc1\x0f\xb6\xc2\x45\x33\xc9"
+	"\x48\x8b\x05\xb8\x13\x00\x00\xff\x15\x22\x00\x00\x00\x0f\x1f\x44\x00\x00"
+	"\x65\x48\x8b\x04\x25\x88\x01\x00\x00\x66\x44\x89\x44\x24\x30"
+	"\xf0\x48\x0f\xb1\x0a\xf3\x48\xab\xc5\xf8\x77\x0f\x01\xd9\x0f\xae\x5c\x24\x04"
+	"\x48\xb8\x88\x77\x66\x55\x44\x33\x22\x11\xc7\x44\x24\x20\x01\x00\x00\x00"
+	"\x66\x0f\x6f\x05\x00\x10\x00\x00\xc4\xe2\x79\x18\x05\x00\x00\x00\x00"
+	"\x48\x83\xc4\x20\x5f\xc3\xcc\xcc\xe9\x79\xff\xff\xff\xeb\xfe";
+
+static const uint8_t kKernelCode32[] =
+	"\x8b\xff\x55\x8b\xec\x83\xec\x10\x53\x56\x57\x64\xa1\x24\x01\x00\x00"
+	"\x8d\x4c\x32\x08\x01\xcb\x81\xc1\xff\xff\x00\x00\x8b\x45\x08\x0f\xb6\x4d\x0c"
+	"\x66\x89\x45\xfc\xf0\x0f\xc1\x08\xff\x75\x08\xe8\x00\x00\x00\x00"
+	"\x5f\x5e\x5b\xc9\xc2\x08\x00";
+
+// The number of bytes of pseudo-random code to compare
+#define RANDOM_CODE_SIZE (256 * 1024)
+
+static int compare(cs_mode mode, const uint8_t *code, size_t size,
+		const char *name)
+{
+	csh reused;
+	cs_insn *insn;
+	size_t offset, compared = 0, mismatches = 0;
+
+	if (cs_open(CS_ARCH_X86, mode, &reused) != CS_ERR_OK) {
+		printf("ERROR: cs_open() failed\n");
+		return 1;
+	}
+	cs_option(reused, CS_OPT_DETAIL, CS_OPT_OFF);
+	insn = cs_malloc(reused);
+
+	// Sweep every offset so that both paths see the same starting bytes
+	for (offset = 0; offset < size; offset++) {
+		const uint8_t *iter_code = code + offset;
+		size_t iter_size = size - offset;
+		uint64_t iter_address = 0x1000 + offset;
+		size_t iter_length = 0, reference_length = 0, length_only;
+		cs_insn *reference;
+		csh fresh;
+		size_t count;
+
+		if (iter_size > 15)
+			iter_size = 15;
+		if (cs_disasm_iter(reused, &iter_code, &iter_size, &iter_address, insn))
+			iter_length = insn->size;
+		length_only = cs_insn_length(reused, code + offset,
+				(size - offset > 15) ? 15 : size - offset, 0x1000 + offset);
+
+		if (cs_open(CS_ARCH_X86, mode, &fresh) != CS_ERR_OK) {
+			printf("ERROR: cs_open() failed\n");
+			return 1;
+		}
+		cs_option(fresh, CS_OPT_DETAIL, CS_OPT_ON);
+		count = cs_disasm(fresh, code + offset,
+				(size - offset > 15) ? 15 : size - offset,
+				0x1000 + offset, 1, &reference);
+		if (count) {
+			reference_length = reference[0].size;
+			cs_free(reference, count);
+		}
+		cs_close(&fresh);
+
+		compared++;
+		if (iter_length != reference_length ||
+				length_only != reference_length) {
+			if (mismatches++ < 10)
+				printf("%s: length mismatch at offset 0x%zx: %zu, %zu != %zu\n",
+						name, offset, iter_length, length_only,
+						reference_length);
+		}
+	}
+
+	cs_free(insn, 1);
+	cs_close(&reused);
+	printf("%s: %zu offsets compared, %zu mismatches\n", name, compared,
+			mismatches);
+	return mismatches != 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t *random_code;
+	uint32_t state = 0x12345678;
+	size_t i;
+	int failed = 0;
+
+	failed |= compare(CS_MODE_64, kKernelCode64, sizeof(kKernelCode64) - 1,
+			"x64 kernel code");
+	failed |= compare(CS_MODE_32, kKernelCode32, sizeof(kKernelCode32) - 1,
+			"x86 kernel code");
+
+	// A deterministic linear congruential generator keeps failures
+	// reproducible
+	random_code = malloc(RANDOM_CODE_SIZE);
+	if (!random_code) {
+		printf("ERROR: malloc() failed\n");
+		return 1;
+	}
+	for (i = 0; i < RANDOM_CODE_SIZE; i++) {
+		state = state * 1103515245 + 12345;
+		random_code[i] = (uint8_t)(state >> 16);
+	}
+	failed |= compare(CS_MODE_64, random_code, RANDOM_CODE_SIZE, "x64 random");
+	failed |= compare(CS_MODE_32, random_code, RANDOM_CODE_SIZE, "x86 random");
+	free(random_code);
+
+	printf(failed ? "FAILED\n" : "PASSED\n");
+	return failed;
+}
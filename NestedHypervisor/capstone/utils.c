@@ -11,13 +11,16 @@
 #include "utils.h"
 
 // create a cache for fast id lookup
-static unsigned short *make_id2insn(insn_map *insns, unsigned int size)
+unsigned short *insn_cache_build(insn_map *insns, unsigned int size)
 {
 	// NOTE: assume that the max id is always put at the end of insns array
 	unsigned short max_id = insns[size - 1].id;
 	unsigned short i;
 
-	unsigned short *cache = (unsigned short *)cs_mem_malloc(sizeof(*cache) * (max_id + 1));
+	// ids missing in @insns must map to 0, meaning "not found"
+	unsigned short *cache = (unsigned short *)cs_mem_calloc(max_id + 1, sizeof(*cache));
+	if (!cache)
+		return NULL;
 
 	for (i = 1; i < size; i++)
 		cache[insns[i].id] = i;
@@ -25,17 +28,15 @@ static unsigned short *make_id2insn(insn_map *insns, unsigned int size)
 	return cache;
 }
 
-// look for @id in @insns, given its size in @max. first time call will update @cache.
+// look for @id in @insns, given its size in @max, with @cache built by
+// insn_cache_build(). it only reads memory, so is safe to call concurrently.
 // return 0 if not found
-unsigned short insn_find(insn_map *insns, unsigned int max, unsigned int id, unsigned short **cache)
+unsigned short insn_find(insn_map *insns, unsigned int max, unsigned int id, const unsigned short *cache)
 {
 	if (id > insns[max - 1].id)
 		return 0;
 
-	if (*cache == NULL)
-		*cache = make_id2insn(insns, max);
-
-	return (*cache)[id];
+	return cache[id];
 }
 
 int name2id(name_map* map, int max, const char *name)
@@ -24,9 +24,13 @@ typedef struct insn_map {
 #endif
 } insn_map;
 
-// look for @id in @m, given its size in @max. first time call will update @cache.
+// create a cache mapping ids of @m, given its size in @size, to their indexes.
+// return NULL if memory is insufficient
+unsigned short *insn_cache_build(insn_map *m, unsigned int size);
+
+// look for @id in @m, given its size in @max, with @cache from insn_cache_build().
 // return 0 if not found
-unsigned short insn_find(insn_map *m, unsigned int max, unsigned int id, unsigned short **cache);
+unsigned short insn_find(insn_map *m, unsigned int max, unsigned int id, const unsigned short *cache);
 
 // map id to string
 typedef struct name_map {
@@ -10,13 +10,19 @@
 #define POOL_NX_OPTIN 1
 #endif
 #include "driver.h"
+#include <intrin.h>
+#include <wdmsec.h>
 #include "common.h"
+#include "exit_trace.h"
+#include "flight_recorder.h"
 #include "global_object.h"
 #include "hotplug_callback.h"
 #include "log.h"
 #include "power_callback.h"
+#include "shared_statistics.h"
 #include "util.h"
 #include "vm.h"
+#include "vmm_statistics.h"
 
 #ifndef HYPERPLATFORM_PERFORMANCE_ENABLE_PERFCOUNTER
 #define HYPERPLATFORM_PERFORMANCE_ENABLE_PERFCOUNTER 1
@@ -51,11 +57,25 @@ extern "C" {
 // constants and macros
 //
 
+// A class of the control device, which lets an administrator override its
+// security descriptor in the registry
+static const GUID kDriverpControlDeviceClassGuid = {
+    0x3f9d2c41,
+    0x7b6e,
+    0x4a58,
+    {0x8e, 0x13, 0x5d, 0xa2, 0x96, 0x0c, 0xe4, 0x7b}};
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // types
 //
 
+// Per-handle state of the control device, stored in FileObject->FsContext
+struct DriverpFileContext {
+  FAST_MUTEX mutex;                 // Serializes mapping and unmapping
+  SharedStatisticsMapping mapping;  // Made by DriverpMapStatistics()
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // prototypes
@@ -65,11 +85,42 @@ DRIVER_INITIALIZE DriverEntry;
 
 static DRIVER_UNLOAD DriverpDriverUnload;
 
+_Dispatch_type_(IRP_MJ_CREATE) _Dispatch_type_(
+    IRP_MJ_CLOSE) static DRIVER_DISPATCH DriverpDispatchCreateClose;
+
+_Dispatch_type_(IRP_MJ_CLEANUP) static DRIVER_DISPATCH DriverpDispatchCleanup;
+
+_Dispatch_type_(
+    IRP_MJ_DEVICE_CONTROL) static DRIVER_DISPATCH DriverpDispatchDeviceControl;
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static NTSTATUS
+    DriverpCreateControlDevice(_In_ PDRIVER_OBJECT driver_object);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static void DriverpDeleteControlDevice(
+    _In_ PDRIVER_OBJECT driver_object);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static NTSTATUS
+    DriverpQueryVmExitStatistics(_Inout_ PIRP irp,
+                                 _In_ PIO_STACK_LOCATION stack);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static NTSTATUS
+    DriverpMapStatistics(_Inout_ PIRP irp, _In_ PIO_STACK_LOCATION stack);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static void DriverpMeasureCpuidRoundTrip();
+
 _IRQL_requires_max_(PASSIVE_LEVEL) bool DriverpIsSuppoetedOS();
 
 #if defined(ALLOC_PRAGMA)
 #pragma alloc_text(INIT, DriverEntry)
 #pragma alloc_text(PAGE, DriverpDriverUnload)
+#pragma alloc_text(PAGE, DriverpDispatchCreateClose)
+#pragma alloc_text(PAGE, DriverpDispatchCleanup)
+#pragma alloc_text(PAGE, DriverpDispatchDeviceControl)
+#pragma alloc_text(INIT, DriverpCreateControlDevice)
+#pragma alloc_text(PAGE, DriverpDeleteControlDevice)
+#pragma alloc_text(PAGE, DriverpQueryVmExitStatistics)
+#pragma alloc_text(PAGE, DriverpMapStatistics)
+#pragma alloc_text(INIT, DriverpMeasureCpuidRoundTrip)
 #pragma alloc_text(INIT, DriverpIsSuppoetedOS)
 #endif
 
@@ -86,7 +137,6 @@ _IRQL_requires_max_(PASSIVE_LEVEL) bool DriverpIsSuppoetedOS();
 // A driver entry point
 _Use_decl_annotations_ NTSTATUS DriverEntry(PDRIVER_OBJECT driver_object,
                                             PUNICODE_STRING registry_path) {
-  UNREFERENCED_PARAMETER(registry_path);
   PAGED_CODE();
 
   static const wchar_t kLogFilePath[] = L"\\SystemRoot\\HyperPlatform.log";
@@ -131,9 +181,42 @@ _Use_decl_annotations_ NTSTATUS DriverEntry(PDRIVER_OBJECT driver_object,
     return status;
   }
 
+  // Initialize the VM-exit flight recorder
+  status = FlightRecorderInitialization(registry_path);
+  if (!NT_SUCCESS(status)) {
+    PerfTermination();
+    GlobalObjectTermination();
+    LogTermination();
+    return status;
+  }
+
+  // Initialize the VM-exit trace recorder
+  status = ExitTraceInitialization(registry_path);
+  if (!NT_SUCCESS(status)) {
+    FlightRecorderTermination();
+    PerfTermination();
+    GlobalObjectTermination();
+    LogTermination();
+    return status;
+  }
+
+  // Initialize statistics shared with user mode
+  status = SharedStatisticsInitialization();
+  if (!NT_SUCCESS(status)) {
+    ExitTraceTermination();
+    FlightRecorderTermination();
+    PerfTermination();
+    GlobalObjectTermination();
+    LogTermination();
+    return status;
+  }
+
   // Initialize utility functions
   status = UtilInitialization(driver_object);
   if (!NT_SUCCESS(status)) {
+    SharedStatisticsTermination();
+    ExitTraceTermination();
+    FlightRecorderTermination();
     PerfTermination();
     GlobalObjectTermination();
     LogTermination();
@@ -144,6 +227,9 @@ _Use_decl_annotations_ NTSTATUS DriverEntry(PDRIVER_OBJECT driver_object,
   status = PowerCallbackInitialization();
   if (!NT_SUCCESS(status)) {
     UtilTermination();
+    SharedStatisticsTermination();
+    ExitTraceTermination();
+    FlightRecorderTermination();
     PerfTermination();
     GlobalObjectTermination();
     LogTermination();
@@ -155,6 +241,9 @@ _Use_decl_annotations_ NTSTATUS DriverEntry(PDRIVER_OBJECT driver_object,
   if (!NT_SUCCESS(status)) {
     PowerCallbackTermination();
     UtilTermination();
+    SharedStatisticsTermination();
+    ExitTraceTermination();
+    FlightRecorderTermination();
     PerfTermination();
     GlobalObjectTermination();
     LogTermination();
@@ -167,6 +256,25 @@ _Use_decl_annotations_ NTSTATUS DriverEntry(PDRIVER_OBJECT driver_object,
     HotplugCallbackTermination();
     PowerCallbackTermination();
     UtilTermination();
+    SharedStatisticsTermination();
+    ExitTraceTermination();
+    FlightRecorderTermination();
+    PerfTermination();
+    GlobalObjectTermination();
+    LogTermination();
+    return status;
+  }
+
+  // Create a device to let user-mode query statistics
+  status = DriverpCreateControlDevice(driver_object);
+  if (!NT_SUCCESS(status)) {
+    VmTermination();
+    HotplugCallbackTermination();
+    PowerCallbackTermination();
+    UtilTermination();
+    SharedStatisticsTermination();
+    ExitTraceTermination();
+    FlightRecorderTermination();
     PerfTermination();
     GlobalObjectTermination();
     LogTermination();
@@ -179,9 +287,35 @@ _Use_decl_annotations_ NTSTATUS DriverEntry(PDRIVER_OBJECT driver_object,
   }
 
   HYPERPLATFORM_LOG_INFO("The VMM has been installed.");
+  if (!IsReleaseBuild()) {
+    DriverpMeasureCpuidRoundTrip();
+  }
   return status;
 }
 
+// Logs the average cost of CPUID on the current processor, which is dominated
+// by a round trip of VM-exit and VM-entry handled on the fast path. Debug
+// builds only, since it holds DISPATCH_LEVEL for 10000 VM-exits.
+_Use_decl_annotations_ static void DriverpMeasureCpuidRoundTrip() {
+  PAGED_CODE();
+
+  static const auto kNumberOfIterations = 10000ull;
+
+  // Stay on the same processor while measuring
+  KIRQL old_irql = 0;
+  KeRaiseIrql(DISPATCH_LEVEL, &old_irql);
+  int cpu_info[4] = {};
+  const auto begin_tsc = __rdtsc();
+  for (auto i = 0ull; i < kNumberOfIterations; ++i) {
+    __cpuid(cpu_info, 0);
+  }
+  const auto elapsed_cycles = __rdtsc() - begin_tsc;
+  KeLowerIrql(old_irql);
+
+  HYPERPLATFORM_LOG_INFO("CPUID costs %I64u cycles on average.",
+                         elapsed_cycles / kNumberOfIterations);
+}
+
 // Unload handler
 _Use_decl_annotations_ static void DriverpDriverUnload(
     PDRIVER_OBJECT driver_object) {
@@ -190,15 +324,215 @@ _Use_decl_annotations_ static void DriverpDriverUnload(
 
   HYPERPLATFORM_COMMON_DBG_BREAK();
 
+  DriverpDeleteControlDevice(driver_object);
   VmTermination();
   HotplugCallbackTermination();
   PowerCallbackTermination();
   UtilTermination();
+  SharedStatisticsTermination();
+  ExitTraceTermination();
+  FlightRecorderTermination();
   PerfTermination();
   GlobalObjectTermination();
   LogTermination();
 }
 
+// Creates a control device and its symbolic link. Only SYSTEM and
+// administrators can open the device since it exposes VMM internals.
+_Use_decl_annotations_ static NTSTATUS DriverpCreateControlDevice(
+    PDRIVER_OBJECT driver_object) {
+  PAGED_CODE();
+
+  UNICODE_STRING device_name = RTL_CONSTANT_STRING(HYPERPLATFORM_DEVICE_NAME_W);
+  PDEVICE_OBJECT device_object = nullptr;
+  auto status = IoCreateDeviceSecure(
+      driver_object, 0, &device_name, FILE_DEVICE_UNKNOWN,
+      FILE_DEVICE_SECURE_OPEN, FALSE, &SDDL_DEVOBJ_SYS_ALL_ADM_ALL,
+      &kDriverpControlDeviceClassGuid, &device_object);
+  if (!NT_SUCCESS(status)) {
+    return status;
+  }
+
+  UNICODE_STRING dos_device_name =
+      RTL_CONSTANT_STRING(HYPERPLATFORM_DOS_DEVICE_NAME_W);
+  status = IoCreateSymbolicLink(&dos_device_name, &device_name);
+  if (!NT_SUCCESS(status)) {
+    IoDeleteDevice(device_object);
+    return status;
+  }
+
+  driver_object->MajorFunction[IRP_MJ_CREATE] = DriverpDispatchCreateClose;
+  driver_object->MajorFunction[IRP_MJ_CLOSE] = DriverpDispatchCreateClose;
+  driver_object->MajorFunction[IRP_MJ_CLEANUP] = DriverpDispatchCleanup;
+  driver_object->MajorFunction[IRP_MJ_DEVICE_CONTROL] =
+      DriverpDispatchDeviceControl;
+  return status;
+}
+
+// Deletes the control device and its symbolic link if they exist
+_Use_decl_annotations_ static void DriverpDeleteControlDevice(
+    PDRIVER_OBJECT driver_object) {
+  PAGED_CODE();
+
+  if (!driver_object->DeviceObject) {
+    return;
+  }
+
+  UNICODE_STRING dos_device_name =
+      RTL_CONSTANT_STRING(HYPERPLATFORM_DOS_DEVICE_NAME_W);
+  IoDeleteSymbolicLink(&dos_device_name);
+  IoDeleteDevice(driver_object->DeviceObject);
+}
+
+// IRP_MJ_CREATE and IRP_MJ_CLOSE; allocates and frees per-handle state
+_Use_decl_annotations_ static NTSTATUS DriverpDispatchCreateClose(
+    PDEVICE_OBJECT device_object, PIRP irp) {
+  UNREFERENCED_PARAMETER(device_object);
+  PAGED_CODE();
+
+  const auto stack = IoGetCurrentIrpStackLocation(irp);
+  auto status = STATUS_SUCCESS;
+  if (stack->MajorFunction == IRP_MJ_CREATE) {
+    const auto context = reinterpret_cast<DriverpFileContext *>(
+        ExAllocatePoolWithTag(NonPagedPool, sizeof(DriverpFileContext),
+                              kHyperPlatformCommonPoolTag));
+    if (context) {
+      RtlZeroMemory(context, sizeof(*context));
+      ExInitializeFastMutex(&context->mutex);
+      stack->FileObject->FsContext = context;
+    } else {
+      status = STATUS_INSUFFICIENT_RESOURCES;
+    }
+  } else if (stack->FileObject->FsContext) {
+    ExFreePoolWithTag(stack->FileObject->FsContext,
+                      kHyperPlatformCommonPoolTag);
+    stack->FileObject->FsContext = nullptr;
+  }
+
+  irp->IoStatus.Status = status;
+  irp->IoStatus.Information = 0;
+  IoCompleteRequest(irp, IO_NO_INCREMENT);
+  return status;
+}
+
+// IRP_MJ_CLEANUP; removes a mapping made by DriverpMapStatistics(). This is
+// called in the context of the process closing the last handle, which may not
+// be the process owning the mapping.
+_Use_decl_annotations_ static NTSTATUS DriverpDispatchCleanup(
+    PDEVICE_OBJECT device_object, PIRP irp) {
+  UNREFERENCED_PARAMETER(device_object);
+  PAGED_CODE();
+
+  const auto stack = IoGetCurrentIrpStackLocation(irp);
+  const auto context =
+      reinterpret_cast<DriverpFileContext *>(stack->FileObject->FsContext);
+  if (context) {
+    ExAcquireFastMutex(&context->mutex);
+    SharedStatisticsUnmapFromUser(&context->mapping);
+    ExReleaseFastMutex(&context->mutex);
+  }
+
+  irp->IoStatus.Status = STATUS_SUCCESS;
+  irp->IoStatus.Information = 0;
+  IoCompleteRequest(irp, IO_NO_INCREMENT);
+  return STATUS_SUCCESS;
+}
+
+// IRP_MJ_DEVICE_CONTROL
+_Use_decl_annotations_ static NTSTATUS DriverpDispatchDeviceControl(
+    PDEVICE_OBJECT device_object, PIRP irp) {
+  UNREFERENCED_PARAMETER(device_object);
+  PAGED_CODE();
+
+  const auto stack = IoGetCurrentIrpStackLocation(irp);
+  irp->IoStatus.Information = 0;
+
+  NTSTATUS status = STATUS_INVALID_DEVICE_REQUEST;
+  switch (stack->Parameters.DeviceIoControl.IoControlCode) {
+    case IOCTL_HYPERPLATFORM_QUERY_VM_EXIT_STATISTICS:
+      status = DriverpQueryVmExitStatistics(irp, stack);
+      break;
+    case IOCTL_HYPERPLATFORM_MAP_STATISTICS:
+      status = DriverpMapStatistics(irp, stack);
+      break;
+    default:
+      break;
+  }
+
+  irp->IoStatus.Status = status;
+  IoCompleteRequest(irp, IO_NO_INCREMENT);
+  return status;
+}
+
+// Handles IOCTL_HYPERPLATFORM_QUERY_VM_EXIT_STATISTICS
+_Use_decl_annotations_ static NTSTATUS DriverpQueryVmExitStatistics(
+    PIRP irp, PIO_STACK_LOCATION stack) {
+  PAGED_CODE();
+
+  const auto snapshot = reinterpret_cast<VmExitStatisticsSnapshot *>(
+      irp->AssociatedIrp.SystemBuffer);
+  const auto output_length =
+      stack->Parameters.DeviceIoControl.OutputBufferLength;
+  const auto header_size = FIELD_OFFSET(VmExitStatisticsSnapshot, processors);
+  if (output_length < header_size) {
+    return STATUS_BUFFER_TOO_SMALL;
+  }
+
+  // Match SharedStatisticsInitialization() which covers hot-plugged ones
+  const auto number_of_processors =
+      KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+  RtlZeroMemory(snapshot, header_size);
+  snapshot->number_of_processors = number_of_processors;
+  irp->IoStatus.Information = header_size;
+  if (output_length <
+      header_size + sizeof(VmExitStatistics) * number_of_processors) {
+    return STATUS_BUFFER_OVERFLOW;
+  }
+
+  const auto status =
+      SharedStatisticsGetVmExitStatistics(snapshot, number_of_processors);
+  if (!NT_SUCCESS(status)) {
+    irp->IoStatus.Information = 0;
+    return status;
+  }
+  irp->IoStatus.Information =
+      header_size + sizeof(VmExitStatistics) * number_of_processors;
+  return status;
+}
+
+// Handles IOCTL_HYPERPLATFORM_MAP_STATISTICS
+_Use_decl_annotations_ static NTSTATUS DriverpMapStatistics(
+    PIRP irp, PIO_STACK_LOCATION stack) {
+  PAGED_CODE();
+
+  if (stack->Parameters.DeviceIoControl.OutputBufferLength < sizeof(ULONG64)) {
+    return STATUS_BUFFER_TOO_SMALL;
+  }
+
+  // Map it once per handle; the mapping is removed on IRP_MJ_CLEANUP. The
+  // address is only valid in the process that mapped it, so refuse requests
+  // through a handle inherited or duplicated into another process.
+  const auto context =
+      reinterpret_cast<DriverpFileContext *>(stack->FileObject->FsContext);
+  auto status = STATUS_SUCCESS;
+  ExAcquireFastMutex(&context->mutex);
+  if (!context->mapping.user_address) {
+    status = SharedStatisticsMapToUser(&context->mapping);
+  } else if (context->mapping.process != PsGetCurrentProcess()) {
+    status = STATUS_ACCESS_DENIED;
+  }
+  const auto user_address = context->mapping.user_address;
+  ExReleaseFastMutex(&context->mutex);
+  if (!NT_SUCCESS(status)) {
+    return status;
+  }
+
+  *reinterpret_cast<ULONG64 *>(irp->AssociatedIrp.SystemBuffer) =
+      reinterpret_cast<ULONG_PTR>(user_address);
+  irp->IoStatus.Information = sizeof(ULONG64);
+  return STATUS_SUCCESS;
+}
+
 // Test if the system is one of supported OS versions
 _Use_decl_annotations_ bool DriverpIsSuppoetedOS() {
   PAGED_CODE();
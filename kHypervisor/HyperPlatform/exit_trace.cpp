@@ -0,0 +1,285 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the VM-exit trace recorder.
+
+#include "exit_trace.h"
+#include "common.h"
+#include "log.h"
+
+extern "C" {
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+static const wchar_t kExitTracepRecordsValueName[] = L"ExitTraceRecords";
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static ULONG
+    ExitTracepReadNumberOfRecords(_In_ PCUNICODE_STRING registry_path);
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static NTSTATUS ExitTracepWriteFile();
+
+static ExitTraceRecord *ExitTracepGetRecords(_In_ ULONG processor);
+
+static ExitTraceRecord *ExitTracepGetNextRecord();
+
+#if defined(ALLOC_PRAGMA)
+#pragma alloc_text(INIT, ExitTraceInitialization)
+#pragma alloc_text(INIT, ExitTracepReadNumberOfRecords)
+#pragma alloc_text(PAGE, ExitTraceTermination)
+#pragma alloc_text(PAGE, ExitTracepWriteFile)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+// ExitTraceStream[g_etp_number_of_processors] followed by
+// ExitTraceRecord[g_etp_number_of_processors][g_etp_records_per_processor]
+static ExitTraceStream *g_etp_buffer;
+static ULONG g_etp_number_of_processors;
+static ULONG g_etp_records_per_processor;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Allocates buffers for active processors, holding at most
+// kExitTraceMaxTotalRecords records in total
+_Use_decl_annotations_ NTSTATUS
+ExitTraceInitialization(PCUNICODE_STRING registry_path) {
+  PAGED_CODE();
+
+  auto records_per_processor = ExitTracepReadNumberOfRecords(registry_path);
+  if (!records_per_processor) {
+    return STATUS_SUCCESS;
+  }
+
+  // Processors hot-plugged later are not recorded, so that the size is bound
+  // by processors actually running
+  const auto number_of_processors =
+      KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+  if (records_per_processor > kExitTraceMaxTotalRecords / number_of_processors) {
+    records_per_processor = kExitTraceMaxTotalRecords / number_of_processors;
+  }
+  const auto buffer_size =
+      sizeof(ExitTraceStream) * number_of_processors +
+      sizeof(ExitTraceRecord) * number_of_processors *
+          static_cast<SIZE_T>(records_per_processor);
+  const auto buffer = reinterpret_cast<ExitTraceStream *>(ExAllocatePoolWithTag(
+      NonPagedPool, buffer_size, kHyperPlatformCommonPoolTag));
+  if (!buffer) {
+    return STATUS_MEMORY_NOT_ALLOCATED;
+  }
+  RtlZeroMemory(buffer, buffer_size);
+
+  g_etp_number_of_processors = number_of_processors;
+  g_etp_records_per_processor = records_per_processor;
+  g_etp_buffer = buffer;
+  HYPERPLATFORM_LOG_INFO("Exit trace enabled (%lu records x %lu CPUs).",
+                         records_per_processor, number_of_processors);
+  return STATUS_SUCCESS;
+}
+
+// Reads the number of records per processor from the registry
+_Use_decl_annotations_ static ULONG ExitTracepReadNumberOfRecords(
+    PCUNICODE_STRING registry_path) {
+  PAGED_CODE();
+
+  OBJECT_ATTRIBUTES object_attributes = {};
+  InitializeObjectAttributes(&object_attributes,
+                             const_cast<PUNICODE_STRING>(registry_path),
+                             OBJ_KERNEL_HANDLE | OBJ_CASE_INSENSITIVE, nullptr,
+                             nullptr);
+  HANDLE key = nullptr;
+  auto status = ZwOpenKey(&key, KEY_READ, &object_attributes);
+  if (!NT_SUCCESS(status)) {
+    return 0;
+  }
+
+  UNICODE_STRING value_name = RTL_CONSTANT_STRING(kExitTracepRecordsValueName);
+  KEY_VALUE_PARTIAL_INFORMATION value[2] = {};  // Large enough for REG_DWORD
+  ULONG returned_length = 0;
+  status = ZwQueryValueKey(key, &value_name, KeyValuePartialInformation, value,
+                           sizeof(value), &returned_length);
+  ZwClose(key);
+  if (!NT_SUCCESS(status) || value[0].Type != REG_DWORD ||
+      value[0].DataLength != sizeof(ULONG)) {
+    return 0;
+  }
+
+  const auto records = *reinterpret_cast<ULONG *>(value[0].Data);
+  return (records < kExitTraceMaxRecords) ? records : kExitTraceMaxRecords;
+}
+
+// Writes the trace file and frees buffers
+_Use_decl_annotations_ void ExitTraceTermination() {
+  PAGED_CODE();
+
+  if (!g_etp_buffer) {
+    return;
+  }
+
+  const auto status = ExitTracepWriteFile();
+  if (!NT_SUCCESS(status)) {
+    HYPERPLATFORM_LOG_ERROR("Failed to write the exit trace (%08x).", status);
+  }
+
+  const auto buffer = g_etp_buffer;
+  g_etp_buffer = nullptr;
+  ExFreePoolWithTag(buffer, kHyperPlatformCommonPoolTag);
+}
+
+// Writes the header, streams and recorded part of each buffer. Nothing is
+// written when no VM-exit has been recorded, so that a previous trace is not
+// overwritten when initialization fails.
+_Use_decl_annotations_ static NTSTATUS ExitTracepWriteFile() {
+  PAGED_CODE();
+
+  auto has_records = false;
+  for (auto i = 0ul; i < g_etp_number_of_processors; ++i) {
+    has_records |= (g_etp_buffer[i].number_of_records != 0);
+  }
+  if (!has_records) {
+    return STATUS_SUCCESS;
+  }
+
+  UNICODE_STRING path = RTL_CONSTANT_STRING(kExitTraceFilePath);
+  OBJECT_ATTRIBUTES oa = {};
+  InitializeObjectAttributes(&oa, &path,
+                             OBJ_KERNEL_HANDLE | OBJ_CASE_INSENSITIVE, nullptr,
+                             nullptr);
+  HANDLE file = nullptr;
+  IO_STATUS_BLOCK io_status = {};
+  auto status = ZwCreateFile(
+      &file, FILE_WRITE_DATA | SYNCHRONIZE, &oa, &io_status, nullptr,
+      FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_OVERWRITE_IF,
+      FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE, nullptr, 0);
+  if (!NT_SUCCESS(status)) {
+    return status;
+  }
+
+  ExitTraceHeader header = {kExitTraceSignature, kExitTraceVersion,
+                            g_etp_number_of_processors,
+                            sizeof(ExitTraceRecord)};
+  status = ZwWriteFile(file, nullptr, nullptr, nullptr, &io_status, &header,
+                       sizeof(header), nullptr, nullptr);
+  if (NT_SUCCESS(status)) {
+    status = ZwWriteFile(
+        file, nullptr, nullptr, nullptr, &io_status, g_etp_buffer,
+        static_cast<ULONG>(sizeof(ExitTraceStream) * g_etp_number_of_processors),
+        nullptr, nullptr);
+  }
+  for (auto i = 0ul; NT_SUCCESS(status) && i < g_etp_number_of_processors;
+       ++i) {
+    const auto number_of_records = g_etp_buffer[i].number_of_records;
+    if (!number_of_records) {
+      continue;
+    }
+    status = ZwWriteFile(
+        file, nullptr, nullptr, nullptr, &io_status, ExitTracepGetRecords(i),
+        static_cast<ULONG>(sizeof(ExitTraceRecord) * number_of_records),
+        nullptr, nullptr);
+  }
+  ZwClose(file);
+  if (NT_SUCCESS(status)) {
+    HYPERPLATFORM_LOG_INFO("Exit trace has been saved to %S.",
+                           kExitTraceFilePath);
+  }
+  return status;
+}
+
+// Tests if the trace recorder is enabled
+/*_Use_decl_annotations_*/ bool ExitTraceIsEnabled() {
+  return g_etp_buffer != nullptr;
+}
+
+// Returns a buffer of the processor following the streams
+_Use_decl_annotations_ static ExitTraceRecord *ExitTracepGetRecords(
+    ULONG processor) {
+  const auto records = reinterpret_cast<ExitTraceRecord *>(
+      g_etp_buffer + g_etp_number_of_processors);
+  return records + static_cast<SIZE_T>(processor) * g_etp_records_per_processor;
+}
+
+// Returns the record following saved ones of the current processor, or
+// nullptr when the buffer is full. Only the owner processor writes to its
+// buffer, so no lock is required.
+/*_Use_decl_annotations_*/ static ExitTraceRecord *ExitTracepGetNextRecord() {
+  if (!g_etp_buffer) {
+    return nullptr;
+  }
+
+  const auto processor = KeGetCurrentProcessorNumberEx(nullptr);
+  if (processor >= g_etp_number_of_processors) {
+    return nullptr;
+  }
+
+  const auto &stream = g_etp_buffer[processor];
+  if (stream.number_of_records >= g_etp_records_per_processor) {
+    return nullptr;
+  }
+  return ExitTracepGetRecords(processor) + stream.number_of_records;
+}
+
+// Writes a record into the next free entry without saving it yet, so that
+// handlers can add to it
+_Use_decl_annotations_ void ExitTraceRecordVmExit(
+    const ExitTraceRecord *record) {
+  const auto next_record = ExitTracepGetNextRecord();
+  if (next_record) {
+    *next_record = *record;
+  }
+}
+
+// Adds an operand to the record written by ExitTraceRecordVmExit()
+_Use_decl_annotations_ void ExitTraceRecordMemoryOperand(
+    ULONG64 memory_operand) {
+  const auto next_record = ExitTracepGetNextRecord();
+  if (next_record) {
+    next_record->memory_operand = memory_operand;
+    next_record->flags |= kExitTraceFlagMemoryOperand;
+  }
+}
+
+// Saves the record written by ExitTraceRecordVmExit(), or counts it as
+// dropped when the buffer is full
+/*_Use_decl_annotations_*/ void ExitTraceCommitVmExit() {
+  if (!g_etp_buffer) {
+    return;
+  }
+
+  const auto processor = KeGetCurrentProcessorNumberEx(nullptr);
+  if (processor >= g_etp_number_of_processors) {
+    return;
+  }
+
+  auto &stream = g_etp_buffer[processor];
+  if (stream.number_of_records >= g_etp_records_per_processor) {
+    stream.dropped_records++;
+    return;
+  }
+  stream.number_of_records++;
+}
+
+}  // extern "C"
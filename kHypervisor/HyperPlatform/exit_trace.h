@@ -0,0 +1,150 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Declares interfaces to the VM-exit trace recorder and its file format.
+///
+/// The trace recorder saves everything a VM-exit handler consumes, so that a
+/// captured workload can be replayed offline against the nested VMX emulation
+/// on the simulated processor (see NestedSim/exit_replay.cpp). Unlike the
+/// flight recorder it keeps the earliest VM-exits of each processor and stops
+/// when the buffer is full, since replay needs an unbroken stream from VMXON
+/// on. It is disabled unless the ExitTraceRecords (REG_DWORD) value under the
+/// driver's service key specifies the number of records per processor. The
+/// trace is written to #kExitTraceFilePath when the driver is unloaded.
+///
+/// A trace file consists of ExitTraceHeader, ExitTraceStream[
+/// number_of_processors] and then the records of each stream in order of
+/// processors, each stream holding only as many records as it recorded.
+
+#ifndef HYPERPLATFORM_EXIT_TRACE_H_
+#define HYPERPLATFORM_EXIT_TRACE_H_
+
+#include <fltKernel.h>
+
+extern "C" {
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+/// Identifies a trace file; 'TEyH'
+static const ULONG32 kExitTraceSignature = 0x54457948;
+
+/// A version of the file format
+static const ULONG32 kExitTraceVersion = 1;
+
+/// The largest number of records per processor accepted from the registry
+static const ULONG kExitTraceMaxRecords = 0x10000;
+
+/// The largest number of records of all processors (44 MB of non-paged pool)
+static const ULONG kExitTraceMaxTotalRecords = 0x40000;
+
+/// A path of the trace file written on unload
+static const wchar_t kExitTraceFilePath[] = L"\\SystemRoot\\kHypervisor.trace";
+
+/// ExitTraceRecord::flags: the VM-exit occurred in L2, i.e. VMCS02 was current
+static const UCHAR kExitTraceFlagL2 = 0x01;
+
+/// ExitTraceRecord::flags: ExitTraceRecord::memory_operand is valid
+static const UCHAR kExitTraceFlagMemoryOperand = 0x02;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+/// A record of a single VM-exit. General purpose registers are stored in
+/// order of register numbers used by VM-exit instruction information, so the
+/// format does not depend on the layout of GpRegisters.
+struct ExitTraceRecord {
+  ULONG64 gp_regs[16];           //!< rax, rcx, rdx, rbx, rsp, rbp, rsi, ...
+  ULONG64 guest_ip;              //!< Guest RIP
+  ULONG64 guest_flags;           //!< Guest RFLAGS
+  ULONG64 exit_qualification;    //!< Exit qualification
+  ULONG64 memory_operand;        //!< 8 bytes a VMX instruction read from memory
+  ULONG32 exit_reason;           //!< Full VM-exit reason field
+  ULONG32 instruction_info;      //!< VM-exit instruction information
+  ULONG32 interruption_info;     //!< VM-exit interruption information
+  UCHAR instruction_length;      //!< VM-exit instruction length
+  UCHAR flags;                   //!< kExitTraceFlag*
+  USHORT reserved;               //!< Unused
+};
+static_assert(sizeof(ExitTraceRecord) == 176, "Size check");
+
+/// The number of records of a processor
+struct ExitTraceStream {
+  ULONG64 number_of_records;   //!< Records saved in the file
+  ULONG64 dropped_records;     //!< VM-exits not recorded as the buffer was full
+};
+static_assert(sizeof(ExitTraceStream) == 16, "Size check");
+
+/// A header of a trace file
+struct ExitTraceHeader {
+  ULONG32 signature;             //!< #kExitTraceSignature
+  ULONG32 version;               //!< #kExitTraceVersion
+  ULONG32 number_of_processors;  //!< Number of streams
+  ULONG32 record_size;           //!< sizeof(ExitTraceRecord)
+};
+static_assert(sizeof(ExitTraceHeader) == 16, "Size check");
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+/// Allocates buffers when a number of records is configured in the registry
+/// @param registry_path  A registry path passed to DriverEntry()
+/// @return STATUS_SUCCESS on success, including when it is not configured
+///
+/// Buffers are allocated for processors active at this time. The number of
+/// records per processor is reduced so that the total does not exceed
+/// #kExitTraceMaxTotalRecords.
+_IRQL_requires_max_(PASSIVE_LEVEL) NTSTATUS
+    ExitTraceInitialization(_In_ PCUNICODE_STRING registry_path);
+
+/// Stops recording, writes the trace file and frees buffers
+///
+/// It must be called after all processors are de-virtualized.
+_IRQL_requires_max_(PASSIVE_LEVEL) void ExitTraceTermination();
+
+/// Tests if the trace recorder is enabled
+/// @return true if ExitTraceRecordVmExit() records anything
+bool ExitTraceIsEnabled();
+
+/// Starts a record of a VM-exit of the current processor
+/// @param record   A record to save
+///
+/// Called from VMM context; it does not call any kernel API but
+/// KeGetCurrentProcessorNumberEx(). The record is not saved until
+/// ExitTraceCommitVmExit() is called.
+void ExitTraceRecordVmExit(_In_ const ExitTraceRecord* record);
+
+/// Adds a memory operand to the record of the current VM-exit
+/// @param memory_operand   8 bytes a handler read from guest memory
+///
+/// Called from a handler of the VM-exit, after ExitTraceRecordVmExit().
+void ExitTraceRecordMemoryOperand(_In_ ULONG64 memory_operand);
+
+/// Saves the record of the current VM-exit once it has been handled
+void ExitTraceCommitVmExit();
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+}  // extern "C"
+
+#endif  // HYPERPLATFORM_EXIT_TRACE_H_
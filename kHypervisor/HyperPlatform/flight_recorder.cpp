@@ -0,0 +1,245 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the VM-exit flight recorder.
+
+#include "flight_recorder.h"
+#include <intrin.h>
+#include "common.h"
+#include "log.h"
+
+extern "C" {
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+static const ULONG32 kFlightRecorderpSignature = 'RFyH';
+
+static const wchar_t kFlightRecorderpDepthValueName[] = L"FlightRecorderDepth";
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+_IRQL_requires_max_(PASSIVE_LEVEL) static ULONG
+    FlightRecorderpReadDepth(_In_ PCUNICODE_STRING registry_path);
+
+static FlightRecorderCursor *FlightRecorderpGetCursors(
+    _In_ FlightRecorderHeader *header);
+
+static FlightRecord *FlightRecorderpGetRing(_In_ FlightRecorderHeader *header,
+                                            _In_ ULONG processor);
+
+static KBUGCHECK_REASON_CALLBACK_ROUTINE FlightRecorderpBugCheckCallback;
+
+#if defined(ALLOC_PRAGMA)
+#pragma alloc_text(INIT, FlightRecorderInitialization)
+#pragma alloc_text(INIT, FlightRecorderpReadDepth)
+#pragma alloc_text(PAGE, FlightRecorderTermination)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+static FlightRecorderHeader *g_frp_buffer;
+static SIZE_T g_frp_buffer_size;
+static KBUGCHECK_REASON_CALLBACK_RECORD g_frp_bug_check_callback_record;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Allocates rings for all possible processors and registers a bug check
+// callback to save them into a crash dump
+_Use_decl_annotations_ NTSTATUS
+FlightRecorderInitialization(PCUNICODE_STRING registry_path) {
+  PAGED_CODE();
+
+  const auto depth = FlightRecorderpReadDepth(registry_path);
+  if (!depth) {
+    return STATUS_SUCCESS;
+  }
+
+  // Use the maximum count so that hot-plugged processors are covered
+  const auto number_of_processors =
+      KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+  const auto buffer_size =
+      sizeof(FlightRecorderHeader) +
+      sizeof(FlightRecorderCursor) * number_of_processors +
+      sizeof(FlightRecord) * number_of_processors * static_cast<SIZE_T>(depth);
+  const auto buffer = reinterpret_cast<FlightRecorderHeader *>(
+      ExAllocatePoolWithTag(NonPagedPool, buffer_size,
+                            kHyperPlatformCommonPoolTag));
+  if (!buffer) {
+    return STATUS_MEMORY_NOT_ALLOCATED;
+  }
+  RtlZeroMemory(buffer, buffer_size);
+  buffer->signature = kFlightRecorderpSignature;
+  buffer->number_of_processors = number_of_processors;
+  buffer->depth = depth;
+  buffer->record_size = sizeof(FlightRecord);
+
+  KeInitializeCallbackRecord(&g_frp_bug_check_callback_record);
+  if (!KeRegisterBugCheckReasonCallback(
+          &g_frp_bug_check_callback_record, FlightRecorderpBugCheckCallback,
+          KbCallbackSecondaryDumpData,
+          reinterpret_cast<PUCHAR>("kHypervisorFlightRecorder"))) {
+    ExFreePoolWithTag(buffer, kHyperPlatformCommonPoolTag);
+    return STATUS_UNSUCCESSFUL;
+  }
+
+  g_frp_buffer_size = buffer_size;
+  g_frp_buffer = buffer;
+  HYPERPLATFORM_LOG_INFO("Flight recorder enabled (%lu records x %lu CPUs).",
+                         depth, number_of_processors);
+  return STATUS_SUCCESS;
+}
+
+// Reads the number of records per processor from the registry
+_Use_decl_annotations_ static ULONG FlightRecorderpReadDepth(
+    PCUNICODE_STRING registry_path) {
+  PAGED_CODE();
+
+  OBJECT_ATTRIBUTES object_attributes = {};
+  InitializeObjectAttributes(&object_attributes,
+                             const_cast<PUNICODE_STRING>(registry_path),
+                             OBJ_KERNEL_HANDLE | OBJ_CASE_INSENSITIVE, nullptr,
+                             nullptr);
+  HANDLE key = nullptr;
+  auto status = ZwOpenKey(&key, KEY_READ, &object_attributes);
+  if (!NT_SUCCESS(status)) {
+    return 0;
+  }
+
+  UNICODE_STRING value_name =
+      RTL_CONSTANT_STRING(kFlightRecorderpDepthValueName);
+  KEY_VALUE_PARTIAL_INFORMATION value[2] = {};  // Large enough for REG_DWORD
+  ULONG returned_length = 0;
+  status = ZwQueryValueKey(key, &value_name, KeyValuePartialInformation, value,
+                           sizeof(value), &returned_length);
+  ZwClose(key);
+  if (!NT_SUCCESS(status) || value[0].Type != REG_DWORD ||
+      value[0].DataLength != sizeof(ULONG)) {
+    return 0;
+  }
+
+  const auto depth = *reinterpret_cast<ULONG *>(value[0].Data);
+  return (depth < kFlightRecorderMaxDepth) ? depth : kFlightRecorderMaxDepth;
+}
+
+// Deregisters the bug check callback and frees rings
+_Use_decl_annotations_ void FlightRecorderTermination() {
+  PAGED_CODE();
+
+  if (!g_frp_buffer) {
+    return;
+  }
+
+  KeDeregisterBugCheckReasonCallback(&g_frp_bug_check_callback_record);
+  const auto buffer = g_frp_buffer;
+  g_frp_buffer = nullptr;
+  g_frp_buffer_size = 0;
+  ExFreePoolWithTag(buffer, kHyperPlatformCommonPoolTag);
+}
+
+// Tests if the flight recorder is enabled
+/*_Use_decl_annotations_*/ bool FlightRecorderIsEnabled() {
+  return g_frp_buffer != nullptr;
+}
+
+// Returns an array of cursors following the header
+_Use_decl_annotations_ static FlightRecorderCursor *FlightRecorderpGetCursors(
+    FlightRecorderHeader *header) {
+  return reinterpret_cast<FlightRecorderCursor *>(header + 1);
+}
+
+// Returns a ring of the processor following the cursors
+_Use_decl_annotations_ static FlightRecord *FlightRecorderpGetRing(
+    FlightRecorderHeader *header, ULONG processor) {
+  const auto rings = reinterpret_cast<FlightRecord *>(
+      FlightRecorderpGetCursors(header) + header->number_of_processors);
+  return rings + static_cast<SIZE_T>(processor) * header->depth;
+}
+
+// Records a VM-exit. Only the owner processor writes to its ring, so no lock
+// is required.
+_Use_decl_annotations_ void FlightRecorderRecordVmExit(
+    ULONG32 exit_reason, ULONG_PTR exit_qualification, ULONG_PTR guest_ip) {
+  const auto header = g_frp_buffer;
+  if (!header) {
+    return;
+  }
+
+  const auto processor = KeGetCurrentProcessorNumberEx(nullptr);
+  if (processor >= header->number_of_processors) {
+    return;
+  }
+
+  const auto now = __rdtsc();
+  auto &cursor = FlightRecorderpGetCursors(header)[processor];
+  auto &record = FlightRecorderpGetRing(
+      header, processor)[cursor.total_records % header->depth];
+  record.guest_ip = guest_ip;
+  record.exit_qualification = exit_qualification;
+  record.tsc_delta = (cursor.last_tsc) ? now - cursor.last_tsc : 0;
+  record.exit_reason = exit_reason;
+  cursor.last_tsc = now;
+  cursor.total_records++;
+}
+
+// Copies the whole buffer as is
+_Use_decl_annotations_ SIZE_T FlightRecorderDump(void *buffer,
+                                                 SIZE_T buffer_size) {
+  const auto source = g_frp_buffer;
+  if (!source) {
+    return 0;
+  }
+
+  const auto copy_size =
+      (buffer_size < g_frp_buffer_size) ? buffer_size : g_frp_buffer_size;
+  RtlCopyMemory(buffer, source, copy_size);
+  return copy_size;
+}
+
+// Hands over the rings as secondary dump data. The buffer is non-paged and
+// resident, so it can be given to the system without copying.
+_Use_decl_annotations_ static void FlightRecorderpBugCheckCallback(
+    KBUGCHECK_CALLBACK_REASON reason,
+    PKBUGCHECK_REASON_CALLBACK_RECORD record, PVOID reason_specific_data,
+    ULONG reason_specific_data_length) {
+  UNREFERENCED_PARAMETER(record);
+
+  if (reason != KbCallbackSecondaryDumpData ||
+      reason_specific_data_length < sizeof(KBUGCHECK_SECONDARY_DUMP_DATA) ||
+      !g_frp_buffer) {
+    return;
+  }
+
+  const auto dump_data =
+      reinterpret_cast<PKBUGCHECK_SECONDARY_DUMP_DATA>(reason_specific_data);
+  const auto size = (dump_data->MaximumAllowed < g_frp_buffer_size)
+                        ? dump_data->MaximumAllowed
+                        : static_cast<ULONG>(g_frp_buffer_size);
+  dump_data->Guid = kFlightRecorderDumpGuid;
+  dump_data->OutBuffer = g_frp_buffer;
+  dump_data->OutBufferLength = size;
+}
+
+}  // extern "C"
@@ -0,0 +1,125 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Declares interfaces to the VM-exit flight recorder.
+///
+/// The flight recorder keeps the latest VM-exits of each processor in a ring
+/// buffer for trouble shooting. It is disabled unless the FlightRecorderDepth
+/// (REG_DWORD) value under the driver's service key specifies the number of
+/// records per processor. Contents are saved into a crash dump as secondary
+/// dump data identified by #kFlightRecorderDumpGuid.
+
+#ifndef HYPERPLATFORM_FLIGHT_RECORDER_H_
+#define HYPERPLATFORM_FLIGHT_RECORDER_H_
+
+#include <fltKernel.h>
+
+extern "C" {
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+/// Identifies flight recorder data in a crash dump
+static const GUID kFlightRecorderDumpGuid = {
+    0x6b3c1f2e,
+    0x8d4a,
+    0x4e1b,
+    {0x9a, 0x57, 0x2c, 0x41, 0xd0, 0x8e, 0x73, 0xf5}};
+
+/// The largest number of records per processor accepted from the registry
+static const ULONG kFlightRecorderMaxDepth = 4096;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+/// A compact record of a single VM-exit
+struct FlightRecord {
+  ULONG64 guest_ip;            //!< Guest RIP at the time of VM-exit
+  ULONG64 exit_qualification;  //!< Exit qualification
+  ULONG64 tsc_delta;           //!< TSC since the previous record
+  ULONG32 exit_reason;         //!< Full VM-exit reason field
+  ULONG32 reserved;            //!< Unused
+};
+static_assert(sizeof(FlightRecord) == 32, "Size check");
+
+/// A per-processor position of a ring
+struct FlightRecorderCursor {
+  ULONG64 last_tsc;       //!< TSC of the latest record
+  ULONG64 total_records;  //!< Total number of records ever written
+};
+
+/// Describes a layout of the flight recorder buffer, which is followed by
+/// FlightRecorderCursor[number_of_processors] and then
+/// FlightRecord[number_of_processors][depth]. The latest record of processor N
+/// is at index (cursors[N].total_records - 1) % depth of its ring.
+struct FlightRecorderHeader {
+  ULONG32 signature;             //!< 'RFyH'
+  ULONG32 number_of_processors;  //!< Number of rings
+  ULONG32 depth;                 //!< Number of records per ring
+  ULONG32 record_size;           //!< sizeof(FlightRecord)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+/// Allocates rings when a depth is configured in the registry
+/// @param registry_path  A registry path passed to DriverEntry()
+/// @return STATUS_SUCCESS on success, including when it is not configured
+_IRQL_requires_max_(PASSIVE_LEVEL) NTSTATUS
+    FlightRecorderInitialization(_In_ PCUNICODE_STRING registry_path);
+
+/// Stops recording and frees rings
+///
+/// It must be called after all processors are de-virtualized.
+_IRQL_requires_max_(PASSIVE_LEVEL) void FlightRecorderTermination();
+
+/// Tests if the flight recorder is enabled
+/// @return true if FlightRecorderRecordVmExit() records anything
+bool FlightRecorderIsEnabled();
+
+/// Records a VM-exit of the current processor
+/// @param exit_reason  A full VM-exit reason field
+/// @param exit_qualification   An exit qualification
+/// @param guest_ip   Guest RIP
+///
+/// Called from VMM context; it does not call any kernel API but
+/// KeGetCurrentProcessorNumberEx().
+void FlightRecorderRecordVmExit(_In_ ULONG32 exit_reason,
+                                _In_ ULONG_PTR exit_qualification,
+                                _In_ ULONG_PTR guest_ip);
+
+/// Copies all rings into \a buffer as described by FlightRecorderHeader
+/// @param buffer   A buffer to store contents
+/// @param buffer_size  A size of \a buffer in bytes
+/// @return   The number of bytes copied, which may be truncated
+///
+/// It neither allocates memory nor acquires a lock so that it can be called
+/// from a bug check callback at HIGH_LEVEL.
+SIZE_T FlightRecorderDump(_Out_writes_bytes_(buffer_size) void* buffer,
+                          _In_ SIZE_T buffer_size);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+}  // extern "C"
+
+#endif  // HYPERPLATFORM_FLIGHT_RECORDER_H_
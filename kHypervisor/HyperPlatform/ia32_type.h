@@ -944,9 +944,9 @@ enum class memory_type : unsigned __int8 {
 
 /// See: Virtual-Machine Control Structures & FORMAT OF THE VMCS REGION
 struct VmControlStructure {
-  unsigned long revision_identifier;
-  unsigned long vmx_abort_indicator;
-  unsigned long data[1];  //!< Implementation-specific format.
+  ULONG32 revision_identifier;
+  ULONG32 vmx_abort_indicator;
+  ULONG32 data[1];  //!< Implementation-specific format.
 };
 
 /// See: Definitions of Pin-Based VM-Execution Controls
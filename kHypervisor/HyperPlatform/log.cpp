@@ -9,6 +9,7 @@
 #include "log.h"
 #define NTSTRSAFE_NO_CB_FUNCTIONS
 #include <ntstrsafe.h>
+#include "shared_statistics.h"
 
 // See common.h for details
 #pragma prefast(disable : 30030)
@@ -686,6 +687,7 @@ _Use_decl_annotations_ static NTSTATUS LogpBufferMessage(const char *message,
     }
   } else {
     info->log_max_usage = kLogpBufferSize;  // Indicates overflow
+    SharedStatisticsCountDroppedLogMessage();
   }
   *info->log_buffer_tail = '\0';
 
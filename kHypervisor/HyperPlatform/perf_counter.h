@@ -16,6 +16,7 @@
 #define HYPERPLATFORM_PERF_COUNTER_H_
 
 #include <fltKernel.h>
+#include <intrin.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -110,6 +111,116 @@
 // implementations
 //
 
+/// Log-bucketed latency histogram in the style of HdrHistogram.
+///
+/// A value below kSubBucketCount gets its own bucket. Any larger value is
+/// bucketed by the position of its most significant bit and the next
+/// kSubBucketBits bits below it, so each bucket spans at most 1/kSubBucketCount
+/// of its lower bound and the whole 64-bit range fits in kBucketCount buckets.
+/// Only integer operations are used, so it is safe to update from the VMM.
+class PerfHistogram {
+ public:
+  static const ULONG kSubBucketBits = 2;
+  static const ULONG kSubBucketCount = 1ul << kSubBucketBits;
+  static const ULONG kBucketCount = (64 - kSubBucketBits + 1) * kSubBucketCount;
+
+  /// Clears all recorded values
+  void Reset() {
+    count_ = 0;
+    min_ = MAXULONG64;
+    max_ = 0;
+    memset(buckets_, 0, sizeof(buckets_));
+  }
+
+  /// Records a value
+  /// @param value  A value to record, typically TSC cycles
+  void Record(_In_ ULONG64 value) {
+    count_++;
+    if (value < min_) {
+      min_ = value;
+    }
+    if (value > max_) {
+      max_ = value;
+    }
+    buckets_[GetBucketIndex(value)]++;
+  }
+
+  /// Returns the number of recorded values
+  ULONG64 GetCount() const { return count_; }
+
+  /// Returns the smallest recorded value or 0 if nothing is recorded
+  ULONG64 GetMin() const { return (count_) ? min_ : 0; }
+
+  /// Returns the largest recorded value
+  ULONG64 GetMax() const { return max_; }
+
+  /// Returns a value at the given percentile
+  /// @param per_mille  A percentile in 1/1000 units, e.g. 990 for p99
+  /// @return   The highest value equivalent to the bucket containing the
+  ///           percentile, capped with the largest recorded value
+  ULONG64 GetValueAtPerMille(_In_ ULONG per_mille) const {
+    if (!count_) {
+      return 0;
+    }
+
+    auto rank = (count_ / 1000) * per_mille +
+                ((count_ % 1000) * per_mille + 999) / 1000;
+    if (!rank) {
+      rank = 1;
+    }
+
+    ULONG64 cumulative_count = 0;
+    for (auto i = 0ul; i < kBucketCount; i++) {
+      cumulative_count += buckets_[i];
+      if (cumulative_count >= rank) {
+        const auto upper_bound = GetBucketUpperBound(i);
+        return (upper_bound < max_) ? upper_bound : max_;
+      }
+    }
+    return max_;
+  }
+
+  /// Returns an index of a bucket that \a value belongs to
+  static ULONG GetBucketIndex(_In_ ULONG64 value) {
+    if (value < kSubBucketCount) {
+      return static_cast<ULONG>(value);
+    }
+
+    ULONG msb = 0;
+#if defined(_AMD64_)
+    _BitScanReverse64(&msb, value);
+#else
+    const auto high = static_cast<ULONG>(value >> 32);
+    if (high) {
+      _BitScanReverse(&msb, high);
+      msb += 32;
+    } else {
+      _BitScanReverse(&msb, static_cast<ULONG>(value));
+    }
+#endif
+    const auto shift = msb - kSubBucketBits;
+    const auto sub_bucket = static_cast<ULONG>(value >> shift);
+    return (shift + 1) * kSubBucketCount + (sub_bucket - kSubBucketCount);
+  }
+
+  /// Returns the largest value that falls into the bucket \a index
+  static ULONG64 GetBucketUpperBound(_In_ ULONG index) {
+    if (index < kSubBucketCount) {
+      return index;
+    }
+
+    const auto shift = index / kSubBucketCount - 1;
+    const ULONG64 sub_bucket = index % kSubBucketCount + kSubBucketCount;
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+
+ private:
+  ULONG64 count_;
+  ULONG64 min_;
+  ULONG64 max_;
+  ULONG64 buckets_[kBucketCount];
+};
+
 /// Responsible for collecting and saving data supplied by PerfCounter.
 class PerfCollector {
  public:
@@ -123,6 +234,7 @@ class PerfCollector {
   using OutputRoutine = void(_In_ const char* location_name,
                              _In_ ULONG64 total_execution_count,
                              _In_ ULONG64 total_elapsed_time,
+                             _In_ const PerfHistogram* latency,
                              _In_opt_ void* output_context);
 
   /// A function type for acquiring and releasing a lock
@@ -156,6 +268,9 @@ class PerfCollector {
     lock_context_ = lock_context;
     output_context_ = output_context;
     memset(data_, 0, sizeof(data_));
+    for (auto& entry : data_) {
+      entry.latency.Reset();
+    }
   }
 
   /// Destructor; prints out accumulated performance results.
@@ -170,7 +285,8 @@ class PerfCollector {
       }
 
       output_routine_(data_[i].key, data_[i].total_execution_count,
-                      data_[i].total_elapsed_time, output_context_);
+                      data_[i].total_elapsed_time, &data_[i].latency,
+                      output_context_);
     }
     if (data_[0].key) {
       final_output_routine_(output_context_);
@@ -188,6 +304,7 @@ class PerfCollector {
 
     data_[data_index].total_execution_count++;
     data_[data_index].total_elapsed_time += elapsed_time;
+    data_[data_index].latency.Record(elapsed_time);
     return true;
   }
 
@@ -200,6 +317,7 @@ class PerfCollector {
     const char* key;                //!< Identifies a subject matter location
     ULONG64 total_execution_count;  //!< How many times executed
     ULONG64 total_elapsed_time;     //!< An accumulated elapsed time
+    PerfHistogram latency;          //!< Distribution of elapsed times
   };
 
   /// Scoped lock
@@ -82,23 +82,31 @@ _Use_decl_annotations_ void PerfTermination() {
 }
 
 /*_Use_decl_annotations_*/ ULONG64 PerfGetTime() {
-  LARGE_INTEGER counter = KeQueryPerformanceCounter(nullptr);
-  return static_cast<ULONG64>(counter.QuadPart);
+  // TSC rather than KeQueryPerformanceCounter() since this is called from the
+  // VMM where calling the HAL is not safe, and the histogram is in cycles.
+  return __rdtsc();
 }
 
 _Use_decl_annotations_ static void PerfpInitialOutputRoutine(
     void* output_context) {
   UNREFERENCED_PARAMETER(output_context);
-  HYPERPLATFORM_LOG_INFO("%-45s,%-20s,%-20s", "FunctionName(Line)",
-                         "Execution Count", "Elapsed Time");
+  HYPERPLATFORM_LOG_INFO("%-45s,%-20s,%-20s,%-12s,%-12s,%-12s,%-12s,%-12s",
+                         "FunctionName(Line)", "Execution Count",
+                         "Elapsed Cycles", "Min", "P50", "P99", "P99.9",
+                         "Max");
 }
 
 _Use_decl_annotations_ static void PerfpOutputRoutine(
     const char* location_name, ULONG64 total_execution_count,
-    ULONG64 total_elapsed_time, void* output_context) {
+    ULONG64 total_elapsed_time, const PerfHistogram* latency,
+    void* output_context) {
   UNREFERENCED_PARAMETER(output_context);
-  HYPERPLATFORM_LOG_INFO("%-45s,%20I64u,%20I64u,", location_name,
-                         total_execution_count, total_elapsed_time);
+  HYPERPLATFORM_LOG_INFO(
+      "%-45s,%20I64u,%20I64u,%12I64u,%12I64u,%12I64u,%12I64u,%12I64u,",
+      location_name, total_execution_count, total_elapsed_time,
+      latency->GetMin(), latency->GetValueAtPerMille(500),
+      latency->GetValueAtPerMille(990), latency->GetValueAtPerMille(999),
+      latency->GetMax());
 }
 
 _Use_decl_annotations_ static void PerfpFinalOutputRoutine(
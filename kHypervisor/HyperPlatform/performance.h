@@ -54,7 +54,7 @@ _IRQL_requires_max_(PASSIVE_LEVEL) NTSTATUS PerfInitialization();
 _IRQL_requires_max_(PASSIVE_LEVEL) void PerfTermination();
 
 /// Returns the current "time" for performance measurement.
-/// @return Current performance counter
+/// @return Current TSC value
 ///
 /// It should only be used by #HYPERPLATFORM_PERFORMANCE_MEASURE_THIS_SCOPE().
 ULONG64 PerfGetTime();
@@ -0,0 +1,223 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the statistics region shared with user mode.
+
+#include "shared_statistics.h"
+#include "common.h"
+#include "log.h"
+#include "perf_counter.h"
+
+extern "C" {
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+static_assert(kVmExitLatencyNumberOfBuckets == PerfHistogram::kBucketCount,
+              "Bucketing must match PerfHistogram");
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+NTKERNELAPI NTSTATUS NTAPI PsGetProcessExitStatus(_In_ PEPROCESS process);
+
+static void SharedStatisticspReadVmExitStatistics(
+    _In_ const VmExitProcessorStatistics *source,
+    _Out_ VmExitStatistics *destination);
+
+#if defined(ALLOC_PRAGMA)
+#pragma alloc_text(INIT, SharedStatisticsInitialization)
+#pragma alloc_text(PAGE, SharedStatisticsTermination)
+#pragma alloc_text(PAGE, SharedStatisticsMapToUser)
+#pragma alloc_text(PAGE, SharedStatisticsUnmapFromUser)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+static SharedStatistics *g_ssp_region;
+static PMDL g_ssp_mdl;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Allocates the region as pages of its own rather than from pool, so that
+// mapping it to user mode never exposes unrelated kernel data sharing a page
+_Use_decl_annotations_ NTSTATUS SharedStatisticsInitialization() {
+  PAGED_CODE();
+
+  const auto number_of_processors =
+      KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+  const auto region_size = ROUND_TO_PAGES(
+      FIELD_OFFSET(SharedStatistics, processors) +
+      sizeof(VmExitProcessorStatistics) * number_of_processors);
+
+  const PHYSICAL_ADDRESS lowest = {};
+  PHYSICAL_ADDRESS highest = {};
+  highest.QuadPart = -1;
+  const auto mdl = MmAllocatePagesForMdlEx(lowest, highest, lowest,
+                                           region_size, MmCached,
+                                           MM_ALLOCATE_FULLY_REQUIRED);
+  if (!mdl) {
+    return STATUS_MEMORY_NOT_ALLOCATED;
+  }
+  const auto region = reinterpret_cast<SharedStatistics *>(
+      MmGetSystemAddressForMdlSafe(
+          mdl, NormalPagePriority | MdlMappingNoExecute));
+  if (!region) {
+    MmFreePagesFromMdl(mdl);
+    ExFreePool(mdl);
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+  RtlZeroMemory(region, region_size);
+  region->signature = kSharedStatisticsSignature;
+  region->size = static_cast<ULONG32>(region_size);
+  region->number_of_processors = number_of_processors;
+
+  g_ssp_mdl = mdl;
+  g_ssp_region = region;
+  return STATUS_SUCCESS;
+}
+
+// Frees the region
+_Use_decl_annotations_ void SharedStatisticsTermination() {
+  PAGED_CODE();
+
+  if (!g_ssp_mdl) {
+    return;
+  }
+  g_ssp_region = nullptr;
+  MmUnmapLockedPages(MmGetSystemAddressForMdl(g_ssp_mdl), g_ssp_mdl);
+  MmFreePagesFromMdl(g_ssp_mdl);
+  ExFreePool(g_ssp_mdl);
+  g_ssp_mdl = nullptr;
+}
+
+// Returns statistics of the processor
+_Use_decl_annotations_ VmExitProcessorStatistics *SharedStatisticsGetProcessor(
+    ULONG processor_index) {
+  if (!g_ssp_region ||
+      processor_index >= g_ssp_region->number_of_processors) {
+    return nullptr;
+  }
+  return &g_ssp_region->processors[processor_index];
+}
+
+// Counts a log message that could not be buffered. The region may not exist
+// yet since the log is initialized first.
+/*_Use_decl_annotations_*/ void SharedStatisticsCountDroppedLogMessage() {
+  if (g_ssp_region) {
+    InterlockedIncrement64(&g_ssp_region->log_dropped_messages);
+  }
+}
+
+// Takes a consistent copy of VM-exit statistics of all processors
+_Use_decl_annotations_ NTSTATUS SharedStatisticsGetVmExitStatistics(
+    VmExitStatisticsSnapshot *snapshot, ULONG number_of_processors) {
+  if (!g_ssp_region) {
+    return STATUS_UNSUCCESSFUL;
+  }
+  if (number_of_processors < g_ssp_region->number_of_processors) {
+    return STATUS_BUFFER_TOO_SMALL;
+  }
+
+  snapshot->number_of_processors = g_ssp_region->number_of_processors;
+  snapshot->tsc = __rdtsc();
+  for (auto i = 0ul; i < g_ssp_region->number_of_processors; i++) {
+    SharedStatisticspReadVmExitStatistics(&g_ssp_region->processors[i],
+                                          &snapshot->processors[i]);
+  }
+  return STATUS_SUCCESS;
+}
+
+// Reads statistics of a processor as a reader side of the seqlock. Compiler
+// barriers are sufficient since x86 does not reorder loads with other loads.
+_Use_decl_annotations_ static void SharedStatisticspReadVmExitStatistics(
+    const VmExitProcessorStatistics *source, VmExitStatistics *destination) {
+  for (;;) {
+    const auto sequence = source->sequence;
+    if (sequence & 1) {
+      YieldProcessor();
+      continue;
+    }
+    KeMemoryBarrierWithoutFence();
+    *destination = source->exit_statistics;
+    KeMemoryBarrierWithoutFence();
+    if (source->sequence == sequence) {
+      break;
+    }
+  }
+}
+
+// Maps the whole region into the current process without write access
+_Use_decl_annotations_ NTSTATUS
+SharedStatisticsMapToUser(SharedStatisticsMapping *mapping) {
+  PAGED_CODE();
+
+  RtlZeroMemory(mapping, sizeof(*mapping));
+  if (!g_ssp_mdl) {
+    return STATUS_UNSUCCESSFUL;
+  }
+
+  void *address = nullptr;
+  __try {
+    address = MmMapLockedPagesSpecifyCache(
+        g_ssp_mdl, UserMode, MmCached, nullptr, FALSE,
+        NormalPagePriority | MdlMappingNoWrite | MdlMappingNoExecute);
+  } __except (EXCEPTION_EXECUTE_HANDLER) {
+    return GetExceptionCode();
+  }
+  if (!address) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
+  mapping->process = PsGetCurrentProcess();
+  mapping->user_address = address;
+  ObReferenceObject(mapping->process);
+  return STATUS_SUCCESS;
+}
+
+// Unmaps the region from the process that mapped it. A handle may be closed
+// last by another process that inherited or duplicated it, so attach to the
+// owner when needed. When the owner has already exited, the mapping has gone
+// with its address space.
+_Use_decl_annotations_ void SharedStatisticsUnmapFromUser(
+    SharedStatisticsMapping *mapping) {
+  PAGED_CODE();
+
+  if (!mapping->user_address) {
+    return;
+  }
+
+  if (mapping->process == PsGetCurrentProcess()) {
+    MmUnmapLockedPages(mapping->user_address, g_ssp_mdl);
+  } else if (PsGetProcessExitStatus(mapping->process) == STATUS_PENDING) {
+    KAPC_STATE apc_state = {};
+    KeStackAttachProcess(mapping->process, &apc_state);
+    MmUnmapLockedPages(mapping->user_address, g_ssp_mdl);
+    KeUnstackDetachProcess(&apc_state);
+  }
+  ObDereferenceObject(mapping->process);
+  RtlZeroMemory(mapping, sizeof(*mapping));
+}
+
+}  // extern "C"
@@ -0,0 +1,95 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Declares interfaces to the statistics region shared with user mode.
+
+#ifndef HYPERPLATFORM_SHARED_STATISTICS_H_
+#define HYPERPLATFORM_SHARED_STATISTICS_H_
+
+#include <fltKernel.h>
+#include "vmm_statistics.h"
+
+extern "C" {
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+/// A mapping of the shared statistics region in a process
+struct SharedStatisticsMapping {
+  PEPROCESS process;   //!< A referenced process owning the mapping
+  void *user_address;  //!< A mapped address in \a process
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+/// Allocates the shared statistics region for all possible processors
+/// @return STATUS_SUCCESS on success
+_IRQL_requires_max_(PASSIVE_LEVEL) NTSTATUS SharedStatisticsInitialization();
+
+/// Frees the shared statistics region
+///
+/// It must be called after all processors are de-virtualized and all user
+/// mappings are removed.
+_IRQL_requires_max_(PASSIVE_LEVEL) void SharedStatisticsTermination();
+
+/// Returns statistics of the processor
+/// @param processor_index  A system-wide processor index
+/// @return A pointer to statistics, or nullptr if it is out of range
+VmExitProcessorStatistics *SharedStatisticsGetProcessor(
+    _In_ ULONG processor_index);
+
+/// Counts a log message that could not be buffered
+void SharedStatisticsCountDroppedLogMessage();
+
+/// Takes a consistent copy of VM-exit statistics of all processors
+/// @param snapshot   A buffer to store statistics
+/// @param number_of_processors   The number of elements available in
+///        \a snapshot->processors
+/// @return STATUS_SUCCESS on success
+_IRQL_requires_max_(DISPATCH_LEVEL) NTSTATUS
+    SharedStatisticsGetVmExitStatistics(
+        _Out_ VmExitStatisticsSnapshot *snapshot,
+        _In_ ULONG number_of_processors);
+
+/// Maps the shared statistics region into the current process as read-only
+/// @param mapping   A mapping to initialize with the current process
+/// @return STATUS_SUCCESS on success
+_IRQL_requires_max_(APC_LEVEL) NTSTATUS
+    SharedStatisticsMapToUser(_Out_ SharedStatisticsMapping *mapping);
+
+/// Unmaps the region mapped by SharedStatisticsMapToUser()
+/// @param mapping   A mapping made by SharedStatisticsMapToUser()
+///
+/// It can be called in the context of any process.
+_IRQL_requires_max_(APC_LEVEL) void SharedStatisticsUnmapFromUser(
+    _Inout_ SharedStatisticsMapping *mapping);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+}  // extern "C"
+
+#endif  // HYPERPLATFORM_SHARED_STATISTICS_H_
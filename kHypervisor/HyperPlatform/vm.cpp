@@ -13,8 +13,10 @@
 #include "common.h"
 #include "ept.h"
 #include "log.h"
+#include "shared_statistics.h"
 #include "util.h"
 #include "vmm.h"
+#include "vmx.h"
 
 extern "C" {
 ////////////////////////////////////////////////////////////////////////////////
@@ -154,8 +156,14 @@ _Use_decl_annotations_ NTSTATUS VmInitialization() {
     return STATUS_HV_FEATURE_UNAVAILABLE;
   }
 
+  // Allocate VCPUs for nested VMX while the pool can still be used
+  if (!NestedVmmInitialization()) {
+    return STATUS_MEMORY_NOT_ALLOCATED;
+  }
+
   const auto shared_data = VmpInitializeSharedData();
   if (!shared_data) {
+    NestedVmmTermination();
     return STATUS_MEMORY_NOT_ALLOCATED;
   }
 
@@ -163,6 +171,7 @@ _Use_decl_annotations_ NTSTATUS VmInitialization() {
   auto status = UtilForEachProcessor(VmpStartVm, shared_data);
   if (!NT_SUCCESS(status)) {
     UtilForEachProcessor(VmpStopVm, nullptr);
+    NestedVmmTermination();
     return status;
   }
   return status;
@@ -388,6 +397,8 @@ _Use_decl_annotations_ static void VmpInitializeVm(
   RtlZeroMemory(processor_data, sizeof(ProcessorData));
   processor_data->shared_data = shared_data;
   InterlockedIncrement(&processor_data->shared_data->reference_count);
+  processor_data->statistics =
+      SharedStatisticsGetProcessor(KeGetCurrentProcessorNumberEx(nullptr));
 
   // Set up EPT
   processor_data->ept_data = EptInitialization();
@@ -938,6 +949,7 @@ _Use_decl_annotations_ void VmTermination() {
     HYPERPLATFORM_LOG_WARN("The VMM has not been uninstalled (%08x).", status);
   }
   NT_ASSERT(!VmpIsHyperPlatformInstalled());
+  NestedVmmTermination();
 }
 
 // Stops virtualization through a hypercall and frees all related memory
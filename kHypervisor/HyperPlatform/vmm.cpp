@@ -11,6 +11,8 @@
 #include "asm.h"
 #include "common.h"
 #include "ept.h"
+#include "exit_trace.h"
+#include "flight_recorder.h"
 #include "log.h"
 #include "util.h"
 #include "performance.h"
@@ -27,15 +29,6 @@ extern "C" {
 //
 // constants and macros
 //
-BOOLEAN IsEmulateVMExit = FALSE;
-// Whether VM-exit recording is enabled
-static const long kVmmpEnableRecordVmExit = false;
-
-// How many events should be recorded per a processor
-static const long kVmmpNumberOfRecords = 100;
-
-// How many processors are supported for recording
-static const long kVmmpNumberOfProcessors = 4;
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -59,6 +52,7 @@ struct GuestContext {
 	ULONG_PTR cr8;
 	KIRQL irql;
 	bool vm_continue;
+	bool vm_exit_emulated;  //!< Reflected to L1 as an emulated VM-exit
 };
 #pragma pack()
 
@@ -69,18 +63,6 @@ static_assert(sizeof(GuestContext) == 20, "Size check");
 #endif
 
 
-
-
-// Context at the moment of vmexit
-struct VmExitHistory {
-  GpRegisters gp_regs;
-  ULONG_PTR ip;
-  VmExitInformation exit_reason;
-  ULONG_PTR exit_qualification;
-  ULONG_PTR instruction_info;
-  VmExitInterruptionInformationField exception_infomation_field;
-};
-
 ////////////////////////////////////////////////////////////////////////////////
 //
 // prototypes
@@ -91,7 +73,20 @@ bool __stdcall VmmVmExitHandler(_Inout_ VmmInitialStack *stack);
 DECLSPEC_NORETURN void __stdcall VmmVmxFailureHandler(
     _Inout_ AllRegisters *all_regs);
 
-static void VmmpHandleVmExit(_Inout_ GuestContext *guest_context);
+static void VmmpHandleVmExit(_Inout_ GuestContext *guest_context,
+                             _In_ VmExitInformation exit_reason,
+                             _In_ bool fast_path);
+
+static void VmmpRecordExitTrace(_In_ GuestContext *guest_context,
+                                _In_ VmExitInformation exit_reason);
+
+static bool VmmpIsNestedVmExit();
+
+static void VmmpUpdateVmExitStatistics(_Inout_ ProcessorData *processor_data,
+                                       _In_ VmExitInformation exit_reason,
+                                       _In_ bool is_nested,
+                                       _In_ bool is_reflected,
+                                       _In_ ULONG64 elapsed_cycles);
 
 DECLSPEC_NORETURN static void VmmpHandleTripleFault(
     _Inout_ GuestContext *guest_context);
@@ -173,11 +168,8 @@ static void VmmpInjectInterruption(_In_ InterruptionType interruption_type,
 ////////////////////////////////////////////////////////////////////////////////
 //
 // variables
-// 
-// Those variables are all for diagnostic purpose
-static ULONG g_vmmp_next_history_index[kVmmpNumberOfProcessors];
-static VmExitHistory g_vmmp_vm_exit_history[kVmmpNumberOfProcessors]
-                                           [kVmmpNumberOfRecords];
+//
+
 GpRegisters* GetGpReg(GuestContext* guest_context)
 {
 	return	guest_context->gp_regs;
@@ -211,11 +203,19 @@ extern NestedVmm* GetCurrentCPU(bool IsNested);
 #pragma warning(disable : 28167)
 _Use_decl_annotations_ bool __stdcall VmmVmExitHandler(VmmInitialStack *stack) 
 {
+  const auto exit_begin_tsc = __rdtsc();
+
+  // Read it here since the current VMCS may be switched by the handler
+  const VmExitInformation exit_reason = {
+      static_cast<ULONG32>(UtilVmRead(VmcsField::kVmExitReason))};
+  const auto is_nested = VmmpIsNestedVmExit();
 
-  // Save guest's context and raise IRQL as quick as possible
+  // Save guest's context and raise IRQL as quick as possible unless the exit
+  // is handled without calling any IRQL sensitive kernel API
+  const auto fast_path = VmmIsFastPathVmExit(exit_reason);
   const auto guest_irql = KeGetCurrentIrql();
   const auto guest_cr8 = IsX64() ? __readcr8() : 0;
-  if (guest_irql < DISPATCH_LEVEL) {
+  if (!fast_path && guest_irql < DISPATCH_LEVEL) {
   	KeRaiseIrqlToDpcLevel();
   }
   NT_ASSERT(stack->reserved == MAXULONG_PTR);
@@ -226,14 +226,18 @@ _Use_decl_annotations_ bool __stdcall VmmVmExitHandler(VmmInitialStack *stack)
   							  UtilVmRead(VmcsField::kGuestRip),
   							  guest_cr8,
   							  guest_irql,
-  							  true };
+  							  true,
+  							  false };
 
   guest_context.gp_regs->sp = UtilVmRead(VmcsField::kGuestRsp);
-  
+
   VmmpSaveExtendedProcessorState(&guest_context);
  
   // Dispatch the current VM-exit event
-  VmmpHandleVmExit(&guest_context);
+  VmmpHandleVmExit(&guest_context, exit_reason, fast_path);
+  if (ExitTraceIsEnabled()) {
+    ExitTraceCommitVmExit();
+  }
 
   VmmpRestoreExtendedProcessorState(&guest_context);
 
@@ -245,49 +249,48 @@ _Use_decl_annotations_ bool __stdcall VmmVmExitHandler(VmmInitialStack *stack)
     UtilInvvpidAllContext();
   }
 
-  // Restore guest's context
-  if (guest_context.irql < DISPATCH_LEVEL && ! IsEmulateVMExit )
-  {
-    KeLowerIrql(guest_context.irql);
-  }
+  // Restore guest's context. Neither is needed when IRQL was not raised, or
+  // when the exit was reflected to L1, whose CR8 is restored on VMRESUME.
+  if (!fast_path && !guest_context.vm_exit_emulated) {
+    if (guest_context.irql < DISPATCH_LEVEL) {
+      KeLowerIrql(guest_context.irql);
+    }
 
-  // Apply possibly updated CR8 by the handler
-  if (IsX64() && !IsEmulateVMExit ) {
-    __writecr8(guest_context.cr8);
+    // Apply possibly updated CR8 by the handler
+    if (IsX64()) {
+      __writecr8(guest_context.cr8);
+    }
   }
+
+  VmmpUpdateVmExitStatistics(stack->processor_data, exit_reason, is_nested,
+                             guest_context.vm_exit_emulated,
+                             __rdtsc() - exit_begin_tsc);
   return guest_context.vm_continue;
 }
 #pragma warning(pop)
  
 //---------------------------------------------------------------------------------------------------------------------//
 // Dispatches VM-exit to a corresponding handler
-_Use_decl_annotations_ static void VmmpHandleVmExit(GuestContext *guest_context) 
+_Use_decl_annotations_ static void VmmpHandleVmExit(
+    GuestContext *guest_context, VmExitInformation exit_reason,
+    bool fast_path) 
 {
   HYPERPLATFORM_PERFORMANCE_MEASURE_THIS_SCOPE();
 
-  const VmExitInformation exit_reason = { static_cast<ULONG32>(UtilVmRead(VmcsField::kVmExitReason))};
-
-  if (kVmmpEnableRecordVmExit) 
-  {	 // Save them for ease of trouble shooting
-	 const auto processor = KeGetCurrentProcessorNumberEx(nullptr);
-	 auto &index = g_vmmp_next_history_index[processor];
-	 auto &history = g_vmmp_vm_exit_history[processor][index];
-
-	 history.gp_regs = *guest_context->gp_regs;
-	 history.ip = guest_context->ip;
-	 history.exit_reason = exit_reason;
-	 history.exit_qualification = UtilVmRead(VmcsField::kExitQualification);
-	 history.instruction_info = UtilVmRead(VmcsField::kVmxInstructionInfo);
-	 history.exception_infomation_field = { (ULONG32)UtilVmRead(VmcsField::kVmExitIntrInfo) };
-	 if (++index == kVmmpNumberOfRecords)
-	 {
-		  index = 0;
-	 }
-  } 
-  IsEmulateVMExit = FALSE; 
-  if (VMExitEmulationTest(exit_reason, guest_context))
+  if (FlightRecorderIsEnabled()) {
+    // Save them for ease of trouble shooting
+    FlightRecorderRecordVmExit(exit_reason.all,
+                               UtilVmRead(VmcsField::kExitQualification),
+                               guest_context->ip);
+  }
+  if (ExitTraceIsEnabled()) {
+    VmmpRecordExitTrace(guest_context, exit_reason);
+  }
+  // Only exceptions are reflected to L1, hence never exits on the fast path
+  if (!fast_path &&
+      VMExitEmulationTest(exit_reason, guest_context))
   {
-	  IsEmulateVMExit = TRUE;
+	  guest_context->vm_exit_emulated = true;
 	  return;
   } 
    switch (exit_reason.fields.reason) 
@@ -365,6 +368,69 @@ _Use_decl_annotations_ static void VmmpHandleVmExit(GuestContext *guest_context)
       break;
   }  
 }
+
+// Saves everything the handlers consume for offline replay. It runs before
+// dispatch so that registers are captured as the handler will read them.
+// Memory operands are added by the handlers that read them, and the record is
+// saved by VmmVmExitHandler() after dispatch.
+_Use_decl_annotations_ static void VmmpRecordExitTrace(
+    GuestContext *guest_context, VmExitInformation exit_reason) {
+  ExitTraceRecord record = {};
+  const auto number_of_registers = (IsX64()) ? 16ul : 8ul;
+  for (auto i = 0ul; i < number_of_registers; ++i) {
+    record.gp_regs[i] = *VmmpSelectRegister(i, guest_context);
+  }
+  record.guest_ip = guest_context->ip;
+  record.guest_flags = guest_context->flag_reg.all;
+  record.exit_qualification = UtilVmRead(VmcsField::kExitQualification);
+  record.exit_reason = exit_reason.all;
+  record.instruction_info =
+      static_cast<ULONG32>(UtilVmRead(VmcsField::kVmxInstructionInfo));
+  record.interruption_info =
+      static_cast<ULONG32>(UtilVmRead(VmcsField::kVmExitIntrInfo));
+  record.instruction_length =
+      static_cast<UCHAR>(UtilVmRead(VmcsField::kVmExitInstructionLen));
+  if (VmmpIsNestedVmExit()) {
+    record.flags |= kExitTraceFlagL2;
+  }
+  ExitTraceRecordVmExit(&record);
+}
+
+// Tests if the VM-exit occurred in L2, that is, while VMCS02 of a VCPU in
+// guest mode is current. It must be called before the handler switches VMCS.
+/*_Use_decl_annotations_*/ static bool VmmpIsNestedVmExit() {
+  const auto vcpu = GetCurrentCPU(false);
+  return vcpu && !vcpu->inRoot;
+}
+
+// Accounts a VM-exit to the per-processor statistics. The table is only ever
+// written by the owner processor, so no interlocked operation is required;
+// the sequence number only lets readers detect a torn copy.
+_Use_decl_annotations_ static void VmmpUpdateVmExitStatistics(
+    ProcessorData *processor_data, VmExitInformation exit_reason,
+    bool is_nested, bool is_reflected, ULONG64 elapsed_cycles) {
+  const auto statistics = processor_data->statistics;
+  const auto reason = static_cast<ULONG>(exit_reason.fields.reason);
+  if (!statistics || reason >= kVmExitStatisticsNumberOfReasons) {
+    return;
+  }
+
+  const auto origin =
+      static_cast<ULONG>((is_nested) ? VmExitOrigin::kNested
+                                     : VmExitOrigin::kNonNested);
+  statistics->sequence++;
+  KeMemoryBarrierWithoutFence();
+  auto &entry = statistics->exit_statistics.entries[origin][reason];
+  entry.count++;
+  entry.elapsed_cycles += elapsed_cycles;
+  if (is_reflected) {
+    entry.reflected++;
+  }
+  statistics->latency_histogram[PerfHistogram::GetBucketIndex(
+      elapsed_cycles)]++;
+  KeMemoryBarrierWithoutFence();
+  statistics->sequence++;
+}
 //---------------------------------------------------------------------------------------------------------------------//
 
 // Triple fault VM-exit. Fatal error.
@@ -1114,6 +1180,7 @@ _Use_decl_annotations_ static void VmmpHandleVmCall(
           guest_context->stack->processor_data->shared_data;
       VmmpIndicateSuccessfulVmcall(guest_context);
       break;
+
     default:
       // Unsupported hypercall
       VmmpIndicateUnsuccessfulVmcall(guest_context);
@@ -10,6 +10,8 @@
 #define HYPERPLATFORM_VMM_H_
 
 #include <fltKernel.h>
+#include "ia32_type.h"
+#include "vmm_statistics.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -44,11 +46,13 @@ struct ProcessorData {
   void* xsave_area;                         //!< VA to store state components
   ULONG64 xsave_inst_mask;                  //!< A mask to save state components
   UCHAR fxsave_area[512 + 16];              //!< For fxsave (+16 for alignment)
-}; 
+  VmExitProcessorStatistics* statistics;    //!< Always-on VM-exit accounting
+};
 typedef struct NestedVmm
 {
 	ULONG64   vmxon_region;
 	ULONG64   vmcs02_pa;				///VMCS02 , actual VMCS L1 will runs on
+	void*     vmcs02_region;			///VA of a region VMCS02 is loaded into
 	ULONG64   vmcs12_pa;				///VMCS12 , for L1's VMREAD and VMWRITE, as a shadow VMCS
 	ULONG64   vmcs01_pa;				///VMCS01 , Initial VMCS
 	ULONG     CpuNumber;				///VCPU number
@@ -82,4 +86,25 @@ typedef struct NestedVmm
 // implementations
 //
 
+/// Tests if a VM-exit is handled entirely in VMM context without calling any
+/// kernel API that depends on IRQL, so that VmmVmExitHandler() can leave IRQL
+/// and CR8 of the guest untouched
+/// @param exit_reason  A VM-exit reason
+/// @return true if the VM-exit is handled on the fast path
+///
+/// Shared with the simulator so that replayed VM-exits take the same path.
+inline bool VmmIsFastPathVmExit(_In_ VmExitInformation exit_reason) {
+  switch (exit_reason.fields.reason) {
+    case VmxExitReason::kCpuid:
+    case VmxExitReason::kRdtsc:
+    case VmxExitReason::kRdtscp:
+    case VmxExitReason::kXsetbv:
+    case VmxExitReason::kMsrRead:
+    case VmxExitReason::kMsrWrite:
+      return true;
+    default:
+      return false;
+  }
+}
+
 #endif  // HYPERPLATFORM_VMM_H_
@@ -0,0 +1,137 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Declares VM-exit statistics types and the interface to query them.
+///
+/// Statistics live in a region shared with user mode. A consumer either takes
+/// a copy with #IOCTL_HYPERPLATFORM_QUERY_VM_EXIT_STATISTICS, or maps the
+/// region once with #IOCTL_HYPERPLATFORM_MAP_STATISTICS and samples it without
+/// issuing any further request.
+///
+/// This header is shared with user-mode consumers and therefore must not
+/// depend on any kernel-only header. Include either <fltKernel.h> or
+/// <Windows.h> (with <winioctl.h>) before this file.
+
+#ifndef HYPERPLATFORM_VMM_STATISTICS_H_
+#define HYPERPLATFORM_VMM_STATISTICS_H_
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+/// A name of the control device
+#define HYPERPLATFORM_DEVICE_NAME_W L"\\Device\\kHypervisor"
+
+/// A name of a symbolic link to the control device
+#define HYPERPLATFORM_DOS_DEVICE_NAME_W L"\\DosDevices\\kHypervisor"
+
+/// A name user-mode consumers pass to CreateFile()
+#define HYPERPLATFORM_WIN32_DEVICE_NAME_W L"\\\\.\\kHypervisor"
+
+/// Returns VmExitStatisticsSnapshot. When the output buffer is too small to
+/// hold VmExitStatisticsSnapshot::processors for all processors, the request
+/// completes with STATUS_BUFFER_OVERFLOW (ERROR_MORE_DATA) and only
+/// VmExitStatisticsSnapshot::number_of_processors is returned.
+#define IOCTL_HYPERPLATFORM_QUERY_VM_EXIT_STATISTICS \
+  CTL_CODE(FILE_DEVICE_UNKNOWN, 0x800, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+/// Maps SharedStatistics into the calling process as read-only and returns its
+/// address as ULONG64. The mapping is valid until the handle is closed. Only
+/// the process that made the mapping can issue this request on the handle.
+#define IOCTL_HYPERPLATFORM_MAP_STATISTICS \
+  CTL_CODE(FILE_DEVICE_UNKNOWN, 0x801, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+/// The number of basic exit reasons tracked (up to XRSTORS)
+static const unsigned long kVmExitStatisticsNumberOfReasons = 65;
+
+/// The number of buckets in VmExitProcessorStatistics::latency_histogram
+static const unsigned long kVmExitLatencyNumberOfBuckets = 252;
+
+/// 'tSyH'
+static const unsigned long kSharedStatisticsSignature = 0x74537948;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+/// Distinguishes exits from a guest of this VMM from those from an L2 guest
+enum class VmExitOrigin : unsigned long {
+  kNonNested,  //!< Occurred in L1, or with no nested hypervisor running
+  kNested,     //!< Occurred in L2, i.e. with VMCS02 current
+  kNumberOfOrigins,
+};
+
+/// Accumulated cost of VM-exits for a single exit reason
+struct VmExitStatisticsEntry {
+  ULONG64 count;           //!< How many times the exit occurred
+  ULONG64 elapsed_cycles;  //!< TSC cycles spent in VmmVmExitHandler()
+  ULONG64 reflected;       //!< Of count, emulated as a VM-exit to L1
+};
+
+/// Per-processor VM-exit accounting indexed by an origin and an exit reason
+struct VmExitStatistics {
+  VmExitStatisticsEntry entries[static_cast<unsigned long>(
+      VmExitOrigin::kNumberOfOrigins)][kVmExitStatisticsNumberOfReasons];
+};
+
+/// Statistics of a processor updated by the VMM
+///
+/// The VMM increments \a sequence before and after updating the other fields,
+/// so an odd value means an update is in progress. A reader should copy the
+/// fields it needs and retry when \a sequence was odd or changed meanwhile.
+struct VmExitProcessorStatistics {
+  volatile ULONG32 sequence;         //!< Seqlock sequence number
+  ULONG32 reserved;                  //!< Unused
+  VmExitStatistics exit_statistics;  //!< Per exit reason accounting
+  /// Distribution of TSC cycles spent in VmmVmExitHandler(). Values below 4
+  /// have their own buckets. A value V above that goes to the bucket
+  /// (S + 1) * 4 + (V >> S) - 4 where S is (index of the MSB of V) - 2.
+  ULONG64 latency_histogram[kVmExitLatencyNumberOfBuckets];
+};
+
+/// A layout of the region mapped by #IOCTL_HYPERPLATFORM_MAP_STATISTICS
+struct SharedStatistics {
+  ULONG32 signature;                        //!< kSharedStatisticsSignature
+  ULONG32 size;                             //!< Size of this region in bytes
+  ULONG32 number_of_processors;             //!< Number of processors
+  ULONG32 reserved;                         //!< Unused
+  volatile LONG64 log_dropped_messages;     //!< Log messages lost
+  VmExitProcessorStatistics processors[1];  //!< Indexed by processor number
+};
+
+/// Output of #IOCTL_HYPERPLATFORM_QUERY_VM_EXIT_STATISTICS
+///
+/// Rates can be calculated by taking two snapshots and dividing differences of
+/// counts by a difference of \a tsc.
+struct VmExitStatisticsSnapshot {
+  ULONG number_of_processors;      //!< Number of valid elements in processors
+  ULONG reserved;                  //!< Unused
+  ULONG64 tsc;                     //!< TSC when the snapshot was taken
+  VmExitStatistics processors[1];  //!< Indexed by a processor number
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+#endif  // HYPERPLATFORM_VMM_STATISTICS_H_
@@ -0,0 +1,571 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Replays a recorded VM-exit trace on the simulated processor.
+///
+/// Each stream of a trace written by the trace recorder (exit_trace.h) is
+/// replayed on a freshly initialized simulator: guest registers, RIP and
+/// RFLAGS of a record are restored, its VM-exit information is stored into
+/// the current VMCS and the VM-exit is dispatched like VmmpHandleVmExit().
+/// The time spent from capturing the guest context to the return of the
+/// dispatch is accounted to the basic exit reason, so that changes to the
+/// nested VMX emulation can be compared against captured workloads.
+///
+/// Physical addresses of VMXON regions and VMCSs L1 passed to VMX instructions
+/// are mapped to pages of simulated physical memory on first use, and memory
+/// operands are redirected to a buffer of the simulator. L1 itself always runs
+/// in 64-bit mode at CPL 0 as set up by SimVmmSetupL1(). VM-exits handled only
+/// by HyperPlatform cannot be run in user mode and are reported as skipped.
+///
+/// Usage: exit_replay [-p processor] [-v] trace_file
+///        exit_replay -s trace_file [-n iterations]
+///
+/// -s writes a synthetic trace of an L1 hypervisor running an L2 guest that
+/// repeats CPUID and int 3, for trying out the tool without hardware.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <vector>
+#include "sim_hal.h"
+#include "sim_vmm.h"
+#include "../HyperPlatform/exit_trace.h"
+#include "../kHypervisor/vmcs.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+// The number of basic exit reasons accounted
+static const ULONG kExitReplaypNumberOfReasons = 66;
+
+// The default number of L2 round trips in a synthetic trace
+static const ULONG64 kExitReplaypDefaultIterations = 10000;
+
+// Bits of VM-exit instruction information shared by VMCLEAR, VMPTRLD,
+// VMPTRST, VMXON, VMREAD and VMWRITE
+static const ULONG32 kExitReplaypAddressSizeMask = 7 << 7;
+static const ULONG32 kExitReplaypAddressSize64 = 2 << 7;
+static const ULONG32 kExitReplaypIndexRegInvalid = 1 << 22;
+static const ULONG32 kExitReplaypBaseRegInvalid = 1 << 27;
+static const ULONG32 kExitReplaypMemOrReg = 1 << 10;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// Cost of VM-exits of a basic exit reason
+struct ExitReplayStatistics {
+  ULONG64 count;
+  ULONG64 reflected;  // Reflected to L1
+  ULONG64 skipped;    // Handled by HyperPlatform only
+  ULONG64 failed;     // Emulated VMX instructions that did not succeed
+  double total_ns;
+  double max_ns;
+  ULONG64 vmread;
+  ULONG64 vmwrite;
+};
+
+// State of replay of a stream
+struct ExitReplayState {
+  GpRegisters gp_regs;
+  GuestContext guest_context;
+  ULONG64 vmcs01_pa;
+  ULONG64* operand;                      // Memory operand of VMX instructions
+  std::map<ULONG64, ULONG64> pa_map;     // Recorded PA to simulated PA
+  bool in_vmx_operation;
+  ULONG64 out_of_sync;  // Records whose VMCS did not match the simulator
+  ULONG64 unmapped;     // Records whose memory operand could not be mapped
+  ExitReplayStatistics statistics[kExitReplaypNumberOfReasons];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+static bool ExitReplaypReplayStream(_In_ const ExitTraceRecord* records,
+                                    _In_ ULONG64 number_of_records,
+                                    _In_ bool verbose,
+                                    _Out_ ExitReplayState* state);
+
+static bool ExitReplaypPrepare(_Inout_ ExitReplayState* state,
+                               _In_ const ExitTraceRecord& record);
+
+static void ExitReplaypLeaveVmx(_Inout_ ExitReplayState* state);
+
+static void ExitReplaypPrint(_In_ const ExitReplayState& state);
+
+static const char* ExitReplaypGetReasonName(_In_ ULONG reason);
+
+static int ExitReplaypSynthesize(_In_ const char* path,
+                                 _In_ ULONG64 iterations);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Replays records of a processor on a freshly initialized simulator
+_Use_decl_annotations_ static bool ExitReplaypReplayStream(
+    const ExitTraceRecord* records, ULONG64 number_of_records, bool verbose,
+    ExitReplayState* state) {
+  SimInitialize(verbose);
+  if (!SimVmmSetupL1(&state->vmcs01_pa)) {
+    SimTermination();
+    return false;
+  }
+  state->operand = static_cast<ULONG64*>(NestedHalAllocate(PAGE_SIZE));
+  if (!state->operand) {
+    SimTermination();
+    return false;
+  }
+
+  for (ULONG64 i = 0; i < number_of_records; ++i) {
+    const auto& record = records[i];
+    if (!ExitReplaypPrepare(state, record)) {
+      continue;
+    }
+
+    const auto before = *SimGetCounters();
+    const auto begin = std::chrono::steady_clock::now();
+    SimVmmCaptureGuestContext(&state->gp_regs, &state->guest_context);
+    const auto disposition = SimVmmHandleVmExit(&state->guest_context);
+    const auto end = std::chrono::steady_clock::now();
+    const auto after = *SimGetCounters();
+
+    const VmExitInformation exit_reason = {record.exit_reason};
+    auto& statistics = state->statistics[static_cast<ULONG>(exit_reason.fields.reason)];
+    const auto ns =
+        std::chrono::duration<double, std::nano>(end - begin).count();
+    statistics.count++;
+    statistics.total_ns += ns;
+    statistics.max_ns = (ns > statistics.max_ns) ? ns : statistics.max_ns;
+    statistics.vmread += after.vmread - before.vmread;
+    statistics.vmwrite += after.vmwrite - before.vmwrite;
+    switch (disposition) {
+      case SimVmExitDisposition::kReflected:
+        statistics.reflected++;
+        break;
+      case SimVmExitDisposition::kSkipped:
+        statistics.skipped++;
+        break;
+      case SimVmExitDisposition::kEmulated:
+        if (exit_reason.fields.reason == VmxExitReason::kVmresume) {
+          break;
+        }
+        if (state->guest_context.flag_reg.fields.cf ||
+            state->guest_context.flag_reg.fields.zf) {
+          statistics.failed++;
+        } else if (exit_reason.fields.reason == VmxExitReason::kVmon) {
+          state->in_vmx_operation = true;
+        } else if (exit_reason.fields.reason == VmxExitReason::kVmoff) {
+          state->in_vmx_operation = false;
+        }
+        break;
+    }
+  }
+
+  ExitReplaypLeaveVmx(state);
+  SimTermination();
+  return true;
+}
+
+// Restores guest state of the record onto the simulator and stores VM-exit
+// information into the current VMCS. Returns false when the record cannot be
+// replayed.
+_Use_decl_annotations_ static bool ExitReplaypPrepare(
+    ExitReplayState* state, const ExitTraceRecord& record) {
+  const VmExitInformation exit_reason = {record.exit_reason};
+  if (static_cast<ULONG>(exit_reason.fields.reason) >=
+      kExitReplaypNumberOfReasons) {
+    state->out_of_sync++;
+    return false;
+  }
+
+  // The VM-exit must come from the level the simulator is running
+  ULONG64 current_vmcs_pa = 0;
+  NestedHalVmPtrst(&current_vmcs_pa);
+  const auto in_l2 = (current_vmcs_pa != state->vmcs01_pa);
+  if (in_l2 != ((record.flags & kExitTraceFlagL2) != 0)) {
+    state->out_of_sync++;
+    return false;
+  }
+
+  GuestContext guest_context = {};
+  guest_context.gp_regs = &state->gp_regs;
+  for (ULONG i = 0; i < RTL_NUMBER_OF(record.gp_regs); ++i) {
+    *VmmpSelectRegister(i, &guest_context) = record.gp_regs[i];
+  }
+  NestedHalVmWrite(VmcsField::kGuestRip, record.guest_ip);
+  NestedHalVmWrite(VmcsField::kGuestRflags, record.guest_flags);
+  NestedHalVmWrite(VmcsField::kGuestRsp, record.gp_regs[4]);
+
+  // Redirect a memory operand to the simulator's buffer by making its address
+  // a plain displacement
+  auto exit_qualification = record.exit_qualification;
+  auto instruction_info = record.instruction_info;
+  auto redirect = false;
+  switch (exit_reason.fields.reason) {
+    case VmxExitReason::kVmon:
+    case VmxExitReason::kVmclear:
+    case VmxExitReason::kVmptrld: {
+      if (!(record.flags & kExitTraceFlagMemoryOperand)) {
+        state->unmapped++;
+        return false;
+      }
+      auto& pa = state->pa_map[record.memory_operand];
+      if (!pa) {
+        const auto region =
+            static_cast<VmControlStructure*>(NestedHalAllocate(PAGE_SIZE));
+        if (!region) {
+          state->pa_map.erase(record.memory_operand);
+          state->unmapped++;
+          return false;
+        }
+        region->revision_identifier = kSimVmcsRevisionId;
+        pa = NestedHalPaFromVa(region);
+      }
+      *state->operand = pa;
+      redirect = true;
+      break;
+    }
+    case VmxExitReason::kVmptrst:
+      redirect = true;
+      break;
+    case VmxExitReason::kVmread:
+    case VmxExitReason::kVmwrite:
+      if (instruction_info & kExitReplaypMemOrReg) {
+        break;
+      }
+      *state->operand = record.memory_operand;
+      // Reg1 is undefined for a memory operand, but DecodeVmwriteOrVmRead()
+      // adds an index register unless it is non-zero
+      instruction_info |= 1 << 3;
+      redirect = true;
+      break;
+    default:
+      break;
+  }
+  if (redirect) {
+    instruction_info &= ~kExitReplaypAddressSizeMask;
+    instruction_info |= kExitReplaypAddressSize64 |
+                        kExitReplaypIndexRegInvalid |
+                        kExitReplaypBaseRegInvalid;
+    exit_qualification = reinterpret_cast<ULONG_PTR>(state->operand);
+  }
+
+  return SimVmExit(record.exit_reason, exit_qualification,
+                   record.interruption_info, record.instruction_length,
+                   instruction_info);
+}
+
+// Has L1 execute VMXOFF unless the trace did, so that emulation state is
+// released before the next stream
+_Use_decl_annotations_ static void ExitReplaypLeaveVmx(ExitReplayState* state) {
+  if (!state->in_vmx_operation) {
+    return;
+  }
+  NestedHalVmPtrld(&state->vmcs01_pa);
+  SimVmExit(static_cast<ULONG32>(VmxExitReason::kVmoff), 0, 0, 3, 0);
+  SimVmmCaptureGuestContext(&state->gp_regs, &state->guest_context);
+  SimVmmHandleVmx(&state->guest_context);
+  state->in_vmx_operation = false;
+}
+
+// Prints cost per basic exit reason
+_Use_decl_annotations_ static void ExitReplaypPrint(
+    const ExitReplayState& state) {
+  printf("%-20s %9s %9s %9s %7s %10s %10s %10s %8s %8s\n", "reason", "count",
+         "reflected", "skipped", "failed", "total ms", "ns/exit", "max ns",
+         "vmread", "vmwrite");
+  ExitReplayStatistics total = {};
+  for (ULONG reason = 0; reason < kExitReplaypNumberOfReasons; ++reason) {
+    const auto& statistics = state.statistics[reason];
+    if (!statistics.count) {
+      continue;
+    }
+    printf("%-20s %9llu %9llu %9llu %7llu %10.3f %10.1f %10.1f %8.1f %8.1f\n",
+           ExitReplaypGetReasonName(reason),
+           static_cast<unsigned long long>(statistics.count),
+           static_cast<unsigned long long>(statistics.reflected),
+           static_cast<unsigned long long>(statistics.skipped),
+           static_cast<unsigned long long>(statistics.failed),
+           statistics.total_ns / 1000000, statistics.total_ns / statistics.count,
+           statistics.max_ns,
+           static_cast<double>(statistics.vmread) / statistics.count,
+           static_cast<double>(statistics.vmwrite) / statistics.count);
+    total.count += statistics.count;
+    total.total_ns += statistics.total_ns;
+  }
+  if (total.count) {
+    printf("%-20s %9llu %9s %9s %7s %10.3f %10.1f\n", "total",
+           static_cast<unsigned long long>(total.count), "", "", "",
+           total.total_ns / 1000000, total.total_ns / total.count);
+  }
+  if (state.out_of_sync || state.unmapped) {
+    printf("not replayed: %llu out of sync, %llu unmapped\n",
+           static_cast<unsigned long long>(state.out_of_sync),
+           static_cast<unsigned long long>(state.unmapped));
+  }
+}
+
+// Returns a name of a basic exit reason
+_Use_decl_annotations_ static const char* ExitReplaypGetReasonName(
+    ULONG reason) {
+  static const char* kNames[kExitReplaypNumberOfReasons] = {
+      "ExceptionOrNmi", "ExternalInterrupt", "TripleFault", "Init", "Sipi",
+      "IoSmi", "OtherSmi", "PendingInterrupt", "NmiWindow", "TaskSwitch",
+      "Cpuid", "Getsec", "Hlt", "Invd", "Invlpg", "Rdpmc", "Rdtsc", "Rsm",
+      "Vmcall", "Vmclear", "Vmlaunch", "Vmptrld", "Vmptrst", "Vmread",
+      "Vmresume", "Vmwrite", "Vmoff", "Vmon", "CrAccess", "DrAccess",
+      "IoInstruction", "MsrRead", "MsrWrite", "InvalidGuestState",
+      "MsrLoading", "Undefined35", "MwaitInstruction", "MonitorTrapFlag",
+      "Undefined38", "MonitorInstruction", "PauseInstruction", "MachineCheck",
+      "Undefined42", "TprBelowThreshold", "ApicAccess", "VirtualizedEoi",
+      "GdtrOrIdtrAccess", "LdtrOrTrAccess", "EptViolation", "EptMisconfig",
+      "Invept", "Rdtscp", "VmxPreemptionTime", "Invvpid", "Wbinvd", "Xsetbv",
+      "ApicWrite", "Rdrand", "Invpcid", "Vmfunc", "Encls", "Rdseed",
+      "PageModificationLog", "Xsaves", "Xrstors", "Undefined65",
+  };
+  return (reason < kExitReplaypNumberOfReasons) ? kNames[reason] : "Unknown";
+}
+
+// Writes a synthetic single-processor trace: L1 enters VMX operation and
+// launches L2, then L2 repeatedly executes CPUID, handled by L0, and int 3,
+// reflected to L1, which reads exit information, updates guest RIP and
+// resumes L2.
+_Use_decl_annotations_ static int ExitReplaypSynthesize(const char* path,
+                                                        ULONG64 iterations) {
+  // Physical addresses of the recording machine
+  static const ULONG64 kVmxonRegionPa = 0x12345000;
+  static const ULONG64 kVmcs12Pa = 0x12346000;
+  // VMWRITE and VMREAD with rbx as the value and rcx as the field, and VMXON,
+  // VMCLEAR and VMPTRLD with [rax]
+  static const ULONG32 kRegisterOperandInfo =
+      (3 << 3) | kExitReplaypAddressSize64 | kExitReplaypMemOrReg | (1 << 28);
+  static const ULONG32 kMemoryOperandInfo =
+      kExitReplaypAddressSize64 | kExitReplaypIndexRegInvalid;
+  static const ULONG32 kBreakpointInfo =
+      static_cast<ULONG32>(InterruptionVector::kBreakpointException) |
+      (static_cast<ULONG32>(InterruptionType::kSoftwareException) << 8) |
+      (1u << 31);
+
+  std::vector<ExitTraceRecord> records;
+  ULONG64 l1_ip = 0xfffff80000001000;
+  ULONG64 l2_ip = 0x401000;
+  const auto add = [&records](VmxExitReason reason, bool in_l2, ULONG64 ip,
+                              ULONG32 instruction_info, UCHAR length) {
+    ExitTraceRecord record = {};
+    record.gp_regs[4] = (in_l2) ? 0x7ff000 : 0xfffff80000100000;
+    record.guest_ip = ip;
+    record.guest_flags = 0x2;
+    record.exit_reason = static_cast<ULONG32>(reason);
+    record.instruction_info = instruction_info;
+    record.instruction_length = length;
+    record.flags = (in_l2) ? kExitTraceFlagL2 : 0;
+    records.push_back(record);
+    return &records.back();
+  };
+  const auto vmx_memory = [&](VmxExitReason reason, ULONG64 pa) {
+    const auto record = add(reason, false, l1_ip, kMemoryOperandInfo, 4);
+    record->memory_operand = pa;
+    record->flags |= kExitTraceFlagMemoryOperand;
+    l1_ip += 4;
+  };
+  const auto vmx_register = [&](VmxExitReason reason, VmcsField field,
+                                ULONG64 value) {
+    const auto record = add(reason, false, l1_ip, kRegisterOperandInfo, 3);
+    record->gp_regs[1] = static_cast<ULONG64>(field);
+    record->gp_regs[3] = value;
+    l1_ip += 3;
+  };
+
+  vmx_memory(VmxExitReason::kVmon, kVmxonRegionPa);
+  vmx_memory(VmxExitReason::kVmclear, kVmcs12Pa);
+  vmx_memory(VmxExitReason::kVmptrld, kVmcs12Pa);
+  const struct {
+    VmcsField field;
+    ULONG64 value;
+  } vmcs12_fields[] = {
+      {VmcsField::kHostCr0, 0x80000021},
+      {VmcsField::kHostCr4, 0x2020},
+      {VmcsField::kHostCsSelector, kSimVmmCodeSelector},
+      {VmcsField::kHostRip, 0xfffff80000003000},
+      {VmcsField::kHostRsp, 0xfffff80000300000},
+      {VmcsField::kGuestCr0, 0x80000021},
+      {VmcsField::kGuestCr4, 0x2020},
+      {VmcsField::kGuestRflags, 0x2},
+      {VmcsField::kGuestCsSelector, kSimVmmCodeSelector},
+      {VmcsField::kGuestRip, l2_ip},
+      {VmcsField::kGuestRsp, 0x7ff000},
+  };
+  for (const auto& vmcs12_field : vmcs12_fields) {
+    vmx_register(VmxExitReason::kVmwrite, vmcs12_field.field,
+                 vmcs12_field.value);
+  }
+  add(VmxExitReason::kVmlaunch, false, l1_ip, 0, 3);
+
+  for (ULONG64 i = 0; i < iterations; ++i) {
+    add(VmxExitReason::kCpuid, true, l2_ip, 0, 2);
+    l2_ip += 2;
+    add(VmxExitReason::kExceptionOrNmi, true, l2_ip, 0, 1)->interruption_info =
+        kBreakpointInfo;
+    l2_ip += 1;
+
+    // L1 handles the breakpoint at its VM-exit handler and resumes L2
+    l1_ip = 0xfffff80000003000;
+    add(VmxExitReason::kCpuid, false, l1_ip, 0, 2);
+    l1_ip += 2;
+    vmx_register(VmxExitReason::kVmread, VmcsField::kVmExitReason, 0);
+    vmx_register(VmxExitReason::kVmread, VmcsField::kGuestRip, 0);
+    vmx_register(VmxExitReason::kVmwrite, VmcsField::kGuestRip, l2_ip);
+    add(VmxExitReason::kVmresume, false, l1_ip, 0, 3);
+  }
+
+  const auto file = fopen(path, "wb");
+  if (!file) {
+    perror(path);
+    return EXIT_FAILURE;
+  }
+  const ExitTraceHeader header = {kExitTraceSignature, kExitTraceVersion, 1,
+                                  sizeof(ExitTraceRecord)};
+  const ExitTraceStream stream = {records.size(), 0};
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(&stream, sizeof(stream), 1, file);
+  fwrite(records.data(), sizeof(ExitTraceRecord), records.size(), file);
+  fclose(file);
+  printf("%s: %llu records\n", path,
+         static_cast<unsigned long long>(records.size()));
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = nullptr;
+  auto synthesize = false;
+  auto iterations = kExitReplaypDefaultIterations;
+  auto processor = MAXULONG;
+  auto verbose = false;
+  for (auto i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-s")) {
+      synthesize = true;
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      iterations = strtoull(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+      processor = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "-v")) {
+      verbose = true;
+    } else if (argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      path = nullptr;
+      break;
+    }
+  }
+  if (!path) {
+    fprintf(stderr,
+            "Usage: %s [-p processor] [-v] trace_file\n"
+            "       %s -s trace_file [-n iterations]\n",
+            argv[0], argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (synthesize) {
+    return ExitReplaypSynthesize(path, iterations);
+  }
+
+  const auto file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return EXIT_FAILURE;
+  }
+  ExitTraceHeader header = {};
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.signature != kExitTraceSignature ||
+      header.version != kExitTraceVersion ||
+      header.record_size != sizeof(ExitTraceRecord)) {
+    fprintf(stderr, "%s: not a supported trace file\n", path);
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  // Counts in the file are checked against its size before allocating for them
+  fseek(file, 0, SEEK_END);
+  const auto file_size = ftell(file);
+  fseek(file, sizeof(header), SEEK_SET);
+  auto remaining_size =
+      (file_size > 0) ? static_cast<ULONG64>(file_size) - sizeof(header) : 0;
+  if (header.number_of_processors >
+      remaining_size / sizeof(ExitTraceStream)) {
+    fprintf(stderr, "%s: truncated\n", path);
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+  if (processor != MAXULONG && processor >= header.number_of_processors) {
+    fprintf(stderr, "%s: no processor %lu in %u processors\n", path,
+            processor, header.number_of_processors);
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+  remaining_size -= sizeof(ExitTraceStream) * header.number_of_processors;
+
+  std::vector<ExitTraceStream> streams(header.number_of_processors);
+  if (fread(streams.data(), sizeof(ExitTraceStream), streams.size(), file) !=
+      streams.size()) {
+    fprintf(stderr, "%s: truncated\n", path);
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  auto result = EXIT_SUCCESS;
+  std::vector<ExitTraceRecord> records;
+  for (ULONG i = 0; i < header.number_of_processors; ++i) {
+    const auto& stream = streams[i];
+    if (stream.number_of_records > remaining_size / sizeof(ExitTraceRecord)) {
+      fprintf(stderr, "%s: truncated\n", path);
+      result = EXIT_FAILURE;
+      break;
+    }
+    remaining_size -= sizeof(ExitTraceRecord) * stream.number_of_records;
+    records.resize(stream.number_of_records);
+    if (fread(records.data(), sizeof(ExitTraceRecord), records.size(),
+              file) != records.size()) {
+      fprintf(stderr, "%s: truncated\n", path);
+      result = EXIT_FAILURE;
+      break;
+    }
+    if (!stream.number_of_records || (processor != MAXULONG && processor != i)) {
+      continue;
+    }
+
+    printf("processor %u: %llu records, %llu dropped\n", i,
+           static_cast<unsigned long long>(stream.number_of_records),
+           static_cast<unsigned long long>(stream.dropped_records));
+    auto state = new ExitReplayState();
+    if (!ExitReplaypReplayStream(records.data(), records.size(), verbose,
+                                 state)) {
+      fprintf(stderr, "processor %u: setup failed\n", i);
+      result = EXIT_FAILURE;
+    } else {
+      ExitReplaypPrint(*state);
+    }
+    delete state;
+  }
+  fclose(file);
+  return result;
+}
@@ -0,0 +1,144 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Stands in for the WDK header on Linux.
+///
+/// Defines only what the platform-neutral nested VMX code and the headers it
+/// includes from HyperPlatform use: LLP64 integer types, a few constants and
+/// structures, and SAL annotations expanding to nothing. Kernel APIs are not
+/// provided here; the code reaches the platform through nested_hal.h.
+
+#ifndef NESTED_SIM_FLTKERNEL_H_
+#define NESTED_SIM_FLTKERNEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+#define EXTERN_C extern "C"
+#define RTL_NUMBER_OF(A) (sizeof(A) / sizeof((A)[0]))
+
+#define RtlFillMemory(Destination, Length, Fill) \
+  memset((Destination), (Fill), (Length))
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#define RtlCopyMemory(Destination, Source, Length) \
+  memcpy((Destination), (Source), (Length))
+
+#define CTL_CODE(DeviceType, Function, Method, Access) \
+  (((DeviceType) << 16) | ((Access) << 14) | ((Function) << 2) | (Method))
+
+// SAL annotations
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+#define _Inout_opt_
+#define _Use_decl_annotations_
+#define _Success_(expr)
+#define _IRQL_requires_max_(irql)
+#define _IRQL_raises_(irql)
+#define _IRQL_saves_
+#define _IRQL_restores_
+#define _When_(expr, annotation)
+#define _Must_inspect_result_
+
+// MSVC integer keywords used by ia32_type.h
+#define __int8 char
+#define __int16 short
+#define __int32 int
+#define __int64 long long
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+#if defined(__x86_64__) && !defined(_AMD64_)
+#define _AMD64_ 1
+#endif
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAXUCHAR 0xff
+#define MAXUSHORT 0xffff
+#define MAXULONG 0xffffffffUL
+#define MAXULONG64 0xffffffffffffffffULL
+#define MAXULONG_PTR (~static_cast<ULONG_PTR>(0))
+
+#define PAGE_SIZE 0x1000
+#define PAGE_SHIFT 12
+
+#define PASSIVE_LEVEL 0
+#define APC_LEVEL 1
+#define DISPATCH_LEVEL 2
+
+#define FILE_DEVICE_UNKNOWN 0x00000022
+#define METHOD_BUFFERED 0
+#define FILE_ANY_ACCESS 0
+#define FILE_READ_ACCESS 0x0001
+#define FILE_WRITE_ACCESS 0x0002
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+typedef void VOID, *PVOID;
+typedef char CHAR, *PCHAR;
+typedef unsigned char UCHAR, *PUCHAR;
+typedef unsigned char BOOLEAN, *PBOOLEAN;
+typedef short SHORT, *PSHORT;
+typedef unsigned short USHORT, *PUSHORT;
+typedef int32_t LONG, *PLONG;
+typedef uint32_t ULONG, *PULONG;
+typedef int32_t LONG32, *PLONG32;
+typedef uint32_t ULONG32, *PULONG32;
+typedef int64_t LONG64, *PLONG64;
+typedef uint64_t ULONG64, *PULONG64;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR, *PULONG_PTR;
+typedef uintptr_t SIZE_T;
+typedef UCHAR KIRQL;
+typedef LONG NTSTATUS;
+typedef ULONG PFN_COUNT;
+typedef ULONG_PTR PFN_NUMBER;
+
+// Opaque kernel objects that appear only in prototypes
+typedef struct _DRIVER_OBJECT *PDRIVER_OBJECT;
+typedef const struct _UNICODE_STRING *PCUNICODE_STRING;
+typedef struct _KDPC *PKDPC;
+typedef void KDEFERRED_ROUTINE(_In_ PKDPC dpc, _In_opt_ PVOID context,
+                               _In_opt_ PVOID system_argument1,
+                               _In_opt_ PVOID system_argument2);
+typedef KDEFERRED_ROUTINE *PKDEFERRED_ROUTINE;
+
+typedef union _LARGE_INTEGER {
+  struct {
+    ULONG LowPart;
+    LONG HighPart;
+  };
+  LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _PROCESSOR_NUMBER {
+  USHORT Group;
+  UCHAR Number;
+  UCHAR Reserved;
+} PROCESSOR_NUMBER, *PPROCESSOR_NUMBER;
+
+static_assert(sizeof(ULONG) == 4, "LLP64 requires 32-bit ULONG");
+static_assert(sizeof(ULONG_PTR) == sizeof(void*), "Size check");
+
+#endif  // NESTED_SIM_FLTKERNEL_H_
@@ -0,0 +1,20 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Stands in for the MSVC header on Linux. Only __rdtsc() and interlocked
+/// operations are provided; VMX and control register intrinsics are reached
+/// through nested_hal.h instead.
+
+#ifndef NESTED_SIM_INTRIN_H_
+#define NESTED_SIM_INTRIN_H_
+
+#include <x86intrin.h>
+
+#define _InterlockedIncrement(Addend) \
+  __atomic_add_fetch((Addend), 1, __ATOMIC_SEQ_CST)
+#define _InterlockedDecrement(Addend) \
+  __atomic_sub_fetch((Addend), 1, __ATOMIC_SEQ_CST)
+
+#endif  // NESTED_SIM_INTRIN_H_
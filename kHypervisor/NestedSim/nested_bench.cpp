@@ -0,0 +1,340 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Measures the nested VMX emulation on the simulated processor.
+///
+/// An L1 hypervisor is played by writing VM-exit information of its VMX
+/// instructions into VMCS01 and handing them to the emulation code exactly as
+/// VmmpHandleVmx() does, and an L2 guest by raising breakpoint VM-exits on
+/// VMCS02 and handing them to VMExitEmulationTest(). Each benchmark reports
+/// time per operation and how many simulated VMX operations one operation
+/// needed, so that the cost of the emulation itself is visible apart from the
+/// cost of VT-x.
+///
+/// Usage: nested_bench [-n iterations] [-v]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "sim_hal.h"
+#include "sim_vmm.h"
+#include "../kHypervisor/vmcs.h"
+#include "../kHypervisor/vmx.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+// The default number of iterations of each benchmark
+static const ULONG64 kNestedBenchpDefaultIterations = 1000000;
+
+// Registers used as operands of VMX instructions executed by L1
+static const ULONG kNestedBenchpRax = 0;  // A memory operand address
+static const ULONG kNestedBenchpRcx = 1;  // A VMCS field encoding
+static const ULONG kNestedBenchpRbx = 3;  // A value to VMREAD or VMWRITE
+
+// VM-exit instruction information
+// See: Format of the VM-Exit Instruction-Information Field as Used for
+// VMCLEAR, VMPTRLD, VMPTRST, VMXON, XRSTORS, and XSAVES: [rax] in 64-bit mode
+static const ULONG32 kNestedBenchpMemoryOperandInfo =
+    (2 << 7) | (1 << 22) | (kNestedBenchpRax << 23);
+// See: Format of the VM-Exit Instruction-Information Field as Used for VMREAD
+// and VMWRITE: rbx as the value and rcx as the field
+static const ULONG32 kNestedBenchpRegisterOperandInfo =
+    (kNestedBenchpRbx << 3) | (2 << 7) | (1 << 10) | (kNestedBenchpRcx << 28);
+
+// VM-exit interruption information of int 3
+static const ULONG32 kNestedBenchpBreakpointInfo =
+    static_cast<ULONG32>(InterruptionVector::kBreakpointException) |
+    (static_cast<ULONG32>(InterruptionType::kSoftwareException) << 8) |
+    (1u << 31);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// The guest as seen by the VMM
+struct NestedBenchGuest {
+  GpRegisters gp_regs;
+  GuestContext guest_context;
+  ULONG64* operand;  // Memory operand of VMCLEAR, VMPTRLD and VMXON
+  ULONG64 vmxon_region_pa;
+  ULONG64 vmcs01_pa;
+  ULONG64 vmcs12_pa;
+  ULONG64 failures;  // Emulated instructions that did not succeed
+};
+
+// A benchmark; returns false when the scenario could not be set up
+typedef bool (*NestedBenchRoutine)(NestedBenchGuest* guest);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+static bool NestedBenchpSetupL1(_Out_ NestedBenchGuest* guest);
+
+static void NestedBenchpExecuteL1(_Inout_ NestedBenchGuest* guest,
+                                  _In_ VmxExitReason reason,
+                                  _In_ ULONG32 instruction_info);
+
+static void NestedBenchpExitL2(_Inout_ NestedBenchGuest* guest);
+
+static bool NestedBenchpLaunchL2(_Inout_ NestedBenchGuest* guest);
+
+static void NestedBenchpRun(_In_ const char* name, _In_ ULONG64 iterations,
+                            _In_ bool verbose, _In_ bool needs_l2,
+                            _In_ NestedBenchRoutine routine);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Sets up VMCS01 for an L1 hypervisor, and has it execute VMXON and VMPTRLD
+_Use_decl_annotations_ static bool NestedBenchpSetupL1(
+    NestedBenchGuest* guest) {
+  RtlZeroMemory(guest, sizeof(*guest));
+  if (!SimVmmSetupL1(&guest->vmcs01_pa)) {
+    return false;
+  }
+
+  const auto vmxon_region = static_cast<VmControlStructure*>(
+      NestedHalAllocate(PAGE_SIZE));
+  const auto vmcs12 = static_cast<VmControlStructure*>(
+      NestedHalAllocate(PAGE_SIZE));
+  guest->operand = static_cast<ULONG64*>(NestedHalAllocate(PAGE_SIZE));
+  if (!vmxon_region || !vmcs12 || !guest->operand) {
+    return false;
+  }
+  vmxon_region->revision_identifier = kSimVmcsRevisionId;
+  vmcs12->revision_identifier = kSimVmcsRevisionId;
+  guest->vmxon_region_pa = NestedHalPaFromVa(vmxon_region);
+  guest->vmcs12_pa = NestedHalPaFromVa(vmcs12);
+
+  *guest->operand = guest->vmxon_region_pa;
+  NestedBenchpExecuteL1(guest, VmxExitReason::kVmon,
+                        kNestedBenchpMemoryOperandInfo);
+  *guest->operand = guest->vmcs12_pa;
+  NestedBenchpExecuteL1(guest, VmxExitReason::kVmptrld,
+                        kNestedBenchpMemoryOperandInfo);
+
+  // L1 state to be loaded on VM-exit from L2, and L2 state, both of which are
+  // the same mode as L1 set up by SimVmmSetupL1()
+  const Cr0 cr0 = {0x80000021};  // PG, NE and PE
+  const Cr4 cr4 = {0x2020};      // VMXE and PAE
+  const struct {
+    VmcsField field;
+    ULONG_PTR value;
+  } vmcs12_fields[] = {
+      {VmcsField::kHostCr0, cr0.all},
+      {VmcsField::kHostCr4, cr4.all},
+      {VmcsField::kHostCsSelector, kSimVmmCodeSelector},
+      {VmcsField::kHostRip, 0xfffff80000003000},
+      {VmcsField::kHostRsp, 0xfffff80000300000},
+      {VmcsField::kGuestCr0, cr0.all},
+      {VmcsField::kGuestCr4, cr4.all},
+      {VmcsField::kGuestRflags, 0x2},
+      {VmcsField::kGuestCsSelector, kSimVmmCodeSelector},
+      {VmcsField::kGuestRip, 0x401000},
+      {VmcsField::kGuestRsp, 0x7ff000},
+  };
+  for (const auto& vmcs12_field : vmcs12_fields) {
+    guest->gp_regs.cx = static_cast<ULONG_PTR>(vmcs12_field.field);
+    guest->gp_regs.bx = vmcs12_field.value;
+    NestedBenchpExecuteL1(guest, VmxExitReason::kVmwrite,
+                          kNestedBenchpRegisterOperandInfo);
+  }
+  return guest->failures == 0;
+}
+
+// Has L1 execute a VMX instruction, and emulates it like VmmVmExitHandler()
+_Use_decl_annotations_ static void NestedBenchpExecuteL1(
+    NestedBenchGuest* guest, VmxExitReason reason, ULONG32 instruction_info) {
+  guest->gp_regs.ax = reinterpret_cast<ULONG_PTR>(guest->operand);
+  SimVmExit(static_cast<ULONG32>(reason), 0, 0, 3, instruction_info);
+  SimVmmCaptureGuestContext(&guest->gp_regs, &guest->guest_context);
+  SimVmmHandleVmx(&guest->guest_context);
+  if (reason != VmxExitReason::kVmresume &&
+      (guest->guest_context.flag_reg.fields.cf ||
+       guest->guest_context.flag_reg.fields.zf)) {
+    guest->failures++;
+  }
+}
+
+// Has L2 execute int 3, and reflects it to L1 like VmmVmExitHandler()
+_Use_decl_annotations_ static void NestedBenchpExitL2(NestedBenchGuest* guest) {
+  SimVmExit(static_cast<ULONG32>(VmxExitReason::kExceptionOrNmi), 0,
+            kNestedBenchpBreakpointInfo, 1, 0);
+  SimVmmCaptureGuestContext(&guest->gp_regs, &guest->guest_context);
+  const VmExitInformation exit_reason = {
+      static_cast<ULONG32>(NestedHalVmRead(VmcsField::kVmExitReason))};
+  if (!VMExitEmulationTest(exit_reason, &guest->guest_context)) {
+    guest->failures++;
+  }
+}
+
+// Has L1 launch L2 and L2 exit to L1, so that VMRESUME can be emulated
+_Use_decl_annotations_ static bool NestedBenchpLaunchL2(
+    NestedBenchGuest* guest) {
+  NestedBenchpExecuteL1(guest, VmxExitReason::kVmlaunch, 0);
+  NestedBenchpExitL2(guest);
+  return guest->failures == 0;
+}
+
+// VMREAD by the simulator itself
+static bool NestedBenchpSimVmRead(NestedBenchGuest* guest) {
+  UNREFERENCED_PARAMETER(guest);
+  NestedHalVmRead(VmcsField::kGuestRip);
+  return true;
+}
+
+// VMWRITE by the simulator itself
+static bool NestedBenchpSimVmWrite(NestedBenchGuest* guest) {
+  NestedHalVmWrite(VmcsField::kGuestRsp, guest->gp_regs.sp);
+  return true;
+}
+
+// VMREAD of VMCS12 in memory
+static bool NestedBenchpVmcs12Read(NestedBenchGuest* guest) {
+  ULONG64 value = 0;
+  VmRead64(VmcsField::kGuestRip,
+           reinterpret_cast<ULONG_PTR>(NestedHalVaFromPa(guest->vmcs12_pa)),
+           &value);
+  return true;
+}
+
+// VMREAD executed by L1
+static bool NestedBenchpVmReadEmulation(NestedBenchGuest* guest) {
+  guest->gp_regs.cx = static_cast<ULONG_PTR>(VmcsField::kGuestRip);
+  NestedBenchpExecuteL1(guest, VmxExitReason::kVmread,
+                        kNestedBenchpRegisterOperandInfo);
+  return true;
+}
+
+// VMWRITE executed by L1
+static bool NestedBenchpVmWriteEmulation(NestedBenchGuest* guest) {
+  guest->gp_regs.cx = static_cast<ULONG_PTR>(VmcsField::kGuestRip);
+  guest->gp_regs.bx = 0x1000;
+  NestedBenchpExecuteL1(guest, VmxExitReason::kVmwrite,
+                        kNestedBenchpRegisterOperandInfo);
+  return true;
+}
+
+// VMPTRLD executed by L1, which replaces VMCS02
+static bool NestedBenchpVmPtrldEmulation(NestedBenchGuest* guest) {
+  *guest->operand = guest->vmcs12_pa;
+  NestedBenchpExecuteL1(guest, VmxExitReason::kVmptrld,
+                        kNestedBenchpMemoryOperandInfo);
+  return true;
+}
+
+// VMLAUNCH executed by L1 followed by a VM-exit from L2 reflected to L1
+static bool NestedBenchpVmLaunchEmulation(NestedBenchGuest* guest) {
+  NestedBenchpExecuteL1(guest, VmxExitReason::kVmlaunch, 0);
+  NestedBenchpExitL2(guest);
+  return true;
+}
+
+// VMRESUME executed by L1 followed by a VM-exit from L2 reflected to L1
+static bool NestedBenchpVmResumeEmulation(NestedBenchGuest* guest) {
+  NestedBenchpExecuteL1(guest, VmxExitReason::kVmresume, 0);
+  NestedBenchpExitL2(guest);
+  return true;
+}
+
+// Runs a benchmark on a freshly initialized simulator and prints results
+_Use_decl_annotations_ static void NestedBenchpRun(const char* name,
+                                                   ULONG64 iterations,
+                                                   bool verbose, bool needs_l2,
+                                                   NestedBenchRoutine routine) {
+  SimInitialize(verbose);
+  auto guest = new NestedBenchGuest();
+  if (!NestedBenchpSetupL1(guest) || (needs_l2 && !NestedBenchpLaunchL2(guest))) {
+    printf("%-24s setup failed\n", name);
+    delete guest;
+    SimTermination();
+    exit(EXIT_FAILURE);
+  }
+
+  const auto before = *SimGetCounters();
+  const auto begin = std::chrono::steady_clock::now();
+  for (ULONG64 i = 0; i < iterations; ++i) {
+    routine(guest);
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const auto after = *SimGetCounters();
+
+  // Leave VMX operation so that the next benchmark can execute VMXON again
+  NestedBenchpExecuteL1(guest, VmxExitReason::kVmoff, 0);
+
+  const auto ns = std::chrono::duration<double, std::nano>(end - begin).count();
+  const auto per_op = [iterations](ULONG64 from, ULONG64 to) {
+    return static_cast<double>(to - from) / iterations;
+  };
+  printf("%-24s %10llu %10.1f %9.1f %9.1f %9.1f %7.1f %7.1f%s\n", name,
+         static_cast<unsigned long long>(iterations), ns / iterations,
+         per_op(before.vmread, after.vmread),
+         per_op(before.vmwrite, after.vmwrite),
+         per_op(before.log, after.log),
+         per_op(before.vmptrld + before.vmclear, after.vmptrld + after.vmclear),
+         per_op(before.debug_break, after.debug_break),
+         (guest->failures || after.vmx_failure != before.vmx_failure)
+             ? "  FAILED"
+             : "");
+  delete guest;
+  SimTermination();
+}
+
+int main(int argc, char* argv[]) {
+  auto iterations = kNestedBenchpDefaultIterations;
+  auto verbose = false;
+  for (auto i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      iterations = strtoull(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "-v")) {
+      verbose = true;
+    } else {
+      fprintf(stderr, "Usage: %s [-n iterations] [-v]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (!iterations) {
+    iterations = 1;
+  }
+
+  printf("%-24s %10s %10s %9s %9s %9s %7s %7s\n", "benchmark", "iterations",
+         "ns/op", "vmread", "vmwrite", "log", "vmptr", "break");
+  NestedBenchpRun("sim VMREAD", iterations, verbose, false,
+                  NestedBenchpSimVmRead);
+  NestedBenchpRun("sim VMWRITE", iterations, verbose, false,
+                  NestedBenchpSimVmWrite);
+  NestedBenchpRun("VMCS12 VmRead64", iterations, verbose, false,
+                  NestedBenchpVmcs12Read);
+  NestedBenchpRun("VMREAD emulation", iterations, verbose, false,
+                  NestedBenchpVmReadEmulation);
+  NestedBenchpRun("VMWRITE emulation", iterations, verbose, false,
+                  NestedBenchpVmWriteEmulation);
+  NestedBenchpRun("VMPTRLD emulation", iterations, verbose, false,
+                  NestedBenchpVmPtrldEmulation);
+  NestedBenchpRun("VMLAUNCH + VM-exit", iterations, verbose, false,
+                  NestedBenchpVmLaunchEmulation);
+  NestedBenchpRun("VMRESUME + VM-exit", iterations, verbose, true,
+                  NestedBenchpVmResumeEmulation);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,560 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the nested VMX hardware abstraction on a simulated processor.
+///
+/// Simulated physical memory is a table of page-sized allocations; the
+/// physical address of a page is kSimpPhysicalBase plus its slot number times
+/// PAGE_SIZE, so that VA-to-PA and PA-to-VA translations are cheap and
+/// addresses look like real, page-aligned physical addresses to the emulation
+/// code. Each page also owns a field array used when the page is loaded as a
+/// VMCS, so VMREAD and VMWRITE never touch the page contents, just like on a
+/// processor, while VMCS12 accessed through VmRead*() and VmWrite*() lives in
+/// the page itself.
+
+#include "sim_hal.h"
+#include "../kHypervisor/vmcs.h"
+#include "../kHypervisor/vmx.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+extern "C" {
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+// A physical address of the first simulated page
+static const ULONG64 kSimpPhysicalBase = 0x10000000;
+
+// The number of VMCS field types (width and type combined) and indexes
+static const ULONG kSimpVmcsFieldTypes = 16;
+static const ULONG kSimpVmcsFieldIndexes = 64;
+
+// A VMCS field type of VM-exit information fields, which are read-only
+static const ULONG kSimpVmcsReadOnlyType = 1;
+
+// An invalid VMCS pointer, which is the current VMCS after VMXON or VMCLEAR
+static const ULONG64 kSimpInvalidVmcsPointer = 0xFFFFFFFFFFFFFFFF;
+
+// The number of simulated MSRs
+static const ULONG kSimpNumberOfMsrs = 16;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// A VMCS as the processor keeps it
+struct SimVmcs {
+  ULONG64 fields[kSimpVmcsFieldTypes][kSimpVmcsFieldIndexes];
+  bool launched;  // The launch state; false means "clear"
+};
+
+// A page of simulated physical memory
+struct SimPage {
+  void* va;      // A page-aligned allocation, or nullptr when free
+  SimVmcs vmcs;  // Used while the page is VMCS
+};
+
+// A simulated MSR
+struct SimMsr {
+  Msr msr;
+  ULONG64 value;
+};
+
+// The state of the simulated processor
+struct SimProcessor {
+  SimPage pages[kSimNumberOfPages];
+  ULONG64 current_vmcs_pa;
+  SimMsr msrs[kSimpNumberOfMsrs];
+  ULONG number_of_msrs;
+  ULONG_PTR cr8;
+  KIRQL irql;
+  bool verbose;
+  SimCounters counters;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+static SimPage* SimpGetPage(_In_ ULONG64 pa);
+
+static SimVmcs* SimpGetCurrentVmcs();
+
+static bool SimpDecodeField(_In_ VmcsField field, _Out_ ULONG* type,
+                            _Out_ ULONG* index, _Out_ ULONG* width,
+                            _Out_ bool* high);
+
+static VmxStatus SimpVmFailValid(_In_ VmxInstructionError error);
+
+static VmxStatus SimpVmRead(_In_ VmcsField field, _Out_ ULONG64* value);
+
+static VmxStatus SimpVmWrite(_In_ VmcsField field, _In_ ULONG64 value);
+
+static SimMsr* SimpFindMsr(_In_ Msr msr);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+static SimProcessor* g_simp_processor;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Resets the simulated processor and frees all simulated physical memory
+_Use_decl_annotations_ void SimInitialize(bool verbose) {
+  SimTermination();
+  g_simp_processor = new SimProcessor();
+  RtlZeroMemory(g_simp_processor, sizeof(SimProcessor));
+  g_simp_processor->current_vmcs_pa = kSimpInvalidVmcsPointer;
+  g_simp_processor->verbose = verbose;
+
+  // Advertise VMCS revision kSimVmcsRevisionId, a 4KB VMCS region, write-back
+  // memory type and true VMX controls. Allowed-1 settings are all ones.
+  const Ia32VmxBasicMsr vmx_basic = {
+      kSimVmcsRevisionId | (0x1000ull << 32) | (6ull << 50) | (1ull << 54) |
+      (1ull << 55)};
+  SimSetMsr(Msr::kIa32VmxBasic, vmx_basic.all);
+  SimSetMsr(Msr::kIa32FeatureControl, 0x5);  // lock and enable_vmxon
+  SimSetMsr(Msr::kIa32VmxPinbasedCtls, 0xffffffff00000016);
+  SimSetMsr(Msr::kIa32VmxProcBasedCtls, 0xffffffff0401e172);
+  SimSetMsr(Msr::kIa32VmxExitCtls, 0xffffffff00036dff);
+  SimSetMsr(Msr::kIa32VmxEntryCtls, 0xffffffff000011ff);
+  SimSetMsr(Msr::kIa32VmxTruePinbasedCtls, 0xffffffff00000016);
+  SimSetMsr(Msr::kIa32VmxTrueProcBasedCtls, 0xffffffff04006172);
+  SimSetMsr(Msr::kIa32VmxTrueExitCtls, 0xffffffff00036dfb);
+  SimSetMsr(Msr::kIa32VmxTrueEntryCtls, 0xffffffff000011fb);
+  SimSetMsr(Msr::kIa32VmxProcBasedCtls2, 0xffffffff00000000);
+}
+
+// Frees VCPUs and all simulated physical memory
+_Use_decl_annotations_ void SimTermination() {
+  if (!g_simp_processor) {
+    return;
+  }
+  NestedVmmTermination();
+  for (auto& page : g_simp_processor->pages) {
+    free(page.va);
+  }
+  delete g_simp_processor;
+  g_simp_processor = nullptr;
+}
+
+// Returns counts of operations since SimInitialize()
+_Use_decl_annotations_ const SimCounters* SimGetCounters() {
+  return &g_simp_processor->counters;
+}
+
+// Sets a value NestedHalReadMsr64() returns for the MSR
+_Use_decl_annotations_ void SimSetMsr(Msr msr, ULONG64 value) {
+  auto entry = SimpFindMsr(msr);
+  if (!entry) {
+    if (g_simp_processor->number_of_msrs == kSimpNumberOfMsrs) {
+      return;
+    }
+    entry = &g_simp_processor->msrs[g_simp_processor->number_of_msrs++];
+    entry->msr = msr;
+  }
+  entry->value = value;
+}
+
+// Stores VM-exit information into the current VMCS like a processor does. A
+// VMCS stays current and launched across VM-exit.
+_Use_decl_annotations_ bool SimVmExit(ULONG32 exit_reason,
+                                      ULONG_PTR exit_qualification,
+                                      ULONG32 interruption_info,
+                                      ULONG32 instruction_length,
+                                      ULONG32 instruction_info) {
+  const auto vmcs = SimpGetCurrentVmcs();
+  if (!vmcs) {
+    return false;
+  }
+  const struct {
+    VmcsField field;
+    ULONG64 value;
+  } exit_information[] = {
+      {VmcsField::kVmExitReason, exit_reason},
+      {VmcsField::kExitQualification, exit_qualification},
+      {VmcsField::kVmExitIntrInfo, interruption_info},
+      {VmcsField::kVmExitInstructionLen, instruction_length},
+      {VmcsField::kVmxInstructionInfo, instruction_info},
+  };
+  for (const auto& info : exit_information) {
+    ULONG type = 0, index = 0, width = 0;
+    bool high = false;
+    if (!SimpDecodeField(info.field, &type, &index, &width, &high)) {
+      return false;
+    }
+    vmcs->fields[type][index] = info.value;
+  }
+  return true;
+}
+
+// Tests if a VMCS has been launched
+_Use_decl_annotations_ bool SimIsVmcsLaunched(ULONG64 vmcs_pa) {
+  const auto page = SimpGetPage(vmcs_pa);
+  return page && page->vmcs.launched;
+}
+
+// Returns a simulated page for the physical address, or nullptr
+_Use_decl_annotations_ static SimPage* SimpGetPage(ULONG64 pa) {
+  if (pa < kSimpPhysicalBase) {
+    return nullptr;
+  }
+  const auto slot = (pa - kSimpPhysicalBase) >> PAGE_SHIFT;
+  if (slot >= kSimNumberOfPages || !g_simp_processor->pages[slot].va) {
+    return nullptr;
+  }
+  return &g_simp_processor->pages[slot];
+}
+
+// Returns the current VMCS, or nullptr
+_Use_decl_annotations_ static SimVmcs* SimpGetCurrentVmcs() {
+  const auto page = SimpGetPage(g_simp_processor->current_vmcs_pa);
+  return (page) ? &page->vmcs : nullptr;
+}
+
+// Splits a field encoding into a field type and an index for SimVmcs::fields.
+// See: Structure of VMCS Component Encoding
+_Use_decl_annotations_ static bool SimpDecodeField(VmcsField field,
+                                                   ULONG* type, ULONG* index,
+                                                   ULONG* width, bool* high) {
+  const auto encoding = static_cast<ULONG>(field);
+  if (encoding & 0xffff9000) {  // bits 12 and 15-31 are reserved
+    return false;
+  }
+  *high = (encoding & 1) != 0;
+  *index = (encoding >> 1) & 0x1ff;
+  *width = (encoding >> 13) & 3;
+  *type = (*width << 2) | ((encoding >> 10) & 3);
+  // High access is valid only for 64-bit fields
+  if (*index >= kSimpVmcsFieldIndexes ||
+      (*high && *width != VMCS_FIELD_WIDTH_64BIT)) {
+    return false;
+  }
+  return true;
+}
+
+// Stores an error number into the current VMCS and returns VMfailValid
+_Use_decl_annotations_ static VmxStatus SimpVmFailValid(
+    VmxInstructionError error) {
+  g_simp_processor->counters.vmx_failure++;
+  const auto vmcs = SimpGetCurrentVmcs();
+  if (!vmcs) {
+    return VmxStatus::kErrorWithoutStatus;
+  }
+  ULONG type, index, width;
+  bool high;
+  SimpDecodeField(VmcsField::kVmInstructionError, &type, &index, &width,
+                  &high);
+  vmcs->fields[type][index] = static_cast<ULONG64>(error);
+  return VmxStatus::kErrorWithStatus;
+}
+
+// Reads a field of the current VMCS
+_Use_decl_annotations_ static VmxStatus SimpVmRead(VmcsField field,
+                                                   ULONG64* value) {
+  *value = 0;
+  const auto vmcs = SimpGetCurrentVmcs();
+  if (!vmcs) {
+    g_simp_processor->counters.vmx_failure++;
+    return VmxStatus::kErrorWithoutStatus;
+  }
+  ULONG type, index, width;
+  bool high;
+  if (!SimpDecodeField(field, &type, &index, &width, &high)) {
+    return SimpVmFailValid(VmxInstructionError::kUnsupportedVmcsComponent);
+  }
+
+  const auto stored = vmcs->fields[type][index];
+  if (high) {
+    *value = stored >> 32;
+  } else if (width == VMCS_FIELD_WIDTH_16BIT) {
+    *value = stored & 0xffff;
+  } else if (width == VMCS_FIELD_WIDTH_32BIT) {
+    *value = stored & 0xffffffff;
+  } else {
+    *value = stored;
+  }
+  return VmxStatus::kOk;
+}
+
+// Writes a field of the current VMCS
+_Use_decl_annotations_ static VmxStatus SimpVmWrite(VmcsField field,
+                                                    ULONG64 value) {
+  const auto vmcs = SimpGetCurrentVmcs();
+  if (!vmcs) {
+    g_simp_processor->counters.vmx_failure++;
+    return VmxStatus::kErrorWithoutStatus;
+  }
+  ULONG type, index, width;
+  bool high;
+  if (!SimpDecodeField(field, &type, &index, &width, &high)) {
+    return SimpVmFailValid(VmxInstructionError::kUnsupportedVmcsComponent);
+  }
+  if ((type & 3) == kSimpVmcsReadOnlyType) {
+    return SimpVmFailValid(VmxInstructionError::kVmwriteReadOnlyVmcsComponent);
+  }
+
+  auto& stored = vmcs->fields[type][index];
+  if (high) {
+    stored = (stored & 0xffffffff) | (value << 32);
+  } else if (width == VMCS_FIELD_WIDTH_16BIT) {
+    stored = value & 0xffff;
+  } else if (width == VMCS_FIELD_WIDTH_32BIT) {
+    stored = value & 0xffffffff;
+  } else {
+    stored = value;
+  }
+  return VmxStatus::kOk;
+}
+
+// Returns a simulated MSR, or nullptr
+_Use_decl_annotations_ static SimMsr* SimpFindMsr(Msr msr) {
+  for (ULONG i = 0; i < g_simp_processor->number_of_msrs; ++i) {
+    if (g_simp_processor->msrs[i].msr == msr) {
+      return &g_simp_processor->msrs[i];
+    }
+  }
+  return nullptr;
+}
+
+//
+// nested_hal.h
+//
+
+_Use_decl_annotations_ ULONG_PTR NestedHalVmRead(VmcsField field) {
+  g_simp_processor->counters.vmread++;
+  ULONG64 value = 0;
+  SimpVmRead(field, &value);
+  return static_cast<ULONG_PTR>(value);
+}
+
+_Use_decl_annotations_ ULONG64 NestedHalVmRead64(VmcsField field) {
+  g_simp_processor->counters.vmread++;
+  ULONG64 value = 0;
+  SimpVmRead(field, &value);
+  return value;
+}
+
+_Use_decl_annotations_ VmxStatus NestedHalVmWrite(VmcsField field,
+                                                  ULONG_PTR field_value) {
+  g_simp_processor->counters.vmwrite++;
+  return SimpVmWrite(field, field_value);
+}
+
+_Use_decl_annotations_ VmxStatus NestedHalVmWrite64(VmcsField field,
+                                                    ULONG64 field_value) {
+  g_simp_processor->counters.vmwrite++;
+  return SimpVmWrite(field, field_value);
+}
+
+// See: VMCLEAR-Clear Virtual-Machine Control Structure
+_Use_decl_annotations_ VmxStatus NestedHalVmClear(ULONG64* vmcs_pa) {
+  g_simp_processor->counters.vmclear++;
+  const auto page = SimpGetPage(*vmcs_pa);
+  if (!page) {
+    return SimpVmFailValid(VmxInstructionError::kVmclearInvalidAddress);
+  }
+  page->vmcs.launched = false;
+  if (*vmcs_pa == g_simp_processor->current_vmcs_pa) {
+    g_simp_processor->current_vmcs_pa = kSimpInvalidVmcsPointer;
+  }
+  return VmxStatus::kOk;
+}
+
+// See: VMPTRLD-Load Pointer to Virtual-Machine Control Structure
+_Use_decl_annotations_ VmxStatus NestedHalVmPtrld(ULONG64* vmcs_pa) {
+  g_simp_processor->counters.vmptrld++;
+  const auto page = SimpGetPage(*vmcs_pa);
+  if (!page) {
+    return SimpVmFailValid(VmxInstructionError::kVmptrldInvalidAddress);
+  }
+  const auto vmcs_region = static_cast<VmControlStructure*>(page->va);
+  if (vmcs_region->revision_identifier != kSimVmcsRevisionId) {
+    return SimpVmFailValid(
+        VmxInstructionError::kVmptrldIncorrectVmcsRevisionId);
+  }
+  g_simp_processor->current_vmcs_pa = *vmcs_pa;
+  return VmxStatus::kOk;
+}
+
+// See: VMPTRST-Store Pointer to Virtual-Machine Control Structure
+_Use_decl_annotations_ VOID NestedHalVmPtrst(ULONG64* vmcs_pa) {
+  g_simp_processor->counters.vmptrst++;
+  *vmcs_pa = g_simp_processor->current_vmcs_pa;
+}
+
+// Enters the guest without running it. A caller emulates a VM-exit with
+// SimVmExit().
+_Use_decl_annotations_ VmxStatus NestedHalVmLaunch() {
+  g_simp_processor->counters.vmlaunch++;
+  const auto vmcs = SimpGetCurrentVmcs();
+  if (!vmcs) {
+    g_simp_processor->counters.vmx_failure++;
+    return VmxStatus::kErrorWithoutStatus;
+  }
+  if (vmcs->launched) {
+    return SimpVmFailValid(VmxInstructionError::kVmlaunchNonclearVmcs);
+  }
+  vmcs->launched = true;
+  return VmxStatus::kOk;
+}
+
+_Use_decl_annotations_ VmxStatus NestedHalVmResume() {
+  g_simp_processor->counters.vmresume++;
+  const auto vmcs = SimpGetCurrentVmcs();
+  if (!vmcs) {
+    g_simp_processor->counters.vmx_failure++;
+    return VmxStatus::kErrorWithoutStatus;
+  }
+  if (!vmcs->launched) {
+    return SimpVmFailValid(VmxInstructionError::kVmresumeNonlaunchedVmcs);
+  }
+  return VmxStatus::kOk;
+}
+
+// Returns 0 for MSRs not set by SimSetMsr()
+_Use_decl_annotations_ ULONG64 NestedHalReadMsr64(Msr msr) {
+  g_simp_processor->counters.read_msr++;
+  const auto entry = SimpFindMsr(msr);
+  return (entry) ? entry->value : 0;
+}
+
+_Use_decl_annotations_ VOID NestedHalWriteMsr64(Msr msr, ULONG64 value) {
+  g_simp_processor->counters.write_msr++;
+  SimSetMsr(msr, value);
+}
+
+_Use_decl_annotations_ ULONG_PTR NestedHalReadCr8() {
+  return g_simp_processor->cr8;
+}
+
+_Use_decl_annotations_ VOID NestedHalWriteCr8(ULONG_PTR value) {
+  g_simp_processor->cr8 = value;
+}
+
+// Returns 0 for addresses outside of simulated physical memory. Addresses
+// within a page are translated so that guest operands can be located too.
+_Use_decl_annotations_ ULONG64 NestedHalPaFromVa(void* va) {
+  g_simp_processor->counters.pa_from_va++;
+  const auto address = reinterpret_cast<ULONG_PTR>(va);
+  const auto page_base = address & ~static_cast<ULONG_PTR>(PAGE_SIZE - 1);
+  for (ULONG slot = 0; slot < kSimNumberOfPages; ++slot) {
+    if (reinterpret_cast<ULONG_PTR>(g_simp_processor->pages[slot].va) ==
+        page_base) {
+      return kSimpPhysicalBase + (static_cast<ULONG64>(slot) << PAGE_SHIFT) +
+             (address - page_base);
+    }
+  }
+  return 0;
+}
+
+// Returns nullptr for addresses outside of simulated physical memory
+_Use_decl_annotations_ void* NestedHalVaFromPa(ULONG64 pa) {
+  g_simp_processor->counters.va_from_pa++;
+  const auto page = SimpGetPage(pa);
+  if (!page) {
+    return nullptr;
+  }
+  return static_cast<UCHAR*>(page->va) + (pa & (PAGE_SIZE - 1));
+}
+
+// Allocates a page of simulated physical memory. Larger allocations are not
+// physically contiguous on the simulator and are refused.
+_Use_decl_annotations_ void* NestedHalAllocate(SIZE_T size) {
+  if (size > PAGE_SIZE) {
+    return nullptr;
+  }
+  for (auto& page : g_simp_processor->pages) {
+    if (page.va) {
+      continue;
+    }
+    page.va = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+    if (!page.va) {
+      return nullptr;
+    }
+    RtlZeroMemory(page.va, PAGE_SIZE);
+    RtlZeroMemory(&page.vmcs, sizeof(page.vmcs));
+    return page.va;
+  }
+  return nullptr;
+}
+
+_Use_decl_annotations_ VOID NestedHalFree(void* address) {
+  const auto pa = NestedHalPaFromVa(address);
+  const auto page = SimpGetPage(pa);
+  if (!page || page->va != address) {
+    return;
+  }
+  if (pa == g_simp_processor->current_vmcs_pa) {
+    g_simp_processor->current_vmcs_pa = kSimpInvalidVmcsPointer;
+  }
+  free(page->va);
+  page->va = nullptr;
+}
+
+// The simulator is a single processor
+_Use_decl_annotations_ ULONG
+NestedHalGetCurrentProcessorNumber(PROCESSOR_NUMBER* number) {
+  if (number) {
+    RtlZeroMemory(number, sizeof(*number));
+  }
+  return 0;
+}
+
+_Use_decl_annotations_ ULONG NestedHalGetProcessorCount() { return 1; }
+
+_Use_decl_annotations_ VOID NestedHalLowerIrql(KIRQL new_irql) {
+  g_simp_processor->irql = new_irql;
+}
+
+// The simulator does not record VM-exits
+_Use_decl_annotations_ VOID NestedHalTraceMemoryOperand(ULONG64 operand) {
+  UNREFERENCED_PARAMETER(operand);
+}
+
+// Prints a message when verbose. The WDK-only "%I64" size prefix is rewritten
+// to "%ll" so that messages format as they do in the driver.
+_Use_decl_annotations_ VOID NestedHalLogDebug(const char* function,
+                                              const char* format, ...) {
+  g_simp_processor->counters.log++;
+  if (!g_simp_processor->verbose) {
+    return;
+  }
+
+  std::string converted(format);
+  for (auto pos = converted.find("%I64"); pos != std::string::npos;
+       pos = converted.find("%I64", pos)) {
+    converted.replace(pos, 4, "%ll");
+  }
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "[DBG]\t%-40s\t", function);
+  vfprintf(stderr, converted.c_str(), args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+
+// Counts places the driver would break into a debugger, and continues
+_Use_decl_annotations_ VOID NestedHalDebugBreak() {
+  g_simp_processor->counters.debug_break++;
+}
+
+}  // extern "C"
@@ -0,0 +1,110 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Declares interfaces to the simulated processor behind nested_hal.h.
+///
+/// The simulator implements the nested VMX hardware abstraction in user mode.
+/// Every VMCS (VMCS01, VMCS02 and VMCS12 alike) is a page of simulated
+/// physical memory whose field values are kept in an array next to the page,
+/// just as a processor keeps the current VMCS in its own format. VMCLEAR,
+/// VMPTRLD, VMLAUNCH and VMRESUME update a launch state and the current-VMCS
+/// pointer and fail the way VT-x does, but no guest code runs: a caller plays
+/// the guest by calling SimVmExit() and then an emulation routine.
+
+#ifndef NESTED_SIM_SIM_HAL_H_
+#define NESTED_SIM_SIM_HAL_H_
+
+#include "../kHypervisor/nested_hal.h"
+
+extern "C" {
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+/// A VMCS revision identifier reported by IA32_VMX_BASIC
+static const ULONG32 kSimVmcsRevisionId = 1;
+
+/// The number of pages of simulated physical memory
+static const ULONG kSimNumberOfPages = 256;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+/// Counts of operations requested through nested_hal.h
+struct SimCounters {
+  ULONG64 vmread;       //!< NestedHalVmRead() and NestedHalVmRead64()
+  ULONG64 vmwrite;      //!< NestedHalVmWrite() and NestedHalVmWrite64()
+  ULONG64 vmclear;      //!< NestedHalVmClear()
+  ULONG64 vmptrld;      //!< NestedHalVmPtrld()
+  ULONG64 vmptrst;      //!< NestedHalVmPtrst()
+  ULONG64 vmlaunch;     //!< NestedHalVmLaunch()
+  ULONG64 vmresume;     //!< NestedHalVmResume()
+  ULONG64 vmx_failure;  //!< VMX instructions that failed
+  ULONG64 read_msr;     //!< NestedHalReadMsr64()
+  ULONG64 write_msr;    //!< NestedHalWriteMsr64()
+  ULONG64 va_from_pa;   //!< NestedHalVaFromPa()
+  ULONG64 pa_from_va;   //!< NestedHalPaFromVa()
+  ULONG64 log;          //!< Debug messages
+  ULONG64 debug_break;  //!< Places the driver would break into a debugger
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+/// Resets the simulated processor and frees all simulated physical memory
+/// @param verbose  true to print debug messages to stderr
+void SimInitialize(_In_ bool verbose);
+
+/// Frees all simulated physical memory
+void SimTermination();
+
+/// Returns counts of operations since SimInitialize()
+/// @return A pointer to the counters, which are updated in place
+const SimCounters* SimGetCounters();
+
+/// Sets a value NestedHalReadMsr64() returns for the MSR
+/// @param msr  MSR to set
+/// @param value  A value to set
+void SimSetMsr(_In_ Msr msr, _In_ ULONG64 value);
+
+/// Stores VM-exit information into the current VMCS like a processor does
+/// @param exit_reason  A full VM-exit reason field
+/// @param exit_qualification   An exit qualification
+/// @param interruption_info  VM-exit interruption information
+/// @param instruction_length   A length of the instruction caused VM-exit
+/// @param instruction_info   VM-exit instruction information
+/// @return false if there is no current VMCS
+bool SimVmExit(_In_ ULONG32 exit_reason, _In_ ULONG_PTR exit_qualification,
+               _In_ ULONG32 interruption_info, _In_ ULONG32 instruction_length,
+               _In_ ULONG32 instruction_info);
+
+/// Tests if a VMCS has been launched
+/// @param vmcs_pa  A physical address of VMCS
+/// @return true if the launch state of \a vmcs_pa is "launched"
+bool SimIsVmcsLaunched(_In_ ULONG64 vmcs_pa);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+}  // extern "C"
+
+#endif  // NESTED_SIM_SIM_HAL_H_
@@ -0,0 +1,219 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the parts of HyperPlatform's VMM the nested VMX emulation calls.
+
+#include "sim_vmm.h"
+#include "sim_hal.h"
+#include "../kHypervisor/vmx.h"
+#include "../kHypervisor/vmx_common.h"
+
+extern "C" {
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+static void SimVmmpAdjustGuestInstructionPointer(
+    _In_ GuestContext *guest_context);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+// Sets up VMCS01 for L1 in 64-bit mode at CPL 0, which is what the nested VMX
+// emulation checks before emulating an instruction
+_Use_decl_annotations_ bool SimVmmSetupL1(ULONG64 *vmcs01_pa) {
+  const auto gdt = static_cast<ULONG64 *>(NestedHalAllocate(PAGE_SIZE));
+  const auto vmcs01 =
+      static_cast<VmControlStructure *>(NestedHalAllocate(PAGE_SIZE));
+  if (!gdt || !vmcs01 || !NestedVmmInitialization()) {
+    return false;
+  }
+  vmcs01->revision_identifier = kSimVmcsRevisionId;
+  *vmcs01_pa = NestedHalPaFromVa(vmcs01);
+
+  // A present, 64-bit, ring 0 code segment
+  gdt[kSimVmmCodeSelector / sizeof(SegmentDescriptor)] = 0x00209b0000000000;
+
+  if (NestedHalVmPtrld(vmcs01_pa) != VmxStatus::kOk) {
+    return false;
+  }
+  NestedHalVmWrite(VmcsField::kGuestCr0, 0x80000021);  // PG, NE and PE
+  NestedHalVmWrite(VmcsField::kGuestCr4, 0x2020);      // VMXE and PAE
+  NestedHalVmWrite(VmcsField::kGuestRflags, 0x2);
+  NestedHalVmWrite(VmcsField::kGuestIa32Efer, 0x500);  // LMA and LME
+  NestedHalVmWrite(VmcsField::kGuestCsSelector, kSimVmmCodeSelector);
+  NestedHalVmWrite(VmcsField::kGuestGdtrBase, reinterpret_cast<ULONG_PTR>(gdt));
+  NestedHalVmWrite(VmcsField::kGuestGdtrLimit, PAGE_SIZE - 1);
+  NestedHalVmWrite(VmcsField::kGuestRip, 0xfffff80000001000);
+  NestedHalVmWrite(VmcsField::kGuestRsp, 0xfffff80000100000);
+  NestedHalVmWrite(VmcsField::kHostRip, 0xfffff80000002000);
+  NestedHalVmWrite(VmcsField::kHostRsp, 0xfffff80000200000);
+  NestedHalVmWrite(VmcsField::kHostCsSelector, kSimVmmCodeSelector);
+  return true;
+}
+
+// Captures the guest state from the current VMCS like VmmVmExitHandler()
+_Use_decl_annotations_ void SimVmmCaptureGuestContext(
+    GpRegisters *gp_regs, GuestContext *guest_context) {
+  guest_context->gp_regs = gp_regs;
+  guest_context->flag_reg.all = NestedHalVmRead(VmcsField::kGuestRflags);
+  guest_context->ip = NestedHalVmRead(VmcsField::kGuestRip);
+  guest_context->cr8 = NestedHalReadCr8();
+  guest_context->irql = DISPATCH_LEVEL;
+  guest_context->vm_continue = true;
+  guest_context->vm_exit_emulated = false;
+  guest_context->gp_regs->sp = NestedHalVmRead(VmcsField::kGuestRsp);
+}
+
+// Dispatches a VM-exit like VmmpHandleVmExit(). Handlers of HyperPlatform
+// execute the instruction caused VM-exit on the processor, so those VM-exits
+// are only reported as skipped.
+_Use_decl_annotations_ SimVmExitDisposition
+SimVmmHandleVmExit(GuestContext *guest_context) {
+  const VmExitInformation exit_reason = {
+      static_cast<ULONG32>(NestedHalVmRead(VmcsField::kVmExitReason))};
+  if (!VmmIsFastPathVmExit(exit_reason) &&
+      VMExitEmulationTest(exit_reason, guest_context)) {
+    guest_context->vm_exit_emulated = true;
+    return SimVmExitDisposition::kReflected;
+  }
+  switch (exit_reason.fields.reason) {
+    case VmxExitReason::kVmclear:
+    case VmxExitReason::kVmlaunch:
+    case VmxExitReason::kVmptrld:
+    case VmxExitReason::kVmptrst:
+    case VmxExitReason::kVmread:
+    case VmxExitReason::kVmresume:
+    case VmxExitReason::kVmwrite:
+    case VmxExitReason::kVmoff:
+    case VmxExitReason::kVmon:
+      SimVmmHandleVmx(guest_context);
+      return SimVmExitDisposition::kEmulated;
+    default:
+      return SimVmExitDisposition::kSkipped;
+  }
+}
+
+// Emulates a VMX instruction like VmmpHandleVmx()
+_Use_decl_annotations_ void SimVmmHandleVmx(GuestContext *guest_context) {
+  const VmExitInformation exit_reason = {
+      static_cast<ULONG32>(NestedHalVmRead(VmcsField::kVmExitReason))};
+  switch (exit_reason.fields.reason) {
+    case VmxExitReason::kVmon:
+      VmxonEmulate(guest_context);
+      break;
+    case VmxExitReason::kVmclear:
+      VmclearEmulate(guest_context);
+      break;
+    case VmxExitReason::kVmptrld:
+      VmptrldEmulate(guest_context);
+      break;
+    case VmxExitReason::kVmptrst:
+      VmptrstEmulate(guest_context);
+      break;
+    case VmxExitReason::kVmoff:
+      VmxoffEmulate(guest_context);
+      break;
+    case VmxExitReason::kVmwrite:
+      VmwriteEmulate(guest_context);
+      break;
+    case VmxExitReason::kVmread:
+      VmreadEmulate(guest_context);
+      break;
+    case VmxExitReason::kVmlaunch:
+      VmlaunchEmulate(guest_context);
+      break;
+    case VmxExitReason::kVmresume:
+      // Guest RIP is not advanced as VmresumeEmulate() enters L2
+      VmresumeEmulate(guest_context);
+      return;
+    default:
+      VMSucceed(&guest_context->flag_reg);
+      break;
+  }
+
+  NestedHalVmWrite(VmcsField::kGuestRflags, guest_context->flag_reg.all);
+  SimVmmpAdjustGuestInstructionPointer(guest_context);
+}
+
+// Advances guest RIP past the instruction caused VM-exit
+_Use_decl_annotations_ static void SimVmmpAdjustGuestInstructionPointer(
+    GuestContext *guest_context) {
+  const auto exit_inst_length =
+      NestedHalVmRead(VmcsField::kVmExitInstructionLen);
+  NestedHalVmWrite(VmcsField::kGuestRip, guest_context->ip + exit_inst_length);
+}
+
+//
+// Accessors exported by vmm.cpp
+//
+
+_Use_decl_annotations_ ULONG_PTR *VmmpSelectRegister(
+    ULONG index, GuestContext *guest_context) {
+  ULONG_PTR *register_used = nullptr;
+  // clang-format off
+  switch (index) {
+    case 0: register_used = &guest_context->gp_regs->ax; break;
+    case 1: register_used = &guest_context->gp_regs->cx; break;
+    case 2: register_used = &guest_context->gp_regs->dx; break;
+    case 3: register_used = &guest_context->gp_regs->bx; break;
+    case 4: register_used = &guest_context->gp_regs->sp; break;
+    case 5: register_used = &guest_context->gp_regs->bp; break;
+    case 6: register_used = &guest_context->gp_regs->si; break;
+    case 7: register_used = &guest_context->gp_regs->di; break;
+    case 8: register_used = &guest_context->gp_regs->r8; break;
+    case 9: register_used = &guest_context->gp_regs->r9; break;
+    case 10: register_used = &guest_context->gp_regs->r10; break;
+    case 11: register_used = &guest_context->gp_regs->r11; break;
+    case 12: register_used = &guest_context->gp_regs->r12; break;
+    case 13: register_used = &guest_context->gp_regs->r13; break;
+    case 14: register_used = &guest_context->gp_regs->r14; break;
+    case 15: register_used = &guest_context->gp_regs->r15; break;
+    default: HYPERPLATFORM_COMMON_DBG_BREAK(); break;
+  }
+  // clang-format on
+  return register_used;
+}
+
+_Use_decl_annotations_ GpRegisters *GetGpReg(GuestContext *guest_context) {
+  return guest_context->gp_regs;
+}
+
+_Use_decl_annotations_ FlagRegister *GetFlagReg(GuestContext *guest_context) {
+  return &guest_context->flag_reg;
+}
+
+_Use_decl_annotations_ KIRQL GetGuestIrql(GuestContext *guest_context) {
+  return guest_context->irql;
+}
+
+_Use_decl_annotations_ ULONG_PTR GetGuestCr8(GuestContext *guest_context) {
+  return guest_context->cr8;
+}
+
+}  // extern "C"
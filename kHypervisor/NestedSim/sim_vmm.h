@@ -0,0 +1,98 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Declares the parts of HyperPlatform's VMM the nested VMX emulation calls.
+///
+/// vmm.cpp cannot be built in user mode, so the guest context and the
+/// accessors it exports are provided here with the same layout and
+/// behaviour, along with the VM-exit entry and the dispatch of
+/// VmmVmExitHandler(), VmmpHandleVmExit() and VmmpHandleVmx().
+
+#ifndef NESTED_SIM_SIM_VMM_H_
+#define NESTED_SIM_SIM_VMM_H_
+
+#include "../kHypervisor/nested_hal.h"
+
+extern "C" {
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// constants and macros
+//
+
+/// A selector of the 64-bit code segment in the GDT of L1
+static const USHORT kSimVmmCodeSelector = 0x10;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+/// The same as GuestContext in vmm.cpp
+#pragma pack(8)
+struct GuestContext {
+  union {
+    void *stack;
+    GpRegisters *gp_regs;
+  };
+  FlagRegister flag_reg;
+  ULONG_PTR ip;
+  ULONG_PTR cr8;
+  KIRQL irql;
+  bool vm_continue;
+  bool vm_exit_emulated;  //!< Reflected to L1 as an emulated VM-exit
+};
+#pragma pack()
+static_assert(sizeof(GuestContext) == 40, "Size check");
+
+/// How SimVmmHandleVmExit() handled a VM-exit
+enum class SimVmExitDisposition {
+  kReflected,  //!< Reflected to L1 by VMExitEmulationTest()
+  kEmulated,   //!< Handled by the nested VMX emulation
+  kSkipped,    //!< Handled by HyperPlatform only, which cannot run in user mode
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototypes
+//
+
+/// Makes a new VMCS01 current and fills it with L1 in 64-bit mode at CPL 0
+/// @param vmcs01_pa  A physical address of VMCS01
+/// @return true on success
+bool SimVmmSetupL1(_Out_ ULONG64 *vmcs01_pa);
+
+/// Captures the guest state from the current VMCS like VmmVmExitHandler()
+/// @param gp_regs  General purpose registers of the guest
+/// @param guest_context  A guest context to initialize
+void SimVmmCaptureGuestContext(_In_ GpRegisters *gp_regs,
+                               _Out_ GuestContext *guest_context);
+
+/// Dispatches a VM-exit like VmmpHandleVmExit()
+/// @param guest_context  A guest context captured on VM-exit
+/// @return How the VM-exit was handled
+SimVmExitDisposition SimVmmHandleVmExit(_Inout_ GuestContext *guest_context);
+
+/// Emulates a VMX instruction like VmmpHandleVmx()
+/// @param guest_context  A guest context captured on VM-exit
+void SimVmmHandleVmx(_Inout_ GuestContext *guest_context);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// variables
+//
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// implementations
+//
+
+}  // extern "C"
+
+#endif  // NESTED_SIM_SIM_VMM_H_
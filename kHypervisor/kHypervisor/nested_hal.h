@@ -0,0 +1,201 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Declares the hardware abstraction the nested VMX emulation runs on.
+///
+/// vmx.cpp, vmcs.cpp and vmx_common.cpp reach VMX instructions, MSRs, control
+/// registers, physical memory and logging only through this interface, so
+/// that the same emulation code runs on VT-x inside the driver
+/// (nested_hal_win.cpp) and on a simulated processor in user mode on Linux
+/// (NestedSim/sim_hal.cpp). Guest register access goes through the accessors
+/// exported by vmm.cpp, which the simulator provides in the same way.
+
+#ifndef NESTED_HYPERPLATFORM_NESTED_HAL_H_
+#define NESTED_HYPERPLATFORM_NESTED_HAL_H_
+
+#include <fltKernel.h>
+#include <intrin.h>
+#include "../HyperPlatform/ia32_type.h"
+#include "../HyperPlatform/util.h"
+#include "../HyperPlatform/vmm.h"
+
+#if defined(KHYPERVISOR_NESTED_SIM)
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// macro utilities
+//
+
+// Logging and break-in are routed to the simulator. Arguments are evaluated
+// exactly like in the driver, so simulated runs pay for the same VMREADs.
+#define HYPERPLATFORM_LOG_DEBUG_SAFE(format, ...) \
+	NestedHalLogDebug(__FUNCTION__, (format), ##__VA_ARGS__)
+
+#define HYPERPLATFORM_COMMON_DBG_BREAK() NestedHalDebugBreak()
+
+#else
+
+#include "../HyperPlatform/common.h"
+#include "../HyperPlatform/log.h"
+
+#endif  // KHYPERVISOR_NESTED_SIM
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// types
+//
+
+// Defined by vmm.cpp, or by the simulator
+struct GuestContext;
+
+extern "C"
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// prototype
+//
+
+//
+// VMCS access. All of these operate on the current VMCS of the processor.
+//
+ULONG_PTR NestedHalVmRead(
+	_In_ VmcsField field
+);
+
+ULONG64 NestedHalVmRead64(
+	_In_ VmcsField field
+);
+
+VmxStatus NestedHalVmWrite(
+	_In_ VmcsField field,
+	_In_ ULONG_PTR field_value
+);
+
+VmxStatus NestedHalVmWrite64(
+	_In_ VmcsField field,
+	_In_ ULONG64 field_value
+);
+
+VmxStatus NestedHalVmClear(
+	_In_ ULONG64* vmcs_pa
+);
+
+VmxStatus NestedHalVmPtrld(
+	_In_ ULONG64* vmcs_pa
+);
+
+VOID NestedHalVmPtrst(
+	_Out_ ULONG64* vmcs_pa
+);
+
+// Returns only on failure on VT-x
+VmxStatus NestedHalVmLaunch();
+
+// Returns only on failure on VT-x
+VmxStatus NestedHalVmResume();
+
+//
+// MSR and control register access
+//
+ULONG64 NestedHalReadMsr64(
+	_In_ Msr msr
+);
+
+VOID NestedHalWriteMsr64(
+	_In_ Msr msr,
+	_In_ ULONG64 value
+);
+
+ULONG_PTR NestedHalReadCr8();
+
+VOID NestedHalWriteCr8(
+	_In_ ULONG_PTR value
+);
+
+//
+// Physical memory
+//
+ULONG64 NestedHalPaFromVa(
+	_In_ void* va
+);
+
+void* NestedHalVaFromPa(
+	_In_ ULONG64 pa
+);
+
+// Returns zero-filled non-paged memory, or nullptr
+void* NestedHalAllocate(
+	_In_ SIZE_T size
+);
+
+VOID NestedHalFree(
+	_In_ void* address
+);
+
+//
+// Processors
+//
+ULONG NestedHalGetCurrentProcessorNumber(
+	_Out_opt_ PROCESSOR_NUMBER* number
+);
+
+ULONG NestedHalGetProcessorCount();
+
+VOID NestedHalLowerIrql(
+	_In_ KIRQL new_irql
+);
+
+//
+// Tracing
+//
+// Saves an 8-byte operand a VMX instruction read from guest memory into the
+// record of the current VM-exit
+VOID NestedHalTraceMemoryOperand(
+	_In_ ULONG64 operand
+);
+
+#if defined(KHYPERVISOR_NESTED_SIM)
+
+//
+// Logging
+//
+VOID NestedHalLogDebug(
+	_In_ const char* function,
+	_In_ const char* format,
+	...
+);
+
+VOID NestedHalDebugBreak();
+
+#endif  // KHYPERVISOR_NESTED_SIM
+
+//
+// Guest context accessors exported by vmm.cpp
+//
+ULONG_PTR* VmmpSelectRegister(
+	_In_ ULONG index,
+	_In_ GuestContext* guest_context
+);
+
+GpRegisters* GetGpReg(
+	_In_ GuestContext* guest_context
+);
+
+FlagRegister* GetFlagReg(
+	_In_ GuestContext* guest_context
+);
+
+KIRQL GetGuestIrql(
+	_In_ GuestContext* guest_context
+);
+
+ULONG_PTR GetGuestCr8(
+	_In_ GuestContext* guest_context
+);
+
+}
+
+#endif  // NESTED_HYPERPLATFORM_NESTED_HAL_H_
@@ -0,0 +1,150 @@
+// Copyright (c) 2016-2017, KelvinChan. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+/// @file
+/// Implements the nested VMX hardware abstraction on VT-x for the driver.
+
+#include "nested_hal.h"
+#include "../HyperPlatform/exit_trace.h"
+#include "../HyperPlatform/util.h"
+
+extern "C"
+{
+////////////////////////////////////////////////////////////////////////////////
+//
+// Implementation
+//
+
+//---------------------------------------------------------------------------------------------------------------------//
+ULONG_PTR NestedHalVmRead(VmcsField field)
+{
+	return UtilVmRead(field);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+ULONG64 NestedHalVmRead64(VmcsField field)
+{
+	return UtilVmRead64(field);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VmxStatus NestedHalVmWrite(VmcsField field, ULONG_PTR field_value)
+{
+	return UtilVmWrite(field, field_value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VmxStatus NestedHalVmWrite64(VmcsField field, ULONG64 field_value)
+{
+	return UtilVmWrite64(field, field_value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VmxStatus NestedHalVmClear(ULONG64* vmcs_pa)
+{
+	return static_cast<VmxStatus>(__vmx_vmclear(vmcs_pa));
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VmxStatus NestedHalVmPtrld(ULONG64* vmcs_pa)
+{
+	return static_cast<VmxStatus>(__vmx_vmptrld(vmcs_pa));
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VOID NestedHalVmPtrst(ULONG64* vmcs_pa)
+{
+	__vmx_vmptrst(vmcs_pa);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VmxStatus NestedHalVmLaunch()
+{
+	return static_cast<VmxStatus>(__vmx_vmlaunch());
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VmxStatus NestedHalVmResume()
+{
+	return static_cast<VmxStatus>(__vmx_vmresume());
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+ULONG64 NestedHalReadMsr64(Msr msr)
+{
+	return UtilReadMsr64(msr);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VOID NestedHalWriteMsr64(Msr msr, ULONG64 value)
+{
+	UtilWriteMsr64(msr, value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+ULONG_PTR NestedHalReadCr8()
+{
+	return __readcr8();
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VOID NestedHalWriteCr8(ULONG_PTR value)
+{
+	__writecr8(value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+ULONG64 NestedHalPaFromVa(void* va)
+{
+	return UtilPaFromVa(va);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+void* NestedHalVaFromPa(ULONG64 pa)
+{
+	return UtilVaFromPa(pa);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+void* NestedHalAllocate(SIZE_T size)
+{
+	const auto address = ExAllocatePoolWithTag(NonPagedPoolNx, size, kHyperPlatformCommonPoolTag);
+	if (address)
+	{
+		RtlZeroMemory(address, size);
+	}
+	return address;
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VOID NestedHalFree(void* address)
+{
+	ExFreePoolWithTag(address, kHyperPlatformCommonPoolTag);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+ULONG NestedHalGetCurrentProcessorNumber(PROCESSOR_NUMBER* number)
+{
+	return KeGetCurrentProcessorNumberEx(number);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+ULONG NestedHalGetProcessorCount()
+{
+	return KeQueryMaximumProcessorCount();
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VOID NestedHalLowerIrql(KIRQL new_irql)
+{
+	KeLowerIrql(new_irql);
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+VOID NestedHalTraceMemoryOperand(ULONG64 operand)
+{
+	ExitTraceRecordMemoryOperand(operand);
+}
+
+}
@@ -2,13 +2,8 @@
 // Use of this source code is governed by a MIT-style license that can be
 // found in the LICENSE file.
 
-#include <fltKernel.h>
-#include <intrin.h>
+#include "nested_hal.h"
 #include "vmcs.h"
-#include "..\HyperPlatform\util.h" 
-#include "..\HyperPlatform\common.h"
-#include "..\HyperPlatform\asm.h"
-#include "..\HyperPlatform\log.h"   
 
 VOID PrintAllFieldForVmcs12(const char* func, ULONG64 vmcs12)
 {
@@ -24,7 +19,7 @@ VOID PrintAllField(const char* func)
 	PrintHostStateField();
 	PrintGuestStateField();
 	PrintReadOnlyField(); 
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kIa32GsBase: %I64X kIa32KernelGsBase: %I64X \r\n", UtilReadMsr(Msr::kIa32GsBase), UtilReadMsr(Msr::kIa32KernelGsBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kIa32GsBase: %I64X kIa32KernelGsBase: %I64X \r\n", NestedHalReadMsr64(Msr::kIa32GsBase), NestedHalReadMsr64(Msr::kIa32KernelGsBase));
 	HYPERPLATFORM_LOG_DEBUG_SAFE("------------------------- End Printed Current VMCS by %s -----------------------------", func);
 
 }
@@ -83,36 +78,36 @@ VOID PrintHostStateField()
 {
 
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### 16bit Host State #############################");
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostCsSelector : %X", UtilVmRead(VmcsField::kHostCsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostDsSelector : %X", UtilVmRead(VmcsField::kHostDsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostEsSelector : %X", UtilVmRead(VmcsField::kHostEsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostSsSelector : %X", UtilVmRead(VmcsField::kHostSsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostFsSelector : %X", UtilVmRead(VmcsField::kHostFsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostGsSelector : %X", UtilVmRead(VmcsField::kHostGsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostTrSelector : %X", UtilVmRead(VmcsField::kHostTrSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostCsSelector : %X", NestedHalVmRead(VmcsField::kHostCsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostDsSelector : %X", NestedHalVmRead(VmcsField::kHostDsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostEsSelector : %X", NestedHalVmRead(VmcsField::kHostEsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostSsSelector : %X", NestedHalVmRead(VmcsField::kHostSsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostFsSelector : %X", NestedHalVmRead(VmcsField::kHostFsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostGsSelector : %X", NestedHalVmRead(VmcsField::kHostGsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostTrSelector : %X", NestedHalVmRead(VmcsField::kHostTrSelector));
 
 	/*
 	Host 32 bit state field
 	*/
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### 32bit Host State #############################");
 
-	HYPERPLATFORM_LOG_DEBUG_SAFE(" %.8X", UtilVmRead(VmcsField::kHostIa32SysenterCs));
+	HYPERPLATFORM_LOG_DEBUG_SAFE(" %.8X", NestedHalVmRead(VmcsField::kHostIa32SysenterCs));
 
 
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### 64bit Host State #############################");
 
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostCr0 %I64X", UtilVmRead64(VmcsField::kHostCr0));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostCr3 %I64X", UtilVmRead64(VmcsField::kHostCr3));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostCr4 %I64X", UtilVmRead64(VmcsField::kHostCr4));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostFsBase %I64X", UtilVmRead64(VmcsField::kHostFsBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostGsBase %I64X", UtilVmRead64(VmcsField::kHostGsBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostTrBase %I64X", UtilVmRead64(VmcsField::kHostTrBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostGdtrBase %I64X", UtilVmRead64(VmcsField::kHostGdtrBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIdtrBase %I64X", UtilVmRead64(VmcsField::kHostIdtrBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32SysenterEsp %I64X", UtilVmRead64(VmcsField::kHostIa32SysenterEsp));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32SysenterEip %I64X", UtilVmRead64(VmcsField::kHostIa32SysenterEip));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostRsp %I64X", UtilVmRead64(VmcsField::kHostRsp));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostRip %I64X", UtilVmRead64(VmcsField::kHostRip));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostCr0 %I64X", NestedHalVmRead64(VmcsField::kHostCr0));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostCr3 %I64X", NestedHalVmRead64(VmcsField::kHostCr3));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostCr4 %I64X", NestedHalVmRead64(VmcsField::kHostCr4));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostFsBase %I64X", NestedHalVmRead64(VmcsField::kHostFsBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostGsBase %I64X", NestedHalVmRead64(VmcsField::kHostGsBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostTrBase %I64X", NestedHalVmRead64(VmcsField::kHostTrBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostGdtrBase %I64X", NestedHalVmRead64(VmcsField::kHostGdtrBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIdtrBase %I64X", NestedHalVmRead64(VmcsField::kHostIdtrBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32SysenterEsp %I64X", NestedHalVmRead64(VmcsField::kHostIa32SysenterEsp));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32SysenterEip %I64X", NestedHalVmRead64(VmcsField::kHostIa32SysenterEip));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostRsp %I64X", NestedHalVmRead64(VmcsField::kHostRsp));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostRip %I64X", NestedHalVmRead64(VmcsField::kHostRip));
 
 }
 
@@ -123,54 +118,54 @@ VOID PrintControlField()
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### 16bit Control State #############################");
 
 
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32Pat: %x", UtilVmRead(VmcsField::kHostIa32Pat));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32PatHigh: %x", UtilVmRead(VmcsField::kHostIa32PatHigh));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32Efer: %x", UtilVmRead(VmcsField::kHostIa32Efer));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32EferHigh: %x", UtilVmRead(VmcsField::kHostIa32EferHigh));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32PerfGlobalCtrl: %x", UtilVmRead(VmcsField::kHostIa32PerfGlobalCtrl));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32PerfGlobalCtrlHigh: %x", UtilVmRead(VmcsField::kHostIa32PerfGlobalCtrlHigh));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32Pat: %x", NestedHalVmRead(VmcsField::kHostIa32Pat));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32PatHigh: %x", NestedHalVmRead(VmcsField::kHostIa32PatHigh));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32Efer: %x", NestedHalVmRead(VmcsField::kHostIa32Efer));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32EferHigh: %x", NestedHalVmRead(VmcsField::kHostIa32EferHigh));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32PerfGlobalCtrl: %x", NestedHalVmRead(VmcsField::kHostIa32PerfGlobalCtrl));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kHostIa32PerfGlobalCtrlHigh: %x", NestedHalVmRead(VmcsField::kHostIa32PerfGlobalCtrlHigh));
 
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### 32bit Control State #############################");
 
 
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kPinBasedVmExecControl: %x", UtilVmRead(VmcsField::kPinBasedVmExecControl));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kCpuBasedVmExecControl: %x", UtilVmRead(VmcsField::kCpuBasedVmExecControl));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kExceptionBitmap: %x", UtilVmRead(VmcsField::kExceptionBitmap));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kPageFaultErrorCodeMask: %x", UtilVmRead(VmcsField::kPageFaultErrorCodeMask));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kPageFaultErrorCodeMatch: %x", UtilVmRead(VmcsField::kPageFaultErrorCodeMatch));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr3TargetCount: %x", UtilVmRead(VmcsField::kCr3TargetCount));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitControls: %x", UtilVmRead(VmcsField::kVmExitControls));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitMsrStoreCount: %x", UtilVmRead(VmcsField::kVmExitMsrStoreCount));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitMsrLoadCount: %x", UtilVmRead(VmcsField::kVmExitMsrLoadCount));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmEntryControls: %x", UtilVmRead(VmcsField::kVmEntryControls));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmEntryMsrLoadCount: %x", UtilVmRead(VmcsField::kVmEntryMsrLoadCount));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmEntryIntrInfoField: %x", UtilVmRead(VmcsField::kVmEntryIntrInfoField));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmEntryExceptionErrorCode: %x", UtilVmRead(VmcsField::kVmEntryExceptionErrorCode));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmEntryInstructionLen: %x", UtilVmRead(VmcsField::kVmEntryInstructionLen));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kTprThreshold: %x", UtilVmRead(VmcsField::kTprThreshold));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kPleGap: %x", UtilVmRead(VmcsField::kPleGap));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kPleWindow: %x", UtilVmRead(VmcsField::kPleWindow));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kSecondaryVmExecControl: %x", UtilVmRead(VmcsField::kSecondaryVmExecControl));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kPinBasedVmExecControl: %x", NestedHalVmRead(VmcsField::kPinBasedVmExecControl));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kCpuBasedVmExecControl: %x", NestedHalVmRead(VmcsField::kCpuBasedVmExecControl));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kExceptionBitmap: %x", NestedHalVmRead(VmcsField::kExceptionBitmap));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kPageFaultErrorCodeMask: %x", NestedHalVmRead(VmcsField::kPageFaultErrorCodeMask));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kPageFaultErrorCodeMatch: %x", NestedHalVmRead(VmcsField::kPageFaultErrorCodeMatch));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr3TargetCount: %x", NestedHalVmRead(VmcsField::kCr3TargetCount));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitControls: %x", NestedHalVmRead(VmcsField::kVmExitControls));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitMsrStoreCount: %x", NestedHalVmRead(VmcsField::kVmExitMsrStoreCount));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitMsrLoadCount: %x", NestedHalVmRead(VmcsField::kVmExitMsrLoadCount));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmEntryControls: %x", NestedHalVmRead(VmcsField::kVmEntryControls));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmEntryMsrLoadCount: %x", NestedHalVmRead(VmcsField::kVmEntryMsrLoadCount));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmEntryIntrInfoField: %x", NestedHalVmRead(VmcsField::kVmEntryIntrInfoField));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmEntryExceptionErrorCode: %x", NestedHalVmRead(VmcsField::kVmEntryExceptionErrorCode));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmEntryInstructionLen: %x", NestedHalVmRead(VmcsField::kVmEntryInstructionLen));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kTprThreshold: %x", NestedHalVmRead(VmcsField::kTprThreshold));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kPleGap: %x", NestedHalVmRead(VmcsField::kPleGap));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kPleWindow: %x", NestedHalVmRead(VmcsField::kPleWindow));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kSecondaryVmExecControl: %x", NestedHalVmRead(VmcsField::kSecondaryVmExecControl));
 
 
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### 64bit Control State #############################");
 
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kIoBitmapA: %I64X", UtilVmRead64(VmcsField::kIoBitmapA));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kIoBitmapB: %I64X", UtilVmRead64(VmcsField::kIoBitmapB));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kMsrBitmap: %I64X", UtilVmRead64(VmcsField::kMsrBitmap));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kPmlAddress: %I64X", UtilVmRead64(VmcsField::kPmlAddress));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kApicAccessAddr: %I64X", UtilVmRead64(VmcsField::kApicAccessAddr));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmFuncCtls: %I64X", UtilVmRead64(VmcsField::kVmFuncCtls));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kEptPointer: %I64X", UtilVmRead64(VmcsField::kEptPointer));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap0: %I64X", UtilVmRead64(VmcsField::kEoiExitBitmap0));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap0High: %I64X", UtilVmRead64(VmcsField::kEoiExitBitmap0High));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap1: %I64X", UtilVmRead64(VmcsField::kEoiExitBitmap1));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap1High: %I64X", UtilVmRead64(VmcsField::kEoiExitBitmap1High));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap2: %I64X", UtilVmRead64(VmcsField::kEoiExitBitmap2));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap2High: %I64X", UtilVmRead64(VmcsField::kEoiExitBitmap2High));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap3: %I64X", UtilVmRead64(VmcsField::kEoiExitBitmap3));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap3High: %I64X", UtilVmRead64(VmcsField::kEoiExitBitmap3High));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kEptpListAddress: %I64X", UtilVmRead64(VmcsField::kEptpListAddress));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kIoBitmapA: %I64X", NestedHalVmRead64(VmcsField::kIoBitmapA));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kIoBitmapB: %I64X", NestedHalVmRead64(VmcsField::kIoBitmapB));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kMsrBitmap: %I64X", NestedHalVmRead64(VmcsField::kMsrBitmap));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kPmlAddress: %I64X", NestedHalVmRead64(VmcsField::kPmlAddress));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kApicAccessAddr: %I64X", NestedHalVmRead64(VmcsField::kApicAccessAddr));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmFuncCtls: %I64X", NestedHalVmRead64(VmcsField::kVmFuncCtls));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kEptPointer: %I64X", NestedHalVmRead64(VmcsField::kEptPointer));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap0: %I64X", NestedHalVmRead64(VmcsField::kEoiExitBitmap0));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap0High: %I64X", NestedHalVmRead64(VmcsField::kEoiExitBitmap0High));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap1: %I64X", NestedHalVmRead64(VmcsField::kEoiExitBitmap1));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap1High: %I64X", NestedHalVmRead64(VmcsField::kEoiExitBitmap1High));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap2: %I64X", NestedHalVmRead64(VmcsField::kEoiExitBitmap2));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap2High: %I64X", NestedHalVmRead64(VmcsField::kEoiExitBitmap2High));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap3: %I64X", NestedHalVmRead64(VmcsField::kEoiExitBitmap3));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kEoiExitBitmap3High: %I64X", NestedHalVmRead64(VmcsField::kEoiExitBitmap3High));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kEptpListAddress: %I64X", NestedHalVmRead64(VmcsField::kEptpListAddress));
 
 
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### Natural Control State #############################");
@@ -178,14 +173,14 @@ VOID PrintControlField()
 	/*
 	Natural-width field
 	*/
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr0GuestHostMask: %I64X", UtilVmRead64(VmcsField::kCr0GuestHostMask));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr4GuestHostMask: %I64X", UtilVmRead64(VmcsField::kCr4GuestHostMask));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr0ReadShadow: %I64X", UtilVmRead64(VmcsField::kCr0ReadShadow));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr4ReadShadow: %I64X", UtilVmRead64(VmcsField::kCr4ReadShadow));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr3TargetValue0: %I64X", UtilVmRead64(VmcsField::kCr3TargetValue0));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr3TargetValue1: %I64X", UtilVmRead64(VmcsField::kCr3TargetValue1));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr3TargetValue2: %I64X", UtilVmRead64(VmcsField::kCr3TargetValue2));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr3TargetValue3: %I64X", UtilVmRead64(VmcsField::kCr3TargetValue3));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr0GuestHostMask: %I64X", NestedHalVmRead64(VmcsField::kCr0GuestHostMask));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr4GuestHostMask: %I64X", NestedHalVmRead64(VmcsField::kCr4GuestHostMask));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr0ReadShadow: %I64X", NestedHalVmRead64(VmcsField::kCr0ReadShadow));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr4ReadShadow: %I64X", NestedHalVmRead64(VmcsField::kCr4ReadShadow));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr3TargetValue0: %I64X", NestedHalVmRead64(VmcsField::kCr3TargetValue0));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr3TargetValue1: %I64X", NestedHalVmRead64(VmcsField::kCr3TargetValue1));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr3TargetValue2: %I64X", NestedHalVmRead64(VmcsField::kCr3TargetValue2));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kCr3TargetValue3: %I64X", NestedHalVmRead64(VmcsField::kCr3TargetValue3));
 }
 
 
@@ -195,67 +190,67 @@ VOID PrintGuestStateField()
 
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### 16bit Guest State #############################");
 	//16bit guest state field 
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestEsSelector: %x  ", UtilVmRead(VmcsField::kGuestEsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCsSelector: %x  ", UtilVmRead(VmcsField::kGuestCsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSsSelector: %x  ", UtilVmRead(VmcsField::kGuestSsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestDsSelector: %x  ", UtilVmRead(VmcsField::kGuestDsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestFsSelector: %x  ", UtilVmRead(VmcsField::kGuestFsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGsSelector: %x  ", UtilVmRead(VmcsField::kGuestGsSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestLdtrSelector: %x  ", UtilVmRead(VmcsField::kGuestLdtrSelector));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestTrSelector: %x  ", UtilVmRead(VmcsField::kGuestTrSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestEsSelector: %x  ", NestedHalVmRead(VmcsField::kGuestEsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCsSelector: %x  ", NestedHalVmRead(VmcsField::kGuestCsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSsSelector: %x  ", NestedHalVmRead(VmcsField::kGuestSsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestDsSelector: %x  ", NestedHalVmRead(VmcsField::kGuestDsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestFsSelector: %x  ", NestedHalVmRead(VmcsField::kGuestFsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGsSelector: %x  ", NestedHalVmRead(VmcsField::kGuestGsSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestLdtrSelector: %x  ", NestedHalVmRead(VmcsField::kGuestLdtrSelector));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestTrSelector: %x  ", NestedHalVmRead(VmcsField::kGuestTrSelector));
 
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### 32bit Guest State #############################");
 	//32bit guest state field
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestEsLimit: %.8x  ", UtilVmRead(VmcsField::kGuestEsLimit));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCsLimit: %.8x  ", UtilVmRead(VmcsField::kGuestCsLimit));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSsLimit: %.8x  ", UtilVmRead(VmcsField::kGuestSsLimit));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestDsLimit: %.8x  ", UtilVmRead(VmcsField::kGuestDsLimit));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestFsLimit: %.8x  ", UtilVmRead(VmcsField::kGuestFsLimit));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGsLimit: %.8x  ", UtilVmRead(VmcsField::kGuestGsLimit));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestLdtrLimit: %.8x  ", UtilVmRead(VmcsField::kGuestLdtrLimit));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestTrLimit: %.8x  ", UtilVmRead(VmcsField::kGuestTrLimit));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGdtrLimit: %.8x  ", UtilVmRead(VmcsField::kGuestGdtrLimit));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestIdtrLimit: %.8x  ", UtilVmRead(VmcsField::kGuestIdtrLimit));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestEsArBytes: %.8x  ", UtilVmRead(VmcsField::kGuestEsArBytes));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCsArBytes: %.8x  ", UtilVmRead(VmcsField::kGuestCsArBytes));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSsArBytes: %.8x  ", UtilVmRead(VmcsField::kGuestSsArBytes));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestDsArBytes: %.8x  ", UtilVmRead(VmcsField::kGuestDsArBytes));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestFsArBytes: %.8x  ", UtilVmRead(VmcsField::kGuestFsArBytes));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGsArBytes: %.8x  ", UtilVmRead(VmcsField::kGuestGsArBytes));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestLdtrArBytes: %.8x  ", UtilVmRead(VmcsField::kGuestLdtrArBytes));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestTrArBytes: %.8x  ", UtilVmRead(VmcsField::kGuestTrArBytes));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestInterruptibilityInfo: %.8x  ", UtilVmRead(VmcsField::kGuestInterruptibilityInfo));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestActivityState: %.8x  ", UtilVmRead(VmcsField::kGuestActivityState));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSysenterCs: %.8x  ", UtilVmRead(VmcsField::kGuestSysenterCs));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestEsLimit: %.8x  ", NestedHalVmRead(VmcsField::kGuestEsLimit));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCsLimit: %.8x  ", NestedHalVmRead(VmcsField::kGuestCsLimit));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSsLimit: %.8x  ", NestedHalVmRead(VmcsField::kGuestSsLimit));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestDsLimit: %.8x  ", NestedHalVmRead(VmcsField::kGuestDsLimit));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestFsLimit: %.8x  ", NestedHalVmRead(VmcsField::kGuestFsLimit));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGsLimit: %.8x  ", NestedHalVmRead(VmcsField::kGuestGsLimit));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestLdtrLimit: %.8x  ", NestedHalVmRead(VmcsField::kGuestLdtrLimit));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestTrLimit: %.8x  ", NestedHalVmRead(VmcsField::kGuestTrLimit));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGdtrLimit: %.8x  ", NestedHalVmRead(VmcsField::kGuestGdtrLimit));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestIdtrLimit: %.8x  ", NestedHalVmRead(VmcsField::kGuestIdtrLimit));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestEsArBytes: %.8x  ", NestedHalVmRead(VmcsField::kGuestEsArBytes));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCsArBytes: %.8x  ", NestedHalVmRead(VmcsField::kGuestCsArBytes));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSsArBytes: %.8x  ", NestedHalVmRead(VmcsField::kGuestSsArBytes));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestDsArBytes: %.8x  ", NestedHalVmRead(VmcsField::kGuestDsArBytes));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestFsArBytes: %.8x  ", NestedHalVmRead(VmcsField::kGuestFsArBytes));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGsArBytes: %.8x  ", NestedHalVmRead(VmcsField::kGuestGsArBytes));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestLdtrArBytes: %.8x  ", NestedHalVmRead(VmcsField::kGuestLdtrArBytes));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestTrArBytes: %.8x  ", NestedHalVmRead(VmcsField::kGuestTrArBytes));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestInterruptibilityInfo: %.8x  ", NestedHalVmRead(VmcsField::kGuestInterruptibilityInfo));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestActivityState: %.8x  ", NestedHalVmRead(VmcsField::kGuestActivityState));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSysenterCs: %.8x  ", NestedHalVmRead(VmcsField::kGuestSysenterCs));
 
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### 64bit Guest State #############################");
 	//64bit guest state field 
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmcsLinkPointer: %I64X  ", UtilVmRead64(VmcsField::kVmcsLinkPointer));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestIa32Debugctl: %I64X  ", UtilVmRead64(VmcsField::kGuestIa32Debugctl));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmcsLinkPointer: %I64X  ", NestedHalVmRead64(VmcsField::kVmcsLinkPointer));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestIa32Debugctl: %I64X  ", NestedHalVmRead64(VmcsField::kGuestIa32Debugctl));
 
 
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### Natural Guest State #############################");
 	//natural
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCr0: %I64X  ", UtilVmRead(VmcsField::kGuestCr0));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCr3: %I64X  ", UtilVmRead(VmcsField::kGuestCr3));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCr4: %I64X  ", UtilVmRead(VmcsField::kGuestCr4));
-
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestEsBase: %I64X  ", UtilVmRead(VmcsField::kGuestEsBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCsBase: %I64X  ", UtilVmRead(VmcsField::kGuestCsBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSsBase: %I64X  ", UtilVmRead(VmcsField::kGuestSsBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestDsBase: %I64X  ", UtilVmRead(VmcsField::kGuestDsBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestFsBase: %I64X  ", UtilVmRead(VmcsField::kGuestFsBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGsBase: %I64X  ", UtilVmRead(VmcsField::kGuestGsBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestLdtrBase: %I64X  ", UtilVmRead(VmcsField::kGuestLdtrBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestTrBase: %I64X  ", UtilVmRead(VmcsField::kGuestTrBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGdtrBase: %I64X  ", UtilVmRead(VmcsField::kGuestGdtrBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestIdtrBase: %I64X  ", UtilVmRead(VmcsField::kGuestIdtrBase));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestDr7: %I64X  ", UtilVmRead(VmcsField::kGuestDr7));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestRflags: %I64X  ", UtilVmRead(VmcsField::kGuestRflags));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSysenterEsp: %I64X  ", UtilVmRead(VmcsField::kGuestSysenterEsp));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSysenterEip: %I64X  ", UtilVmRead(VmcsField::kGuestSysenterEip));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestRip: %I64X  ", UtilVmRead(VmcsField::kGuestRip));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestRsp: %I64X  ", UtilVmRead(VmcsField::kGuestRsp));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCr0: %I64X  ", NestedHalVmRead(VmcsField::kGuestCr0));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCr3: %I64X  ", NestedHalVmRead(VmcsField::kGuestCr3));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCr4: %I64X  ", NestedHalVmRead(VmcsField::kGuestCr4));
+
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestEsBase: %I64X  ", NestedHalVmRead(VmcsField::kGuestEsBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestCsBase: %I64X  ", NestedHalVmRead(VmcsField::kGuestCsBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSsBase: %I64X  ", NestedHalVmRead(VmcsField::kGuestSsBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestDsBase: %I64X  ", NestedHalVmRead(VmcsField::kGuestDsBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestFsBase: %I64X  ", NestedHalVmRead(VmcsField::kGuestFsBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGsBase: %I64X  ", NestedHalVmRead(VmcsField::kGuestGsBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestLdtrBase: %I64X  ", NestedHalVmRead(VmcsField::kGuestLdtrBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestTrBase: %I64X  ", NestedHalVmRead(VmcsField::kGuestTrBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestGdtrBase: %I64X  ", NestedHalVmRead(VmcsField::kGuestGdtrBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestIdtrBase: %I64X  ", NestedHalVmRead(VmcsField::kGuestIdtrBase));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestDr7: %I64X  ", NestedHalVmRead(VmcsField::kGuestDr7));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestRflags: %I64X  ", NestedHalVmRead(VmcsField::kGuestRflags));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSysenterEsp: %I64X  ", NestedHalVmRead(VmcsField::kGuestSysenterEsp));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestSysenterEip: %I64X  ", NestedHalVmRead(VmcsField::kGuestSysenterEip));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestRip: %I64X  ", NestedHalVmRead(VmcsField::kGuestRip));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestRsp: %I64X  ", NestedHalVmRead(VmcsField::kGuestRsp));
 
 }
 
@@ -264,16 +259,16 @@ VOID PrintReadOnlyField()
 {
 
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### Natural Read-only data field #############################");
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestPhysicalAddress: %I64X  ", UtilVmRead(VmcsField::kGuestPhysicalAddress));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kGuestPhysicalAddress: %I64X  ", NestedHalVmRead(VmcsField::kGuestPhysicalAddress));
 	HYPERPLATFORM_LOG_DEBUG_SAFE("###################### 64bit Read-only data field #############################");
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmInstructionError	:%I64X  ", UtilVmRead(VmcsField::kVmInstructionError));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitReason			:%I64X  ", UtilVmRead(VmcsField::kVmExitReason));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitIntrInfo		:%I64X  ", UtilVmRead(VmcsField::kVmExitIntrInfo));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitIntrErrorCode	:%I64X  ", UtilVmRead(VmcsField::kVmExitIntrErrorCode));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kIdtVectoringInfoField	:%I64X  ", UtilVmRead(VmcsField::kIdtVectoringInfoField));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kIdtVectoringErrorCode	:%I64X  ", UtilVmRead(VmcsField::kIdtVectoringErrorCode));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitInstructionLen	:%I64X  ", UtilVmRead(VmcsField::kVmExitInstructionLen));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmxInstructionInfo	:%I64X  ", UtilVmRead(VmcsField::kVmxInstructionInfo));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmInstructionError	:%I64X  ", NestedHalVmRead(VmcsField::kVmInstructionError));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitReason			:%I64X  ", NestedHalVmRead(VmcsField::kVmExitReason));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitIntrInfo		:%I64X  ", NestedHalVmRead(VmcsField::kVmExitIntrInfo));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitIntrErrorCode	:%I64X  ", NestedHalVmRead(VmcsField::kVmExitIntrErrorCode));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kIdtVectoringInfoField	:%I64X  ", NestedHalVmRead(VmcsField::kIdtVectoringInfoField));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kIdtVectoringErrorCode	:%I64X  ", NestedHalVmRead(VmcsField::kIdtVectoringErrorCode));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmExitInstructionLen	:%I64X  ", NestedHalVmRead(VmcsField::kVmExitInstructionLen));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("kVmxInstructionInfo	:%I64X  ", NestedHalVmRead(VmcsField::kVmxInstructionInfo));
 
 }
 //---------------------------------------------------------------------------------------------------------------------------//
@@ -334,7 +329,7 @@ ULONG GetVMCSOffset(ULONG_PTR encoded)
 VmcsField DecodeVmwriteOrVmRead(GpRegisters* guest_context, ULONG_PTR* Offset, ULONG_PTR* Value, BOOLEAN* RorM, ULONG_PTR* RegIndex, ULONG_PTR* MemAddr)
 {
 	const VMInstructionQualificationForVmreadOrVmwrite exit_qualification = {
-		static_cast<ULONG32>(UtilVmRead(VmcsField::kVmxInstructionInfo))
+		static_cast<ULONG32>(NestedHalVmRead(VmcsField::kVmxInstructionInfo))
 	};
 
 	ULONG VmcsFieldRegIndex = exit_qualification.fields.Reg2;
@@ -363,7 +358,7 @@ VmcsField DecodeVmwriteOrVmRead(GpRegisters* guest_context, ULONG_PTR* Offset, U
 	else
 	{
 		//offset
-		const auto displacement = UtilVmRead(VmcsField::kExitQualification);
+		const auto displacement = NestedHalVmRead(VmcsField::kExitQualification);
 
 		//base
 		ULONG_PTR base_value = 0;
@@ -769,55 +764,6 @@ VOID BuildGernericVMCSMap()
 	}
 }
 
-// Returns a base address of segment_descriptor
-_Use_decl_annotations_ static ULONG_PTR GetSegmentBaseByDescriptor(
-	const SegmentDescriptor *segment_descriptor) {
-	// Caluculate a 32bit base address
-	const auto base_high = segment_descriptor->fields.base_high << (6 * 4);
-	const auto base_middle = segment_descriptor->fields.base_mid << (4 * 4);
-	const auto base_low = segment_descriptor->fields.base_low;
-	ULONG_PTR base = (base_high | base_middle | base_low) & MAXULONG;
-	// Get upper 32bit of the base address if needed
-	if (IsX64() && !segment_descriptor->fields.system) {
-		auto desc64 =
-			reinterpret_cast<const SegmentDesctiptorX64 *>(segment_descriptor);
-		ULONG64 base_upper32 = desc64->base_upper32;
-		base |= (base_upper32 << 32);
-	}
-	return base;
-}
-
-// Returns the segment descriptor corresponds to the SegmentSelector
-_Use_decl_annotations_ static SegmentDescriptor *GetSegmentDescriptor(
-	ULONG_PTR descriptor_table_base, USHORT segment_selector) {
-	const SegmentSelector ss = { segment_selector };
-	return reinterpret_cast<SegmentDescriptor *>(descriptor_table_base + ss.fields.index * sizeof(SegmentDescriptor));
-}
-
-// Returns a base address of the segment specified by SegmentSelector
-_Use_decl_annotations_ static ULONG_PTR GetSegmentBase(
-	ULONG_PTR gdt_base, USHORT segment_selector) {
-	const SegmentSelector ss = { segment_selector };
-	if (!ss.all) {
-		return 0;
-	}
-
-	if (ss.fields.ti) {
-		const auto local_segment_descriptor =
-			GetSegmentDescriptor(gdt_base, AsmReadLDTR());
-		const auto ldt_base =
-			GetSegmentBaseByDescriptor(local_segment_descriptor);
-		const auto segment_descriptor =
-			GetSegmentDescriptor(ldt_base, segment_selector);
-		return GetSegmentBaseByDescriptor(segment_descriptor);
-	}
-	else {
-		const auto segment_descriptor =
-			GetSegmentDescriptor(gdt_base, segment_selector);
-		return	GetSegmentBaseByDescriptor(segment_descriptor);
-	}
-}
-
 //IF (register operand) or (CR0.PE = 0) or (CR4.VMXE = 0) or (RFLAGS.VM = 1) or (IA32_EFER.LMA = 1 and CS.L = 0) 
 //if and only if compatibility mode is on 
 /*
@@ -837,7 +783,7 @@ ULONG64 GetControlValue(Msr msr, ULONG32* highpart, ULONG32* lowpart)
 {
 	LARGE_INTEGER msr_value = {};
 
-	msr_value.QuadPart = UtilReadMsr64(msr);
+	msr_value.QuadPart = NestedHalReadMsr64(msr);
 	// bit == 0 in high word ==> must be zero  
 	*highpart = msr_value.HighPart;
 	// bit == 1 in low word  ==> must be one
@@ -854,114 +800,114 @@ VOID PrepareHostAndControlField(ULONG_PTR vmcs12_va, ULONG_PTR vmcs02_pa, BOOLEA
 	USHORT my_guest_vpid;
 
 	//vmcs0-1 32bit control field
-	ULONG32 exit_control = (ULONG32)UtilVmRead(VmcsField::kVmExitControls);
-	ULONG32 guest_pin_base_ctls = (ULONG32)UtilVmRead(VmcsField::kPinBasedVmExecControl);
-	ULONG32 guest_primary_processor_base_ctls = (ULONG32)UtilVmRead(VmcsField::kCpuBasedVmExecControl);
-	ULONG32 guest_secondary_processor_base_ctls = (ULONG32)UtilVmRead(VmcsField::kSecondaryVmExecControl);
+	ULONG32 exit_control = (ULONG32)NestedHalVmRead(VmcsField::kVmExitControls);
+	ULONG32 guest_pin_base_ctls = (ULONG32)NestedHalVmRead(VmcsField::kPinBasedVmExecControl);
+	ULONG32 guest_primary_processor_base_ctls = (ULONG32)NestedHalVmRead(VmcsField::kCpuBasedVmExecControl);
+	ULONG32 guest_secondary_processor_base_ctls = (ULONG32)NestedHalVmRead(VmcsField::kSecondaryVmExecControl);
 
-	ULONG32 vmexit_ctrls = (ULONG32)UtilVmRead(VmcsField::kVmExitControls);
-	ULONG32 vmexit_msr_store_cnt = (ULONG32)UtilVmRead(VmcsField::kVmExitMsrStoreCount);
-	ULONG32 vmexit_msr_load_cnt = (ULONG32)UtilVmRead(VmcsField::kVmExitMsrLoadCount);
+	ULONG32 vmexit_ctrls = (ULONG32)NestedHalVmRead(VmcsField::kVmExitControls);
+	ULONG32 vmexit_msr_store_cnt = (ULONG32)NestedHalVmRead(VmcsField::kVmExitMsrStoreCount);
+	ULONG32 vmexit_msr_load_cnt = (ULONG32)NestedHalVmRead(VmcsField::kVmExitMsrLoadCount);
 
-	ULONG32 vmentry_interr_info = (ULONG32)UtilVmRead(VmcsField::kVmEntryIntrInfoField);
-	ULONG32 vmentry_except_Err_code = (ULONG32)UtilVmRead(VmcsField::kVmEntryExceptionErrorCode);
-	ULONG32 vmentry_instr_length = (ULONG32)UtilVmRead(VmcsField::kVmEntryInstructionLen);
-	ULONG32 vmentry_ctrls = (ULONG32)UtilVmRead(VmcsField::kVmEntryControls);
-	ULONG32 vmentry_msr_load_cnt = (ULONG32)UtilVmRead(VmcsField::kVmEntryMsrLoadCount);
+	ULONG32 vmentry_interr_info = (ULONG32)NestedHalVmRead(VmcsField::kVmEntryIntrInfoField);
+	ULONG32 vmentry_except_Err_code = (ULONG32)NestedHalVmRead(VmcsField::kVmEntryExceptionErrorCode);
+	ULONG32 vmentry_instr_length = (ULONG32)NestedHalVmRead(VmcsField::kVmEntryInstructionLen);
+	ULONG32 vmentry_ctrls = (ULONG32)NestedHalVmRead(VmcsField::kVmEntryControls);
+	ULONG32 vmentry_msr_load_cnt = (ULONG32)NestedHalVmRead(VmcsField::kVmEntryMsrLoadCount);
 
-	ULONG32 guest_exception_bitmap = (ULONG32)UtilVmRead(VmcsField::kExceptionBitmap);
-	ULONG32 guest_page_fault_mask = (ULONG32)UtilVmRead(VmcsField::kPageFaultErrorCodeMask);
-	ULONG32 guest_page_fault_error_code_match = (ULONG32)UtilVmRead(VmcsField::kPageFaultErrorCodeMatch);
-	ULONG32 guest_cr3_target_count = (ULONG32)UtilVmRead(VmcsField::kCr3TargetCount);
+	ULONG32 guest_exception_bitmap = (ULONG32)NestedHalVmRead(VmcsField::kExceptionBitmap);
+	ULONG32 guest_page_fault_mask = (ULONG32)NestedHalVmRead(VmcsField::kPageFaultErrorCodeMask);
+	ULONG32 guest_page_fault_error_code_match = (ULONG32)NestedHalVmRead(VmcsField::kPageFaultErrorCodeMatch);
+	ULONG32 guest_cr3_target_count = (ULONG32)NestedHalVmRead(VmcsField::kCr3TargetCount);
 
 
 	//vmcs0-1 natural-width control field
-	ULONG_PTR guest_cr0_mask = UtilVmRead64(VmcsField::kCr0GuestHostMask);
-	ULONG_PTR guest_cr4_mask = UtilVmRead64(VmcsField::kCr4GuestHostMask);
-	ULONG_PTR guest_cr0_read_shadow = UtilVmRead64(VmcsField::kCr0ReadShadow);
-	ULONG_PTR guest_cr4_read_shadow = UtilVmRead64(VmcsField::kCr4ReadShadow);
+	ULONG_PTR guest_cr0_mask = NestedHalVmRead64(VmcsField::kCr0GuestHostMask);
+	ULONG_PTR guest_cr4_mask = NestedHalVmRead64(VmcsField::kCr4GuestHostMask);
+	ULONG_PTR guest_cr0_read_shadow = NestedHalVmRead64(VmcsField::kCr0ReadShadow);
+	ULONG_PTR guest_cr4_read_shadow = NestedHalVmRead64(VmcsField::kCr4ReadShadow);
 	ULONG_PTR guest_cr3_target_value[4] = { 0 };
-	guest_cr3_target_value[0] = UtilVmRead64(VmcsField::kCr3TargetValue0);
-	guest_cr3_target_value[1] = UtilVmRead64(VmcsField::kCr3TargetValue1);
-	guest_cr3_target_value[2] = UtilVmRead64(VmcsField::kCr3TargetValue2);
-	guest_cr3_target_value[3] = UtilVmRead64(VmcsField::kCr3TargetValue3);
+	guest_cr3_target_value[0] = NestedHalVmRead64(VmcsField::kCr3TargetValue0);
+	guest_cr3_target_value[1] = NestedHalVmRead64(VmcsField::kCr3TargetValue1);
+	guest_cr3_target_value[2] = NestedHalVmRead64(VmcsField::kCr3TargetValue2);
+	guest_cr3_target_value[3] = NestedHalVmRead64(VmcsField::kCr3TargetValue3);
 
 
 	// vmcs0-1 64bit Control Field
 	ULONG64 guest_io_bitmap[2] = { 0 };
-	guest_io_bitmap[0] = UtilVmRead64(VmcsField::kIoBitmapA);
-	guest_io_bitmap[1] = UtilVmRead64(VmcsField::kIoBitmapB);
-	ULONG64 guest_msr_bitmap = UtilVmRead64(VmcsField::kMsrBitmap);
-	ULONG64 guest_vmreadBitmapAddress = UtilVmRead64(VmcsField::kVmreadBitmapAddress);
-	ULONG64 guest_vmwriteBitMapAddress = UtilVmRead64(VmcsField::kVmwriteBitmapAddress);
-	ULONG64 guest_vmexceptionAddress = UtilVmRead64(VmcsField::kVirtualizationExceptionInfoAddress);
-	ULONG64 guest_virtual_apicpage = UtilVmRead64(VmcsField::kVirtualApicPageAddr);
+	guest_io_bitmap[0] = NestedHalVmRead64(VmcsField::kIoBitmapA);
+	guest_io_bitmap[1] = NestedHalVmRead64(VmcsField::kIoBitmapB);
+	ULONG64 guest_msr_bitmap = NestedHalVmRead64(VmcsField::kMsrBitmap);
+	ULONG64 guest_vmreadBitmapAddress = NestedHalVmRead64(VmcsField::kVmreadBitmapAddress);
+	ULONG64 guest_vmwriteBitMapAddress = NestedHalVmRead64(VmcsField::kVmwriteBitmapAddress);
+	ULONG64 guest_vmexceptionAddress = NestedHalVmRead64(VmcsField::kVirtualizationExceptionInfoAddress);
+	ULONG64 guest_virtual_apicpage = NestedHalVmRead64(VmcsField::kVirtualApicPageAddr);
 	ULONG64 guest_eoi_exit_bitmap[8] = { 0 };
-    guest_eoi_exit_bitmap[0] = UtilVmRead64(VmcsField::kEoiExitBitmap0);
-    guest_eoi_exit_bitmap[1] = UtilVmRead64(VmcsField::kEoiExitBitmap0High);
-    guest_eoi_exit_bitmap[2] = UtilVmRead64(VmcsField::kEoiExitBitmap1);
-    guest_eoi_exit_bitmap[3] = UtilVmRead64(VmcsField::kEoiExitBitmap1High);
-    guest_eoi_exit_bitmap[4] = UtilVmRead64(VmcsField::kEoiExitBitmap2);
-    guest_eoi_exit_bitmap[5] = UtilVmRead64(VmcsField::kEoiExitBitmap2High);
-    guest_eoi_exit_bitmap[6] = UtilVmRead64(VmcsField::kEoiExitBitmap3);
-    guest_eoi_exit_bitmap[7] = UtilVmRead64(VmcsField::kEoiExitBitmap3High);
-
-	ULONG64 guest_tpr_threshold = (ULONG32)UtilVmRead(VmcsField::kTprThreshold);
-	ULONG64 guest_apic_access_address = UtilVmRead64(VmcsField::kApicAccessAddr);
-	ULONG64 guest_ept_pointer = UtilVmRead64(VmcsField::kEptPointer);
-	ULONG64 vmfunc_ctrls = UtilVmRead64(VmcsField::kVmFuncCtls);
-	ULONG64 eptp_list_address = UtilVmRead64(VmcsField::kEptpListAddress);
-	ULONG64 pml_address = UtilVmRead64(VmcsField::kPmlAddress);
-	ULONG64 pause_loop_exiting_gap = (ULONG32)UtilVmRead(VmcsField::kPleGap);
-	ULONG64 pause_loop_exiting_window = (ULONG32)UtilVmRead(VmcsField::kPleWindow);
-	ULONG64 guest_vpid = (USHORT)UtilVmRead(VmcsField::kVirtualProcessorId);
+    guest_eoi_exit_bitmap[0] = NestedHalVmRead64(VmcsField::kEoiExitBitmap0);
+    guest_eoi_exit_bitmap[1] = NestedHalVmRead64(VmcsField::kEoiExitBitmap0High);
+    guest_eoi_exit_bitmap[2] = NestedHalVmRead64(VmcsField::kEoiExitBitmap1);
+    guest_eoi_exit_bitmap[3] = NestedHalVmRead64(VmcsField::kEoiExitBitmap1High);
+    guest_eoi_exit_bitmap[4] = NestedHalVmRead64(VmcsField::kEoiExitBitmap2);
+    guest_eoi_exit_bitmap[5] = NestedHalVmRead64(VmcsField::kEoiExitBitmap2High);
+    guest_eoi_exit_bitmap[6] = NestedHalVmRead64(VmcsField::kEoiExitBitmap3);
+    guest_eoi_exit_bitmap[7] = NestedHalVmRead64(VmcsField::kEoiExitBitmap3High);
+
+	ULONG64 guest_tpr_threshold = (ULONG32)NestedHalVmRead(VmcsField::kTprThreshold);
+	ULONG64 guest_apic_access_address = NestedHalVmRead64(VmcsField::kApicAccessAddr);
+	ULONG64 guest_ept_pointer = NestedHalVmRead64(VmcsField::kEptPointer);
+	ULONG64 vmfunc_ctrls = NestedHalVmRead64(VmcsField::kVmFuncCtls);
+	ULONG64 eptp_list_address = NestedHalVmRead64(VmcsField::kEptpListAddress);
+	ULONG64 pml_address = NestedHalVmRead64(VmcsField::kPmlAddress);
+	ULONG64 pause_loop_exiting_gap = (ULONG32)NestedHalVmRead(VmcsField::kPleGap);
+	ULONG64 pause_loop_exiting_window = (ULONG32)NestedHalVmRead(VmcsField::kPleWindow);
+	ULONG64 guest_vpid = (USHORT)NestedHalVmRead(VmcsField::kVirtualProcessorId);
 
 	//vmcs0-1 16bit Host state Field 
-	ULONG_PTR	kHostCsSelector = UtilVmRead(VmcsField::kHostCsSelector);
-	ULONG_PTR	kHostDsSelector = UtilVmRead(VmcsField::kHostDsSelector);
-	ULONG_PTR	kHostEsSelector = UtilVmRead(VmcsField::kHostEsSelector);
-	ULONG_PTR	kHostSsSelector = UtilVmRead(VmcsField::kHostSsSelector);
-	ULONG_PTR	kHostFsSelector = UtilVmRead(VmcsField::kHostFsSelector);
-	ULONG_PTR	kHostGsSelector = UtilVmRead(VmcsField::kHostGsSelector);
-	ULONG_PTR	kHostTrSelector = UtilVmRead(VmcsField::kHostTrSelector);
+	ULONG_PTR	kHostCsSelector = NestedHalVmRead(VmcsField::kHostCsSelector);
+	ULONG_PTR	kHostDsSelector = NestedHalVmRead(VmcsField::kHostDsSelector);
+	ULONG_PTR	kHostEsSelector = NestedHalVmRead(VmcsField::kHostEsSelector);
+	ULONG_PTR	kHostSsSelector = NestedHalVmRead(VmcsField::kHostSsSelector);
+	ULONG_PTR	kHostFsSelector = NestedHalVmRead(VmcsField::kHostFsSelector);
+	ULONG_PTR	kHostGsSelector = NestedHalVmRead(VmcsField::kHostGsSelector);
+	ULONG_PTR	kHostTrSelector = NestedHalVmRead(VmcsField::kHostTrSelector);
 
 	//vmcs0-1 Natural-Width Host-State Field
-	ULONG_PTR kHostCr0 = UtilVmRead(VmcsField::kHostCr0);
-	ULONG_PTR kHostCr3 = UtilVmRead(VmcsField::kHostCr3);
-	ULONG_PTR kHostCr4 = UtilVmRead(VmcsField::kHostCr4);
-	ULONG_PTR kHostFsBase = UtilVmRead(VmcsField::kHostFsBase);
-	ULONG_PTR kHostGsBase = UtilVmRead(VmcsField::kHostGsBase);
-	ULONG_PTR kHostTrBase = UtilVmRead(VmcsField::kHostTrBase);
-	ULONG_PTR kHostGdtrBase = UtilVmRead(VmcsField::kHostGdtrBase);
-	ULONG_PTR kHostIdtrBase = UtilVmRead(VmcsField::kHostIdtrBase);
-	ULONG_PTR kHostIa32SysenterEsp= UtilVmRead(VmcsField::kHostIa32SysenterEsp);
-	ULONG_PTR kHostIa32SysenterEip= UtilVmRead(VmcsField::kHostIa32SysenterEip);
-	ULONG_PTR kHostRsp = UtilVmRead( VmcsField::kHostRsp );
-	ULONG_PTR kHostRip = UtilVmRead( VmcsField::kHostRip ); 
+	ULONG_PTR kHostCr0 = NestedHalVmRead(VmcsField::kHostCr0);
+	ULONG_PTR kHostCr3 = NestedHalVmRead(VmcsField::kHostCr3);
+	ULONG_PTR kHostCr4 = NestedHalVmRead(VmcsField::kHostCr4);
+	ULONG_PTR kHostFsBase = NestedHalVmRead(VmcsField::kHostFsBase);
+	ULONG_PTR kHostGsBase = NestedHalVmRead(VmcsField::kHostGsBase);
+	ULONG_PTR kHostTrBase = NestedHalVmRead(VmcsField::kHostTrBase);
+	ULONG_PTR kHostGdtrBase = NestedHalVmRead(VmcsField::kHostGdtrBase);
+	ULONG_PTR kHostIdtrBase = NestedHalVmRead(VmcsField::kHostIdtrBase);
+	ULONG_PTR kHostIa32SysenterEsp= NestedHalVmRead(VmcsField::kHostIa32SysenterEsp);
+	ULONG_PTR kHostIa32SysenterEip= NestedHalVmRead(VmcsField::kHostIa32SysenterEip);
+	ULONG_PTR kHostRsp = NestedHalVmRead( VmcsField::kHostRsp );
+	ULONG_PTR kHostRip = NestedHalVmRead( VmcsField::kHostRip ); 
 
 	//vmcs0-1 32-Bit Host-State Field
-	ULONG_PTR kHostIa32SysenterCs = UtilVmRead(VmcsField::kHostIa32SysenterCs);
+	ULONG_PTR kHostIa32SysenterCs = NestedHalVmRead(VmcsField::kHostIa32SysenterCs);
 	 
 	ULONG32 highpart, lowpart = 0;
 
-	const auto use_true_msrs = Ia32VmxBasicMsr{ UtilReadMsr64(Msr::kIa32VmxBasic) }.fields.vmx_capability_hint;
+	const auto use_true_msrs = Ia32VmxBasicMsr{ NestedHalReadMsr64(Msr::kIa32VmxBasic) }.fields.vmx_capability_hint;
 
 	GetControlValue((use_true_msrs) ? Msr::kIa32VmxTruePinbasedCtls : Msr::kIa32VmxPinbasedCtls, &highpart, &lowpart);
 
 	if (isLaunch)
 	{
-		if (VmxStatus::kOk != (status = static_cast<VmxStatus>(__vmx_vmclear(&vmcs02_pa))))
+		if (VmxStatus::kOk != (status = NestedHalVmClear(&vmcs02_pa)))
 		{
-			VmxInstructionError error = static_cast<VmxInstructionError>(UtilVmRead(VmcsField::kVmInstructionError));
+			VmxInstructionError error = static_cast<VmxInstructionError>(NestedHalVmRead(VmcsField::kVmInstructionError));
 			HYPERPLATFORM_LOG_DEBUG_SAFE("Error vmclear2 error code :%x , %x ", status, error);
 			HYPERPLATFORM_COMMON_DBG_BREAK();
 		}
 	}
 
 	//Load VMCS02 into CPU
-	if (VmxStatus::kOk != (status = static_cast<VmxStatus>(__vmx_vmptrld(&vmcs02_pa))))
+	if (VmxStatus::kOk != (status = NestedHalVmPtrld(&vmcs02_pa)))
 	{
-		VmxInstructionError error = static_cast<VmxInstructionError>(UtilVmRead(VmcsField::kVmInstructionError));
+		VmxInstructionError error = static_cast<VmxInstructionError>(NestedHalVmRead(VmcsField::kVmInstructionError));
 		HYPERPLATFORM_LOG_DEBUG_SAFE("Error vmptrld error code :%x , %x", status, error);
 		HYPERPLATFORM_COMMON_DBG_BREAK();
 	}
@@ -969,36 +915,36 @@ VOID PrepareHostAndControlField(ULONG_PTR vmcs12_va, ULONG_PTR vmcs02_pa, BOOLEA
 	/*
 	Host 16 bit State field
 	*/
-	UtilVmWrite(VmcsField::kHostCsSelector, kHostCsSelector);
-	UtilVmWrite(VmcsField::kHostDsSelector, kHostDsSelector);
-	UtilVmWrite(VmcsField::kHostEsSelector, kHostEsSelector);
-	UtilVmWrite(VmcsField::kHostSsSelector, kHostSsSelector);
-	UtilVmWrite(VmcsField::kHostFsSelector, kHostFsSelector);
-	UtilVmWrite(VmcsField::kHostGsSelector, kHostGsSelector);
-	UtilVmWrite(VmcsField::kHostTrSelector, kHostTrSelector);
+	NestedHalVmWrite(VmcsField::kHostCsSelector, kHostCsSelector);
+	NestedHalVmWrite(VmcsField::kHostDsSelector, kHostDsSelector);
+	NestedHalVmWrite(VmcsField::kHostEsSelector, kHostEsSelector);
+	NestedHalVmWrite(VmcsField::kHostSsSelector, kHostSsSelector);
+	NestedHalVmWrite(VmcsField::kHostFsSelector, kHostFsSelector);
+	NestedHalVmWrite(VmcsField::kHostGsSelector, kHostGsSelector);
+	NestedHalVmWrite(VmcsField::kHostTrSelector, kHostTrSelector);
 
 	/*
 	Host 32 bit state field
 	*/
-	UtilVmWrite(VmcsField::kHostIa32SysenterCs, kHostIa32SysenterCs);
+	NestedHalVmWrite(VmcsField::kHostIa32SysenterCs, kHostIa32SysenterCs);
 
 	/*
 	Host Natural width state field
 	*/
-	UtilVmWrite64(VmcsField::kHostCr0, kHostCr0);
-	UtilVmWrite64(VmcsField::kHostCr3, kHostCr3);
-	UtilVmWrite64(VmcsField::kHostCr4, kHostCr4);
+	NestedHalVmWrite64(VmcsField::kHostCr0, kHostCr0);
+	NestedHalVmWrite64(VmcsField::kHostCr3, kHostCr3);
+	NestedHalVmWrite64(VmcsField::kHostCr4, kHostCr4);
 
-	UtilVmWrite64(VmcsField::kHostFsBase, kHostFsBase);
-	UtilVmWrite64(VmcsField::kHostGsBase, kHostGsBase);
-	UtilVmWrite64(VmcsField::kHostTrBase, kHostTrBase);
-	UtilVmWrite64(VmcsField::kHostGdtrBase, kHostGdtrBase);
-	UtilVmWrite64(VmcsField::kHostIdtrBase, kHostIdtrBase);
-	UtilVmWrite64(VmcsField::kHostIa32SysenterEsp, kHostIa32SysenterEsp);
-	UtilVmWrite64(VmcsField::kHostIa32SysenterEip, kHostIa32SysenterEip);
+	NestedHalVmWrite64(VmcsField::kHostFsBase, kHostFsBase);
+	NestedHalVmWrite64(VmcsField::kHostGsBase, kHostGsBase);
+	NestedHalVmWrite64(VmcsField::kHostTrBase, kHostTrBase);
+	NestedHalVmWrite64(VmcsField::kHostGdtrBase, kHostGdtrBase);
+	NestedHalVmWrite64(VmcsField::kHostIdtrBase, kHostIdtrBase);
+	NestedHalVmWrite64(VmcsField::kHostIa32SysenterEsp, kHostIa32SysenterEsp);
+	NestedHalVmWrite64(VmcsField::kHostIa32SysenterEip, kHostIa32SysenterEip);
 
-	UtilVmWrite64(VmcsField::kHostRsp, kHostRsp);
-	UtilVmWrite64(VmcsField::kHostRip, kHostRip);
+	NestedHalVmWrite64(VmcsField::kHostRsp, kHostRsp);
+	NestedHalVmWrite64(VmcsField::kHostRip, kHostRip);
 
 	//-----------------------------------------------------------------------------------------------------------//	
 	//  Start Mixing Control field with VMCS01 and VMCS12 into VMCS02
@@ -1006,7 +952,7 @@ VOID PrepareHostAndControlField(ULONG_PTR vmcs12_va, ULONG_PTR vmcs02_pa, BOOLEA
 	16 bit Control Field
 	*/ 
 
-	UtilVmWrite(VmcsField::kVirtualProcessorId, guest_vpid);
+	NestedHalVmWrite(VmcsField::kVirtualProcessorId, guest_vpid);
 
 	/*
 	32 bit Control Field
@@ -1049,59 +995,59 @@ VOID PrepareHostAndControlField(ULONG_PTR vmcs12_va, ULONG_PTR vmcs02_pa, BOOLEA
 	VmRead32(VmcsField::kPleWindow, vmcs12_va, &my_pause_loop_exiting_window);
 	VmRead32(VmcsField::kSecondaryVmExecControl, vmcs12_va, &my_guest_secondary_processor_base_ctls);
 
-	UtilVmWrite(VmcsField::kPageFaultErrorCodeMask, my_guest_page_fault_mask);
-	UtilVmWrite(VmcsField::kPageFaultErrorCodeMatch, my_page_fault_error_code_match);
-	UtilVmWrite(VmcsField::kCr3TargetCount, my_cr3_target_count);
+	NestedHalVmWrite(VmcsField::kPageFaultErrorCodeMask, my_guest_page_fault_mask);
+	NestedHalVmWrite(VmcsField::kPageFaultErrorCodeMatch, my_page_fault_error_code_match);
+	NestedHalVmWrite(VmcsField::kCr3TargetCount, my_cr3_target_count);
 
-	UtilVmWrite(VmcsField::kPinBasedVmExecControl, my_pin_base_ctls );
-	UtilVmWrite(VmcsField::kVmExitControls, exit_control);
-	UtilVmWrite(VmcsField::kSecondaryVmExecControl, guest_secondary_processor_base_ctls | my_guest_secondary_processor_base_ctls);
-	UtilVmWrite(VmcsField::kCpuBasedVmExecControl, guest_primary_processor_base_ctls | my_primary_processor_base_ctls);
-	UtilVmWrite(VmcsField::kExceptionBitmap, guest_exception_bitmap | my_exception_bitmap);
+	NestedHalVmWrite(VmcsField::kPinBasedVmExecControl, my_pin_base_ctls );
+	NestedHalVmWrite(VmcsField::kVmExitControls, exit_control);
+	NestedHalVmWrite(VmcsField::kSecondaryVmExecControl, guest_secondary_processor_base_ctls | my_guest_secondary_processor_base_ctls);
+	NestedHalVmWrite(VmcsField::kCpuBasedVmExecControl, guest_primary_processor_base_ctls | my_primary_processor_base_ctls);
+	NestedHalVmWrite(VmcsField::kExceptionBitmap, guest_exception_bitmap | my_exception_bitmap);
 
-	UtilVmWrite(VmcsField::kVmExitMsrStoreCount, my_vmexit_msr_store_cnt);
-	UtilVmWrite(VmcsField::kVmExitMsrLoadCount, my_vmexit_msr_load_cnt);
-	UtilVmWrite(VmcsField::kVmEntryControls, my_vmentry_ctrls);
-	UtilVmWrite(VmcsField::kVmEntryMsrLoadCount, my_vmentry_msr_load_cnt);
-	UtilVmWrite(VmcsField::kVmEntryIntrInfoField, my_vmentry_interr_info);
-	UtilVmWrite(VmcsField::kVmEntryExceptionErrorCode, my_vmentry_except_Err_code);
-	UtilVmWrite(VmcsField::kVmEntryInstructionLen, my_vmentry_instr_length);
-	UtilVmWrite(VmcsField::kTprThreshold, my_guest_tpr_threshold);
-	UtilVmWrite(VmcsField::kPleGap, 0);
-	UtilVmWrite(VmcsField::kPleWindow, 0);
+	NestedHalVmWrite(VmcsField::kVmExitMsrStoreCount, my_vmexit_msr_store_cnt);
+	NestedHalVmWrite(VmcsField::kVmExitMsrLoadCount, my_vmexit_msr_load_cnt);
+	NestedHalVmWrite(VmcsField::kVmEntryControls, my_vmentry_ctrls);
+	NestedHalVmWrite(VmcsField::kVmEntryMsrLoadCount, my_vmentry_msr_load_cnt);
+	NestedHalVmWrite(VmcsField::kVmEntryIntrInfoField, my_vmentry_interr_info);
+	NestedHalVmWrite(VmcsField::kVmEntryExceptionErrorCode, my_vmentry_except_Err_code);
+	NestedHalVmWrite(VmcsField::kVmEntryInstructionLen, my_vmentry_instr_length);
+	NestedHalVmWrite(VmcsField::kTprThreshold, my_guest_tpr_threshold);
+	NestedHalVmWrite(VmcsField::kPleGap, 0);
+	NestedHalVmWrite(VmcsField::kPleWindow, 0);
 
 
 	/*
 	64bit control field
 	*/
-	UtilVmWrite64(VmcsField::kIoBitmapA, guest_io_bitmap[0]);
-	UtilVmWrite64(VmcsField::kIoBitmapB, guest_io_bitmap[1]);
-	UtilVmWrite64(VmcsField::kMsrBitmap, guest_msr_bitmap);
-	UtilVmWrite64(VmcsField::kPmlAddress, pml_address);
-	UtilVmWrite64(VmcsField::kApicAccessAddr, guest_apic_access_address);
-	UtilVmWrite64(VmcsField::kVmFuncCtls, vmfunc_ctrls);
-	UtilVmWrite64(VmcsField::kEptPointer, guest_ept_pointer);
-	UtilVmWrite64(VmcsField::kEoiExitBitmap0, guest_eoi_exit_bitmap[0]);
-	UtilVmWrite64(VmcsField::kEoiExitBitmap0High, guest_eoi_exit_bitmap[1]);
-	UtilVmWrite64(VmcsField::kEoiExitBitmap1, guest_eoi_exit_bitmap[2]);
-	UtilVmWrite64(VmcsField::kEoiExitBitmap1High, guest_eoi_exit_bitmap[3]);
-	UtilVmWrite64(VmcsField::kEoiExitBitmap2, guest_eoi_exit_bitmap[4]);
-	UtilVmWrite64(VmcsField::kEoiExitBitmap2High, guest_eoi_exit_bitmap[5]);
-	UtilVmWrite64(VmcsField::kEoiExitBitmap3, guest_eoi_exit_bitmap[6]);
-	UtilVmWrite64(VmcsField::kEoiExitBitmap3High, guest_eoi_exit_bitmap[7]);
-	UtilVmWrite64(VmcsField::kEptpListAddress, eptp_list_address);
+	NestedHalVmWrite64(VmcsField::kIoBitmapA, guest_io_bitmap[0]);
+	NestedHalVmWrite64(VmcsField::kIoBitmapB, guest_io_bitmap[1]);
+	NestedHalVmWrite64(VmcsField::kMsrBitmap, guest_msr_bitmap);
+	NestedHalVmWrite64(VmcsField::kPmlAddress, pml_address);
+	NestedHalVmWrite64(VmcsField::kApicAccessAddr, guest_apic_access_address);
+	NestedHalVmWrite64(VmcsField::kVmFuncCtls, vmfunc_ctrls);
+	NestedHalVmWrite64(VmcsField::kEptPointer, guest_ept_pointer);
+	NestedHalVmWrite64(VmcsField::kEoiExitBitmap0, guest_eoi_exit_bitmap[0]);
+	NestedHalVmWrite64(VmcsField::kEoiExitBitmap0High, guest_eoi_exit_bitmap[1]);
+	NestedHalVmWrite64(VmcsField::kEoiExitBitmap1, guest_eoi_exit_bitmap[2]);
+	NestedHalVmWrite64(VmcsField::kEoiExitBitmap1High, guest_eoi_exit_bitmap[3]);
+	NestedHalVmWrite64(VmcsField::kEoiExitBitmap2, guest_eoi_exit_bitmap[4]);
+	NestedHalVmWrite64(VmcsField::kEoiExitBitmap2High, guest_eoi_exit_bitmap[5]);
+	NestedHalVmWrite64(VmcsField::kEoiExitBitmap3, guest_eoi_exit_bitmap[6]);
+	NestedHalVmWrite64(VmcsField::kEoiExitBitmap3High, guest_eoi_exit_bitmap[7]);
+	NestedHalVmWrite64(VmcsField::kEptpListAddress, eptp_list_address);
 
 	/*
 	Natural-width field
 	*/
-	UtilVmWrite64(VmcsField::kCr0GuestHostMask, guest_cr0_mask);
-	UtilVmWrite64(VmcsField::kCr4GuestHostMask, guest_cr4_mask);
-	UtilVmWrite64(VmcsField::kCr0ReadShadow, guest_cr0_read_shadow);
-	UtilVmWrite64(VmcsField::kCr4ReadShadow, guest_cr4_read_shadow);
-	UtilVmWrite64(VmcsField::kCr3TargetValue0, guest_cr3_target_value[0]);
-	UtilVmWrite64(VmcsField::kCr3TargetValue1, guest_cr3_target_value[1]);
-	UtilVmWrite64(VmcsField::kCr3TargetValue2, guest_cr3_target_value[2]);
-	UtilVmWrite64(VmcsField::kCr3TargetValue3, guest_cr3_target_value[3]);
+	NestedHalVmWrite64(VmcsField::kCr0GuestHostMask, guest_cr0_mask);
+	NestedHalVmWrite64(VmcsField::kCr4GuestHostMask, guest_cr4_mask);
+	NestedHalVmWrite64(VmcsField::kCr0ReadShadow, guest_cr0_read_shadow);
+	NestedHalVmWrite64(VmcsField::kCr4ReadShadow, guest_cr4_read_shadow);
+	NestedHalVmWrite64(VmcsField::kCr3TargetValue0, guest_cr3_target_value[0]);
+	NestedHalVmWrite64(VmcsField::kCr3TargetValue1, guest_cr3_target_value[1]);
+	NestedHalVmWrite64(VmcsField::kCr3TargetValue2, guest_cr3_target_value[2]);
+	NestedHalVmWrite64(VmcsField::kCr3TargetValue3, guest_cr3_target_value[3]);
 
 	/*
 	VM control field End
@@ -1136,14 +1082,14 @@ VOID PrepareGuestStateField(ULONG_PTR guest_vmcs_va)
 	VmRead16(VmcsField::kGuestTrSelector, guest_vmcs_va, &vmcs12_tr_selector);
 	 
 
-	UtilVmWrite(VmcsField::kGuestEsSelector, vmcs12_es_selector);
-	UtilVmWrite(VmcsField::kGuestCsSelector, vmcs12_cs_selector);
-	UtilVmWrite(VmcsField::kGuestSsSelector, vmcs12_ss_selector);
-	UtilVmWrite(VmcsField::kGuestDsSelector, vmcs12_ds_selector);
-	UtilVmWrite(VmcsField::kGuestFsSelector, vmcs12_fs_selector);
-	UtilVmWrite(VmcsField::kGuestGsSelector, vmcs12_gs_selector);
-	UtilVmWrite(VmcsField::kGuestLdtrSelector, vmcs12_ldtr_selector);
-	UtilVmWrite(VmcsField::kGuestTrSelector, vmcs12_tr_selector); 
+	NestedHalVmWrite(VmcsField::kGuestEsSelector, vmcs12_es_selector);
+	NestedHalVmWrite(VmcsField::kGuestCsSelector, vmcs12_cs_selector);
+	NestedHalVmWrite(VmcsField::kGuestSsSelector, vmcs12_ss_selector);
+	NestedHalVmWrite(VmcsField::kGuestDsSelector, vmcs12_ds_selector);
+	NestedHalVmWrite(VmcsField::kGuestFsSelector, vmcs12_fs_selector);
+	NestedHalVmWrite(VmcsField::kGuestGsSelector, vmcs12_gs_selector);
+	NestedHalVmWrite(VmcsField::kGuestLdtrSelector, vmcs12_ldtr_selector);
+	NestedHalVmWrite(VmcsField::kGuestTrSelector, vmcs12_tr_selector); 
 
 	/*
 	Guest 32bit state field
@@ -1194,39 +1140,39 @@ VOID PrepareGuestStateField(ULONG_PTR guest_vmcs_va)
 	VmRead32(VmcsField::kGuestActivityState, guest_vmcs_va, &vmcs12_kGuestActivityState);
 	VmRead32(VmcsField::kGuestSysenterCs, guest_vmcs_va, &vmcs12_kGuestSysenterCs);
 
-	UtilVmWrite(VmcsField::kGuestEsLimit, vmcs12_kGuestEsLimit);
-	UtilVmWrite(VmcsField::kGuestCsLimit, vmcs12_kGuestCsLimit);
-	UtilVmWrite(VmcsField::kGuestSsLimit, vmcs12_kGuestSsLimit);
-	UtilVmWrite(VmcsField::kGuestDsLimit, vmcs12_kGuestDsLimit);
-	UtilVmWrite(VmcsField::kGuestFsLimit, vmcs12_kGuestFsLimit);
-	UtilVmWrite(VmcsField::kGuestGsLimit, vmcs12_kGuestGsLimit);
-	UtilVmWrite(VmcsField::kGuestLdtrLimit, vmcs12_kGuestLdtrLimit);
-	UtilVmWrite(VmcsField::kGuestTrLimit, vmcs12_kGuestTrLimit);
-	UtilVmWrite(VmcsField::kGuestGdtrLimit, vmcs12_kGuestGdtrLimit);
-	UtilVmWrite(VmcsField::kGuestIdtrLimit, vmcs12_kGuestIdtrLimit);
-
-	UtilVmWrite(VmcsField::kGuestEsArBytes, vmcs12_kGuestEsArBytes);
-	UtilVmWrite(VmcsField::kGuestCsArBytes, vmcs12_kGuestCsArBytes);
-	UtilVmWrite(VmcsField::kGuestSsArBytes, vmcs12_kGuestSsArBytes);
-	UtilVmWrite(VmcsField::kGuestDsArBytes, vmcs12_kGuestDsArBytes);
-	UtilVmWrite(VmcsField::kGuestFsArBytes, vmcs12_kGuestFsArBytes);
-	UtilVmWrite(VmcsField::kGuestGsArBytes, vmcs12_kGuestGsArBytes);
-	UtilVmWrite(VmcsField::kGuestLdtrArBytes, vmcs12_kGuestLdtrArBytes);
+	NestedHalVmWrite(VmcsField::kGuestEsLimit, vmcs12_kGuestEsLimit);
+	NestedHalVmWrite(VmcsField::kGuestCsLimit, vmcs12_kGuestCsLimit);
+	NestedHalVmWrite(VmcsField::kGuestSsLimit, vmcs12_kGuestSsLimit);
+	NestedHalVmWrite(VmcsField::kGuestDsLimit, vmcs12_kGuestDsLimit);
+	NestedHalVmWrite(VmcsField::kGuestFsLimit, vmcs12_kGuestFsLimit);
+	NestedHalVmWrite(VmcsField::kGuestGsLimit, vmcs12_kGuestGsLimit);
+	NestedHalVmWrite(VmcsField::kGuestLdtrLimit, vmcs12_kGuestLdtrLimit);
+	NestedHalVmWrite(VmcsField::kGuestTrLimit, vmcs12_kGuestTrLimit);
+	NestedHalVmWrite(VmcsField::kGuestGdtrLimit, vmcs12_kGuestGdtrLimit);
+	NestedHalVmWrite(VmcsField::kGuestIdtrLimit, vmcs12_kGuestIdtrLimit);
+
+	NestedHalVmWrite(VmcsField::kGuestEsArBytes, vmcs12_kGuestEsArBytes);
+	NestedHalVmWrite(VmcsField::kGuestCsArBytes, vmcs12_kGuestCsArBytes);
+	NestedHalVmWrite(VmcsField::kGuestSsArBytes, vmcs12_kGuestSsArBytes);
+	NestedHalVmWrite(VmcsField::kGuestDsArBytes, vmcs12_kGuestDsArBytes);
+	NestedHalVmWrite(VmcsField::kGuestFsArBytes, vmcs12_kGuestFsArBytes);
+	NestedHalVmWrite(VmcsField::kGuestGsArBytes, vmcs12_kGuestGsArBytes);
+	NestedHalVmWrite(VmcsField::kGuestLdtrArBytes, vmcs12_kGuestLdtrArBytes);
 
 	//Intel needs BUSY TSS for VMRESUME / VMLAUNCH
-	UtilVmWrite(VmcsField::kGuestTrArBytes, vmcs12_kGuestTrArBytes | LONG_MODE_BUSY_TSS);
+	NestedHalVmWrite(VmcsField::kGuestTrArBytes, vmcs12_kGuestTrArBytes | LONG_MODE_BUSY_TSS);
 
-	UtilVmWrite(VmcsField::kGuestInterruptibilityInfo, vmcs12_kGuestInterruptibilityInfo);
-	UtilVmWrite(VmcsField::kGuestActivityState, vmcs12_kGuestActivityState);
-	UtilVmWrite(VmcsField::kGuestSysenterCs, vmcs12_kGuestSysenterCs);
+	NestedHalVmWrite(VmcsField::kGuestInterruptibilityInfo, vmcs12_kGuestInterruptibilityInfo);
+	NestedHalVmWrite(VmcsField::kGuestActivityState, vmcs12_kGuestActivityState);
+	NestedHalVmWrite(VmcsField::kGuestSysenterCs, vmcs12_kGuestSysenterCs);
 
 	/*
 	Guest 64 bit state field
 	*/
 	ULONG64 vmcs12_kIa32Debugctl;
 	VmRead64(VmcsField::kGuestIa32Debugctl, guest_vmcs_va, &vmcs12_kIa32Debugctl);
-	UtilVmWrite64(VmcsField::kVmcsLinkPointer, MAXULONG64);//ʹӰVMCS
-	UtilVmWrite64(VmcsField::kGuestIa32Debugctl, vmcs12_kIa32Debugctl);
+	NestedHalVmWrite64(VmcsField::kVmcsLinkPointer, MAXULONG64);//ʹӰVMCS
+	NestedHalVmWrite64(VmcsField::kGuestIa32Debugctl, vmcs12_kIa32Debugctl);
 
 	/*
 	Guest Natural width state field
@@ -1276,27 +1222,27 @@ VOID PrepareGuestStateField(ULONG_PTR guest_vmcs_va)
 	VmRead64(VmcsField::kGuestRsp, guest_vmcs_va, &vmcs12_kGuestRsp);
 	VmRead64(VmcsField::kGuestRflags, guest_vmcs_va, &vmcs12_kGuestRlags); 
 
-	UtilVmWrite(VmcsField::kGuestSysenterEsp, vmcs12_kGuestSysenterEsp);
-	UtilVmWrite(VmcsField::kGuestSysenterEip, vmcs12_kGuestSysenterEip);
-	UtilVmWrite(VmcsField::kGuestPendingDbgExceptions, vmcs12_guest_Pending_dbg_exception);
-	UtilVmWrite(VmcsField::kGuestEsBase, vmcs12_kGuestEsBase);
-	UtilVmWrite(VmcsField::kGuestCsBase, vmcs12_kGuestCsBase);
-	UtilVmWrite(VmcsField::kGuestSsBase, vmcs12_kGuestSsBase);
-	UtilVmWrite(VmcsField::kGuestDsBase, vmcs12_kGuestDsBase);
-	UtilVmWrite(VmcsField::kGuestFsBase, vmcs12_kGuestFsBase);
-	UtilVmWrite(VmcsField::kGuestGsBase, vmcs12_kGuestGsBase);
-	UtilVmWrite(VmcsField::kGuestLdtrBase, vmcs12_kGuestLdtrBase);
-	UtilVmWrite(VmcsField::kGuestTrBase, vmcs12_kGuestTrBase);
-	UtilVmWrite(VmcsField::kGuestGdtrBase, vmcs12_kGuestGdtrBase);
-	UtilVmWrite(VmcsField::kGuestIdtrBase, vmcs12_kGuestIdtrBase);
-	UtilVmWrite(VmcsField::kGuestDr7, vmcs12_kGuestDr7);
-	UtilVmWrite(VmcsField::kGuestRflags, vmcs12_kGuestRflags);
-	UtilVmWrite(VmcsField::kGuestCr0, vmcs12_kGuestCr0);
-	UtilVmWrite(VmcsField::kGuestCr3, vmcs12_kGuestCr3);
-	UtilVmWrite(VmcsField::kGuestCr4, vmcs12_kGuestCr4);   
-	UtilVmWrite(VmcsField::kGuestRip, vmcs12_kGuestRip);
-	UtilVmWrite(VmcsField::kGuestRsp, vmcs12_kGuestRsp);
-	UtilVmWrite(VmcsField::kGuestRflags, vmcs12_kGuestRlags);
+	NestedHalVmWrite(VmcsField::kGuestSysenterEsp, vmcs12_kGuestSysenterEsp);
+	NestedHalVmWrite(VmcsField::kGuestSysenterEip, vmcs12_kGuestSysenterEip);
+	NestedHalVmWrite(VmcsField::kGuestPendingDbgExceptions, vmcs12_guest_Pending_dbg_exception);
+	NestedHalVmWrite(VmcsField::kGuestEsBase, vmcs12_kGuestEsBase);
+	NestedHalVmWrite(VmcsField::kGuestCsBase, vmcs12_kGuestCsBase);
+	NestedHalVmWrite(VmcsField::kGuestSsBase, vmcs12_kGuestSsBase);
+	NestedHalVmWrite(VmcsField::kGuestDsBase, vmcs12_kGuestDsBase);
+	NestedHalVmWrite(VmcsField::kGuestFsBase, vmcs12_kGuestFsBase);
+	NestedHalVmWrite(VmcsField::kGuestGsBase, vmcs12_kGuestGsBase);
+	NestedHalVmWrite(VmcsField::kGuestLdtrBase, vmcs12_kGuestLdtrBase);
+	NestedHalVmWrite(VmcsField::kGuestTrBase, vmcs12_kGuestTrBase);
+	NestedHalVmWrite(VmcsField::kGuestGdtrBase, vmcs12_kGuestGdtrBase);
+	NestedHalVmWrite(VmcsField::kGuestIdtrBase, vmcs12_kGuestIdtrBase);
+	NestedHalVmWrite(VmcsField::kGuestDr7, vmcs12_kGuestDr7);
+	NestedHalVmWrite(VmcsField::kGuestRflags, vmcs12_kGuestRflags);
+	NestedHalVmWrite(VmcsField::kGuestCr0, vmcs12_kGuestCr0);
+	NestedHalVmWrite(VmcsField::kGuestCr3, vmcs12_kGuestCr3);
+	NestedHalVmWrite(VmcsField::kGuestCr4, vmcs12_kGuestCr4);   
+	NestedHalVmWrite(VmcsField::kGuestRip, vmcs12_kGuestRip);
+	NestedHalVmWrite(VmcsField::kGuestRsp, vmcs12_kGuestRsp);
+	NestedHalVmWrite(VmcsField::kGuestRflags, vmcs12_kGuestRlags);
 
 	/*
 	Guest stated field END
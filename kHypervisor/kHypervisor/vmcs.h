@@ -1,8 +1,8 @@
 // Copyright (c) 2016-2017, KelvinChan. All rights reserved.
 // Use of this source code is governed by a MIT-style license that can be
 // found in the LICENSE file.
-#include <fltKernel.h>
-#include "..\HyperPlatform\asm.h"
+#pragma once
+#include "nested_hal.h"
 
 extern "C"
 {
@@ -1,30 +1,21 @@
 // Copyright (c) 2016-2017, KelvinChan. All rights reserved.
 // Use of this source code is governed by a MIT-style license that can be
-// found in the LICENSE file.#include <fltKernel.h>
+// found in the LICENSE file.
 
-
-#include <intrin.h>
-#include "..\HyperPlatform\util.h"
+#include "nested_hal.h"
 #include "vmcs.h"
 #include "vmx.h"
-#include "..\HyperPlatform\vmm.h"
-#include "..\HyperPlatform\log.h"
-#include "..\HyperPlatform\common.h"
 #include "vmx_common.h"
 extern "C"
 {
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //// Prototype
 ////
-extern ULONG_PTR*	 VmmpSelectRegister(_In_ ULONG index, _In_ GuestContext *guest_context);
-extern GpRegisters*  GetGpReg(GuestContext* guest_context);
-extern FlagRegister* GetFlagReg(GuestContext* guest_context);
-extern KIRQL		 GetGuestIrql(GuestContext* guest_context);
-extern ULONG_PTR	 GetGuestCr8(GuestContext* guest_context);
 void				 SaveGuestCr8(NestedVmm* vcpu, ULONG_PTR cr8);
 void				 SaveGuestMsrs(NestedVmm* vcpu);
 
 NestedVmm*			 GetCurrentCPU(bool IsNested);
+static ULONG		 GetVcpuCount();
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //// Marco
@@ -59,6 +50,63 @@ VOID	LEAVE_GUEST_MODE(NestedVmm* vm) { vm->inRoot = TRUE; }
 VOID	ENTER_GUEST_MODE(NestedVmm* vm) { vm->inRoot = FALSE; }
 BOOLEAN IsRootMode(NestedVmm* vm) { return vm->inRoot; }
 
+//---------------------------------------------------------------------------------------------------------------------//
+// Returns the number of processors g_vcpus can hold VCPUs for
+static ULONG GetVcpuCount()
+{
+	const auto count = NestedHalGetProcessorCount();
+	return (count < RTL_NUMBER_OF(g_vcpus)) ? count : static_cast<ULONG>(RTL_NUMBER_OF(g_vcpus));
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+// Allocates a VCPU and its VMCS02 region for every processor. VMX instructions
+// are emulated in VMX root operation where the pool must not be used, so they
+// only reuse these, and g_vcpus does not change until NestedVmmTermination().
+BOOLEAN NestedVmmInitialization()
+{
+	for (ULONG i = 0; i < GetVcpuCount(); i++)
+	{
+		const auto vm = (NestedVmm*)NestedHalAllocate(sizeof(NestedVmm));
+		const auto vmcs02_region = NestedHalAllocate(PAGE_SIZE);
+		if (!vm || !vmcs02_region)
+		{
+			if (vm)
+			{
+				NestedHalFree(vm);
+			}
+			if (vmcs02_region)
+			{
+				NestedHalFree(vmcs02_region);
+			}
+			NestedVmmTermination();
+			return FALSE;
+		}
+		vm->vmcs02_region = vmcs02_region;
+		vm->vmcs02_pa = 0xFFFFFFFFFFFFFFFF;
+		vm->vmcs12_pa = 0xFFFFFFFFFFFFFFFF;
+		vm->CpuNumber = i;
+		g_vcpus[i] = vm;
+	}
+	return TRUE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------//
+// Frees VCPUs. No processor may be emulating VMX instructions anymore.
+VOID NestedVmmTermination()
+{
+	for (ULONG i = 0; i < RTL_NUMBER_OF(g_vcpus); i++)
+	{
+		const auto vm = g_vcpus[i];
+		if (!vm)
+		{
+			continue;
+		}
+		g_vcpus[i] = NULL;
+		NestedHalFree(vm->vmcs02_region);
+		NestedHalFree(vm);
+	}
+}
+
 //---------------------------------------------------------------------------------------------------------------------//
 NestedVmm* GetCurrentCPU(bool IsNested = true)
 {
@@ -66,14 +114,14 @@ NestedVmm* GetCurrentCPU(bool IsNested = true)
 	ULONG64 vmcs_pa;
 	NestedVmm* ret = NULL;
 	int i = 0;
-	__vmx_vmptrst(&vmcs_pa);
+	NestedHalVmPtrst(&vmcs_pa);
 	if (vmcs_pa)
 	{
-		for (i = 0; i < (int)KeQueryMaximumProcessorCount(); i++)
+		for (i = 0; i < (int)GetVcpuCount(); i++)
 		{
-			if (!g_vcpus[i])
+			if (!g_vcpus[i] || !g_vcpus[i]->inVMX)
 			{
-				break;
+				continue;
 			}
 			if (IsNested)
 			{
@@ -103,14 +151,14 @@ void DumpVcpu()
 	ULONG64 vmcs_pa;
 	NestedVmm* ret = NULL;
 	int i = 0;
-	__vmx_vmptrst(&vmcs_pa);
+	NestedHalVmPtrst(&vmcs_pa);
 	if (vmcs_pa)
 	{
-		for (i = 0; i < (int)KeQueryMaximumProcessorCount(); i++)
+		for (i = 0; i < (int)GetVcpuCount(); i++)
 		{
-			if (!g_vcpus[i])
+			if (!g_vcpus[i] || !g_vcpus[i]->inVMX)
 			{
-				break;
+				continue;
 			}
 			HYPERPLATFORM_LOG_DEBUG_SAFE("Current Vmcs: %I64X i:%d vmcs02: %I64X", vmcs_pa, i, g_vcpus[i]->vmcs02_pa);
 		}
@@ -138,20 +186,20 @@ VOID SaveExceptionInformationFromVmcs02(VmExitInformation exit_reason, ULONG64 v
 {
 
 	const VmExitInterruptionInformationField exception = {
-		static_cast<ULONG32>(UtilVmRead(VmcsField::kVmExitIntrInfo))
+		static_cast<ULONG32>(NestedHalVmRead(VmcsField::kVmExitIntrInfo))
 	};
 
-	ULONG_PTR vmexit_qualification = UtilVmRead(VmcsField::kExitQualification);
+	ULONG_PTR vmexit_qualification = NestedHalVmRead(VmcsField::kExitQualification);
 
 	VmWrite32(VmcsField::kVmExitIntrInfo, vmcs12_va, exception.all);
 	VmWrite32(VmcsField::kVmExitReason, vmcs12_va, exit_reason.all);
 	VmWrite32(VmcsField::kExitQualification, vmcs12_va, vmexit_qualification);
-	VmWrite32(VmcsField::kVmExitInstructionLen, vmcs12_va, UtilVmRead(VmcsField::kVmExitInstructionLen));
-	VmWrite32(VmcsField::kVmInstructionError, vmcs12_va, UtilVmRead(VmcsField::kVmInstructionError));
-	VmWrite32(VmcsField::kVmExitIntrErrorCode, vmcs12_va, UtilVmRead(VmcsField::kVmExitIntrErrorCode));
-	VmWrite32(VmcsField::kIdtVectoringInfoField, vmcs12_va, UtilVmRead(VmcsField::kIdtVectoringInfoField));
-	VmWrite32(VmcsField::kIdtVectoringErrorCode, vmcs12_va, UtilVmRead(VmcsField::kIdtVectoringErrorCode));
-	VmWrite32(VmcsField::kVmxInstructionInfo, vmcs12_va, UtilVmRead(VmcsField::kVmxInstructionInfo));
+	VmWrite32(VmcsField::kVmExitInstructionLen, vmcs12_va, NestedHalVmRead(VmcsField::kVmExitInstructionLen));
+	VmWrite32(VmcsField::kVmInstructionError, vmcs12_va, NestedHalVmRead(VmcsField::kVmInstructionError));
+	VmWrite32(VmcsField::kVmExitIntrErrorCode, vmcs12_va, NestedHalVmRead(VmcsField::kVmExitIntrErrorCode));
+	VmWrite32(VmcsField::kIdtVectoringInfoField, vmcs12_va, NestedHalVmRead(VmcsField::kIdtVectoringInfoField));
+	VmWrite32(VmcsField::kIdtVectoringErrorCode, vmcs12_va, NestedHalVmRead(VmcsField::kIdtVectoringErrorCode));
+	VmWrite32(VmcsField::kVmxInstructionInfo, vmcs12_va, NestedHalVmRead(VmcsField::kVmxInstructionInfo));
 
 }
 //---------------------------------------------------------------------------------------------------------------------//
@@ -171,70 +219,70 @@ VOID SaveGuestFieldFromVmcs02(ULONG64 vmcs12_va)
 {
 	//all nested vm-exit should record 
 
-	VmWrite64(VmcsField::kGuestRip, vmcs12_va, UtilVmRead(VmcsField::kGuestRip));
-	VmWrite64(VmcsField::kGuestRsp, vmcs12_va, UtilVmRead(VmcsField::kGuestRsp));
-	VmWrite64(VmcsField::kGuestCr3, vmcs12_va, UtilVmRead(VmcsField::kGuestCr3));
-	VmWrite64(VmcsField::kGuestCr0, vmcs12_va, UtilVmRead(VmcsField::kGuestCr0));
-	VmWrite64(VmcsField::kGuestCr4, vmcs12_va, UtilVmRead(VmcsField::kGuestCr4));
-	VmWrite64(VmcsField::kGuestDr7, vmcs12_va, UtilVmRead(VmcsField::kGuestDr7));
-	VmWrite64(VmcsField::kGuestRflags, vmcs12_va, UtilVmRead(VmcsField::kGuestRflags));
-
-
-	VmWrite16(VmcsField::kGuestEsSelector, vmcs12_va, UtilVmRead(VmcsField::kGuestEsSelector));
-	VmWrite16(VmcsField::kGuestCsSelector, vmcs12_va, UtilVmRead(VmcsField::kGuestCsSelector));
-	VmWrite16(VmcsField::kGuestSsSelector, vmcs12_va, UtilVmRead(VmcsField::kGuestSsSelector));
-	VmWrite16(VmcsField::kGuestDsSelector, vmcs12_va, UtilVmRead(VmcsField::kGuestDsSelector));
-	VmWrite16(VmcsField::kGuestFsSelector, vmcs12_va, UtilVmRead(VmcsField::kGuestFsSelector));
-	VmWrite16(VmcsField::kGuestGsSelector, vmcs12_va, UtilVmRead(VmcsField::kGuestGsSelector));
-	VmWrite16(VmcsField::kGuestLdtrSelector, vmcs12_va, UtilVmRead(VmcsField::kGuestLdtrSelector));
-	VmWrite16(VmcsField::kGuestTrSelector, vmcs12_va, UtilVmRead(VmcsField::kGuestTrSelector));
-
-	VmWrite32(VmcsField::kGuestEsLimit, vmcs12_va, UtilVmRead(VmcsField::kGuestEsLimit));
-	VmWrite32(VmcsField::kGuestCsLimit, vmcs12_va, UtilVmRead(VmcsField::kGuestCsLimit));
-	VmWrite32(VmcsField::kGuestSsLimit, vmcs12_va, UtilVmRead(VmcsField::kGuestSsLimit));
-	VmWrite32(VmcsField::kGuestDsLimit, vmcs12_va, UtilVmRead(VmcsField::kGuestDsLimit));
-	VmWrite32(VmcsField::kGuestFsLimit, vmcs12_va, UtilVmRead(VmcsField::kGuestFsLimit));
-	VmWrite32(VmcsField::kGuestGsLimit, vmcs12_va, UtilVmRead(VmcsField::kGuestGsLimit));
-	VmWrite32(VmcsField::kGuestLdtrLimit, vmcs12_va, UtilVmRead(VmcsField::kGuestLdtrLimit));
-	VmWrite32(VmcsField::kGuestTrLimit, vmcs12_va, UtilVmRead(VmcsField::kGuestTrLimit));
-	VmWrite32(VmcsField::kGuestGdtrLimit, vmcs12_va, UtilVmRead(VmcsField::kGuestGdtrLimit));
-	VmWrite32(VmcsField::kGuestIdtrLimit, vmcs12_va, UtilVmRead(VmcsField::kGuestIdtrLimit));
-
-	VmWrite32(VmcsField::kGuestEsArBytes, vmcs12_va, UtilVmRead(VmcsField::kGuestEsArBytes));
-	VmWrite32(VmcsField::kGuestCsArBytes, vmcs12_va, UtilVmRead(VmcsField::kGuestCsArBytes));
-	VmWrite32(VmcsField::kGuestSsArBytes, vmcs12_va, UtilVmRead(VmcsField::kGuestSsArBytes));
-	VmWrite32(VmcsField::kGuestDsArBytes, vmcs12_va, UtilVmRead(VmcsField::kGuestDsArBytes));
-	VmWrite32(VmcsField::kGuestFsArBytes, vmcs12_va, UtilVmRead(VmcsField::kGuestFsArBytes));
-	VmWrite32(VmcsField::kGuestGsArBytes, vmcs12_va, UtilVmRead(VmcsField::kGuestGsArBytes));
-	VmWrite32(VmcsField::kGuestLdtrArBytes, vmcs12_va, UtilVmRead(VmcsField::kGuestLdtrArBytes));
-
-	VmWrite32(VmcsField::kGuestTrArBytes, vmcs12_va, UtilVmRead(VmcsField::kGuestTrArBytes));
-
-	VmWrite32(VmcsField::kGuestInterruptibilityInfo, vmcs12_va, UtilVmRead(VmcsField::kGuestInterruptibilityInfo));
-	VmWrite32(VmcsField::kGuestActivityState, vmcs12_va, UtilVmRead(VmcsField::kGuestActivityState));
-	VmWrite32(VmcsField::kGuestSysenterCs, vmcs12_va, UtilVmRead(VmcsField::kGuestSysenterCs));
-
-	VmWrite64(VmcsField::kGuestSysenterEsp, vmcs12_va, UtilVmRead(VmcsField::kGuestSysenterEsp));
-	VmWrite64(VmcsField::kGuestSysenterEip, vmcs12_va, UtilVmRead(VmcsField::kGuestSysenterEip));
-	VmWrite64(VmcsField::kGuestPendingDbgExceptions, vmcs12_va, UtilVmRead(VmcsField::kGuestPendingDbgExceptions));
-	VmWrite64(VmcsField::kGuestEsBase, vmcs12_va, UtilVmRead(VmcsField::kGuestEsBase));
-	VmWrite64(VmcsField::kGuestCsBase, vmcs12_va, UtilVmRead(VmcsField::kGuestCsBase));
-	VmWrite64(VmcsField::kGuestSsBase, vmcs12_va, UtilVmRead(VmcsField::kGuestSsBase));
-	VmWrite64(VmcsField::kGuestDsBase, vmcs12_va, UtilVmRead(VmcsField::kGuestDsBase));
-	VmWrite64(VmcsField::kGuestFsBase, vmcs12_va, UtilVmRead(VmcsField::kGuestFsBase));
-	VmWrite64(VmcsField::kGuestGsBase, vmcs12_va, UtilVmRead(VmcsField::kGuestGsBase));
-	VmWrite64(VmcsField::kGuestLdtrBase, vmcs12_va, UtilVmRead(VmcsField::kGuestLdtrBase));
-	VmWrite64(VmcsField::kGuestTrBase, vmcs12_va, UtilVmRead(VmcsField::kGuestTrBase));
-	VmWrite64(VmcsField::kGuestGdtrBase, vmcs12_va, UtilVmRead(VmcsField::kGuestGdtrBase));
-	VmWrite64(VmcsField::kGuestIdtrBase, vmcs12_va, UtilVmRead(VmcsField::kGuestIdtrBase));
+	VmWrite64(VmcsField::kGuestRip, vmcs12_va, NestedHalVmRead(VmcsField::kGuestRip));
+	VmWrite64(VmcsField::kGuestRsp, vmcs12_va, NestedHalVmRead(VmcsField::kGuestRsp));
+	VmWrite64(VmcsField::kGuestCr3, vmcs12_va, NestedHalVmRead(VmcsField::kGuestCr3));
+	VmWrite64(VmcsField::kGuestCr0, vmcs12_va, NestedHalVmRead(VmcsField::kGuestCr0));
+	VmWrite64(VmcsField::kGuestCr4, vmcs12_va, NestedHalVmRead(VmcsField::kGuestCr4));
+	VmWrite64(VmcsField::kGuestDr7, vmcs12_va, NestedHalVmRead(VmcsField::kGuestDr7));
+	VmWrite64(VmcsField::kGuestRflags, vmcs12_va, NestedHalVmRead(VmcsField::kGuestRflags));
+
+
+	VmWrite16(VmcsField::kGuestEsSelector, vmcs12_va, NestedHalVmRead(VmcsField::kGuestEsSelector));
+	VmWrite16(VmcsField::kGuestCsSelector, vmcs12_va, NestedHalVmRead(VmcsField::kGuestCsSelector));
+	VmWrite16(VmcsField::kGuestSsSelector, vmcs12_va, NestedHalVmRead(VmcsField::kGuestSsSelector));
+	VmWrite16(VmcsField::kGuestDsSelector, vmcs12_va, NestedHalVmRead(VmcsField::kGuestDsSelector));
+	VmWrite16(VmcsField::kGuestFsSelector, vmcs12_va, NestedHalVmRead(VmcsField::kGuestFsSelector));
+	VmWrite16(VmcsField::kGuestGsSelector, vmcs12_va, NestedHalVmRead(VmcsField::kGuestGsSelector));
+	VmWrite16(VmcsField::kGuestLdtrSelector, vmcs12_va, NestedHalVmRead(VmcsField::kGuestLdtrSelector));
+	VmWrite16(VmcsField::kGuestTrSelector, vmcs12_va, NestedHalVmRead(VmcsField::kGuestTrSelector));
+
+	VmWrite32(VmcsField::kGuestEsLimit, vmcs12_va, NestedHalVmRead(VmcsField::kGuestEsLimit));
+	VmWrite32(VmcsField::kGuestCsLimit, vmcs12_va, NestedHalVmRead(VmcsField::kGuestCsLimit));
+	VmWrite32(VmcsField::kGuestSsLimit, vmcs12_va, NestedHalVmRead(VmcsField::kGuestSsLimit));
+	VmWrite32(VmcsField::kGuestDsLimit, vmcs12_va, NestedHalVmRead(VmcsField::kGuestDsLimit));
+	VmWrite32(VmcsField::kGuestFsLimit, vmcs12_va, NestedHalVmRead(VmcsField::kGuestFsLimit));
+	VmWrite32(VmcsField::kGuestGsLimit, vmcs12_va, NestedHalVmRead(VmcsField::kGuestGsLimit));
+	VmWrite32(VmcsField::kGuestLdtrLimit, vmcs12_va, NestedHalVmRead(VmcsField::kGuestLdtrLimit));
+	VmWrite32(VmcsField::kGuestTrLimit, vmcs12_va, NestedHalVmRead(VmcsField::kGuestTrLimit));
+	VmWrite32(VmcsField::kGuestGdtrLimit, vmcs12_va, NestedHalVmRead(VmcsField::kGuestGdtrLimit));
+	VmWrite32(VmcsField::kGuestIdtrLimit, vmcs12_va, NestedHalVmRead(VmcsField::kGuestIdtrLimit));
+
+	VmWrite32(VmcsField::kGuestEsArBytes, vmcs12_va, NestedHalVmRead(VmcsField::kGuestEsArBytes));
+	VmWrite32(VmcsField::kGuestCsArBytes, vmcs12_va, NestedHalVmRead(VmcsField::kGuestCsArBytes));
+	VmWrite32(VmcsField::kGuestSsArBytes, vmcs12_va, NestedHalVmRead(VmcsField::kGuestSsArBytes));
+	VmWrite32(VmcsField::kGuestDsArBytes, vmcs12_va, NestedHalVmRead(VmcsField::kGuestDsArBytes));
+	VmWrite32(VmcsField::kGuestFsArBytes, vmcs12_va, NestedHalVmRead(VmcsField::kGuestFsArBytes));
+	VmWrite32(VmcsField::kGuestGsArBytes, vmcs12_va, NestedHalVmRead(VmcsField::kGuestGsArBytes));
+	VmWrite32(VmcsField::kGuestLdtrArBytes, vmcs12_va, NestedHalVmRead(VmcsField::kGuestLdtrArBytes));
+
+	VmWrite32(VmcsField::kGuestTrArBytes, vmcs12_va, NestedHalVmRead(VmcsField::kGuestTrArBytes));
+
+	VmWrite32(VmcsField::kGuestInterruptibilityInfo, vmcs12_va, NestedHalVmRead(VmcsField::kGuestInterruptibilityInfo));
+	VmWrite32(VmcsField::kGuestActivityState, vmcs12_va, NestedHalVmRead(VmcsField::kGuestActivityState));
+	VmWrite32(VmcsField::kGuestSysenterCs, vmcs12_va, NestedHalVmRead(VmcsField::kGuestSysenterCs));
+
+	VmWrite64(VmcsField::kGuestSysenterEsp, vmcs12_va, NestedHalVmRead(VmcsField::kGuestSysenterEsp));
+	VmWrite64(VmcsField::kGuestSysenterEip, vmcs12_va, NestedHalVmRead(VmcsField::kGuestSysenterEip));
+	VmWrite64(VmcsField::kGuestPendingDbgExceptions, vmcs12_va, NestedHalVmRead(VmcsField::kGuestPendingDbgExceptions));
+	VmWrite64(VmcsField::kGuestEsBase, vmcs12_va, NestedHalVmRead(VmcsField::kGuestEsBase));
+	VmWrite64(VmcsField::kGuestCsBase, vmcs12_va, NestedHalVmRead(VmcsField::kGuestCsBase));
+	VmWrite64(VmcsField::kGuestSsBase, vmcs12_va, NestedHalVmRead(VmcsField::kGuestSsBase));
+	VmWrite64(VmcsField::kGuestDsBase, vmcs12_va, NestedHalVmRead(VmcsField::kGuestDsBase));
+	VmWrite64(VmcsField::kGuestFsBase, vmcs12_va, NestedHalVmRead(VmcsField::kGuestFsBase));
+	VmWrite64(VmcsField::kGuestGsBase, vmcs12_va, NestedHalVmRead(VmcsField::kGuestGsBase));
+	VmWrite64(VmcsField::kGuestLdtrBase, vmcs12_va, NestedHalVmRead(VmcsField::kGuestLdtrBase));
+	VmWrite64(VmcsField::kGuestTrBase, vmcs12_va, NestedHalVmRead(VmcsField::kGuestTrBase));
+	VmWrite64(VmcsField::kGuestGdtrBase, vmcs12_va, NestedHalVmRead(VmcsField::kGuestGdtrBase));
+	VmWrite64(VmcsField::kGuestIdtrBase, vmcs12_va, NestedHalVmRead(VmcsField::kGuestIdtrBase));
 	
-	VmWrite64(VmcsField::kGuestIa32Efer, vmcs12_va, UtilVmRead(VmcsField::kGuestIa32Efer));
+	VmWrite64(VmcsField::kGuestIa32Efer, vmcs12_va, NestedHalVmRead(VmcsField::kGuestIa32Efer));
 
 	/*
-	VmWrite64(VmcsField::kGuestPdptr0, vmcs12_va, UtilVmRead(VmcsField::kGuestPdptr0));
-	VmWrite64(VmcsField::kGuestPdptr1, vmcs12_va, UtilVmRead(VmcsField::kGuestPdptr1));
-	VmWrite64(VmcsField::kGuestPdptr2, vmcs12_va, UtilVmRead(VmcsField::kGuestPdptr2));
-	VmWrite64(VmcsField::kGuestPdptr3, vmcs12_va, UtilVmRead(VmcsField::kGuestPdptr3));
+	VmWrite64(VmcsField::kGuestPdptr0, vmcs12_va, NestedHalVmRead(VmcsField::kGuestPdptr0));
+	VmWrite64(VmcsField::kGuestPdptr1, vmcs12_va, NestedHalVmRead(VmcsField::kGuestPdptr1));
+	VmWrite64(VmcsField::kGuestPdptr2, vmcs12_va, NestedHalVmRead(VmcsField::kGuestPdptr2));
+	VmWrite64(VmcsField::kGuestPdptr3, vmcs12_va, NestedHalVmRead(VmcsField::kGuestPdptr3));
 	*/
 }
 //---------------------------------------------------------------------------------------------------------------------//
@@ -282,25 +330,25 @@ VOID EmulateVmExit(ULONG64 vmcs01, ULONG64 vmcs12_va)
 	ULONG_PTR  VMCS_VMEXIT_HOST_TR = 0;
 
 	//VMCS01 guest rip == VMCS12 host rip (should be)
-	const VmExitInformation exit_reason = { static_cast<ULONG32>(UtilVmRead(VmcsField::kVmExitReason)) };
+	const VmExitInformation exit_reason = { static_cast<ULONG32>(NestedHalVmRead(VmcsField::kVmExitReason)) };
 
-	const VmExitInterruptionInformationField exception = { static_cast<ULONG32>(UtilVmRead(VmcsField::kVmExitIntrInfo)) };
+	const VmExitInterruptionInformationField exception = { static_cast<ULONG32>(NestedHalVmRead(VmcsField::kVmExitIntrInfo)) };
 
 	PrintVMCS();
 	/*
 	1. Print about trapped reason
 	*/
 	/*
-	HYPERPLATFORM_LOG_DEBUG_SAFE("[EmulateVmExit]VMCS id %x", UtilVmRead(VmcsField::kVirtualProcessorId));
-	HYPERPLATFORM_LOG_DEBUG_SAFE("[EmulateVmExit]Trapped by %I64X ", UtilVmRead(VmcsField::kGuestRip));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("[EmulateVmExit]VMCS id %x", NestedHalVmRead(VmcsField::kVirtualProcessorId));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("[EmulateVmExit]Trapped by %I64X ", NestedHalVmRead(VmcsField::kGuestRip));
 	HYPERPLATFORM_LOG_DEBUG_SAFE("[EmulateVmExit]Trapped Reason: %I64X ", exit_reason.fields.reason);
 	HYPERPLATFORM_LOG_DEBUG_SAFE("[EmulateVmExit]Trapped Intrreupt: %I64X ", exception.fields.interruption_type);
 	HYPERPLATFORM_LOG_DEBUG_SAFE("[EmulateVmExit]Trapped Intrreupt vector: %I64X ", exception.fields.vector);
-	HYPERPLATFORM_LOG_DEBUG_SAFE("[EmulateVmExit]Trapped kVmExitInstructionLen: %I64X ", UtilVmRead(VmcsField::kVmExitInstructionLen));
+	HYPERPLATFORM_LOG_DEBUG_SAFE("[EmulateVmExit]Trapped kVmExitInstructionLen: %I64X ", NestedHalVmRead(VmcsField::kVmExitInstructionLen));
 	*/
-	if (VmxStatus::kOk != (status = static_cast<VmxStatus>(__vmx_vmptrld(&vmcs01))))
+	if (VmxStatus::kOk != (status = NestedHalVmPtrld(&vmcs01)))
 	{
-		VmxInstructionError error = static_cast<VmxInstructionError>(UtilVmRead(VmcsField::kVmInstructionError));
+		VmxInstructionError error = static_cast<VmxInstructionError>(NestedHalVmRead(VmcsField::kVmInstructionError));
 		HYPERPLATFORM_LOG_DEBUG_SAFE("Error vmptrld error code :%x , %x", status, error);
 	}
 
@@ -333,35 +381,35 @@ VOID EmulateVmExit(ULONG64 vmcs01, ULONG64 vmcs12_va)
 	VmRead64(VmcsField::kGuestRflags, vmcs12_va, &VMCS_VMEXIT_RFLAGs);
 
 	//Write VMCS01 for L1's VMExit handler
-	UtilVmWrite(VmcsField::kGuestRflags, VMCS_VMEXIT_RFLAGs);
-	UtilVmWrite(VmcsField::kGuestRip, VMCS_VMEXIT_HANDLER);
-	UtilVmWrite(VmcsField::kGuestRsp, VMCS_VMEXIT_STACK);
-	UtilVmWrite(VmcsField::kGuestCr0, VMCS_VMEXIT_CR0);
-	UtilVmWrite(VmcsField::kGuestCr3, VMCS_VMEXIT_CR3);
-	UtilVmWrite(VmcsField::kGuestCr4, VMCS_VMEXIT_CR4);
-	UtilVmWrite(VmcsField::kGuestDr7, 0x400);
-
-	UtilVmWrite(VmcsField::kGuestCsSelector, VMCS_VMEXIT_CS);
-	UtilVmWrite(VmcsField::kGuestSsSelector, VMCS_VMEXIT_SS);
-	UtilVmWrite(VmcsField::kGuestDsSelector, VMCS_VMEXIT_DS);
-	UtilVmWrite(VmcsField::kGuestEsSelector, VMCS_VMEXIT_ES);
-	UtilVmWrite(VmcsField::kGuestFsSelector, VMCS_VMEXIT_FS);
-	UtilVmWrite(VmcsField::kGuestGsSelector, VMCS_VMEXIT_GS);
-	UtilVmWrite(VmcsField::kGuestTrSelector, VMCS_VMEXIT_TR);
-
-	UtilVmWrite(VmcsField::kGuestSysenterCs, VMCS_VMEXIT_SYSENTER_CS);
-	UtilVmWrite(VmcsField::kGuestSysenterEsp, VMCS_VMEXIT_SYSENTER_RSP);
-	UtilVmWrite(VmcsField::kGuestSysenterEip, VMCS_VMEXIT_SYSENTER_RIP);
-
-	UtilVmWrite(VmcsField::kGuestFsBase, VMCS_VMEXIT_HOST_FS);
-	UtilVmWrite(VmcsField::kGuestGsBase, VMCS_VMEXIT_HOST_GS);
-	UtilVmWrite(VmcsField::kGuestTrBase, VMCS_VMEXIT_HOST_TR);
+	NestedHalVmWrite(VmcsField::kGuestRflags, VMCS_VMEXIT_RFLAGs);
+	NestedHalVmWrite(VmcsField::kGuestRip, VMCS_VMEXIT_HANDLER);
+	NestedHalVmWrite(VmcsField::kGuestRsp, VMCS_VMEXIT_STACK);
+	NestedHalVmWrite(VmcsField::kGuestCr0, VMCS_VMEXIT_CR0);
+	NestedHalVmWrite(VmcsField::kGuestCr3, VMCS_VMEXIT_CR3);
+	NestedHalVmWrite(VmcsField::kGuestCr4, VMCS_VMEXIT_CR4);
+	NestedHalVmWrite(VmcsField::kGuestDr7, 0x400);
+
+	NestedHalVmWrite(VmcsField::kGuestCsSelector, VMCS_VMEXIT_CS);
+	NestedHalVmWrite(VmcsField::kGuestSsSelector, VMCS_VMEXIT_SS);
+	NestedHalVmWrite(VmcsField::kGuestDsSelector, VMCS_VMEXIT_DS);
+	NestedHalVmWrite(VmcsField::kGuestEsSelector, VMCS_VMEXIT_ES);
+	NestedHalVmWrite(VmcsField::kGuestFsSelector, VMCS_VMEXIT_FS);
+	NestedHalVmWrite(VmcsField::kGuestGsSelector, VMCS_VMEXIT_GS);
+	NestedHalVmWrite(VmcsField::kGuestTrSelector, VMCS_VMEXIT_TR);
+
+	NestedHalVmWrite(VmcsField::kGuestSysenterCs, VMCS_VMEXIT_SYSENTER_CS);
+	NestedHalVmWrite(VmcsField::kGuestSysenterEsp, VMCS_VMEXIT_SYSENTER_RSP);
+	NestedHalVmWrite(VmcsField::kGuestSysenterEip, VMCS_VMEXIT_SYSENTER_RIP);
+
+	NestedHalVmWrite(VmcsField::kGuestFsBase, VMCS_VMEXIT_HOST_FS);
+	NestedHalVmWrite(VmcsField::kGuestGsBase, VMCS_VMEXIT_HOST_GS);
+	NestedHalVmWrite(VmcsField::kGuestTrBase, VMCS_VMEXIT_HOST_TR);
 
 	VmWrite32(VmcsField::kVmEntryIntrInfoField, vmcs12_va, 0);
 	VmWrite32(VmcsField::kVmEntryExceptionErrorCode, vmcs12_va, 0);
 
-	UtilVmWrite(VmcsField::kVmEntryIntrInfoField, 0);
-	UtilVmWrite(VmcsField::kVmEntryExceptionErrorCode, 0);
+	NestedHalVmWrite(VmcsField::kVmEntryIntrInfoField, 0);
+	NestedHalVmWrite(VmcsField::kVmEntryExceptionErrorCode, 0);
 
 	 PrintVMCS();
 	 PrintVMCS12(vmcs12_va);
@@ -370,7 +418,7 @@ VOID EmulateVmExit(ULONG64 vmcs01, ULONG64 vmcs12_va)
 //Nested breakpoint dispatcher
 VOID VmExitDispatcher(NestedVmm* vcpu, ULONG64 vmcs12_va)
 {
-	const VmExitInformation exit_reason = { static_cast<ULONG32>(UtilVmRead(VmcsField::kVmExitReason)) };
+	const VmExitInformation exit_reason = { static_cast<ULONG32>(NestedHalVmRead(VmcsField::kVmExitReason)) };
 	if (!vcpu->vmcs01_pa)
 	{
 		HYPERPLATFORM_COMMON_DBG_BREAK();
@@ -413,7 +461,7 @@ BOOLEAN VMExitEmulationTest(VmExitInformation exit_reason, GuestContext* guest_c
 	{
 		const VmExitInterruptionInformationField exception =
 		{
-			static_cast<ULONG32>(UtilVmRead(VmcsField::kVmExitIntrInfo))
+			static_cast<ULONG32>(NestedHalVmRead(VmcsField::kVmExitIntrInfo))
 		};
 
 		vm = GetCurrentCPU(false);
@@ -431,7 +479,7 @@ BOOLEAN VMExitEmulationTest(VmExitInformation exit_reason, GuestContext* guest_c
 			break;
 		}
 
-		vmcs12_va = (ULONG64)UtilVaFromPa(vm->vmcs12_pa);
+		vmcs12_va = (ULONG64)NestedHalVaFromPa(vm->vmcs12_pa);
 		// Test L0 exception
 		if (static_cast<InterruptionVector>(exception.fields.vector) == InterruptionVector::kPageFaultException)
 		{
@@ -473,19 +521,19 @@ void SaveGuestMsrs(NestedVmm* vcpu)
 	* We cannot cache SHADOW_GS_BASE while the VCPU runs, as it can
 	* be updated at any time via SWAPGS, which we cannot trap.
 	*/
-	vcpu->guest_gs_kernel_base = UtilReadMsr64(Msr::kIa32KernelGsBase);
-	vcpu->guest_IA32_STAR = UtilReadMsr(Msr::kIa32Star);
-	vcpu->guest_IA32_LSTAR	= UtilReadMsr(Msr::kIa32Lstar);
-	vcpu->guest_IA32_FMASK	= UtilReadMsr(Msr::kIa32Fmask); 
+	vcpu->guest_gs_kernel_base = NestedHalReadMsr64(Msr::kIa32KernelGsBase);
+	vcpu->guest_IA32_STAR = NestedHalReadMsr64(Msr::kIa32Star);
+	vcpu->guest_IA32_LSTAR	= NestedHalReadMsr64(Msr::kIa32Lstar);
+	vcpu->guest_IA32_FMASK	= NestedHalReadMsr64(Msr::kIa32Fmask); 
 	//HYPERPLATFORM_LOG_DEBUG_SAFE("DEBUG###Save GS base: %I64X \r\n ", vcpu->guest_gs_kernel_base);
 }
 //---------------------------------------------------------------------------------------------------------------------//
 void RestoreGuestMsrs(NestedVmm* vcpu)
 {
-	UtilWriteMsr64(Msr::kIa32KernelGsBase, vcpu->guest_gs_kernel_base);
-	UtilWriteMsr64(Msr::kIa32Star, vcpu->guest_IA32_STAR);
-	UtilWriteMsr64(Msr::kIa32Lstar, vcpu->guest_IA32_LSTAR);
-	UtilWriteMsr64(Msr::kIa32Fmask, vcpu->guest_IA32_FMASK);
+	NestedHalWriteMsr64(Msr::kIa32KernelGsBase, vcpu->guest_gs_kernel_base);
+	NestedHalWriteMsr64(Msr::kIa32Star, vcpu->guest_IA32_STAR);
+	NestedHalWriteMsr64(Msr::kIa32Lstar, vcpu->guest_IA32_LSTAR);
+	NestedHalWriteMsr64(Msr::kIa32Fmask, vcpu->guest_IA32_FMASK);
 	HYPERPLATFORM_LOG_DEBUG_SAFE("DEBUG###Restore GS base: %I64X \r\n ", vcpu->guest_gs_kernel_base);
 }
 
@@ -498,8 +546,8 @@ void SaveGuestCr8(NestedVmm* vcpu, ULONG_PTR cr8)
 //---------------------------------------------------------------------------------------------------------------------//
 void RestoreGuestCr8(NestedVmm* vcpu)
 {
-	__writecr8(vcpu->guest_cr8);
-	HYPERPLATFORM_LOG_DEBUG_SAFE("DEBUG###Restore cr8 : %I64X \r\n ", __readcr8());
+	NestedHalWriteCr8(vcpu->guest_cr8);
+	HYPERPLATFORM_LOG_DEBUG_SAFE("DEBUG###Restore cr8 : %I64X \r\n ", NestedHalReadCr8());
 }
  
 //---------------------------------------------------------------------------------------------------------------------//
@@ -507,17 +555,20 @@ VOID VmxonEmulate(GuestContext* guest_context)
 {
 	do
 	{
-		ULONG64				InstructionPointer = { UtilVmRead64(VmcsField::kGuestRip) };
-		ULONG64				StackPointer = { UtilVmRead64(VmcsField::kGuestRsp) };
+		ULONG64				InstructionPointer = { NestedHalVmRead64(VmcsField::kGuestRip) };
+		ULONG64				StackPointer = { NestedHalVmRead64(VmcsField::kGuestRsp) };
 		ULONG64				vmxon_region_pa = *(PULONG64)DecodeVmclearOrVmptrldOrVmptrstOrVmxon(guest_context);
+		NestedHalTraceMemoryOperand(vmxon_region_pa);
 		ULONG64				debug_vmxon_region_pa = DecodeVmclearOrVmptrldOrVmptrstOrVmxon(guest_context);
-		VmControlStructure*   vmxon_region_struct = (VmControlStructure*)UtilVaFromPa(vmxon_region_pa);
+		VmControlStructure*   vmxon_region_struct = (VmControlStructure*)NestedHalVaFromPa(vmxon_region_pa);
 		PROCESSOR_NUMBER      number;
+		const auto            cpu_number = NestedHalGetCurrentProcessorNumber(&number);
+		NestedVmm*            vm = (cpu_number < GetVcpuCount()) ? g_vcpus[cpu_number] : NULL;
 
-		HYPERPLATFORM_LOG_DEBUG_SAFE("UtilVmRead: %I64X", &UtilVmRead);
-		HYPERPLATFORM_LOG_DEBUG_SAFE("UtilVmRead64: %I64X", &UtilVmRead64);
-		HYPERPLATFORM_LOG_DEBUG_SAFE("UtilVmWrite: %I64X", &UtilVmWrite);
-		HYPERPLATFORM_LOG_DEBUG_SAFE("UtilVmWrite64: %I64X", &UtilVmWrite64);
+		HYPERPLATFORM_LOG_DEBUG_SAFE("NestedHalVmRead: %I64X", &NestedHalVmRead);
+		HYPERPLATFORM_LOG_DEBUG_SAFE("NestedHalVmRead64: %I64X", &NestedHalVmRead64);
+		HYPERPLATFORM_LOG_DEBUG_SAFE("NestedHalVmWrite: %I64X", &NestedHalVmWrite);
+		HYPERPLATFORM_LOG_DEBUG_SAFE("NestedHalVmWrite64: %I64X", &NestedHalVmWrite64);
 		HYPERPLATFORM_LOG_DEBUG_SAFE("VmRead: %I64X", &VmRead16);
 		HYPERPLATFORM_LOG_DEBUG_SAFE("VmRead32: %I64X", &VmRead32);
 		HYPERPLATFORM_LOG_DEBUG_SAFE("VmRead64: %I64X", &VmRead64);
@@ -534,7 +585,7 @@ VOID VmxonEmulate(GuestContext* guest_context)
 		}
 
 		// If already VCPU run in VMX operation
-		if (g_vcpus[KeGetCurrentProcessorNumberEx(&number)])
+		if (vm && vm->inVMX)
 		{
 			///TODO: 
 			///if( it is non root ) 
@@ -642,17 +693,25 @@ VOID VmxonEmulate(GuestContext* guest_context)
 
 		///TODO: a20m and in SMX operation3 and bit 1 of IA32_FEATURE_CONTROL MSR is clear
 
-		NestedVmm* vm = (NestedVmm*)ExAllocatePool(NonPagedPoolNx, sizeof(NestedVmm));
+		// A VCPU is allocated by NestedVmmInitialization() in advance
+		if (!vm)
+		{
+			HYPERPLATFORM_LOG_DEBUG_SAFE(("VMXON: No VCPU for the processor %x !"), cpu_number);
+			VMfailInvalid(GetFlagReg(guest_context));
+			break;
+		}
+		const auto vmcs02_region = vm->vmcs02_region;
+		RtlZeroMemory(vm, sizeof(NestedVmm));
+		vm->vmcs02_region = vmcs02_region;
 		vm->inVMX = TRUE;
 		vm->inRoot = TRUE;
 		vm->blockINITsignal = TRUE;
 		vm->blockAndDisableA20M = TRUE;
 		vm->vmcs02_pa = 0xFFFFFFFFFFFFFFFF;
 		vm->vmcs12_pa = 0xFFFFFFFFFFFFFFFF;
-		__vmx_vmptrst(&vm->vmcs01_pa);
+		NestedHalVmPtrst(&vm->vmcs01_pa);
 		vm->vmxon_region = vmxon_region_pa;
-		vm->CpuNumber = KeGetCurrentProcessorNumberEx(&number);
-		g_vcpus[vm->CpuNumber] = vm;
+		vm->CpuNumber = cpu_number;
 		HYPERPLATFORM_LOG_DEBUG_SAFE("VMXON: Guest Instruction Pointer %I64X Guest Stack Pointer: %I64X  Guest VMXON_Region: %I64X stored at %I64x physical address\r\n",
 			InstructionPointer, StackPointer, vmxon_region_pa, debug_vmxon_region_pa);
 
@@ -690,8 +749,18 @@ VOID VmxoffEmulate(
 			break;
 		}
 		//load back vmcs01
-		__vmx_vmptrld(&vm->vmcs01_pa);
-		vm = { 0 };
+		NestedHalVmPtrld(&vm->vmcs01_pa);
+
+		//leave VMX operation so that VMXON can be executed again. NestedVmm and
+		//VMCS02 are kept until NestedVmmTermination() as the pool cannot be
+		//used in VMX root operation.
+		if (vm->vmcs02_pa != 0xFFFFFFFFFFFFFFFF)
+		{
+			NestedHalVmClear(&vm->vmcs02_pa);
+		}
+		vm->vmcs02_pa = 0xFFFFFFFFFFFFFFFF;
+		vm->vmcs12_pa = 0xFFFFFFFFFFFFFFFF;
+		vm->inVMX = FALSE;
 
 		VMSucceed(GetFlagReg(guest_context));
 
@@ -703,12 +772,13 @@ VOID VmclearEmulate(GuestContext* guest_context)
 {
 	do
 	{
-		ULONG64				InstructionPointer = { UtilVmRead64(VmcsField::kGuestRip) };
-		ULONG64				StackPointer = { UtilVmRead64(VmcsField::kGuestRsp) };
+		ULONG64				InstructionPointer = { NestedHalVmRead64(VmcsField::kGuestRip) };
+		ULONG64				StackPointer = { NestedHalVmRead64(VmcsField::kGuestRsp) };
 		ULONG64				vmcs_region_pa = *(PULONG64)DecodeVmclearOrVmptrldOrVmptrstOrVmxon(guest_context);//*(PULONG64)(StackPointer + offset);				//May need to be fixed later
+		NestedHalTraceMemoryOperand(vmcs_region_pa);
 		ULONG64				debug_vmcs_region_pa = DecodeVmclearOrVmptrldOrVmptrstOrVmxon(guest_context);
 		PROCESSOR_NUMBER	procnumber = {};
-		VmControlStructure* vmcs_region_va = (VmControlStructure*)UtilVaFromPa(vmcs_region_pa);
+		VmControlStructure* vmcs_region_va = (VmControlStructure*)NestedHalVaFromPa(vmcs_region_pa);
 		NestedVmm*				vm = GetCurrentCPU();
 
 		if (!vm)
@@ -812,7 +882,10 @@ VOID VmclearEmulate(GuestContext* guest_context)
 			vm->vmcs12_pa = 0xFFFFFFFFFFFFFFFF;
 		}
 
-		__vmx_vmclear(&vm->vmcs02_pa);
+		if (vm->vmcs02_pa != 0xFFFFFFFFFFFFFFFF)
+		{
+			NestedHalVmClear(&vm->vmcs02_pa);
+		}
 		vm->vmcs02_pa = 0xFFFFFFFFFFFFFFFF;
 
 		HYPERPLATFORM_LOG_DEBUG_SAFE("VMCLEAR: Guest Instruction Pointer %I64X Guest Stack Pointer: %I64X  Guest vmcs region: %I64X stored at %I64x on stack\r\n",
@@ -834,10 +907,11 @@ VOID VmptrldEmulate(GuestContext* guest_context)
 	do
 	{
 		PROCESSOR_NUMBER	procnumber = {};
-		ULONG64				InstructionPointer = { UtilVmRead64(VmcsField::kGuestRip) };
-		ULONG64				StackPointer = { UtilVmRead64(VmcsField::kGuestRsp) };
+		ULONG64				InstructionPointer = { NestedHalVmRead64(VmcsField::kGuestRip) };
+		ULONG64				StackPointer = { NestedHalVmRead64(VmcsField::kGuestRsp) };
 		ULONG64				vmcs12_region_pa = *(PULONG64)DecodeVmclearOrVmptrldOrVmptrstOrVmxon(guest_context);
-		VmControlStructure*   vmcs12_region_va = (VmControlStructure*)UtilVaFromPa(vmcs12_region_pa);
+		NestedHalTraceMemoryOperand(vmcs12_region_pa);
+		VmControlStructure*   vmcs12_region_va = (VmControlStructure*)NestedHalVaFromPa(vmcs12_region_pa);
 		NestedVmm*				vm = GetCurrentCPU();
 
 		if (!vm)
@@ -941,19 +1015,26 @@ VOID VmptrldEmulate(GuestContext* guest_context)
 			break;
 		}
 
-		PUCHAR			  vmcs02_region_va = (PUCHAR)ExAllocatePool(NonPagedPoolNx, PAGE_SIZE);
-		ULONG64			  vmcs02_region_pa = UtilPaFromVa(vmcs02_region_va);
+		// Clear VMCS02 of the VMCS12 previously loaded without VMCLEAR, and
+		// reuse its region allocated by NestedVmmInitialization()
+		if (vm->vmcs02_pa != 0xFFFFFFFFFFFFFFFF)
+		{
+			NestedHalVmClear(&vm->vmcs02_pa);
+		}
+
+		PUCHAR			  vmcs02_region_va = (PUCHAR)vm->vmcs02_region;
+		ULONG64			  vmcs02_region_pa = NestedHalPaFromVa(vmcs02_region_va);
 
-		RtlFillMemory(vmcs02_region_va, PAGE_SIZE, 0x0);
+		RtlZeroMemory(vmcs02_region_va, PAGE_SIZE);
 
 		vm->vmcs02_pa = vmcs02_region_pa;		    //vmcs02' physical address - DIRECT VMREAD/WRITE
 		vm->vmcs12_pa = vmcs12_region_pa;		    //vmcs12' physical address - we will control its structure in Vmread/Vmwrite
-		vm->kVirtualProcessorId = (USHORT)KeGetCurrentProcessorNumberEx(nullptr) + 1;
+		vm->kVirtualProcessorId = (USHORT)NestedHalGetCurrentProcessorNumber(nullptr) + 1;
 
 		HYPERPLATFORM_LOG_DEBUG_SAFE("[VMPTRLD] Run Successfully \r\n");
 		HYPERPLATFORM_LOG_DEBUG_SAFE("[VMPTRLD] VMCS02 PA: %I64X VA: %I64X  \r\n", vmcs02_region_pa, vmcs02_region_va);
 		HYPERPLATFORM_LOG_DEBUG_SAFE("[VMPTRLD] VMCS12 PA: %I64X VA: %I64X \r\n", vmcs12_region_pa, vmcs12_region_va);
-		HYPERPLATFORM_LOG_DEBUG_SAFE("[VMPTRLD] VMCS01 PA: %I64X VA: %I64X \r\n", vm->vmcs01_pa, UtilVaFromPa(vm->vmcs01_pa));
+		HYPERPLATFORM_LOG_DEBUG_SAFE("[VMPTRLD] VMCS01 PA: %I64X VA: %I64X \r\n", vm->vmcs01_pa, NestedHalVaFromPa(vm->vmcs01_pa));
 		HYPERPLATFORM_LOG_DEBUG_SAFE("[VMPTRLD] Current Cpu: %x in Cpu Group : %x  Number: %x \r\n", vm->CpuNumber, procnumber.Group, procnumber.Number);
 
 		VMSucceed(GetFlagReg(guest_context));
@@ -969,14 +1050,14 @@ VOID VmreadEmulate(GuestContext* guest_context)
 	{
 		PROCESSOR_NUMBER  procnumber = { 0 };
 		NestedVmm*				 vm = GetCurrentCPU();
-		ULONG64			  vmcs12_pa = vm->vmcs12_pa;
-		ULONG64			  vmcs12_va = (ULONG64)UtilVaFromPa(vmcs12_pa);
 		if (!vm)
 		{
 			DumpVcpu();
 			HYPERPLATFORM_COMMON_DBG_BREAK();
 			break;
 		}
+		ULONG64			  vmcs12_pa = vm->vmcs12_pa;
+		ULONG64			  vmcs12_va = (ULONG64)NestedHalVaFromPa(vmcs12_pa);
 		// if VCPU not run in VMX mode
 		if (!vm->inVMX)
 		{
@@ -1113,14 +1194,14 @@ VOID VmwriteEmulate(GuestContext* guest_context)
 	{
 		PROCESSOR_NUMBER    procnumber = { 0 };
 		NestedVmm*				 vm = GetCurrentCPU();
-		ULONG64			  vmcs12_pa = (ULONG64)vm->vmcs12_pa;
-		ULONG64			  vmcs12_va = (ULONG64)UtilVaFromPa(vmcs12_pa);
 		if (!vm)
 		{
 			DumpVcpu();
 			HYPERPLATFORM_COMMON_DBG_BREAK();
 			break;
 		}
+		ULONG64			  vmcs12_pa = (ULONG64)vm->vmcs12_pa;
+		ULONG64			  vmcs12_va = (ULONG64)NestedHalVaFromPa(vmcs12_pa);
 		// if VCPU not run in VMX mode
 		if (!vm->inVMX)
 		{
@@ -1178,6 +1259,10 @@ VOID VmwriteEmulate(GuestContext* guest_context)
 		BOOLEAN   RorM;
 
 		field = DecodeVmwriteOrVmRead(GetGpReg(guest_context), &offset, &Value, &RorM);
+		if (!RorM)
+		{
+			NestedHalTraceMemoryOperand(Value);
+		}
 
 		if (!is_vmcs_field_supported(field))
 		{
@@ -1324,8 +1409,6 @@ VOID VmlaunchEmulate(GuestContext* guest_context)
 		}
 
 
-		ENTER_GUEST_MODE(vm);
-
 		/*
 		if (!g_vcpus[vcpu_index]->inRoot)
 		{
@@ -1340,15 +1423,17 @@ VOID VmlaunchEmulate(GuestContext* guest_context)
 		auto    vmcs02_pa = vm->vmcs02_pa;
 		auto	vmcs12_pa = vm->vmcs12_pa;
 
-		if (!vmcs02_pa || !vmcs12_pa)
+		if (!vmcs02_pa || !vmcs12_pa || vmcs02_pa == 0xFFFFFFFFFFFFFFFF || vmcs12_pa == 0xFFFFFFFFFFFFFFFF)
 		{
 			HYPERPLATFORM_LOG_DEBUG_SAFE(("VMLAUNCH: VMCS still not loaded ! \r\n"));
 			VMfailInvalid(GetFlagReg(guest_context));
 			break;
 		}
 
-		auto    vmcs02_va = (ULONG64)UtilVaFromPa(vmcs02_pa);
-		auto    vmcs12_va = (ULONG64)UtilVaFromPa(vmcs12_pa);
+		ENTER_GUEST_MODE(vm);
+
+		auto    vmcs02_va = (ULONG64)NestedHalVaFromPa(vmcs02_pa);
+		auto    vmcs12_va = (ULONG64)NestedHalVaFromPa(vmcs12_pa);
 
 
 		///1. Check Setting of VMX Controls and Host State area;
@@ -1359,13 +1444,13 @@ VOID VmlaunchEmulate(GuestContext* guest_context)
 
 		//Guest passed it to us, and read/write it  VMCS 1-2
 		// Write a VMCS revision identifier
-		const Ia32VmxBasicMsr vmx_basic_msr = { UtilReadMsr64(Msr::kIa32VmxBasic) };
-		RtlFillMemory((PVOID)vmcs02_va, 0, PAGE_SIZE);
+		const Ia32VmxBasicMsr vmx_basic_msr = { NestedHalReadMsr64(Msr::kIa32VmxBasic) };
+		RtlZeroMemory((PVOID)vmcs02_va, PAGE_SIZE);
 		VmControlStructure* ptr = (VmControlStructure*)vmcs02_va;
 		ptr->revision_identifier = vmx_basic_msr.fields.revision_identifier;
 
-		ULONG64 vmcs01_rsp = UtilVmRead64(VmcsField::kHostRsp);
-		ULONG64 vmcs01_rip = UtilVmRead64(VmcsField::kHostRip);
+		ULONG64 vmcs01_rsp = NestedHalVmRead64(VmcsField::kHostRsp);
+		ULONG64 vmcs01_rip = NestedHalVmRead64(VmcsField::kHostRip);
 
 		/*
 		1. Mix vmcs control field
@@ -1380,12 +1465,12 @@ VOID VmlaunchEmulate(GuestContext* guest_context)
 
 		if (GetGuestIrql(guest_context) < DISPATCH_LEVEL)
 		{
-			KeLowerIrql(GetGuestIrql(guest_context));
+			NestedHalLowerIrql(GetGuestIrql(guest_context));
 		}
 
-		if (VmxStatus::kOk != (status = static_cast<VmxStatus>(__vmx_vmlaunch())))
+		if (VmxStatus::kOk != (status = NestedHalVmLaunch()))
 		{
-			VmxInstructionError error2 = static_cast<VmxInstructionError>(UtilVmRead(VmcsField::kVmInstructionError));
+			VmxInstructionError error2 = static_cast<VmxInstructionError>(NestedHalVmRead(VmcsField::kVmInstructionError));
 			HYPERPLATFORM_LOG_DEBUG_SAFE("Error VMLAUNCH error code :%x , %x ", status, error2);
 			HYPERPLATFORM_COMMON_DBG_BREAK();
 		}
@@ -1460,23 +1545,23 @@ VOID VmresumeEmulate(GuestContext* guest_context)
 		}
 
 
-		ENTER_GUEST_MODE(vm);
-
 		auto      vmcs02_pa = vm->vmcs02_pa;
 		auto	  vmcs12_pa = vm->vmcs12_pa;
 
-		if (!vmcs02_pa || !vmcs12_pa)
+		if (!vmcs02_pa || !vmcs12_pa || vmcs02_pa == 0xFFFFFFFFFFFFFFFF || vmcs12_pa == 0xFFFFFFFFFFFFFFFF)
 		{
 			HYPERPLATFORM_LOG_DEBUG_SAFE(("VMRESUME: VMCS still not loaded ! \r\n"));
 			VMfailInvalid(GetFlagReg(guest_context));
 			break;
 		}
 
-		auto    vmcs02_va = (ULONG64)UtilVaFromPa(vmcs02_pa);
-		auto    vmcs12_va = (ULONG64)UtilVaFromPa(vmcs12_pa);
+		ENTER_GUEST_MODE(vm);
+
+		auto    vmcs02_va = (ULONG64)NestedHalVaFromPa(vmcs02_pa);
+		auto    vmcs12_va = (ULONG64)NestedHalVaFromPa(vmcs12_pa);
 
 		// Write a VMCS revision identifier
-		const Ia32VmxBasicMsr vmx_basic_msr = { UtilReadMsr64(Msr::kIa32VmxBasic) };
+		const Ia32VmxBasicMsr vmx_basic_msr = { NestedHalReadMsr64(Msr::kIa32VmxBasic) };
 
 		VmControlStructure* ptr = (VmControlStructure*)vmcs02_va;
 		ptr->revision_identifier = vmx_basic_msr.fields.revision_identifier;
@@ -1515,7 +1600,7 @@ VOID VmresumeEmulate(GuestContext* guest_context)
 		
 		HYPERPLATFORM_COMMON_DBG_BREAK();
 
-		__vmx_vmresume();
+		NestedHalVmResume();
 
 	} while (FALSE);
 }
@@ -1526,13 +1611,13 @@ VOID VmptrstEmulate(GuestContext* guest_context)
 	do
 	{
 		PROCESSOR_NUMBER	procnumber = {};
-		ULONG64				InstructionPointer = { UtilVmRead64(VmcsField::kGuestRip) };
-		ULONG64				StackPointer = { UtilVmRead64(VmcsField::kGuestRsp) };
+		ULONG64				InstructionPointer = { NestedHalVmRead64(VmcsField::kGuestRip) };
+		ULONG64				StackPointer = { NestedHalVmRead64(VmcsField::kGuestRsp) };
 		ULONG64				vmcs12_region_pa = *(PULONG64)DecodeVmclearOrVmptrldOrVmptrstOrVmxon(guest_context);
-		ULONG64				vmcs12_region_va = (ULONG64)UtilVaFromPa(vmcs12_region_pa);
-		ULONG				vcpu_index = KeGetCurrentProcessorNumberEx(&procnumber);
+		ULONG64				vmcs12_region_va = (ULONG64)NestedHalVaFromPa(vmcs12_region_pa);
+		ULONG				vcpu_index = NestedHalGetCurrentProcessorNumber(&procnumber);
 
-		__vmx_vmptrst(&vmcs12_region_va);
+		NestedHalVmPtrst(&vmcs12_region_va);
 		VMSucceed(GetFlagReg(guest_context));
 	} while (FALSE);
 }
@@ -5,13 +5,14 @@
 
 #ifndef NESTED_HYPERPLATFORM_VMX_H_
 #define NESTED_HYPERPLATFORM_VMX_H_
-#include <fltKernel.h>
-#include "..\HyperPlatform\vmm.h"
-#include "..\HyperPlatform\util.h"
-extern struct GuestContext;
+#include "nested_hal.h"
 extern "C"
 {
 
+BOOLEAN NestedVmmInitialization();
+
+VOID NestedVmmTermination();
+
 VOID VmxonEmulate(
 	GuestContext* guest_context
 );
@@ -1,10 +1,6 @@
-#include <fltKernel.h>
-#include <intrin.h>
+#include "nested_hal.h"
 #include "vmx_common.h"
 #include "vmx.h"
-#include "..\HyperPlatform\log.h"
-#include "..\HyperPlatform\vmm.h"
-#include "..\HyperPlatform\util.h"
 #include "vmcs.h"
 extern "C"
 {
@@ -34,8 +30,6 @@ extern "C"
 #define MY_VMX_TSC_SCALING           (1 << 23)              /* TSC Scaling */
 
 
-extern ULONG_PTR*	 VmmpSelectRegister(_In_ ULONG index, _In_ GuestContext *guest_context);
-
 ULONG32				 g_vmx_extensions_bitmask;
 
 
@@ -116,35 +110,35 @@ VOID VMfail(FlagRegister *reg, VmxInstructionError err)
 //----------------------------------------------------------------------------------------------------------------//
 BOOLEAN IsGuestinPagingMode()
 {
-	Cr0 cr0 = { UtilVmRead64(VmcsField::kGuestCr0) };
+	Cr0 cr0 = { NestedHalVmRead64(VmcsField::kGuestCr0) };
 	return (cr0.fields.pg) ? TRUE : FALSE;
 }
 
 //----------------------------------------------------------------------------------------------------------------//
 BOOLEAN IsGuestSetNumericErrorBit()
 {
-	Cr0 cr0 = { UtilVmRead64(VmcsField::kGuestCr0) };
+	Cr0 cr0 = { NestedHalVmRead64(VmcsField::kGuestCr0) };
 	return (cr0.fields.ne) ? TRUE : FALSE;
 }
 
 //----------------------------------------------------------------------------------------------------------------//
 BOOLEAN IsGuestInProtectedMode()
 {
-	Cr0 cr0 = { UtilVmRead64(VmcsField::kGuestCr0) };
+	Cr0 cr0 = { NestedHalVmRead64(VmcsField::kGuestCr0) };
 	return (cr0.fields.pe) ? TRUE : FALSE;
 }
 
 //----------------------------------------------------------------------------------------------------------------//
 BOOLEAN IsGuestSupportVMX()
 {
-	Cr4 cr4 = { UtilVmRead64(VmcsField::kGuestCr4) };
+	Cr4 cr4 = { NestedHalVmRead64(VmcsField::kGuestCr4) };
 	return (cr4.fields.vmxe) ? TRUE : FALSE;
 }
 
 //----------------------------------------------------------------------------------------------------------------//
 BOOLEAN IsGuestInVirtual8086()
 {
-	FlagRegister flags = { UtilVmRead64(VmcsField::kGuestRflags) };
+	FlagRegister flags = { NestedHalVmRead64(VmcsField::kGuestRflags) };
 	return (flags.fields.vm) ? TRUE : FALSE;
 }
 
@@ -158,8 +152,8 @@ SegmentDescriptor* GetSegmentDesctiptor(SegmentSelector ss, ULONG64 gdtBase)
 //----------------------------------------------------------------------------------------------------------------//
 BOOLEAN IsGuestinCompatibliltyMode()
 {
-	SegmentSelector ss = { UtilVmRead64(VmcsField::kGuestCsSelector) };
-	ULONG64 gdtBase = UtilVmRead64(VmcsField::kGuestGdtrBase);
+	SegmentSelector ss = { NestedHalVmRead64(VmcsField::kGuestCsSelector) };
+	ULONG64 gdtBase = NestedHalVmRead64(VmcsField::kGuestGdtrBase);
 	SegmentDescriptor* ds = GetSegmentDesctiptor(ss, gdtBase);
 	return (ds->fields.l) ? TRUE : FALSE;
 }
@@ -168,7 +162,7 @@ BOOLEAN IsGuestinCompatibliltyMode()
 //----------------------------------------------------------------------------------------------------------------//
 USHORT GetGuestCPL()
 {
-	const SegmentSelector ss = { UtilVmRead64(VmcsField::kGuestCsSelector) };
+	const SegmentSelector ss = { NestedHalVmRead64(VmcsField::kGuestCsSelector) };
 	USHORT ret = ss.fields.rpl;
 	return ret;
 }
@@ -176,7 +170,7 @@ USHORT GetGuestCPL()
 //----------------------------------------------------------------------------------------------------------------//
 BOOLEAN IsGuestInIA32eMode()
 {
-	MSR_EFER efer = { UtilVmRead64(VmcsField::kGuestIa32Efer) };
+	MSR_EFER efer = { NestedHalVmRead64(VmcsField::kGuestIa32Efer) };
 	return (efer.fields.LMA) ? TRUE : FALSE;
 }
 
@@ -184,7 +178,7 @@ BOOLEAN IsGuestInIA32eMode()
 ///See: Layout of IA32_FEATURE_CONTROL
 BOOLEAN IsLockbitClear()
 {
-	Ia32FeatureControlMsr vmx_feature_control = { UtilReadMsr64(Msr::kIa32FeatureControl) };
+	Ia32FeatureControlMsr vmx_feature_control = { NestedHalReadMsr64(Msr::kIa32FeatureControl) };
 	if (vmx_feature_control.fields.lock) {
 		return TRUE;
 	}
@@ -194,7 +188,7 @@ BOOLEAN IsLockbitClear()
 ///See:  Layout of IA32_FEATURE_CONTROL
 BOOLEAN IsGuestEnableVMXOnInstruction()
 {
-	Ia32FeatureControlMsr vmx_feature_control = { UtilReadMsr64(Msr::kIa32FeatureControl) };
+	Ia32FeatureControlMsr vmx_feature_control = { NestedHalReadMsr64(Msr::kIa32FeatureControl) };
 	if (vmx_feature_control.fields.enable_vmxon) {
 		return TRUE;
 	}
@@ -203,7 +197,7 @@ BOOLEAN IsGuestEnableVMXOnInstruction()
 //----------------------------------------------------------------------------------------------------------------//
 BOOLEAN CheckPhysicalAddress(ULONG64 vmxon_region_pa)
 {
-	Ia32VmxBasicMsr vmx_basic = { UtilReadMsr64(Msr::kIa32VmxBasic) };
+	Ia32VmxBasicMsr vmx_basic = { NestedHalReadMsr64(Msr::kIa32VmxBasic) };
 	if (vmx_basic.fields.supported_ia64)
 	{
 		//0xFFFFFFFF00001234 & 0xFFFFFFFF00000000 != 0
@@ -218,7 +212,7 @@ BOOLEAN CheckPhysicalAddress(ULONG64 vmxon_region_pa)
 //----------------------------------------------------------------------------------------------------------------//
 ULONG GetVMCSRevisionIdentifier()
 {
-	Ia32VmxBasicMsr vmx_basic = { UtilReadMsr64(Msr::kIa32VmxBasic) };
+	Ia32VmxBasicMsr vmx_basic = { NestedHalReadMsr64(Msr::kIa32VmxBasic) };
 	return vmx_basic.fields.revision_identifier;
 }
 
@@ -242,7 +236,7 @@ VOID FillEventInjection(ULONG32 interruption_type, ULONG32 exception_vector, BOO
 	inject.fields.vector = exception_vector;
 	inject.fields.deliver_error_code = isDeliver_error_code;
 	inject.fields.valid = isValid;
-	UtilVmWrite(VmcsField::kVmEntryIntrInfoField, inject.all);
+	NestedHalVmWrite(VmcsField::kVmEntryIntrInfoField, inject.all);
 }
 
 //----------------------------------------------------------------------------------------------------------------//
@@ -263,11 +257,11 @@ ULONG64 DecodeVmclearOrVmptrldOrVmptrstOrVmxon(GuestContext* guest_context)
 {
 	const VMInstructionQualificationForClearOrPtrldOrPtrstOrVmxon exit_qualification =
 	{
-		static_cast<ULONG32>(UtilVmRead(VmcsField::kVmxInstructionInfo))
+		static_cast<ULONG32>(NestedHalVmRead(VmcsField::kVmxInstructionInfo))
 	};
 
 	// Calculate an address to be used for the instruction
-	const auto displacement = UtilVmRead(VmcsField::kExitQualification);
+	const auto displacement = NestedHalVmRead(VmcsField::kExitQualification);
 	// Base
 	ULONG_PTR base_value = 0;
 	if (!exit_qualification.fields.BaseRegInvalid)
@@ -309,8 +303,6 @@ ULONG64 DecodeVmclearOrVmptrldOrVmptrstOrVmxon(GuestContext* guest_context)
 	{
 		operation_address &= MAXULONG;
 	}
-	const auto guest_cr3 = UtilVmRead(VmcsField::kGuestCr3);
-	const auto vmm_cr3 = __readcr3();
 	HYPERPLATFORM_LOG_DEBUG_SAFE("operation_address= %I64x + %I64x + %I64x = %I64x \r\n", base_value, index_value, displacement, operation_address);
 	return operation_address;
 
@@ -1,11 +1,6 @@
 #pragma once
-#include <fltKernel.h>
-#include <intrin.h>
-#include "vmx_common.h"
+#include "nested_hal.h"
 #include "vmx.h"
-#include "..\HyperPlatform\log.h"
-#include "..\HyperPlatform\vmm.h"
-#include "..\HyperPlatform\util.h"
 #include "vmcs.h"
 extern "C"
 {